@@ -0,0 +1,33 @@
+#version 450
+
+const uint kContour = 0u;
+const uint kFlat = 1u;
+
+layout(push_constant) uniform View {
+    vec2 scale;
+    vec2 offset;
+    float minValue;
+    float maxValue;
+    uint mode;
+} view;
+
+layout(location = 0) in float fragValue;
+
+layout(location = 0) out vec4 outColor;
+
+// blue to red through cyan, green and yellow
+vec3 Colormap(float t) {
+    t = clamp(t, 0.0, 1.0);
+    return clamp(vec3(1.5 - abs(4.0 * t - 3.0), 1.5 - abs(4.0 * t - 2.0), 1.5 - abs(4.0 * t - 1.0)), 0.0, 1.0);
+}
+
+void main() {
+    if (view.mode == kContour) {
+        // banded into ten levels so the iso lines stand out
+        outColor = vec4(Colormap((floor(fragValue * 10.0) + 0.5) / 10.0), 1.0);
+    } else if (view.mode == kFlat) {
+        outColor = vec4(0.55, 0.65, 0.8, 1.0);
+    } else {
+        outColor = vec4(0.1, 0.1, 0.1, 1.0);
+    }
+}
@@ -0,0 +1,20 @@
+#version 450
+
+layout(push_constant) uniform View {
+    vec2 scale;
+    vec2 offset;
+    float minValue;
+    float maxValue;
+    uint mode;
+} view;
+
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in float inValue;
+
+layout(location = 0) out float fragValue;
+
+void main() {
+    gl_Position = vec4(inPosition * view.scale + view.offset, 0.0, 1.0);
+    float range = view.maxValue - view.minValue;
+    fragValue = range > 0.0 ? (inValue - view.minValue) / range : 0.0;
+}
@@ -0,0 +1,64 @@
+# Writes every SPIR-V file in SPIRV_DIR into OUTPUT as C++ arrays, looked up by name through LoadShader.
+# Usage: cmake -DSPIRV_DIR=<dir> -DOUTPUT=<file.cpp> -P embed_shaders.cmake
+
+file(GLOB SPIRV_FILES "${SPIRV_DIR}/*.spv")
+list(SORT SPIRV_FILES)
+
+set(ARRAYS "")
+set(NAMES "")
+set(CODE "")
+set(SIZES "")
+set(INDEX 0)
+
+foreach(SPIRV ${SPIRV_FILES})
+  get_filename_component(FILE_NAME ${SPIRV} NAME)
+  string(REGEX REPLACE "\\.spv$" "" SHADER_NAME ${FILE_NAME})
+  file(READ ${SPIRV} HEX HEX)
+  string(LENGTH "${HEX}" HEX_LENGTH)
+  math(EXPR SIZE "${HEX_LENGTH} / 2")
+  string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," BYTES "${HEX}")
+
+  # SPIR-V is consumed as 32 bit words
+  string(APPEND ARRAYS "alignas(4) const unsigned char kShader${INDEX}[] = {${BYTES}};\n")
+  string(APPEND NAMES "    \"${SHADER_NAME}\",\n")
+  string(APPEND CODE "    kShader${INDEX},\n")
+  string(APPEND SIZES "    ${SIZE},\n")
+  math(EXPR INDEX "${INDEX} + 1")
+endforeach()
+
+if(INDEX EQUAL 0)
+  # keeps the arrays below non-empty
+  set(NAMES "    nullptr,\n")
+  set(CODE "    nullptr,\n")
+  set(SIZES "    0,\n")
+endif()
+
+file(WRITE ${OUTPUT}.tmp
+"// generated by shaders/embed_shaders.cmake, do not edit
+#include <cstddef>
+
+namespace vulkan_fem {
+namespace {
+
+${ARRAYS}
+}  // namespace
+
+extern const size_t kEmbeddedShaderCount;
+extern const char *const kEmbeddedShaderNames[];
+extern const unsigned char *const kEmbeddedShaderCode[];
+extern const size_t kEmbeddedShaderSizes[];
+
+const size_t kEmbeddedShaderCount = ${INDEX};
+const char *const kEmbeddedShaderNames[] = {
+${NAMES}};
+const unsigned char *const kEmbeddedShaderCode[] = {
+${CODE}};
+const size_t kEmbeddedShaderSizes[] = {
+${SIZES}};
+
+}  // namespace vulkan_fem
+")
+
+# unchanged output keeps the executable from relinking
+configure_file(${OUTPUT}.tmp ${OUTPUT} COPYONLY)
+file(REMOVE ${OUTPUT}.tmp)
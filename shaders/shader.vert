@@ -1,16 +1,28 @@
 #version 450
 
+layout(set = 0, binding = 0) uniform View {
+    vec2 scale;
+    vec2 offset;
+    float deformationScale;
+    float minValue;
+    float maxValue;
+} view;
+
 layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec2 inDisplacement;
+layout(location = 2) in float inValue;
 
 layout(location = 0) out vec3 fragColor;
 
-vec3 colors[3] = vec3[](
-    vec3(1.0, 0.0, 0.0),
-    vec3(0.0, 1.0, 0.0),
-    vec3(0.0, 0.0, 1.0)
-);
+// blue to red through cyan, green and yellow
+vec3 Colormap(float t) {
+    t = clamp(t, 0.0, 1.0);
+    return clamp(vec3(1.5 - abs(4.0 * t - 3.0), 1.5 - abs(4.0 * t - 2.0), 1.5 - abs(4.0 * t - 1.0)), 0.0, 1.0);
+}
 
 void main() {
-    gl_Position = vec4(inPosition, 0.0, 1.0);
-    fragColor = colors[gl_VertexIndex];
+    gl_Position = vec4((inPosition + view.deformationScale * inDisplacement) * view.scale + view.offset, 0.0, 1.0);
+
+    float range = view.maxValue - view.minValue;
+    fragColor = range > 0.0 ? Colormap((inValue - view.minValue) / range) : vec3(0.8, 0.8, 0.8);
 }
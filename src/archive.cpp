@@ -0,0 +1,357 @@
+#include "archive.h"
+#include <spdlog/spdlog.h>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <utility>
+
+#ifdef VULKAN_FEM_USE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef VULKAN_FEM_USE_LZ4
+#include <lz4.h>
+#endif
+
+namespace vulkan_fem {
+namespace {
+
+constexpr char kMagic[8] = {'V', 'F', 'E', 'M', 'A', 'R', 'C', 'H'};
+constexpr uint32_t kVersion = 1;
+
+// fast levels, a checkpoint has to be written before the next one is due
+constexpr int kZstdLevel = 3;
+// an LZ4 sequence of at least one byte expands to at most 255 bytes
+[[maybe_unused]] constexpr size_t kLz4MaxRatio = 255;
+
+// byte k of every element to plane k
+std::vector<uint8_t> Shuffle(const std::vector<uint8_t> &bytes, uint32_t element_size) {
+  const size_t count = bytes.size() / element_size;
+  std::vector<uint8_t> shuffled(bytes.size());
+  for (size_t i = 0; i < count; ++i) {
+    for (uint32_t k = 0; k < element_size; ++k) {
+      shuffled[k * count + i] = bytes[i * element_size + k];
+    }
+  }
+  return shuffled;
+}
+
+std::vector<uint8_t> Unshuffle(const std::vector<uint8_t> &shuffled, uint32_t element_size) {
+  const size_t count = shuffled.size() / element_size;
+  std::vector<uint8_t> bytes(shuffled.size());
+  for (size_t i = 0; i < count; ++i) {
+    for (uint32_t k = 0; k < element_size; ++k) {
+      bytes[i * element_size + k] = shuffled[k * count + i];
+    }
+  }
+  return bytes;
+}
+
+// compressed bytes, empty when the codec is not available or the data does not shrink
+std::vector<uint8_t> Compress(const std::vector<uint8_t> &raw, Compression compression) {
+  std::vector<uint8_t> stored;
+  switch (compression) {
+#ifdef VULKAN_FEM_USE_ZSTD
+    case Compression::kZstd: {
+      stored.resize(ZSTD_compressBound(raw.size()));
+      const size_t size = ZSTD_compress(stored.data(), stored.size(), raw.data(), raw.size(), kZstdLevel);
+      stored.resize(ZSTD_isError(size) != 0U ? 0 : size);
+      break;
+    }
+#endif
+#ifdef VULKAN_FEM_USE_LZ4
+    case Compression::kLz4: {
+      if (raw.size() > LZ4_MAX_INPUT_SIZE) {
+        break;
+      }
+      stored.resize(static_cast<size_t>(LZ4_compressBound(static_cast<int>(raw.size()))));
+      const int size = LZ4_compress_default(reinterpret_cast<const char *>(raw.data()), reinterpret_cast<char *>(stored.data()),
+                                            static_cast<int>(raw.size()), static_cast<int>(stored.size()));
+      stored.resize(size > 0 ? static_cast<size_t>(size) : 0);
+      break;
+    }
+#endif
+    default:
+      break;
+  }
+  if (stored.size() >= raw.size()) {
+    stored.clear();
+  }
+  return stored;
+}
+
+// raw_size is checked against what the codec can produce from stored before it is allocated
+std::vector<uint8_t> Decompress([[maybe_unused]] const std::vector<uint8_t> &stored, [[maybe_unused]] size_t raw_size,
+                                Compression compression) {
+  std::vector<uint8_t> raw;
+  bool ok = false;
+  switch (compression) {
+#ifdef VULKAN_FEM_USE_ZSTD
+    case Compression::kZstd: {
+      // the frame header records the content size
+      if (ZSTD_getFrameContentSize(stored.data(), stored.size()) != raw_size) {
+        break;
+      }
+      raw.resize(raw_size);
+      const size_t size = ZSTD_decompress(raw.data(), raw.size(), stored.data(), stored.size());
+      ok = ZSTD_isError(size) == 0U && size == raw_size;
+      break;
+    }
+#endif
+#ifdef VULKAN_FEM_USE_LZ4
+    case Compression::kLz4: {
+      if (raw_size > LZ4_MAX_INPUT_SIZE || raw_size > kLz4MaxRatio * stored.size()) {
+        break;
+      }
+      raw.resize(raw_size);
+      const int size = LZ4_decompress_safe(reinterpret_cast<const char *>(stored.data()), reinterpret_cast<char *>(raw.data()),
+                                           static_cast<int>(stored.size()), static_cast<int>(raw.size()));
+      ok = size >= 0 && static_cast<size_t>(size) == raw_size;
+      break;
+    }
+#endif
+    default:
+      throw std::runtime_error("archive block compressed with a codec this build does not have");
+  }
+  if (!ok) {
+    throw std::runtime_error("corrupt compressed archive block");
+  }
+  return raw;
+}
+
+template <typename T>
+void WriteValue(std::ofstream &file, T value) {
+  file.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <typename T>
+T ReadValue(std::ifstream &file) {
+  T value{};
+  if (!file.read(reinterpret_cast<char *>(&value), sizeof(T))) {
+    throw std::runtime_error("truncated archive");
+  }
+  return value;
+}
+
+// bytes between the read position and the end of a file of file_size bytes
+uint64_t GetRemainingBytes(std::ifstream &file, uint64_t file_size) {
+  const auto position = static_cast<uint64_t>(file.tellg());
+  return position < file_size ? file_size - position : 0;
+}
+
+void ReadBytes(std::ifstream &file, void *data, uint64_t size) {
+  if (!file.read(static_cast<char *>(data), static_cast<std::streamsize>(size))) {
+    throw std::runtime_error("truncated archive");
+  }
+}
+
+}  // namespace
+
+bool IsCompressionAvailable(Compression compression) {
+  switch (compression) {
+    case Compression::kNone:
+      return true;
+    case Compression::kLz4:
+#ifdef VULKAN_FEM_USE_LZ4
+      return true;
+#else
+      return false;
+#endif
+    case Compression::kZstd:
+#ifdef VULKAN_FEM_USE_ZSTD
+      return true;
+#else
+      return false;
+#endif
+  }
+  return false;
+}
+
+size_t Archive::GetBytes() const {
+  size_t bytes = 0;
+  for (const auto &[name, block] : blocks_) {
+    bytes += block.bytes_.size();
+  }
+  return bytes;
+}
+
+// magic, version, block count, then per block: name length, name, codec, element size, raw size, stored size, data
+void Archive::Write(const std::string &path, Compression compression) const {
+  if (!IsCompressionAvailable(compression)) {
+    spdlog::warn("archive compression is not available in this build, writing {} uncompressed", path);
+    compression = Compression::kNone;
+  }
+
+  const std::string temporary_path = path + ".tmp";
+  {
+    std::ofstream file(temporary_path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+      throw std::runtime_error("could not open " + temporary_path + " for writing");
+    }
+    file.write(kMagic, sizeof(kMagic));
+    WriteValue(file, kVersion);
+    WriteValue(file, static_cast<uint32_t>(blocks_.size()));
+
+    for (const auto &[name, block] : blocks_) {
+      std::vector<uint8_t> stored;
+      if (compression != Compression::kNone && !block.bytes_.empty()) {
+        stored = Compress(block.element_size_ > 1 ? Shuffle(block.bytes_, block.element_size_) : block.bytes_, compression);
+      }
+      const bool compressed = !stored.empty();
+      const std::vector<uint8_t> &data = compressed ? stored : block.bytes_;
+
+      WriteValue(file, static_cast<uint32_t>(name.size()));
+      file.write(name.data(), static_cast<std::streamsize>(name.size()));
+      WriteValue(file, compressed ? compression : Compression::kNone);
+      WriteValue(file, block.element_size_);
+      WriteValue(file, static_cast<uint64_t>(block.bytes_.size()));
+      WriteValue(file, static_cast<uint64_t>(data.size()));
+      file.write(reinterpret_cast<const char *>(data.data()), static_cast<std::streamsize>(data.size()));
+    }
+
+    file.close();
+    if (!file) {
+      throw std::runtime_error("could not write " + temporary_path);
+    }
+  }
+  std::filesystem::rename(temporary_path, path);
+}
+
+Archive Archive::Read(const std::string &path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    throw std::runtime_error("could not open " + path);
+  }
+
+  char magic[sizeof(kMagic)];
+  ReadBytes(file, magic, sizeof(magic));
+  if (!std::equal(std::begin(magic), std::end(magic), std::begin(kMagic)) || ReadValue<uint32_t>(file) != kVersion) {
+    throw std::runtime_error(path + " is not an archive of this version");
+  }
+
+  // sizes are checked against the file before anything is allocated for them
+  const uint64_t file_size = std::filesystem::file_size(path);
+  Archive archive;
+  const auto block_count = ReadValue<uint32_t>(file);
+  for (uint32_t b = 0; b < block_count; ++b) {
+    const auto name_size = ReadValue<uint32_t>(file);
+    if (name_size > GetRemainingBytes(file, file_size)) {
+      throw std::runtime_error("corrupt archive " + path);
+    }
+    std::string name(name_size, '\0');
+    ReadBytes(file, name.data(), name.size());
+    const auto compression = ReadValue<Compression>(file);
+    const auto element_size = ReadValue<uint32_t>(file);
+    const auto raw_size = ReadValue<uint64_t>(file);
+    const auto stored_size = ReadValue<uint64_t>(file);
+    // compressed blocks are only stored when they shrink
+    const bool sizes_match = compression == Compression::kNone ? stored_size == raw_size : stored_size < raw_size;
+    if (element_size == 0 || raw_size % element_size != 0 || !sizes_match || stored_size > GetRemainingBytes(file, file_size)) {
+      throw std::runtime_error("corrupt archive block " + name + " in " + path);
+    }
+
+    std::vector<uint8_t> stored(stored_size);
+    ReadBytes(file, stored.data(), stored_size);
+
+    Block &block = archive.blocks_[name];
+    block.element_size_ = element_size;
+    if (compression == Compression::kNone) {
+      block.bytes_ = std::move(stored);
+    } else {
+      block.bytes_ = Decompress(stored, raw_size, compression);
+      if (element_size > 1) {
+        block.bytes_ = Unshuffle(block.bytes_, element_size);
+      }
+    }
+  }
+  return archive;
+}
+
+const Archive::Block &Archive::GetBlock(const std::string &name, size_t element_size) const {
+  const auto it = blocks_.find(name);
+  if (it == blocks_.end()) {
+    throw std::runtime_error("archive has no block " + name);
+  }
+  if (it->second.element_size_ != element_size) {
+    throw std::runtime_error("archive block " + name + " holds values of another size");
+  }
+  return it->second;
+}
+
+ArchiveWriter::ArchiveWriter(Compression compression) : compression_(compression), thread_([this] { Run(); }) {}
+
+ArchiveWriter::~ArchiveWriter() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  changed_.notify_all();
+  thread_.join();
+}
+
+void ArchiveWriter::Submit(std::string path, Archive archive) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (pending_) {
+      ++replaced_;
+    }
+    pending_path_ = std::move(path);
+    pending_archive_ = std::move(archive);
+    pending_ = true;
+  }
+  changed_.notify_all();
+}
+
+void ArchiveWriter::Flush() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  changed_.wait(lock, [this] { return !pending_ && !writing_; });
+  if (!error_.empty()) {
+    throw std::runtime_error(std::exchange(error_, {}));
+  }
+}
+
+uint32_t ArchiveWriter::GetWrittenCount() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return written_;
+}
+
+uint32_t ArchiveWriter::GetReplacedCount() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return replaced_;
+}
+
+void ArchiveWriter::Run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    changed_.wait(lock, [this] { return stop_ || pending_; });
+    if (!pending_) {
+      return;  // stopped with nothing left to write
+    }
+
+    const std::string path = std::move(pending_path_);
+    const Archive archive = std::move(pending_archive_);
+    pending_archive_ = Archive();
+    pending_ = false;
+    writing_ = true;
+    lock.unlock();
+
+    std::string error;
+    try {
+      archive.Write(path, compression_);
+    } catch (const std::exception &e) {
+      error = e.what();
+      spdlog::error("writing {} failed: {}", path, error);
+    }
+
+    lock.lock();
+    writing_ = false;
+    if (error.empty()) {
+      ++written_;
+    } else {
+      error_ = std::move(error);
+    }
+    changed_.notify_all();
+  }
+}
+
+}  // namespace vulkan_fem
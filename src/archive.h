@@ -0,0 +1,181 @@
+#pragma once
+
+#include "fem.h"
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace vulkan_fem {
+
+// codec of the blocks of an archive file, blocks that do not shrink are stored as they are
+enum class Compression : uint8_t {
+  kNone,
+  kLz4,   // fast, for checkpoints written every few steps
+  kZstd,  // smaller files at a few times the cost
+};
+
+// whether the codec was compiled in, see VULKAN_FEM_ZSTD and VULKAN_FEM_LZ4
+bool IsCompressionAvailable(Compression compression);
+
+// Named binary blocks of plain values, the checkpoint and result format of the solvers. Values are stored in native
+// byte order and element size, so a file is read back on the same kind of machine that wrote it. Compressed blocks
+// are byte shuffled first, the exponent bytes of neighbouring floats are mostly equal and compress well together.
+class Archive {
+ public:
+  template <typename T>
+  void PutArray(const std::string &name, const T *values, size_t count) {
+    static_assert(std::is_trivially_copyable_v<T>, "archive blocks hold plain values");
+    Block &block = blocks_[name];
+    block.element_size_ = sizeof(T);
+    block.bytes_.resize(count * sizeof(T));
+    if (count > 0) {
+      std::memcpy(block.bytes_.data(), values, block.bytes_.size());
+    }
+  }
+
+  template <typename T>
+  void PutArray(const std::string &name, const std::vector<T> &values) {
+    PutArray(name, values.data(), values.size());
+  }
+
+  template <typename T>
+  void PutValue(const std::string &name, T value) {
+    PutArray(name, &value, 1);
+  }
+
+  void PutVector(const std::string &name, const VectorX &vector) { PutArray(name, vector.data(), static_cast<size_t>(vector.size())); }
+
+  // compressed storage of a sparse matrix in the blocks name.size, name.outer, name.inner and name.values
+  template <typename Matrix>
+  void PutSparse(const std::string &name, const Matrix &matrix) {
+    if (!matrix.isCompressed()) {
+      Matrix compressed = matrix;
+      compressed.makeCompressed();
+      PutSparse(name, compressed);
+      return;
+    }
+    const int64_t size[2] = {matrix.rows(), matrix.cols()};
+    PutArray(name + ".size", size, 2);
+    PutArray(name + ".outer", matrix.outerIndexPtr(), static_cast<size_t>(matrix.outerSize() + 1));
+    PutArray(name + ".inner", matrix.innerIndexPtr(), static_cast<size_t>(matrix.nonZeros()));
+    PutArray(name + ".values", matrix.valuePtr(), static_cast<size_t>(matrix.nonZeros()));
+  }
+
+  [[nodiscard]] bool Has(const std::string &name) const { return blocks_.count(name) != 0; }
+
+  template <typename T>
+  [[nodiscard]] std::vector<T> GetArray(const std::string &name) const {
+    const Block &block = GetBlock(name, sizeof(T));
+    std::vector<T> values(block.bytes_.size() / sizeof(T));
+    if (!values.empty()) {
+      std::memcpy(values.data(), block.bytes_.data(), block.bytes_.size());
+    }
+    return values;
+  }
+
+  template <typename T>
+  [[nodiscard]] T GetValue(const std::string &name) const {
+    const Block &block = GetBlock(name, sizeof(T));
+    if (block.bytes_.size() != sizeof(T)) {
+      throw std::runtime_error("archive block " + name + " is not a single value");
+    }
+    T value;
+    std::memcpy(&value, block.bytes_.data(), sizeof(T));
+    return value;
+  }
+
+  [[nodiscard]] VectorX GetVector(const std::string &name) const {
+    const std::vector<Precision> values = GetArray<Precision>(name);
+    return Eigen::Map<const VectorX>(values.data(), static_cast<Eigen::Index>(values.size()));
+  }
+
+  template <typename Matrix>
+  [[nodiscard]] Matrix GetSparse(const std::string &name) const {
+    using Index = typename Matrix::StorageIndex;
+    const auto size = GetArray<int64_t>(name + ".size");
+    const auto outer = GetArray<Index>(name + ".outer");
+    const auto inner = GetArray<Index>(name + ".inner");
+    const auto values = GetArray<typename Matrix::Scalar>(name + ".values");
+
+    Matrix matrix;
+    if (size.size() != 2) {
+      throw std::runtime_error("archive block " + name + ".size is not a matrix size");
+    }
+    matrix.resize(size[0], size[1]);
+    if (static_cast<Eigen::Index>(outer.size()) != matrix.outerSize() + 1 || inner.size() != values.size() ||
+        static_cast<size_t>(outer.back()) != values.size()) {
+      throw std::runtime_error("archive blocks of " + name + " do not form a sparse matrix");
+    }
+    matrix.resizeNonZeros(static_cast<Eigen::Index>(values.size()));
+    std::copy(outer.begin(), outer.end(), matrix.outerIndexPtr());
+    std::copy(inner.begin(), inner.end(), matrix.innerIndexPtr());
+    std::copy(values.begin(), values.end(), matrix.valuePtr());
+    return matrix;
+  }
+
+  // uncompressed bytes of all blocks
+  [[nodiscard]] size_t GetBytes() const;
+
+  // writes a temporary file next to path and renames it, an interrupted write leaves the previous file intact
+  void Write(const std::string &path, Compression compression = Compression::kNone) const;
+  static Archive Read(const std::string &path);
+
+ private:
+  struct Block {
+    uint32_t element_size_ = 1;
+    std::vector<uint8_t> bytes_;
+  };
+
+  // throws when the block is missing or holds values of another size
+  const Block &GetBlock(const std::string &name, size_t element_size) const;
+
+  std::map<std::string, Block> blocks_;
+};
+
+// Writes archives on a background thread, a solver only pays for building the archive. When the writer falls
+// behind, a pending archive that was not started yet is replaced by the newer one, only the latest state matters.
+class ArchiveWriter {
+ public:
+  explicit ArchiveWriter(Compression compression = Compression::kNone);
+  // writes what is pending
+  ~ArchiveWriter();
+
+  ArchiveWriter(const ArchiveWriter &) = delete;
+  ArchiveWriter &operator=(const ArchiveWriter &) = delete;
+
+  void Submit(std::string path, Archive archive);
+  // blocks until every submitted archive is written or replaced, rethrows the error of a failed write
+  void Flush();
+
+  [[nodiscard]] uint32_t GetWrittenCount() const;
+  [[nodiscard]] uint32_t GetReplacedCount() const;
+
+ private:
+  void Run();
+
+  const Compression compression_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable changed_;
+  bool stop_ = false;
+  bool pending_ = false;
+  bool writing_ = false;
+  std::string pending_path_;
+  Archive pending_archive_;
+  std::string error_;
+  uint32_t written_ = 0;
+  uint32_t replaced_ = 0;
+
+  std::thread thread_;  // last, started once the state above is constructed
+};
+
+}  // namespace vulkan_fem
@@ -0,0 +1,145 @@
+#pragma once
+
+#include "fem.h"
+#include "model.h"
+#include "post_processor.h"
+#include "solver.h"
+#include "thread_pool.h"
+#include "triple_buffer.h"
+#include <spdlog/spdlog.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+
+namespace vulkan_fem {
+
+template <uint32_t DIM>
+struct SolveResult {
+  uint64_t job_ = 0;
+  std::shared_ptr<Model<DIM>> model_;  // solved copy, vertices moved by the displacements
+  VectorX displacements_;
+  RecoveredFields<DIM> fields_;  // stress recovery, done on the worker as well
+  std::string error_;  // empty on success
+};
+
+// Runs Solver::Solve on a worker thread so a long solve never blocks rendering.
+// Every job works on its own copy of the model, results come back through a lock free triple buffer.
+template <uint32_t DIM = 3>
+class AsyncSolver {
+ public:
+  explicit AsyncSolver(std::shared_ptr<Solver<DIM>> solver)
+      : solver_(std::move(solver)), control_(std::make_shared<SolveControl>()), thread_([this] { Run(); }) {
+    solver_->SetControl(control_);
+  }
+
+  ~AsyncSolver() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+      control_->cancel_ = true;
+    }
+    wake_.notify_one();
+    thread_.join();
+    solver_->SetControl(nullptr);
+  }
+
+  AsyncSolver(const AsyncSolver &) = delete;
+  AsyncSolver &operator=(const AsyncSolver &) = delete;
+
+  // false while another job is running
+  bool Start(const Model<DIM> &model) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (running_) {
+      return false;
+    }
+
+    pending_ = std::make_shared<Model<DIM>>(model);
+    job_ = ++started_;
+    control_->cancel_ = false;
+    control_->progress_ = 0.F;
+    running_ = true;
+    wake_.notify_one();
+    return true;
+  }
+
+  // stops the running job at its next checkpoint and drops results that are still to be taken
+  void Cancel() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    control_->cancel_ = true;
+    ++started_;
+  }
+
+  [[nodiscard]] bool IsRunning() const { return running_.load(); }
+  [[nodiscard]] float GetProgress() const { return control_->progress_.load(); }
+
+  // result of the latest job, once, never blocks
+  std::optional<SolveResult<DIM>> TakeResult() {
+    if (!results_.Update()) {
+      return std::nullopt;
+    }
+    SolveResult<DIM> &result = results_.GetReadBuffer();
+    if (result.job_ != started_.load()) {
+      return std::nullopt;  // cancelled or superseded
+    }
+    return std::move(result);
+  }
+
+ private:
+  void Run() {
+    while (true) {
+      std::shared_ptr<Model<DIM>> model;
+      uint64_t job = 0;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        wake_.wait(lock, [this] { return stop_ || pending_; });
+        if (stop_) {
+          return;
+        }
+        model = std::move(pending_);
+        job = job_;
+      }
+
+      SolveResult<DIM> &result = results_.GetWriteBuffer();
+      result = SolveResult<DIM>{};
+      result.job_ = job;
+      try {
+        solver_->Solve(*model);
+        result.model_ = std::move(model);
+        result.displacements_ = solver_->GetDisplacements();
+        result.fields_ = PostProcessor<DIM>(*result.model_, pool_).Run(*solver_->GetSolutionGradients(), result.displacements_);
+      } catch (const SolveCancelled &) {
+        spdlog::info("solve cancelled");
+        running_ = false;
+        continue;
+      } catch (const std::exception &e) {
+        result.error_ = e.what();
+      }
+
+      results_.Publish();
+      running_ = false;
+    }
+  }
+
+  std::shared_ptr<Solver<DIM>> solver_;
+  std::shared_ptr<SolveControl> control_;
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::shared_ptr<Model<DIM>> pending_;
+  uint64_t job_ = 0;
+  std::atomic<uint64_t> started_{0};  // bumped by Start and Cancel, results of older jobs are dropped
+  std::atomic<bool> running_{false};
+  bool stop_ = false;
+
+  TripleBuffer<SolveResult<DIM>> results_;
+  ThreadPool pool_;  // stress recovery of every job
+
+  std::thread thread_;  // last, starts once everything else is initialized
+};
+
+}  // namespace vulkan_fem
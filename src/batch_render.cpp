@@ -0,0 +1,93 @@
+#include "batch_render.h"
+#include "model_factory.h"
+#include "offscreen_renderer.h"
+#include "post_processor.h"
+#include "solver.h"
+#include "thread_pool.h"
+#include "vulkan_model.h"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <memory>
+#include <string>
+
+namespace vulkan_fem {
+namespace {
+
+constexpr uint32_t kWidth = 1024;
+constexpr uint32_t kHeight = 768;
+// frames from the undeformed to the deformed state, rendered back to back to keep all frames in flight busy
+constexpr uint32_t kAnimationFrames = 12;
+// displacements are scaled up to at least this fraction of the model size to be visible
+constexpr Precision kVisibleDeformation = 0.1;
+
+void RenderModel(OffscreenRenderer &renderer, ThreadPool &pool, const std::string &directory, const std::string &name,
+                 std::shared_ptr<Model<2>> model) {
+  const std::vector<Vertex3> reference = model->GetVertices();
+  const std::vector<uint16_t> indices = VulkanModel<2>(model).GetIndices();
+
+  Solver<2> solver;
+  solver.Solve(*model);
+  const VectorX &displacements = solver.GetDisplacements();
+  const RecoveredFields<2> fields = PostProcessor<2>(*model, pool).Run(*solver.GetSolutionGradients(), displacements);
+
+  Vertex3 min_corner = reference.front();
+  Vertex3 max_corner = reference.front();
+  for (const auto &vertex : reference) {
+    min_corner = min_corner.cwiseMin(vertex);
+    max_corner = max_corner.cwiseMax(vertex);
+  }
+  const Precision size = (max_corner - min_corner).head<2>().norm();
+  const Precision largest = displacements.size() > 0 ? displacements.cwiseAbs().maxCoeff() : 0;
+  const Precision scale = largest > 0 ? std::max(Precision(1), kVisibleDeformation * size / largest) : 1;
+  spdlog::info("{}: largest displacement {}, shown {}x", name, largest, scale);
+
+  const auto [min_stress, max_stress] = std::minmax_element(fields.nodal_von_mises_.begin(), fields.nodal_von_mises_.end());
+
+  // t = 0 to 1 of the scaled deformation and the stress
+  const auto mesh_at = [&](Precision t, RenderMode mode) {
+    RenderMesh mesh;
+    mesh.indices_ = indices;
+    mesh.mode_ = mode;
+    mesh.min_value_ = *min_stress;
+    mesh.max_value_ = *max_stress;
+    mesh.vertices_.reserve(reference.size());
+    for (size_t i = 0; i < reference.size(); ++i) {
+      ContourVertex vertex;
+      vertex.x_ = reference[i][0] + t * scale * displacements[static_cast<Eigen::Index>(2 * i)];
+      vertex.y_ = reference[i][1] + t * scale * displacements[static_cast<Eigen::Index>(2 * i + 1)];
+      vertex.value_ = t * fields.nodal_von_mises_[i];
+      mesh.vertices_.push_back(vertex);
+    }
+    return mesh;
+  };
+
+  renderer.Render(mesh_at(0, RenderMode::kFlat), directory + "/" + name + "_undeformed.png");
+  renderer.Render(mesh_at(1, RenderMode::kFlat), directory + "/" + name + "_deformed.png");
+  renderer.Render(mesh_at(1, RenderMode::kContour), directory + "/" + name + "_von_mises.png");
+  for (uint32_t frame = 0; frame <= kAnimationFrames; ++frame) {
+    const Precision t = static_cast<Precision>(frame) / kAnimationFrames;
+    renderer.Render(mesh_at(t, RenderMode::kContour), directory + "/" + name + "_frame_" + std::to_string(frame) + ".png");
+  }
+}
+
+}  // namespace
+
+int RenderReports(const std::string &directory) {
+  try {
+    std::filesystem::create_directories(directory);
+    OffscreenRenderer renderer(kWidth, kHeight);
+    ThreadPool pool;
+    RenderModel(renderer, pool, directory, "rectangle", ModelFactory::CreateRectangle());
+    RenderModel(renderer, pool, directory, "rectangle2", ModelFactory::CreateRectangle2());
+    renderer.Finish();
+  } catch (const std::exception &e) {
+    spdlog::error("batch rendering failed: {}", e.what());
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+}  // namespace vulkan_fem
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <string>
+
+namespace vulkan_fem {
+
+// Solves the 2D sample models and renders their deformed shape and von Mises stress into PNG files
+// in the given directory, headless. Returns the process exit code.
+int RenderReports(const std::string &directory);
+
+}  // namespace vulkan_fem
@@ -0,0 +1,174 @@
+#pragma once
+
+#include "fem.h"
+#include "memory_tracker.h"
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+namespace vulkan_fem {
+
+// Block compressed sparse row matrix with dense DIM x DIM blocks.
+// Rows and columns are indexed per node, so one column index covers DIM * DIM values.
+template <uint32_t DIM>
+class BlockSparseMatrix {
+ public:
+  using Block = Eigen::Matrix<Precision, DIM, DIM>;
+  using BlockVector = Eigen::Matrix<Precision, DIM, 1>;
+  using Blocks = std::vector<Block, TrackingAllocator<Block, Eigen::aligned_allocator<Block>>>;
+
+  BlockSparseMatrix() = default;
+
+  // sparsity pattern from element connectivity, every pair of nodes sharing an element is coupled
+  BlockSparseMatrix(uint32_t node_count, const std::vector<uint16_t> &indices, uint32_t element_count) : node_count_(node_count) {
+    std::vector<std::vector<uint32_t>> rows(node_count);
+    for (size_t index = 0; index + element_count <= indices.size(); index += element_count) {
+      for (uint32_t i = 0; i < element_count; ++i) {
+        for (uint32_t j = 0; j < element_count; ++j) {
+          rows[indices[index + i]].push_back(indices[index + j]);
+        }
+      }
+    }
+
+    row_offsets_.reserve(node_count + 1);
+    row_offsets_.push_back(0);
+    for (auto &row : rows) {
+      std::sort(row.begin(), row.end());
+      row.erase(std::unique(row.begin(), row.end()), row.end());
+      columns_.insert(columns_.end(), row.begin(), row.end());
+      row_offsets_.push_back(static_cast<uint32_t>(columns_.size()));
+    }
+
+    blocks_.resize(columns_.size(), Block::Zero());
+    index_bytes_.Set(GetIndexBytes());
+  }
+
+  [[nodiscard]] uint32_t GetNodeCount() const { return node_count_; }
+  [[nodiscard]] Eigen::Index rows() const { return static_cast<Eigen::Index>(node_count_) * DIM; }
+  [[nodiscard]] Eigen::Index cols() const { return rows(); }
+  [[nodiscard]] size_t GetBlockCount() const { return blocks_.size(); }
+
+  [[nodiscard]] size_t GetIndexBytes() const { return (row_offsets_.size() + columns_.size()) * sizeof(uint32_t); }
+  [[nodiscard]] size_t GetValueBytes() const { return blocks_.size() * sizeof(Block); }
+
+  [[nodiscard]] const std::vector<uint32_t> &GetRowOffsets() const { return row_offsets_; }
+  [[nodiscard]] const std::vector<uint32_t> &GetColumns() const { return columns_; }
+  [[nodiscard]] const Block *GetBlocks() const { return blocks_.data(); }
+
+  void SetZero() { std::fill(blocks_.begin(), blocks_.end(), Block::Zero()); }
+
+  // block (row, col), throws when it is not part of the pattern
+  Block &At(uint32_t row, uint32_t col) { return blocks_[FindBlock(row, col)]; }
+  [[nodiscard]] const Block &At(uint32_t row, uint32_t col) const { return blocks_[FindBlock(row, col)]; }
+
+  template <typename Derived>
+  void AddBlock(uint32_t row, uint32_t col, const Eigen::MatrixBase<Derived> &block) {
+    At(row, col) += block;
+  }
+
+  // y = A * x
+  void Multiply(const VectorX &x, VectorX &y) const {
+    if (x.size() != cols()) {
+      throw std::runtime_error("BlockSparseMatrix::Multiply: dimension mismatch");
+    }
+
+    y.resize(rows());
+    for (uint32_t row = 0; row < node_count_; ++row) {
+      y.template segment<DIM>(DIM * row) = MultiplyRow(row, x);
+    }
+  }
+
+  // zero rows and columns of the given dofs and put 1 on the diagonal
+  void ApplyConstraints(const std::vector<int> &dofs) {
+    std::vector<bool> constrained(rows(), false);
+    for (const auto dof : dofs) {
+      constrained[dof] = true;
+    }
+
+    for (uint32_t row = 0; row < node_count_; ++row) {
+      for (uint32_t k = row_offsets_[row]; k < row_offsets_[row + 1]; ++k) {
+        const uint32_t col = columns_[k];
+        for (uint32_t i = 0; i < DIM; ++i) {
+          for (uint32_t j = 0; j < DIM; ++j) {
+            const uint32_t global_row = DIM * row + i;
+            const uint32_t global_col = DIM * col + j;
+            if (constrained[global_row] || constrained[global_col]) {
+              blocks_[k](i, j) = global_row == global_col ? 1.0F : 0.0F;
+            }
+          }
+        }
+      }
+    }
+  }
+
+  // inverses of the diagonal blocks, for block Jacobi preconditioning
+  [[nodiscard]] Blocks InvertDiagonalBlocks() const {
+    Blocks result(node_count_);
+    for (uint32_t row = 0; row < node_count_; ++row) {
+      result[row] = At(row, row).inverse();
+    }
+    return result;
+  }
+
+  // scalar sparse copy for the direct solvers
+  [[nodiscard]] Eigen::SparseMatrix<Precision> ToSparse() const {
+    std::vector<Eigen::Triplet<Precision>> triplets;
+    triplets.reserve(blocks_.size() * DIM * DIM);
+
+    for (uint32_t row = 0; row < node_count_; ++row) {
+      for (uint32_t k = row_offsets_[row]; k < row_offsets_[row + 1]; ++k) {
+        for (uint32_t i = 0; i < DIM; ++i) {
+          for (uint32_t j = 0; j < DIM; ++j) {
+            triplets.emplace_back(DIM * row + i, DIM * columns_[k] + j, blocks_[k](i, j));
+          }
+        }
+      }
+    }
+
+    Eigen::SparseMatrix<Precision> result(rows(), cols());
+    result.setFromTriplets(triplets.begin(), triplets.end());
+    return result;
+  }
+
+ private:
+  [[nodiscard]] size_t FindBlock(uint32_t row, uint32_t col) const {
+    const auto begin = columns_.begin() + row_offsets_[row];
+    const auto end = columns_.begin() + row_offsets_[row + 1];
+    const auto it = std::lower_bound(begin, end, col);
+    if (it == end || *it != col) {
+      throw std::out_of_range("block is not part of the sparsity pattern");
+    }
+    return it - columns_.begin();
+  }
+
+  [[nodiscard]] BlockVector MultiplyRow(uint32_t row, const VectorX &x) const {
+    if constexpr (DIM == 2) {
+      // a 2x2 block is one 4-wide packet [a00 a10 a01 a11], multiply it with [x0 x0 x1 x1]
+      // and fold the two halves, so the whole row is accumulated in a single SIMD register
+      Eigen::Array<Precision, 4, 1> sum = Eigen::Array<Precision, 4, 1>::Zero();
+      for (uint32_t k = row_offsets_[row]; k < row_offsets_[row + 1]; ++k) {
+        const Precision *x_block = x.data() + DIM * columns_[k];
+        const Eigen::Array<Precision, 4, 1> x_spread(x_block[0], x_block[0], x_block[1], x_block[1]);
+        sum += Eigen::Map<const Eigen::Array<Precision, 4, 1>>(blocks_[k].data()) * x_spread;
+      }
+      return sum.template head<2>().matrix() + sum.template tail<2>().matrix();
+    } else {
+      BlockVector sum = BlockVector::Zero();
+      for (uint32_t k = row_offsets_[row]; k < row_offsets_[row + 1]; ++k) {
+        sum.noalias() += blocks_[k] * x.template segment<DIM>(DIM * columns_[k]);
+      }
+      return sum;
+    }
+  }
+
+  uint32_t node_count_ = 0;
+  std::vector<uint32_t> row_offsets_;
+  std::vector<uint32_t> columns_;
+  TrackedBytes index_bytes_;
+  Blocks blocks_;
+};
+
+}  // namespace vulkan_fem
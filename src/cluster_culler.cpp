@@ -0,0 +1,154 @@
+#include "cluster_culler.h"
+#include "shader_library.h"
+#include <array>
+#include <stdexcept>
+#include <vector>
+
+namespace vulkan_fem {
+
+static_assert(sizeof(ClusterCuller::Parameters) == 24, "push constants of cull.comp");
+
+ClusterCuller::ClusterCuller(VkDevice device, VkPipelineCache pipeline_cache) : device_(device) {
+  try {
+    std::array<VkDescriptorSetLayoutBinding, 2> bindings{};
+    for (uint32_t i = 0; i < bindings.size(); ++i) {
+      bindings[i].binding = i;
+      bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+      bindings[i].descriptorCount = 1;
+      bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo set_layout_info{};
+    set_layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    set_layout_info.bindingCount = static_cast<uint32_t>(bindings.size());
+    set_layout_info.pBindings = bindings.data();
+    if (vkCreateDescriptorSetLayout(device_, &set_layout_info, nullptr, &set_layout_) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create culling descriptor set layout");
+    }
+
+    VkPushConstantRange push_constant_range{};
+    push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    push_constant_range.offset = 0;
+    push_constant_range.size = sizeof(Parameters);
+
+    VkPipelineLayoutCreateInfo layout_info{};
+    layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layout_info.setLayoutCount = 1;
+    layout_info.pSetLayouts = &set_layout_;
+    layout_info.pushConstantRangeCount = 1;
+    layout_info.pPushConstantRanges = &push_constant_range;
+    if (vkCreatePipelineLayout(device_, &layout_info, nullptr, &pipeline_layout_) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create culling pipeline layout");
+    }
+
+    const std::vector<char> code = LoadShader("cull.comp");
+    VkShaderModuleCreateInfo module_info{};
+    module_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    module_info.codeSize = code.size();
+    module_info.pCode = reinterpret_cast<const uint32_t *>(code.data());
+
+    VkShaderModule shader_module;
+    if (vkCreateShaderModule(device_, &module_info, nullptr, &shader_module) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create shader module");
+    }
+
+    VkComputePipelineCreateInfo pipeline_info{};
+    pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipeline_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipeline_info.stage.module = shader_module;
+    pipeline_info.stage.pName = "main";
+    pipeline_info.layout = pipeline_layout_;
+
+    const VkResult result = vkCreateComputePipelines(device_, pipeline_cache, 1, &pipeline_info, nullptr, &pipeline_);
+    vkDestroyShaderModule(device_, shader_module, nullptr);
+    if (result != VK_SUCCESS) {
+      throw std::runtime_error("failed to create culling pipeline");
+    }
+
+    VkDescriptorPoolSize pool_size{};
+    pool_size.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    pool_size.descriptorCount = static_cast<uint32_t>(bindings.size());
+
+    VkDescriptorPoolCreateInfo pool_info{};
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.maxSets = 1;
+    pool_info.poolSizeCount = 1;
+    pool_info.pPoolSizes = &pool_size;
+    if (vkCreateDescriptorPool(device_, &pool_info, nullptr, &descriptor_pool_) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create culling descriptor pool");
+    }
+
+    VkDescriptorSetAllocateInfo set_info{};
+    set_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    set_info.descriptorPool = descriptor_pool_;
+    set_info.descriptorSetCount = 1;
+    set_info.pSetLayouts = &set_layout_;
+    if (vkAllocateDescriptorSets(device_, &set_info, &descriptor_set_) != VK_SUCCESS) {
+      throw std::runtime_error("failed to allocate culling descriptor set");
+    }
+  } catch (...) {
+    Release();
+    throw;
+  }
+}
+
+ClusterCuller::~ClusterCuller() { Release(); }
+
+void ClusterCuller::Release() {
+  vkDestroyDescriptorPool(device_, descriptor_pool_, nullptr);
+  vkDestroyPipeline(device_, pipeline_, nullptr);
+  vkDestroyPipelineLayout(device_, pipeline_layout_, nullptr);
+  vkDestroyDescriptorSetLayout(device_, set_layout_, nullptr);
+  descriptor_pool_ = VK_NULL_HANDLE;
+  pipeline_ = VK_NULL_HANDLE;
+  pipeline_layout_ = VK_NULL_HANDLE;
+  set_layout_ = VK_NULL_HANDLE;
+}
+
+void ClusterCuller::Bind(VkBuffer clusters, VkBuffer draws) {
+  if (clusters == clusters_ && draws == draws_) {
+    return;
+  }
+  clusters_ = clusters;
+  draws_ = draws;
+
+  std::array<VkDescriptorBufferInfo, 2> buffer_infos{};
+  buffer_infos[0].buffer = clusters_;
+  buffer_infos[0].range = VK_WHOLE_SIZE;
+  buffer_infos[1].buffer = draws_;
+  buffer_infos[1].range = VK_WHOLE_SIZE;
+
+  VkWriteDescriptorSet write{};
+  write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  write.dstSet = descriptor_set_;
+  write.dstBinding = 0;
+  write.descriptorCount = static_cast<uint32_t>(buffer_infos.size());
+  write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  write.pBufferInfo = buffer_infos.data();
+  vkUpdateDescriptorSets(device_, 1, &write, 0, nullptr);
+}
+
+void ClusterCuller::Record(VkCommandBuffer command_buffer, const Parameters &parameters) const {
+  if (parameters.cluster_count_ == 0) {
+    return;
+  }
+
+  // the previous frame's indirect draws read the commands about to be overwritten
+  vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr,
+                       0, nullptr);
+
+  vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_);
+  vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout_, 0, 1, &descriptor_set_, 0, nullptr);
+  vkCmdPushConstants(command_buffer, pipeline_layout_, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(Parameters), &parameters);
+  vkCmdDispatch(command_buffer, (parameters.cluster_count_ + kGroupSize - 1) / kGroupSize, 1, 1);
+
+  VkMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+  vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 1, &barrier, 0, nullptr,
+                       0, nullptr);
+}
+
+}  // namespace vulkan_fem
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vulkan/vulkan_core.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+
+namespace vulkan_fem {
+
+// View frustum culling of DrawClusters on the GPU with cull.comp. Every cluster gets a VkDrawIndexedIndirectCommand
+// over its triangles, with no instance when its box, grown by the scaled displacements, is outside the view.
+// Only visible clusters are rasterized, without the CPU looking at the clusters every frame.
+class ClusterCuller {
+ public:
+  // push constants of cull.comp
+  struct Parameters {
+    glm::vec2 scale_;
+    glm::vec2 offset_;
+    float deformation_scale_ = 1.F;
+    uint32_t cluster_count_ = 0;
+  };
+
+  ClusterCuller(VkDevice device, VkPipelineCache pipeline_cache);
+  ~ClusterCuller();
+
+  ClusterCuller(const ClusterCuller &) = delete;
+  ClusterCuller &operator=(const ClusterCuller &) = delete;
+
+  // DrawClusters in, one indirect command per cluster out. The descriptor set is updated in place when the buffers
+  // changed, so no command buffer binding it may be pending then, as after ReserveBuffer reallocated them.
+  void Bind(VkBuffer clusters, VkBuffer draws);
+
+  // outside of a render pass, the commands are visible to indirect draws recorded afterwards
+  void Record(VkCommandBuffer command_buffer, const Parameters &parameters) const;
+
+ private:
+  static constexpr uint32_t kGroupSize = 64;  // local_size_x of cull.comp
+
+  void Release();
+
+  VkDevice device_;
+  VkDescriptorSetLayout set_layout_ = VK_NULL_HANDLE;
+  VkPipelineLayout pipeline_layout_ = VK_NULL_HANDLE;
+  VkPipeline pipeline_ = VK_NULL_HANDLE;
+  VkDescriptorPool descriptor_pool_ = VK_NULL_HANDLE;
+  VkDescriptorSet descriptor_set_ = VK_NULL_HANDLE;
+
+  VkBuffer clusters_ = VK_NULL_HANDLE;
+  VkBuffer draws_ = VK_NULL_HANDLE;
+};
+
+}  // namespace vulkan_fem
@@ -0,0 +1,174 @@
+#include "communicator.h"
+#include <algorithm>
+#include <exception>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+
+namespace vulkan_fem {
+
+void ThreadCommunicator::Group::Abort() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    aborted_ = true;
+  }
+  changed_.notify_all();
+}
+
+void ThreadCommunicator::Group::CheckAborted() const {
+  if (aborted_) {
+    throw std::runtime_error("another rank failed");
+  }
+}
+
+void ThreadCommunicator::AllReduceSum(double *values, size_t count) {
+  Group &group = *group_;
+  std::unique_lock<std::mutex> lock(group.mutex_);
+  group.CheckAborted();
+
+  group.contributions_[rank_].assign(values, values + count);
+  if (++group.arrived_ == group.size_) {
+    group.result_.assign(count, 0.);
+    for (const auto &contribution : group.contributions_) {
+      if (contribution.size() != count) {
+        group.aborted_ = true;
+        group.changed_.notify_all();
+        throw std::runtime_error("ranks reduce different counts");
+      }
+      for (size_t i = 0; i < count; ++i) {
+        group.result_[i] += contribution[i];
+      }
+    }
+    group.arrived_ = 0;
+    ++group.generation_;
+    group.changed_.notify_all();
+  } else {
+    const uint64_t generation = group.generation_;
+    group.changed_.wait(lock, [&] { return group.generation_ != generation || group.aborted_; });
+    group.CheckAborted();
+  }
+
+  // the next reduction cannot complete before this rank joined it, result_ stays valid until then
+  std::copy(group.result_.begin(), group.result_.end(), values);
+}
+
+void ThreadCommunicator::Exchange(const std::vector<uint32_t> &neighbours, const std::vector<std::vector<Precision>> &send,
+                                  std::vector<std::vector<Precision>> &receive) {
+  Group &group = *group_;
+  {
+    std::lock_guard<std::mutex> lock(group.mutex_);
+    group.CheckAborted();
+    for (size_t k = 0; k < neighbours.size(); ++k) {
+      group.mailboxes_[{rank_, neighbours[k]}].push_back(send[k]);
+    }
+  }
+  group.changed_.notify_all();
+
+  std::unique_lock<std::mutex> lock(group.mutex_);
+  for (size_t k = 0; k < neighbours.size(); ++k) {
+    auto &mailbox = group.mailboxes_[{neighbours[k], rank_}];
+    group.changed_.wait(lock, [&] { return !mailbox.empty() || group.aborted_; });
+    group.CheckAborted();
+
+    if (mailbox.front().size() != receive[k].size()) {
+      throw std::runtime_error("received message size does not match");
+    }
+    std::copy(mailbox.front().begin(), mailbox.front().end(), receive[k].begin());
+    mailbox.pop_front();
+  }
+}
+
+void RunThreadRanks(uint32_t size, const std::function<void(Communicator &)> &f) {
+  const auto group = std::make_shared<ThreadCommunicator::Group>(size);
+
+  std::mutex error_mutex;
+  std::exception_ptr error;
+  const auto run = [&](uint32_t rank) {
+    ThreadCommunicator communicator(group, rank);
+    try {
+      f(communicator);
+    } catch (...) {
+      {
+        std::lock_guard<std::mutex> lock(error_mutex);
+        if (!error) {
+          error = std::current_exception();
+        }
+      }
+      group->Abort();
+    }
+  };
+
+  // the calling thread is rank 0
+  std::vector<std::thread> ranks;
+  ranks.reserve(size - 1);
+  for (uint32_t rank = 1; rank < size; ++rank) {
+    ranks.emplace_back(run, rank);
+  }
+  run(0);
+  for (auto &rank : ranks) {
+    rank.join();
+  }
+
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+#ifdef VULKAN_FEM_USE_MPI
+
+static_assert(std::is_same_v<Precision, float>, "Exchange sends MPI_FLOAT");
+
+MpiCommunicator::MpiCommunicator(MPI_Comm communicator) : communicator_(communicator) {
+  int rank = 0;
+  int size = 1;
+  MPI_Comm_rank(communicator_, &rank);
+  MPI_Comm_size(communicator_, &size);
+  rank_ = static_cast<uint32_t>(rank);
+  size_ = static_cast<uint32_t>(size);
+}
+
+void MpiCommunicator::AllReduceSum(double *values, size_t count) {
+  if (count > static_cast<size_t>(std::numeric_limits<int>::max())) {
+    throw std::runtime_error("MPI reduction too large");
+  }
+  // MPI_SUM of doubles may reorder, the reduction is still the same on every rank
+  MPI_Allreduce(MPI_IN_PLACE, values, static_cast<int>(count), MPI_DOUBLE, MPI_SUM, communicator_);
+}
+
+void MpiCommunicator::Exchange(const std::vector<uint32_t> &neighbours, const std::vector<std::vector<Precision>> &send,
+                               std::vector<std::vector<Precision>> &receive) {
+  constexpr int kTag = 0;
+
+  requests_.resize(2 * neighbours.size());
+  for (size_t k = 0; k < neighbours.size(); ++k) {
+    MPI_Irecv(receive[k].data(), static_cast<int>(receive[k].size()), MPI_FLOAT, static_cast<int>(neighbours[k]), kTag, communicator_,
+              &requests_[2 * k]);
+  }
+  for (size_t k = 0; k < neighbours.size(); ++k) {
+    MPI_Isend(send[k].data(), static_cast<int>(send[k].size()), MPI_FLOAT, static_cast<int>(neighbours[k]), kTag, communicator_,
+              &requests_[2 * k + 1]);
+  }
+  MPI_Waitall(static_cast<int>(requests_.size()), requests_.data(), MPI_STATUSES_IGNORE);
+}
+
+void MpiCommunicator::Barrier() { MPI_Barrier(communicator_); }
+
+MpiSession::MpiSession() {
+  int initialized = 0;
+  MPI_Initialized(&initialized);
+  if (initialized == 0) {
+    MPI_Init(nullptr, nullptr);
+    initialized_ = true;
+  }
+}
+
+MpiSession::~MpiSession() {
+  if (initialized_) {
+    MPI_Finalize();
+  }
+}
+
+#endif
+
+}  // namespace vulkan_fem
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "fem.h"
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#ifdef VULKAN_FEM_USE_MPI
+#include <mpi.h>
+#endif
+
+namespace vulkan_fem {
+
+// Collective and point to point operations the distributed solvers need, over MPI processes
+// or over threads of one process standing in for them. Every rank has to make the same calls in the same order.
+class Communicator {
+ public:
+  virtual ~Communicator() = default;
+
+  [[nodiscard]] virtual uint32_t GetRank() const = 0;
+  [[nodiscard]] virtual uint32_t GetSize() const = 0;
+
+  // element wise sum over all ranks in place, every rank gets the same result
+  virtual void AllReduceSum(double *values, size_t count) = 0;
+  // sends send[k] to neighbours[k] and receives receive[k] from it, receive buffers are sized by the caller
+  virtual void Exchange(const std::vector<uint32_t> &neighbours, const std::vector<std::vector<Precision>> &send,
+                        std::vector<std::vector<Precision>> &receive) = 0;
+  virtual void Barrier() = 0;
+
+  double AllReduceSum(double value) {
+    AllReduceSum(&value, 1);
+    return value;
+  }
+};
+
+// Ranks as threads of one process, the local stand-in for MPI
+class ThreadCommunicator : public Communicator {
+ public:
+  // state shared by the ranks of one run
+  class Group {
+   public:
+    explicit Group(uint32_t size) : size_(size), contributions_(size) {}
+
+    // wakes every waiting rank with an exception, for when one of them failed
+    void Abort();
+
+   private:
+    friend class ThreadCommunicator;
+
+    // throws when the group was aborted, the lock is held
+    void CheckAborted() const;
+
+    const uint32_t size_;
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    bool aborted_ = false;
+
+    // reduction in progress, the last rank to arrive sums the contributions
+    std::vector<std::vector<double>> contributions_;
+    std::vector<double> result_;
+    uint32_t arrived_ = 0;
+    uint64_t generation_ = 0;
+
+    // (from, to) -> messages in send order
+    std::map<std::pair<uint32_t, uint32_t>, std::deque<std::vector<Precision>>> mailboxes_;
+  };
+
+  ThreadCommunicator(std::shared_ptr<Group> group, uint32_t rank) : group_(std::move(group)), rank_(rank) {}
+
+  [[nodiscard]] uint32_t GetRank() const override { return rank_; }
+  [[nodiscard]] uint32_t GetSize() const override { return group_->size_; }
+
+  void AllReduceSum(double *values, size_t count) override;
+  void Exchange(const std::vector<uint32_t> &neighbours, const std::vector<std::vector<Precision>> &send,
+                std::vector<std::vector<Precision>> &receive) override;
+  void Barrier() override { AllReduceSum(nullptr, 0); }
+
+  using Communicator::AllReduceSum;
+
+ private:
+  std::shared_ptr<Group> group_;
+  const uint32_t rank_;
+};
+
+// runs f(communicator) on size thread ranks and waits for all of them, rethrows the first exception
+void RunThreadRanks(uint32_t size, const std::function<void(Communicator &)> &f);
+
+#ifdef VULKAN_FEM_USE_MPI
+
+class MpiCommunicator : public Communicator {
+ public:
+  explicit MpiCommunicator(MPI_Comm communicator = MPI_COMM_WORLD);
+
+  [[nodiscard]] uint32_t GetRank() const override { return rank_; }
+  [[nodiscard]] uint32_t GetSize() const override { return size_; }
+
+  void AllReduceSum(double *values, size_t count) override;
+  void Exchange(const std::vector<uint32_t> &neighbours, const std::vector<std::vector<Precision>> &send,
+                std::vector<std::vector<Precision>> &receive) override;
+  void Barrier() override;
+
+  using Communicator::AllReduceSum;
+
+ private:
+  MPI_Comm communicator_;
+  uint32_t rank_ = 0;
+  uint32_t size_ = 1;
+  std::vector<MPI_Request> requests_;
+};
+
+// MPI_Init for its lifetime and MPI_Finalize after, nothing when MPI was initialized already
+class MpiSession {
+ public:
+  MpiSession();
+  ~MpiSession();
+
+  MpiSession(const MpiSession &) = delete;
+  MpiSession &operator=(const MpiSession &) = delete;
+
+ private:
+  bool initialized_ = false;
+};
+
+#endif
+
+}  // namespace vulkan_fem
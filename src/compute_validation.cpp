@@ -0,0 +1,106 @@
+#include "compute_validation.h"
+#include "device_assembly.h"
+#include "model_factory.h"
+#include "solver.h"
+#include "strain_displacement.h"
+#include "vulkan_compute.h"
+#include <spdlog/spdlog.h>
+#include <cstdlib>
+#include <exception>
+#include <memory>
+
+namespace vulkan_fem {
+namespace {
+
+// float kernels accumulate in a different order than Eigen
+constexpr Precision kTolerance = 1e-4;
+constexpr Precision kSolveTolerance = 1e-3;
+
+bool Report(const char *name, uint32_t dim, Precision error, Precision tolerance) {
+  const bool passed = error <= tolerance;
+  if (passed) {
+    spdlog::info("{}D {}: relative error {}", dim, name, error);
+  } else {
+    spdlog::error("{}D {}: relative error {} above {}", dim, name, error, tolerance);
+  }
+  return passed;
+}
+
+template <uint32_t DIM>
+bool Validate(VulkanCompute &compute, Model<DIM> &model) {
+  bool passed = true;
+
+  Solver<DIM> solver;
+  const CsrMatrix reference = solver.AssembleStiffness(model).template selfadjointView<Eigen::Upper>();
+
+  // element matrices and assembly from the same cached gradients the host uses
+  const auto gradients = model.GetElementGradients();
+  LinearMaterial<DIM> material = model.GetMaterial();
+  const MatrixConstitutive<DIM> d_matrix = material.GetStiffnessMatrix();
+
+  const std::vector<Precision> element_matrices = compute.ElementStiffness(DIM, gradients->node_count_, gradients->point_count_,
+                                                                            gradients->gradients_, gradients->scales_, d_matrix.data());
+  const auto element_size = static_cast<Eigen::Index>(DIM * gradients->node_count_);
+  Eigen::Matrix<Precision, Eigen::Dynamic, Eigen::Dynamic> host_element(element_size, element_size);
+  Precision element_error = 0.;
+  for (size_t element = 0; element < gradients->GetElementCount(); ++element) {
+    host_element.setZero();
+    for (uint32_t p = 0; p < gradients->point_count_; ++p) {
+      const size_t point = element * gradients->point_count_ + p;
+      AddStrainStiffness<DIM>(gradients->GetGradient(point), d_matrix, gradients->GetScale(point), host_element);
+    }
+    // row major on the device, K_e is symmetric so the transpose does not matter
+    const Eigen::Map<const Eigen::Matrix<Precision, Eigen::Dynamic, Eigen::Dynamic>> device_element(
+        element_matrices.data() + element * element_size * element_size, element_size, element_size);
+    element_error = std::max(element_error, (device_element - host_element).norm() / host_element.norm());
+  }
+  passed &= Report("element stiffness", DIM, element_error, kTolerance);
+
+  const CsrMatrix assembled = compute.AssembleStiffness(BuildAssemblyPlan(model), gradients->point_count_, gradients->gradients_,
+                                                        gradients->scales_, d_matrix.data());
+  passed &= Report("assembly", DIM, CsrMatrix(assembled - reference).norm() / reference.norm(), kTolerance);
+
+  const VectorX x = VectorX::Random(reference.cols());
+  const VectorX expected = reference * x;
+  VectorX y;
+  compute.Multiply(reference, x, y);
+  passed &= Report("CSR SpMV", DIM, (y - expected).norm() / expected.norm(), kTolerance);
+
+  auto blocks = model.BuildGlobalStiffnessBlockMatrix();
+  model.ApplyConstraints(blocks);
+  compute.MultiplyBlocks(DIM, blocks.GetRowOffsets(), blocks.GetColumns(), blocks.GetBlocks()->data(), x, y);
+  passed &= Report("BSR SpMV", DIM, (y - expected).norm() / expected.norm(), kTolerance);
+
+  const VectorX loads = model.GetLoads();
+  const VectorX direct = solver.Factorize(model).solve(loads);
+  VectorX displacements;
+  const IterativeResult result = compute.ConjugateGradient(reference, loads, displacements, 10000, 1e-6);
+  spdlog::info("{}D device CG: {} iterations, relative residual {}", DIM, result.iterations_, result.relative_residual_);
+  passed &= result.converged_;
+  passed &= Report("CG solution", DIM, (displacements - direct).norm() / direct.norm(), kSolveTolerance);
+
+  return passed;
+}
+
+}  // namespace
+
+int ValidateCompute() {
+  std::unique_ptr<VulkanCompute> compute;
+  try {
+    compute = std::make_unique<VulkanCompute>();
+  } catch (const std::exception &e) {
+    spdlog::error("no Vulkan compute device: {}", e.what());
+    return EXIT_FAILURE;
+  }
+
+  try {
+    const bool passed = Validate<2>(*compute, *ModelFactory::CreateRectangle2()) & Validate<3>(*compute, *ModelFactory::CreateBlock(8, 4, 4));
+    spdlog::info("compute validation on {} {}", compute->GetName(), passed ? "passed" : "failed");
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+  } catch (const std::exception &e) {
+    spdlog::error("compute validation failed: {}", e.what());
+    return EXIT_FAILURE;
+  }
+}
+
+}  // namespace vulkan_fem
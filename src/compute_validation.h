@@ -0,0 +1,9 @@
+#pragma once
+
+namespace vulkan_fem {
+
+// Runs the compute kernels on a headless device against the Eigen reference on small 2D and 3D models.
+// Returns the process exit code, non-zero when no device is found or a result is off.
+int ValidateCompute();
+
+}  // namespace vulkan_fem
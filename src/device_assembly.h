@@ -0,0 +1,109 @@
+#pragma once
+
+#include "block_sparse.h"
+#include "device_solver.h"
+#include "fem.h"
+#include "model.h"
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+namespace vulkan_fem {
+
+// Where every entry of the element matrices goes in the global CSR matrix. With it the device assembles
+// by gathering, one thread per non-zero, instead of scattering with atomics. Depends on the topology only.
+struct AssemblyPlan {
+  uint32_t dim_ = 0;
+  uint32_t node_count_ = 0;  // nodes per element
+  uint32_t element_count_ = 0;
+
+  // scalar CSR pattern of the full matrix
+  std::vector<uint32_t> row_offsets_;
+  std::vector<uint32_t> columns_;
+  std::vector<uint32_t> rows_;  // row of every non-zero
+
+  // non-zero k sums element matrix entries sources_[source_offsets_[k]] .. sources_[source_offsets_[k + 1] - 1],
+  // an entry is element * size * size + row * size + col with size = dim_ * node_count_
+  std::vector<uint32_t> source_offsets_;
+  std::vector<uint32_t> sources_;
+
+  std::vector<uint32_t> constrained_;  // 1 for constrained dofs
+
+  [[nodiscard]] uint32_t GetRowCount() const { return static_cast<uint32_t>(row_offsets_.size()) - 1; }
+  [[nodiscard]] uint32_t GetNonZeroCount() const { return static_cast<uint32_t>(columns_.size()); }
+  [[nodiscard]] uint32_t GetElementSize() const { return dim_ * node_count_; }
+};
+
+template <uint32_t DIM>
+AssemblyPlan BuildAssemblyPlan(const Model<DIM> &model) {
+  const auto &indices = model.GetIndices();
+  const uint32_t node_count = model.GetElementType()->GetElementCount();
+  const auto vertex_count = static_cast<uint32_t>(model.GetVertices().size());
+
+  AssemblyPlan plan;
+  plan.dim_ = DIM;
+  plan.node_count_ = node_count;
+  plan.element_count_ = static_cast<uint32_t>(indices.size() / node_count);
+
+  // node coupling pattern of the block matrix, expanded to scalar rows
+  const BlockSparseMatrix<DIM> blocks(vertex_count, indices, node_count);
+  const auto &block_offsets = blocks.GetRowOffsets();
+  const auto &block_columns = blocks.GetColumns();
+
+  plan.row_offsets_.reserve(DIM * vertex_count + 1);
+  plan.row_offsets_.push_back(0);
+  for (uint32_t node = 0; node < vertex_count; ++node) {
+    for (uint32_t i = 0; i < DIM; ++i) {
+      for (uint32_t k = block_offsets[node]; k < block_offsets[node + 1]; ++k) {
+        for (uint32_t j = 0; j < DIM; ++j) {
+          plan.columns_.push_back(DIM * block_columns[k] + j);
+          plan.rows_.push_back(DIM * node + i);
+        }
+      }
+      plan.row_offsets_.push_back(static_cast<uint32_t>(plan.columns_.size()));
+    }
+  }
+
+  // non-zero of every element matrix entry, counted first for the CSR layout of the sources
+  const uint32_t size = plan.GetElementSize();
+  std::vector<uint32_t> targets(static_cast<size_t>(plan.element_count_) * size * size);
+  plan.source_offsets_.assign(plan.columns_.size() + 1, 0);
+
+  for (uint32_t element = 0; element < plan.element_count_; ++element) {
+    const uint16_t *nodes = indices.data() + static_cast<size_t>(element) * node_count;
+    for (uint32_t row = 0; row < size; ++row) {
+      const uint32_t global_row = DIM * nodes[row / DIM] + row % DIM;
+      const auto begin = plan.columns_.begin() + plan.row_offsets_[global_row];
+      const auto end = plan.columns_.begin() + plan.row_offsets_[global_row + 1];
+      for (uint32_t col = 0; col < size; ++col) {
+        const uint32_t global_col = DIM * nodes[col / DIM] + col % DIM;
+        const auto it = std::lower_bound(begin, end, global_col);
+        if (it == end || *it != global_col) {
+          throw std::runtime_error("element entry outside of the sparsity pattern");
+        }
+        const auto target = static_cast<uint32_t>(it - plan.columns_.begin());
+        targets[(static_cast<size_t>(element) * size + row) * size + col] = target;
+        ++plan.source_offsets_[target + 1];
+      }
+    }
+  }
+
+  for (size_t k = 0; k + 1 < plan.source_offsets_.size(); ++k) {
+    plan.source_offsets_[k + 1] += plan.source_offsets_[k];
+  }
+
+  plan.sources_.resize(targets.size());
+  std::vector<uint32_t> fill(plan.source_offsets_.begin(), plan.source_offsets_.end() - 1);
+  for (uint32_t entry = 0; entry < targets.size(); ++entry) {
+    plan.sources_[fill[targets[entry]]++] = entry;
+  }
+
+  plan.constrained_.assign(DIM * vertex_count, 0);
+  for (const auto dof : model.GetConstrainedDofs()) {
+    plan.constrained_[dof] = 1;
+  }
+  return plan;
+}
+
+}  // namespace vulkan_fem
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "fem.h"
+#include "iterative.h"
+#include <Eigen/Sparse>
+#include <string>
+
+namespace vulkan_fem {
+
+// full (both triangles) row major sparse matrix, the layout compute devices consume directly
+using CsrMatrix = Eigen::SparseMatrix<Precision, Eigen::RowMajor, int>;
+
+// Linear algebra offloaded to a compute device. Solvers keep to the host path when none is set.
+class DeviceSolver {
+ public:
+  virtual ~DeviceSolver() = default;
+
+  [[nodiscard]] virtual std::string GetName() const = 0;
+
+  // y = A * x
+  virtual void Multiply(const CsrMatrix &matrix, const VectorX &x, VectorX &y) = 0;
+
+  // Jacobi preconditioned CG from x = 0, iterations and their scalars stay on the device
+  virtual IterativeResult ConjugateGradient(const CsrMatrix &matrix, const VectorX &b, VectorX &x, uint32_t max_iterations,
+                                            Precision tolerance) = 0;
+};
+
+}  // namespace vulkan_fem
@@ -0,0 +1,143 @@
+#include "distributed_benchmark.h"
+#include "communicator.h"
+#include "distributed_solver.h"
+#include "model_factory.h"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <memory>
+#include <utility>
+
+namespace vulkan_fem {
+namespace {
+
+// the CG stops at 1e-6 of its recursive residual in float, the true residual drifts away from it on large meshes
+constexpr Precision kResidualTolerance = 1e-3;
+
+struct BenchmarkRow {
+  uint32_t ranks_ = 0;
+  uint32_t iterations_ = 0;
+  bool converged_ = false;
+  double assemble_ms_ = 0.;  // partitioning included
+  double solve_ms_ = 0.;
+  VectorX displacements_;
+};
+
+// one distributed solve between barriers, every rank gets the gathered displacements
+BenchmarkRow SolveDistributed(Communicator &communicator, const Model<3> &model) {
+  using Clock = std::chrono::steady_clock;
+  SolverOptions options;
+  options.method_ = SolverMethod::kConjugateGradient;
+
+  communicator.Barrier();
+  const Clock::time_point start = Clock::now();
+  DistributedSolver<3> solver(communicator, DecomposeModel(model, communicator.GetSize(), communicator.GetRank()), options);
+  solver.Assemble(model);
+  communicator.Barrier();
+  const Clock::time_point assembled = Clock::now();
+  const VectorX local = solver.Solve(model);
+  communicator.Barrier();
+  const Clock::time_point solved = Clock::now();
+
+  BenchmarkRow row;
+  row.ranks_ = communicator.GetSize();
+  row.iterations_ = solver.GetResult().iterations_;
+  row.converged_ = solver.GetResult().converged_;
+  row.assemble_ms_ = std::chrono::duration<double, std::milli>(assembled - start).count();
+  row.solve_ms_ = std::chrono::duration<double, std::milli>(solved - assembled).count();
+  row.displacements_ = solver.Gather(local, model.GetVertices().size());
+  return row;
+}
+
+// |K u - f| / |f| with the serially assembled K, in double so the check does not add float rounding of its own
+Precision GetRelativeResidual(Model<3> &model, const VectorX &displacements) {
+  auto stiffness = model.BuildGlobalStiffnessMatrix(StiffnessStorage::kUpper);
+  model.ApplyConstraints(stiffness);
+  const Eigen::SparseMatrix<double> upper = stiffness.cast<double>();
+  const Eigen::VectorXd loads = model.GetLoads().cast<double>();
+  const Eigen::VectorXd residual = upper.selfadjointView<Eigen::Upper>() * displacements.cast<double>() - loads;
+  return static_cast<Precision>(residual.norm() / loads.norm());
+}
+
+// logs the row and returns whether its solution is good, speedup against the single rank time when known
+bool Report(const BenchmarkRow &row, Model<3> &model, double single_rank_ms) {
+  const double total_ms = row.assemble_ms_ + row.solve_ms_;
+  const Precision residual = GetRelativeResidual(model, row.displacements_);
+  if (single_rank_ms > 0.) {
+    const double speedup = single_rank_ms / total_ms;
+    spdlog::info("{:>6} {:>10} {:>12.1f} {:>12.1f} {:>12.1f} {:>8.2f} {:>10.0f}% {:>12.2e}", row.ranks_, row.iterations_, row.assemble_ms_,
+                 row.solve_ms_, total_ms, speedup, 100. * speedup / row.ranks_, residual);
+  } else {
+    spdlog::info("{:>6} {:>10} {:>12.1f} {:>12.1f} {:>12.1f} {:>8} {:>11} {:>12.2e}", row.ranks_, row.iterations_, row.assemble_ms_,
+                 row.solve_ms_, total_ms, "-", "-", residual);
+  }
+
+  const bool passed = row.converged_ && residual <= kResidualTolerance;
+  if (!passed) {
+    spdlog::error("{} ranks: {}, relative residual {} above {}", row.ranks_, row.converged_ ? "converged" : "not converged", residual,
+                  kResidualTolerance);
+  }
+  return passed;
+}
+
+void LogHeader(const Model<3> &model) {
+  spdlog::info("distributed CG on {} nodes, {} elements", model.GetVertices().size(),
+               model.GetIndices().size() / model.GetElementType()->GetElementCount());
+  spdlog::info("{:>6} {:>10} {:>12} {:>12} {:>12} {:>8} {:>11} {:>12}", "ranks", "iterations", "assemble ms", "solve ms", "total ms",
+               "speedup", "efficiency", "residual");
+}
+
+}  // namespace
+
+int RunDistributedBenchmark(uint32_t max_ranks, uint32_t elements) {
+  try {
+    // 16 bit indices bound the node count
+    elements = std::clamp(elements, 2U, 62U);
+    const auto model = ModelFactory::CreateBlock(elements, elements / 2, elements / 2);
+
+#ifdef VULKAN_FEM_USE_MPI
+    const MpiSession session;
+    MpiCommunicator world;
+    if (world.GetSize() > 1) {
+      const BenchmarkRow row = SolveDistributed(world, *model);
+      bool passed = true;
+      if (world.GetRank() == 0) {
+        LogHeader(*model);
+        passed = Report(row, *model, 0.);
+      }
+      // every process exits with the verdict of rank 0
+      return world.AllReduceSum(passed ? 0. : 1.) == 0. ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+#endif
+
+    LogHeader(*model);
+    bool passed = true;
+    double single_rank_ms = 0.;
+    // powers of two, then max_ranks itself
+    max_ranks = std::max(max_ranks, 1U);
+    for (uint32_t ranks = 1;; ranks = std::min(2 * ranks, max_ranks)) {
+      BenchmarkRow row;
+      RunThreadRanks(ranks, [&](Communicator &communicator) {
+        BenchmarkRow rank_row = SolveDistributed(communicator, *model);
+        if (communicator.GetRank() == 0) {
+          row = std::move(rank_row);
+        }
+      });
+      if (ranks == 1) {
+        single_rank_ms = row.assemble_ms_ + row.solve_ms_;
+      }
+      passed &= Report(row, *model, single_rank_ms);
+      if (ranks == max_ranks) {
+        break;
+      }
+    }
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+  } catch (const std::exception &e) {
+    spdlog::error("distributed benchmark failed: {}", e.what());
+    return EXIT_FAILURE;
+  }
+}
+
+}  // namespace vulkan_fem
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstdint>
+
+namespace vulkan_fem {
+
+// Solves a cantilever block of elements x elements/2 x elements/2 hexahedra with the distributed solver on
+// 1, 2, 4, ... up to max_ranks thread ranks and logs time, CG iterations, speedup and parallel efficiency per
+// rank count. In an MPI build started by mpirun with more than one process the ranks are the MPI processes
+// instead and rank 0 logs a single row. Returns the process exit code, non-zero when a solution is off.
+int RunDistributedBenchmark(uint32_t max_ranks, uint32_t elements);
+
+}  // namespace vulkan_fem
@@ -0,0 +1,193 @@
+#pragma once
+
+#include "communicator.h"
+#include "domain_decomposition.h"
+#include "iterative.h"
+#include "model.h"
+#include "profiler.h"
+#include "solver.h"
+#include <Eigen/Sparse>
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace vulkan_fem {
+
+// Jacobi preconditioned CG over ranks, each holding the rows of its owned nodes of the constrained K.
+// Ghost values are exchanged with the neighbours before every SpMV and the dot products are reduced over all
+// ranks, two at a time where the iteration allows. Vectors are local: owned nodes first, then ghosts, DIM dofs each.
+template <uint32_t DIM = 3>
+class DistributedSolver {
+ public:
+  DistributedSolver(Communicator &communicator, Subdomain subdomain, SolverOptions options = {})
+      : communicator_(communicator), subdomain_(std::move(subdomain)), options_(options) {
+    for (const auto &nodes : subdomain_.send_nodes_) {
+      send_buffers_.emplace_back(nodes.size() * DIM);
+    }
+    for (const auto &nodes : subdomain_.receive_nodes_) {
+      receive_buffers_.emplace_back(nodes.size() * DIM);
+    }
+  }
+
+  // owned rows of K from the elements of the subdomain, constrained dofs as in Model::ApplyConstraints
+  void Assemble(const Model<DIM> &model) {
+    const ScopedTimer timer("distributed assemble", "solver");
+    const uint32_t element_nodes = model.GetElementType()->GetElementCount();
+    const auto &indices = model.GetIndices();
+
+    std::unordered_map<uint32_t, uint32_t> local_nodes;
+    local_nodes.reserve(subdomain_.GetLocalCount());
+    for (uint32_t local = 0; local < subdomain_.GetLocalCount(); ++local) {
+      local_nodes.emplace(subdomain_.global_nodes_[local], local);
+    }
+
+    constrained_.assign(size_t{subdomain_.GetLocalCount()} * DIM, false);
+    for (const int dof : model.GetConstrainedDofs()) {
+      if (const auto it = local_nodes.find(static_cast<uint32_t>(dof) / DIM); it != local_nodes.end()) {
+        constrained_[DIM * it->second + dof % DIM] = true;
+      }
+    }
+
+    LinearMaterial<DIM> material = model.GetMaterial();
+    const MatrixConstitutive<DIM> d_matrix = material.GetStiffnessMatrix();
+
+    std::vector<Eigen::Triplet<Precision>> triplets;
+    triplets.reserve(subdomain_.elements_.size() * element_nodes * element_nodes * DIM * DIM);
+    std::vector<uint32_t> element_locals(element_nodes);
+    MatrixElementStiffness<DIM> element_stiffness_matrix;
+    for (const uint32_t element : subdomain_.elements_) {
+      model.CalcElementStiffness(element, d_matrix, element_stiffness_matrix);
+      for (uint32_t a = 0; a < element_nodes; ++a) {
+        element_locals[a] = local_nodes.at(indices[element * element_nodes + a]);
+      }
+
+      for (uint32_t a = 0; a < element_nodes; ++a) {
+        if (element_locals[a] >= subdomain_.owned_count_) {
+          continue;
+        }
+        for (uint32_t b = 0; b < element_nodes; ++b) {
+          for (uint32_t di = 0; di < DIM; ++di) {
+            for (uint32_t dj = 0; dj < DIM; ++dj) {
+              const uint32_t row = DIM * element_locals[a] + di;
+              const uint32_t col = DIM * element_locals[b] + dj;
+              if (!constrained_[row] && !constrained_[col]) {
+                triplets.emplace_back(row, col, element_stiffness_matrix(DIM * a + di, DIM * b + dj));
+              }
+            }
+          }
+        }
+      }
+    }
+    for (uint32_t dof = 0; dof < subdomain_.owned_count_ * DIM; ++dof) {
+      if (constrained_[dof]) {
+        triplets.emplace_back(dof, dof, 1.F);
+      }
+    }
+
+    stiffness_.resize(subdomain_.owned_count_ * DIM, subdomain_.GetLocalCount() * DIM);
+    stiffness_.setFromTriplets(triplets.begin(), triplets.end());
+    inverse_diagonal_ = stiffness_.diagonal().cwiseInverse();
+  }
+
+  // solves K u = f over all ranks, returns the local displacements with their ghosts up to date
+  VectorX Solve(const Model<DIM> &model) {
+    const ScopedTimer timer("distributed conjugate gradient", "solver");
+    const VectorX loads = model.GetLoads();
+    const Eigen::Index owned = stiffness_.rows();
+
+    VectorX b(owned);
+    for (uint32_t local = 0; local < subdomain_.owned_count_; ++local) {
+      b.template segment<DIM>(DIM * local) = loads.template segment<DIM>(DIM * subdomain_.global_nodes_[local]);
+    }
+
+    VectorX x = VectorX::Zero(stiffness_.cols());
+    VectorX r = b;
+    VectorX z = inverse_diagonal_.cwiseProduct(r);
+    VectorX p = VectorX::Zero(stiffness_.cols());
+    p.head(owned) = z;
+    VectorX q(owned);
+
+    double sums[2] = {r.template cast<double>().squaredNorm(), r.template cast<double>().dot(z.template cast<double>())};
+    communicator_.AllReduceSum(sums, 2);
+    const double b_norm = std::sqrt(sums[0]);
+    double rz = sums[1];
+
+    result_ = {};
+    if (b_norm == 0.) {
+      result_.converged_ = true;
+      return x;
+    }
+
+    for (;; ++result_.iterations_) {
+      result_.relative_residual_ = static_cast<Precision>(std::sqrt(sums[0]) / b_norm);
+      if (result_.relative_residual_ <= options_.tolerance_ || result_.iterations_ >= options_.max_iterations_) {
+        break;
+      }
+
+      UpdateGhosts(p);
+      q.noalias() = stiffness_ * p;
+      const double alpha = rz / communicator_.AllReduceSum(p.head(owned).template cast<double>().dot(q.template cast<double>()));
+      x.head(owned) += static_cast<Precision>(alpha) * p.head(owned);
+      r -= static_cast<Precision>(alpha) * q;
+
+      z = inverse_diagonal_.cwiseProduct(r);
+      sums[0] = r.template cast<double>().squaredNorm();
+      sums[1] = r.template cast<double>().dot(z.template cast<double>());
+      communicator_.AllReduceSum(sums, 2);
+      p.head(owned) = z + static_cast<Precision>(sums[1] / rz) * p.head(owned);
+      rz = sums[1];
+    }
+
+    result_.converged_ = result_.relative_residual_ <= options_.tolerance_;
+    ProfileCount("CG iterations", result_.iterations_);
+    UpdateGhosts(x);
+    return x;
+  }
+
+  // the local values of every rank in one global vector on all ranks, for checking against a serial solve
+  VectorX Gather(const VectorX &local, size_t node_count) {
+    std::vector<double> values(node_count * DIM, 0.);
+    for (uint32_t node = 0; node < subdomain_.owned_count_; ++node) {
+      for (uint32_t d = 0; d < DIM; ++d) {
+        values[DIM * subdomain_.global_nodes_[node] + d] = local[DIM * node + d];
+      }
+    }
+    communicator_.AllReduceSum(values.data(), values.size());
+    return Eigen::Map<const Eigen::VectorXd>(values.data(), static_cast<Eigen::Index>(values.size())).template cast<Precision>();
+  }
+
+  [[nodiscard]] const IterativeResult &GetResult() const { return result_; }
+  [[nodiscard]] const Subdomain &GetSubdomain() const { return subdomain_; }
+
+ private:
+  // ghost values of x from their owners
+  void UpdateGhosts(VectorX &x) {
+    for (size_t k = 0; k < subdomain_.neighbours_.size(); ++k) {
+      for (size_t i = 0; i < subdomain_.send_nodes_[k].size(); ++i) {
+        Eigen::Map<VectorX>(send_buffers_[k].data() + DIM * i, DIM) = x.template segment<DIM>(DIM * subdomain_.send_nodes_[k][i]);
+      }
+    }
+    communicator_.Exchange(subdomain_.neighbours_, send_buffers_, receive_buffers_);
+    for (size_t k = 0; k < subdomain_.neighbours_.size(); ++k) {
+      for (size_t i = 0; i < subdomain_.receive_nodes_[k].size(); ++i) {
+        x.template segment<DIM>(DIM * subdomain_.receive_nodes_[k][i]) = Eigen::Map<const VectorX>(receive_buffers_[k].data() + DIM * i, DIM);
+      }
+    }
+  }
+
+  Communicator &communicator_;
+  Subdomain subdomain_;
+  SolverOptions options_;
+
+  Eigen::SparseMatrix<Precision, Eigen::RowMajor> stiffness_;  // owned dofs x local dofs
+  VectorX inverse_diagonal_;
+  std::vector<bool> constrained_;  // per local dof
+  IterativeResult result_;
+
+  std::vector<std::vector<Precision>> send_buffers_;
+  std::vector<std::vector<Precision>> receive_buffers_;
+};
+
+}  // namespace vulkan_fem
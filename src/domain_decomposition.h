@@ -0,0 +1,145 @@
+#pragma once
+
+#include "model.h"
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <set>
+#include <stdexcept>
+#include <vector>
+
+namespace vulkan_fem {
+
+// The part of a model one rank works on. The rank owns a set of nodes and assembles their rows of K,
+// which takes every element touching an owned node, the ghost layer of elements shared with other ranks.
+// Nodes of those elements owned elsewhere are ghosts, their values come from the owner before every SpMV.
+struct Subdomain {
+  uint32_t rank_ = 0;
+  uint32_t owned_count_ = 0;            // local nodes [0, owned_count_) are owned, the rest are ghosts
+  std::vector<uint32_t> global_nodes_;  // local -> global node, ascending within owned and within ghosts
+  std::vector<uint32_t> elements_;      // elements touching an owned node, ghost layer included
+
+  // one entry per neighbour rank, the lists are in global node order on both sides
+  std::vector<uint32_t> neighbours_;
+  std::vector<std::vector<uint32_t>> send_nodes_;     // local owned nodes the neighbour keeps as ghosts
+  std::vector<std::vector<uint32_t>> receive_nodes_;  // local ghosts the neighbour owns
+
+  [[nodiscard]] uint32_t GetLocalCount() const { return static_cast<uint32_t>(global_nodes_.size()); }
+};
+
+// owner rank of every node by recursive coordinate bisection. Each cut goes across the longest extent of the
+// node set, splitting it in proportion to the ranks on either side, so any rank count gets balanced parts.
+inline std::vector<uint32_t> PartitionNodes(const std::vector<Vertex3> &vertices, uint32_t parts) {
+  std::vector<uint32_t> owners(vertices.size(), 0);
+  std::vector<uint32_t> nodes(vertices.size());
+  std::iota(nodes.begin(), nodes.end(), 0);
+
+  const auto bisect = [&](auto &self, std::vector<uint32_t>::iterator begin, std::vector<uint32_t>::iterator end, uint32_t first_part,
+                          uint32_t part_count) -> void {
+    if (part_count == 1) {
+      for (auto it = begin; it != end; ++it) {
+        owners[*it] = first_part;
+      }
+      return;
+    }
+
+    Vertex3 low = Vertex3::Constant(std::numeric_limits<Precision>::max());
+    Vertex3 high = Vertex3::Constant(std::numeric_limits<Precision>::lowest());
+    for (auto it = begin; it != end; ++it) {
+      low = low.cwiseMin(vertices[*it]);
+      high = high.cwiseMax(vertices[*it]);
+    }
+    Eigen::Index axis = 0;
+    (high - low).maxCoeff(&axis);
+
+    // ties broken by index, the cut does not depend on the sort implementation
+    const uint32_t left_parts = part_count / 2;
+    const auto middle = begin + (end - begin) * left_parts / part_count;
+    std::nth_element(begin, middle, end, [&](uint32_t a, uint32_t b) {
+      return vertices[a][axis] < vertices[b][axis] || (vertices[a][axis] == vertices[b][axis] && a < b);
+    });
+    self(self, begin, middle, first_part, left_parts);
+    self(self, middle, end, first_part + left_parts, part_count - left_parts);
+  };
+  bisect(bisect, nodes.begin(), nodes.end(), 0, std::max(parts, 1U));
+
+  return owners;
+}
+
+// Subdomain of rank out of parts. Every rank partitions the whole model the same way and keeps its own part.
+template <uint32_t DIM>
+Subdomain DecomposeModel(const Model<DIM> &model, uint32_t parts, uint32_t rank) {
+  if (rank >= parts) {
+    throw std::runtime_error("rank out of range");
+  }
+
+  const auto &indices = model.GetIndices();
+  const uint32_t element_nodes = model.GetElementType()->GetElementCount();
+  const auto element_count = static_cast<uint32_t>(indices.size() / element_nodes);
+  const std::vector<uint32_t> owners = PartitionNodes(model.GetVertices(), parts);
+
+  Subdomain subdomain;
+  subdomain.rank_ = rank;
+
+  std::set<uint32_t> ghosts;
+  std::vector<std::set<uint32_t>> sent(parts);  // per rank, owned nodes it keeps as ghosts
+  for (uint32_t element = 0; element < element_count; ++element) {
+    const uint16_t *nodes = indices.data() + element * element_nodes;
+    if (std::none_of(nodes, nodes + element_nodes, [&](uint16_t node) { return owners[node] == rank; })) {
+      continue;
+    }
+
+    subdomain.elements_.push_back(element);
+    for (uint32_t a = 0; a < element_nodes; ++a) {
+      const uint32_t owner = owners[nodes[a]];
+      if (owner != rank) {
+        ghosts.insert(nodes[a]);
+        // the element is in the other rank's ghost layer too, with the nodes owned here as its ghosts
+        for (uint32_t b = 0; b < element_nodes; ++b) {
+          if (owners[nodes[b]] == rank) {
+            sent[owner].insert(nodes[b]);
+          }
+        }
+      }
+    }
+  }
+
+  for (uint32_t node = 0; node < owners.size(); ++node) {
+    if (owners[node] == rank) {
+      subdomain.global_nodes_.push_back(node);
+    }
+  }
+  subdomain.owned_count_ = static_cast<uint32_t>(subdomain.global_nodes_.size());
+  subdomain.global_nodes_.insert(subdomain.global_nodes_.end(), ghosts.begin(), ghosts.end());
+
+  const auto to_local = [&](uint32_t node) {
+    const auto begin = subdomain.global_nodes_.begin();
+    const auto owned_end = begin + subdomain.owned_count_;
+    const auto range_begin = owners[node] == rank ? begin : owned_end;
+    const auto range_end = owners[node] == rank ? owned_end : subdomain.global_nodes_.end();
+    return static_cast<uint32_t>(std::lower_bound(range_begin, range_end, node) - begin);
+  };
+
+  // ghosts and sent nodes are ordered sets, so both sides of every pair list the nodes in the same order
+  for (uint32_t neighbour = 0; neighbour < parts; ++neighbour) {
+    if (neighbour == rank || sent[neighbour].empty()) {
+      continue;
+    }
+    subdomain.neighbours_.push_back(neighbour);
+    auto &send_nodes = subdomain.send_nodes_.emplace_back();
+    for (const uint32_t node : sent[neighbour]) {
+      send_nodes.push_back(to_local(node));
+    }
+    auto &receive_nodes = subdomain.receive_nodes_.emplace_back();
+    for (const uint32_t node : ghosts) {
+      if (owners[node] == neighbour) {
+        receive_nodes.push_back(to_local(node));
+      }
+    }
+  }
+
+  return subdomain;
+}
+
+}  // namespace vulkan_fem
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "fem.h"
+#include "memory_tracker.h"
+#include <Eigen/Dense>
+#include <cstdint>
+#include <vector>
+
+namespace vulkan_fem {
+
+// Shape function gradients of every element at its integration points, stored flat so element loops
+// stream through them. Point p of element e is at index e * point_count_ + p.
+template <uint32_t DIM>
+struct ElementGradients {
+  uint32_t node_count_ = 0;      // nodes per element
+  uint32_t point_count_ = 0;     // integration points per element
+  uint64_t revision_ = 0;        // model revision of the geometry
+  std::vector<Precision> gradients_;  // dN/dx, DIM x node_count_ column major per point
+  std::vector<Precision> scales_;     // w * det J per point
+  TrackedBytes bytes_;                // capacity of both, for the MemoryTracker
+
+  [[nodiscard]] size_t GetElementCount() const { return point_count_ == 0 ? 0 : scales_.size() / point_count_; }
+
+  [[nodiscard]] Eigen::Map<const MatrixFixedRows<DIM>> GetGradient(size_t point) const {
+    return {gradients_.data() + point * DIM * node_count_, DIM, node_count_};
+  }
+
+  [[nodiscard]] Eigen::Map<MatrixFixedRows<DIM>> GetGradient(size_t point) {
+    return {gradients_.data() + point * DIM * node_count_, DIM, node_count_};
+  }
+
+  [[nodiscard]] Precision GetScale(size_t point) const { return scales_[point]; }
+
+  // sizes the storage for all elements up front, points are then written in place through GetGradient and scales_
+  void Resize(size_t element_count, uint32_t node_count, uint32_t point_count) {
+    node_count_ = node_count;
+    point_count_ = point_count;
+    gradients_.resize(element_count * point_count * DIM * node_count);
+    scales_.resize(element_count * point_count);
+    bytes_.Set((gradients_.capacity() + scales_.capacity()) * sizeof(Precision));
+  }
+};
+
+}  // namespace vulkan_fem
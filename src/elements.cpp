@@ -1,34 +1,50 @@
 #include "elements.h"
+#include "enumerate.h"
 
 namespace vulkan_fem {
 
-template<uint32_t DIM>
-Eigen::Matrix<Precision, 3, Eigen::Dynamic> Element<DIM>::MakeStrainMatrix(const uint16_t element_count,
-                                                                      const MatrixFixedRows<DIM> &elem_matrix) const {
-  Eigen::Matrix<Precision, 3, Eigen::Dynamic> strain_matrix(3, element_count * DIM);
+template <uint32_t DIM>
+MatrixStrainDisplacement<DIM> Element<DIM>::MakeStrainMatrix(const uint16_t element_count, const MatrixFixedRows<DIM> &elem_matrix) const {
+  MatrixStrainDisplacement<DIM> strain_matrix = MatrixStrainDisplacement<DIM>::Zero(kStrainSize<DIM>, element_count * DIM);
 
   for (int i = 0; i < element_count; ++i) {
-    strain_matrix(0, 2 * i + 0) = elem_matrix(0, i);  // Nix
-    strain_matrix(0, 2 * i + 1) = 0.0F;
-
-    strain_matrix(1, 2 * i + 0) = 0.0F;
-    strain_matrix(1, 2 * i + 1) = elem_matrix(1, i);  // Niy
-
-    strain_matrix(2, 2 * i + 0) = elem_matrix(1, i);  // Niy
-    strain_matrix(2, 2 * i + 1) = elem_matrix(0, i);  // Nix
+    if constexpr (DIM == 2) {
+      strain_matrix(0, 2 * i + 0) = elem_matrix(0, i);  // Nix
+      strain_matrix(1, 2 * i + 1) = elem_matrix(1, i);  // Niy
+
+      strain_matrix(2, 2 * i + 0) = elem_matrix(1, i);  // Niy
+      strain_matrix(2, 2 * i + 1) = elem_matrix(0, i);  // Nix
+    } else {
+      strain_matrix(0, 3 * i + 0) = elem_matrix(0, i);  // Nix
+      strain_matrix(1, 3 * i + 1) = elem_matrix(1, i);  // Niy
+      strain_matrix(2, 3 * i + 2) = elem_matrix(2, i);  // Niz
+
+      strain_matrix(3, 3 * i + 0) = elem_matrix(1, i);  // Niy
+      strain_matrix(3, 3 * i + 1) = elem_matrix(0, i);  // Nix
+
+      strain_matrix(4, 3 * i + 1) = elem_matrix(2, i);  // Niz
+      strain_matrix(4, 3 * i + 2) = elem_matrix(1, i);  // Niy
+
+      strain_matrix(5, 3 * i + 0) = elem_matrix(2, i);  // Niz
+      strain_matrix(5, 3 * i + 2) = elem_matrix(0, i);  // Nix
+    }
   }
 
   return strain_matrix;
 }
 
+template class Element<2>;
+template class Element<3>;
+
 TetrahedronElement::TetrahedronElement() : Element<3>(4, 1) {}
 
 std::vector<std::vector<Precision>> TetrahedronElement::GetIntegrationPoints() const {
-  static const std::vector<std::vector<Precision>> kIntegrationPoints{{0.25, 0.25, 0.25}};  // TODO(dmitrygladky): add correct IP
+  static const std::vector<std::vector<Precision>> kIntegrationPoints{{0.25, 0.25, 0.25}};
   return kIntegrationPoints;
 };
 
-Precision TetrahedronElement::GetIntegrationWeight(uint8_t /*p*/) const { return 1.; }
+// volume of the reference tetrahedron
+Precision TetrahedronElement::GetIntegrationWeight(uint8_t /*p*/) const { return 1. / 6.; }
 
 std::vector<Precision> TetrahedronElement::CalcShape(const std::vector<Precision> &ip) const {
   const Precision xi = ip[0];
@@ -65,6 +81,104 @@ MatrixFixedRows<3, Precision> TetrahedronElement::CalcDShape(const std::vector<P
   return dshape;
 }
 
+template <uint32_t ORDER>
+std::vector<std::vector<Precision>> LagrangeHexahedronElement<ORDER>::GetIntegrationPoints() const {
+  return Quadrature::GetPoints();
+}
+
+template <uint32_t ORDER>
+Precision LagrangeHexahedronElement<ORDER>::GetIntegrationWeight(uint8_t p) const {
+  return Quadrature::GetWeight(p);
+}
+
+template <>
+const std::array<std::array<uint8_t, 3>, 8> &LagrangeHexahedronElement<1>::GetNodeLattice() {
+  static const std::array<std::array<uint8_t, 3>, 8> kLattice{{
+      {0, 0, 0}, {1, 0, 0}, {1, 1, 0}, {0, 1, 0},  // bottom corners
+      {0, 0, 1}, {1, 0, 1}, {1, 1, 1}, {0, 1, 1},  // top corners
+  }};
+  return kLattice;
+}
+
+template <>
+const std::array<std::array<uint8_t, 3>, 27> &LagrangeHexahedronElement<2>::GetNodeLattice() {
+  static const std::array<std::array<uint8_t, 3>, 27> kLattice{{
+      {0, 0, 0}, {2, 0, 0}, {2, 2, 0}, {0, 2, 0},  // bottom corners
+      {0, 0, 2}, {2, 0, 2}, {2, 2, 2}, {0, 2, 2},  // top corners
+      {1, 0, 0}, {2, 1, 0}, {1, 2, 0}, {0, 1, 0},  // bottom edges
+      {1, 0, 2}, {2, 1, 2}, {1, 2, 2}, {0, 1, 2},  // top edges
+      {0, 0, 1}, {2, 0, 1}, {2, 2, 1}, {0, 2, 1},  // vertical edges
+      {0, 1, 1}, {2, 1, 1}, {1, 0, 1},             // faces -xi, +xi, -eta
+      {1, 2, 1}, {1, 1, 0}, {1, 1, 2},             // faces +eta, -zeta, +zeta
+      {1, 1, 1},                                   // centre
+  }};
+  return kLattice;
+}
+
+template <uint32_t ORDER>
+Precision LagrangeHexahedronElement<ORDER>::CalcShape1D(uint32_t i, Precision x) {
+  const auto node = [](uint32_t n) { return static_cast<Precision>(-1. + 2. * n / ORDER); };
+
+  Precision value = 1.;
+  for (uint32_t m = 0; m < kNodes1D; ++m) {
+    if (m != i) {
+      value *= (x - node(m)) / (node(i) - node(m));
+    }
+  }
+  return value;
+}
+
+template <uint32_t ORDER>
+Precision LagrangeHexahedronElement<ORDER>::CalcDShape1D(uint32_t i, Precision x) {
+  const auto node = [](uint32_t n) { return static_cast<Precision>(-1. + 2. * n / ORDER); };
+
+  // product rule over all factors of the Lagrange polynomial
+  Precision value = 0.;
+  for (uint32_t k = 0; k < kNodes1D; ++k) {
+    if (k == i) {
+      continue;
+    }
+
+    Precision term = 1. / (node(i) - node(k));
+    for (uint32_t m = 0; m < kNodes1D; ++m) {
+      if (m != i && m != k) {
+        term *= (x - node(m)) / (node(i) - node(m));
+      }
+    }
+    value += term;
+  }
+  return value;
+}
+
+template <uint32_t ORDER>
+std::vector<Precision> LagrangeHexahedronElement<ORDER>::CalcShape(const std::vector<Precision> &ip) const {
+  std::vector<Precision> shape(kNodeCount);
+  for (const auto &[a, node] : Enumerate(GetNodeLattice())) {
+    shape[a] = CalcShape1D(node[0], ip[0]) * CalcShape1D(node[1], ip[1]) * CalcShape1D(node[2], ip[2]);
+  }
+  return shape;
+}
+
+template <uint32_t ORDER>
+MatrixFixedRows<3, Precision> LagrangeHexahedronElement<ORDER>::CalcDShape(const std::vector<Precision> &ip) {
+  MatrixFixedRows<3, Precision> dshape(3, kNodeCount);
+
+  for (const auto &[a, node] : Enumerate(GetNodeLattice())) {
+    const Precision n_xi = CalcShape1D(node[0], ip[0]);
+    const Precision n_eta = CalcShape1D(node[1], ip[1]);
+    const Precision n_zeta = CalcShape1D(node[2], ip[2]);
+
+    dshape(0, a) = CalcDShape1D(node[0], ip[0]) * n_eta * n_zeta;  // dN(i) / dXi
+    dshape(1, a) = n_xi * CalcDShape1D(node[1], ip[1]) * n_zeta;   // dN(i) / dEta
+    dshape(2, a) = n_xi * n_eta * CalcDShape1D(node[2], ip[2]);    // dN(i) / dZeta
+  }
+
+  return dshape;
+}
+
+template class LagrangeHexahedronElement<1>;
+template class LagrangeHexahedronElement<2>;
+
 TriangleElement::TriangleElement() : Element<2>(3, 1) {}
 
 std::vector<std::vector<Precision>> TriangleElement::GetIntegrationPoints() const {
@@ -1,7 +1,9 @@
 #pragma once
 
 #include "fem.h"
+#include "quadrature.h"
 #include <Eigen/Dense>
+#include <array>
 #include <vector>
 
 namespace vulkan_fem {
@@ -27,11 +29,15 @@ class Element {
   [[nodiscard]] virtual MatrixFixedRows<DIM, Precision> CalcDShape(const std::vector<Precision> &ip) = 0;
 
   // B matrix
-  // [ Nix 0
-  // [ 0   Niy
-  // [ Niy Nix
-  [[nodiscard]] virtual Eigen::Matrix<Precision, 3, Eigen::Dynamic> MakeStrainMatrix(const uint16_t element_count,
-                                                                                     const MatrixFixedRows<DIM> &elem_matrix) const;
+  // 2D:            3D:
+  // [ Nix 0        [ Nix 0   0
+  // [ 0   Niy      [ 0   Niy 0
+  // [ Niy Nix      [ 0   0   Niz
+  //                [ Niy Nix 0
+  //                [ 0   Niz Niy
+  //                [ Niz 0   Nix
+  [[nodiscard]] virtual MatrixStrainDisplacement<DIM> MakeStrainMatrix(const uint16_t element_count,
+                                                                       const MatrixFixedRows<DIM> &elem_matrix) const;
 
  protected:
   Element(uint32_t element_count, uint32_t order) : element_count_(element_count), order_(order) {}
@@ -57,6 +63,50 @@ class TetrahedronElement : public Element<3> {
   [[nodiscard]] MatrixFixedRows<3, Precision> CalcDShape(const std::vector<Precision> & /*ip*/) override;
 };
 
+// Lagrange hexahedron built as a tensor product of 1D Lagrange polynomials.
+// Nodes follow the VTK numbering: corners, edge midpoints, face centres, centre.
+template <uint32_t ORDER>
+class LagrangeHexahedronElement : public Element<3> {
+ public:
+  static constexpr uint32_t kNodes1D = ORDER + 1;
+  static constexpr uint32_t kNodeCount = kNodes1D * kNodes1D * kNodes1D;
+
+  // full Gauss rule, exact for the stiffness of an undistorted element
+  using Quadrature = TensorGauss<3, ORDER + 1>;
+
+  [[nodiscard]] std::vector<std::vector<Precision>> GetIntegrationPoints() const override;
+  [[nodiscard]] Precision GetIntegrationWeight(uint8_t p) const override;
+  [[nodiscard]] std::vector<Precision> CalcShape(const std::vector<Precision> &ip) const override;
+  [[nodiscard]] MatrixFixedRows<3, Precision> CalcDShape(const std::vector<Precision> &ip) override;
+
+  // position of every node on the 1D lattice along xi, eta, zeta
+  static const std::array<std::array<uint8_t, 3>, kNodeCount> &GetNodeLattice();
+
+  // 1D Lagrange polynomial i and its derivative on equally spaced nodes in [-1, 1]
+  static Precision CalcShape1D(uint32_t i, Precision x);
+  static Precision CalcDShape1D(uint32_t i, Precision x);
+
+ protected:
+  LagrangeHexahedronElement() : Element<3>(kNodeCount, ORDER) {}
+};
+
+template <>
+const std::array<std::array<uint8_t, 3>, 8> &LagrangeHexahedronElement<1>::GetNodeLattice();
+template <>
+const std::array<std::array<uint8_t, 3>, 27> &LagrangeHexahedronElement<2>::GetNodeLattice();
+
+// 8 node trilinear hexahedron
+class HexahedronElement : public LagrangeHexahedronElement<1> {
+ public:
+  HexahedronElement() = default;
+};
+
+// 27 node triquadratic hexahedron
+class Hexahedron2Element : public LagrangeHexahedronElement<2> {
+ public:
+  Hexahedron2Element() = default;
+};
+
 class TriangleElement : public Element<2> {
  public:
   TriangleElement();
@@ -0,0 +1,240 @@
+#pragma once
+
+#include "fem.h"
+#include "frame_stream.h"
+#include "model.h"
+#include "strain_displacement.h"
+#include "thread_pool.h"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace vulkan_fem {
+
+struct ExplicitOptions {
+  Precision end_time_ = 1.;
+  // 0 - stable step from the element stiffness and mass
+  Precision time_step_ = 0.;
+  // fraction of the critical step used when time_step_ is 0
+  Precision safety_factor_ = 0.9;
+  // mass proportional damping, C = damping_ * M
+  Precision damping_ = 0.;
+  // a frame is streamed every output_interval_ steps, 0 streams only the final state
+  uint32_t output_interval_ = 100;
+  // frames waiting for the output callback, further frames are dropped instead of stalling the integration
+  uint32_t max_pending_frames_ = 8;
+  // 0 - one thread per hardware core
+  uint32_t thread_count_ = 0;
+  // loads are scaled by load_curve_(t), a step load when empty
+  std::function<Precision(Precision)> load_curve_;
+};
+
+struct ExplicitResult {
+  uint32_t steps_ = 0;
+  Precision time_ = 0.;
+  Precision time_step_ = 0.;
+  uint32_t frames_ = 0;
+  uint32_t dropped_frames_ = 0;
+};
+
+// Central difference time integration of M * a + C * v + K * u = f(t) with a lumped M.
+// The internal force K * u is evaluated element by element from cached shape function gradients,
+// so no global matrix is assembled; elements are split between threads with per-thread force buffers.
+template <uint32_t DIM = 3>
+class ExplicitDynamics {
+ public:
+  explicit ExplicitDynamics(Model<DIM> &model, ExplicitOptions options = {})
+      : options_(std::move(options)),
+        node_count_(model.GetElementType()->GetElementCount()),
+        indices_(model.GetIndices()),
+        gradients_(model.GetElementGradients()),
+        loads_(model.GetLoads()) {
+    LinearMaterial<DIM> material = model.GetMaterial();
+    d_matrix_ = material.GetStiffnessMatrix();
+
+    // constrained dofs get an infinite mass, their acceleration stays zero
+    inverse_mass_ = model.BuildLumpedMassVector().cwiseInverse();
+    for (const auto dof : model.GetConstrainedDofs()) {
+      inverse_mass_[dof] = 0.;
+      loads_[dof] = 0.;
+    }
+
+    // sum_j |K_ij| from the element matrices, bounds the largest eigenvalue of M^-1 * K (Gershgorin)
+    VectorX stiffness_row_sums = VectorX::Zero(inverse_mass_.size());
+    MatrixElementStiffness<DIM> element_stiffness_matrix;
+
+    for (size_t element = 0; element < gradients_->GetElementCount(); ++element) {
+      element_stiffness_matrix.setZero(DIM * node_count_, DIM * node_count_);
+      for (uint32_t p = 0; p < gradients_->point_count_; ++p) {
+        const size_t point = element * gradients_->point_count_ + p;
+        AddStrainStiffness<DIM>(gradients_->GetGradient(point), d_matrix_, gradients_->GetScale(point), element_stiffness_matrix);
+      }
+
+      const VectorElement<DIM> row_sums = element_stiffness_matrix.cwiseAbs().rowwise().sum();
+      for (uint32_t a = 0; a < node_count_; ++a) {
+        stiffness_row_sums.template segment<DIM>(DIM * indices_[element * node_count_ + a]) += row_sums.template segment<DIM>(DIM * a);
+      }
+    }
+
+    // dt_crit = 2 / omega_max
+    const Precision max_eigenvalue = inverse_mass_.cwiseProduct(stiffness_row_sums).maxCoeff();
+    if (max_eigenvalue <= 0) {
+      throw std::runtime_error("model has no free dofs, no stable time step");
+    }
+    stable_time_step_ = 2 / std::sqrt(max_eigenvalue);
+    time_step_ = options_.time_step_ > 0 ? options_.time_step_ : options_.safety_factor_ * stable_time_step_;
+
+    displacements_.setZero(inverse_mass_.size());
+    velocities_.setZero(inverse_mass_.size());
+  }
+
+  // lower bound of the critical central difference step, 2 / omega_max with omega_max bounded from above
+  [[nodiscard]] Precision GetStableTimeStep() const { return stable_time_step_; }
+  [[nodiscard]] Precision GetTimeStep() const { return time_step_; }
+
+  [[nodiscard]] const VectorX &GetDisplacements() const { return displacements_; }
+  [[nodiscard]] const VectorX &GetVelocities() const { return velocities_; }
+
+  // called on a background thread with every streamed frame
+  void SetOutputCallback(FrameStream::Callback callback) { callback_ = std::move(callback); }
+
+  ExplicitResult Run() {
+    ThreadPool pool(options_.thread_count_);
+    thread_forces_.assign(pool.GetThreadCount(), VectorX::Zero(inverse_mass_.size()));
+
+    FrameStream stream(callback_, std::max(options_.max_pending_frames_, 1U));
+
+    ExplicitResult result;
+    result.time_step_ = time_step_;
+    const Precision dt = time_step_;
+    const auto steps = static_cast<uint32_t>(std::ceil(options_.end_time_ / dt));
+
+    spdlog::info("explicit dynamics: {} steps of {} s, {} threads", steps, dt, pool.GetThreadCount());
+
+    const auto stream_frame = [&](uint32_t step, const VectorX &velocities) {
+      if (stream.Push({step, step * dt, displacements_, velocities})) {
+        ++result.frames_;
+      } else {
+        ++result.dropped_frames_;
+      }
+    };
+
+    VectorX internal_forces;
+    VectorX accelerations;
+
+    // a_0 from the initial state, then v_1/2 = v_0 + dt / 2 * a_0
+    CalcAccelerations(pool, 0., internal_forces, accelerations);
+    velocities_ += dt / 2 * accelerations;
+
+    for (uint32_t step = 1; step <= steps; ++step) {
+      // u_n+1 = u_n + dt * v_n+1/2
+      displacements_ += dt * velocities_;
+
+      // v_n+3/2 = v_n+1/2 + dt * a_n+1
+      CalcAccelerations(pool, step * dt, internal_forces, accelerations);
+
+      const bool last = step == steps;
+      if (last || (options_.output_interval_ != 0 && step % options_.output_interval_ == 0)) {
+        // the synchronous velocity v_n+1 = v_n+1/2 + dt / 2 * a_n+1
+        const VectorX velocities = velocities_ + dt / 2 * accelerations;
+        stream_frame(step, velocities);
+        if (last) {
+          velocities_ = velocities;
+          break;
+        }
+      }
+
+      velocities_ += dt * accelerations;
+    }
+
+    stream.Close();
+
+    result.steps_ = steps;
+    result.time_ = steps * dt;
+    if (result.dropped_frames_ != 0) {
+      spdlog::warn("explicit dynamics: {} frames dropped, the output callback is slower than the integration", result.dropped_frames_);
+    }
+    return result;
+  }
+
+ private:
+  // a = M^-1 * (f(t) - K * u) - damping * v, with v lagging half a step
+  void CalcAccelerations(ThreadPool &pool, Precision time, VectorX &internal_forces, VectorX &accelerations) {
+    CalcInternalForces(pool, internal_forces);
+
+    const Precision load_scale = options_.load_curve_ ? options_.load_curve_(time) : 1.;
+    accelerations = inverse_mass_.cwiseProduct(load_scale * loads_ - internal_forces);
+    if (options_.damping_ != 0) {
+      accelerations -= options_.damping_ * velocities_;
+    }
+  }
+
+  // f_int = sum over elements of B^T * D * B * u_e, integrated with the cached gradients
+  void CalcInternalForces(ThreadPool &pool, VectorX &internal_forces) {
+    const auto element_total = static_cast<uint32_t>(indices_.size() / node_count_);
+
+    pool.ParallelFor(element_total, [&](size_t begin, size_t end, uint32_t thread) {
+      VectorX &forces = thread_forces_[thread];
+      forces.setZero();
+
+      VectorX element_displacements(DIM * node_count_);
+      VectorX element_forces(DIM * node_count_);
+      for (size_t element = begin; element < end; ++element) {
+        const uint16_t *nodes = indices_.data() + element * node_count_;
+        for (uint32_t a = 0; a < node_count_; ++a) {
+          element_displacements.template segment<DIM>(DIM * a) = displacements_.template segment<DIM>(DIM * nodes[a]);
+        }
+
+        element_forces.setZero();
+        for (uint32_t p = 0; p < gradients_->point_count_; ++p) {
+          const size_t point = element * gradients_->point_count_ + p;
+          const auto dshape = gradients_->GetGradient(point);
+
+          const Eigen::Matrix<Precision, kStrainSize<DIM>, 1> stress =
+              d_matrix_ * MultiplyStrain<DIM>(dshape, element_displacements) * gradients_->GetScale(point);
+          AddStrainTransposed<DIM>(dshape, stress, element_forces);
+        }
+
+        for (uint32_t a = 0; a < node_count_; ++a) {
+          forces.template segment<DIM>(DIM * nodes[a]) += element_forces.template segment<DIM>(DIM * a);
+        }
+      }
+    });
+
+    // reduce the per-thread buffers, again split between threads by dof ranges
+    internal_forces.resize(inverse_mass_.size());
+    pool.ParallelFor(internal_forces.size(), [&](size_t begin, size_t end, uint32_t /*thread*/) {
+      const auto size = static_cast<Eigen::Index>(end - begin);
+      auto segment = internal_forces.segment(begin, size);
+      segment = thread_forces_.front().segment(begin, size);
+      for (size_t t = 1; t < thread_forces_.size(); ++t) {
+        segment += thread_forces_[t].segment(begin, size);
+      }
+    });
+  }
+
+  ExplicitOptions options_;
+  FrameStream::Callback callback_;
+
+  const uint32_t node_count_;
+  const std::vector<uint16_t> indices_;
+  std::shared_ptr<const ElementGradients<DIM>> gradients_;
+  MatrixConstitutive<DIM> d_matrix_;
+
+  VectorX inverse_mass_;
+  VectorX loads_;
+
+  Precision stable_time_step_ = 0.;
+  Precision time_step_ = 0.;
+
+  VectorX displacements_;
+  VectorX velocities_;  // v_n+1/2 while running, v_n after Run
+  std::vector<VectorX> thread_forces_;
+};
+
+}  // namespace vulkan_fem
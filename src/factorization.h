@@ -0,0 +1,73 @@
+#pragma once
+
+#include "archive.h"
+#include <Eigen/SparseCholesky>
+#include <stdexcept>
+#include <string>
+
+namespace vulkan_fem {
+
+// SimplicialLDLT that can be archived and restored without factorizing again. The factor, its diagonal, the fill
+// reducing permutation and the elimination tree are all a back substitution needs; restoring them takes a copy
+// instead of the ordering and numeric factorization. Relies on the members of Eigen's SimplicialCholeskyBase.
+template <typename MatrixType, int UpLo = Eigen::Lower>
+class RestorableLDLT : public Eigen::SimplicialLDLT<MatrixType, UpLo> {
+  using Base = Eigen::SimplicialLDLT<MatrixType, UpLo>;
+
+ public:
+  using Scalar = typename Base::Scalar;
+  using StorageIndex = typename Base::StorageIndex;
+
+  RestorableLDLT() = default;
+  explicit RestorableLDLT(const MatrixType &matrix) : Base(matrix) {}
+
+  void Save(Archive &archive, const std::string &name) const {
+    if (this->info() != Eigen::Success) {
+      throw std::runtime_error("only a successful factorization can be archived");
+    }
+    archive.PutSparse(name + ".factor", this->m_matrix);
+    archive.PutArray(name + ".diagonal", this->m_diag.data(), static_cast<size_t>(this->m_diag.size()));
+    archive.PutArray(name + ".permutation", this->m_P.indices().data(), static_cast<size_t>(this->m_P.size()));
+    archive.PutArray(name + ".parent", this->m_parent.data(), static_cast<size_t>(this->m_parent.size()));
+    archive.PutArray(name + ".column_counts", this->m_nonZerosPerCol.data(), static_cast<size_t>(this->m_nonZerosPerCol.size()));
+  }
+
+  void Restore(const Archive &archive, const std::string &name) {
+    this->m_matrix = archive.GetSparse<typename Base::CholMatrixType>(name + ".factor");
+    const auto size = this->m_matrix.rows();
+
+    const auto diagonal = archive.GetArray<Scalar>(name + ".diagonal");
+    const auto permutation = archive.GetArray<StorageIndex>(name + ".permutation");
+    const auto parent = archive.GetArray<StorageIndex>(name + ".parent");
+    const auto column_counts = archive.GetArray<StorageIndex>(name + ".column_counts");
+    const auto matches = [size](const auto &values) { return static_cast<Eigen::Index>(values.size()) == size; };
+    // the natural ordering leaves the permutation empty
+    if (this->m_matrix.cols() != size || !matches(diagonal) || (!permutation.empty() && !matches(permutation)) || !matches(parent) ||
+        !matches(column_counts)) {
+      throw std::runtime_error("archived factorization " + name + " is inconsistent");
+    }
+
+    this->m_diag = Eigen::Map<const Values>(diagonal.data(), size);
+    this->m_parent = Eigen::Map<const Indices>(parent.data(), size);
+    this->m_nonZerosPerCol = Eigen::Map<const Indices>(column_counts.data(), size);
+    if (permutation.empty()) {
+      this->m_P.resize(0);
+      this->m_Pinv.resize(0);
+    } else {
+      this->m_P.indices() = Eigen::Map<const Indices>(permutation.data(), size);
+      this->m_Pinv = this->m_P.inverse();
+    }
+
+    this->m_info = Eigen::Success;
+    this->m_analysisIsOk = true;
+    this->m_factorizationIsOk = true;
+    // SimplicialCholeskyBase makes m_isInitialized private, it is still protected in SparseSolverBase
+    this->Eigen::SparseSolverBase<Base>::m_isInitialized = true;
+  }
+
+ private:
+  using Values = Eigen::Matrix<Scalar, Eigen::Dynamic, 1>;
+  using Indices = Eigen::Matrix<StorageIndex, Eigen::Dynamic, 1>;
+};
+
+}  // namespace vulkan_fem
@@ -8,6 +8,8 @@
 namespace vulkan_fem {
 using Precision = float;
 
+using VectorX = Eigen::Matrix<Precision, Eigen::Dynamic, 1>;
+
 template <size_t DIM = 3, typename Scalar = Precision>
 using MatrixFixedRows = Eigen::Matrix<Scalar, DIM, Eigen::Dynamic>;
 
@@ -20,5 +22,48 @@ using MatrixDim = Eigen::Matrix<Scalar, DIM, DIM>;
 template <size_t DIM = 3, typename Scalar = Precision>
 using MatrixStrain = Eigen::Matrix<Scalar, DIM, DIM>;
 
+// number of independent strain components in Voigt notation
+// 2D: [exx, eyy, gxy], 3D: [exx, eyy, ezz, gxy, gyz, gzx]
+template <size_t DIM>
+constexpr int kStrainSize = DIM == 2 ? 3 : 6;
+
+template <size_t DIM = 3, typename Scalar = Precision>
+using MatrixStrainDisplacement = Eigen::Matrix<Scalar, kStrainSize<DIM>, Eigen::Dynamic>;
+
+template <size_t DIM = 3, typename Scalar = Precision>
+using VoigtVector = Eigen::Matrix<Scalar, kStrainSize<DIM>, 1>;
+
+template <size_t DIM = 3, typename Scalar = Precision>
+using MatrixConstitutive = Eigen::Matrix<Scalar, kStrainSize<DIM>, kStrainSize<DIM>>;
+
+// nodes of the largest element, the 27 node hexahedron. Element level temporaries are bounded by it,
+// so they live on the stack instead of being allocated for every element.
+constexpr int kMaxElementNodes = 27;
+
+// node coordinates of one element, one row per node
+template <size_t DIM = 3, typename Scalar = Precision>
+using MatrixElementNodes = Eigen::Matrix<Scalar, Eigen::Dynamic, DIM, Eigen::ColMajor, kMaxElementNodes, DIM>;
+
+// shape function derivatives of one element at one point, one column per node
+template <size_t DIM = 3, typename Scalar = Precision>
+using MatrixElementGradient = Eigen::Matrix<Scalar, DIM, Eigen::Dynamic, Eigen::ColMajor, DIM, kMaxElementNodes>;
+
+// element stiffness, DIM dofs per node
+template <size_t DIM = 3, typename Scalar = Precision>
+using MatrixElementStiffness =
+    Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic, Eigen::ColMajor, DIM * kMaxElementNodes, DIM * kMaxElementNodes>;
+
+// scalar element matrix, one row per node
+template <typename Scalar = Precision>
+using MatrixElementScalar = Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic, Eigen::ColMajor, kMaxElementNodes, kMaxElementNodes>;
+
+// B matrix of one element
+template <size_t DIM = 3, typename Scalar = Precision>
+using MatrixElementStrain = Eigen::Matrix<Scalar, kStrainSize<DIM>, Eigen::Dynamic, Eigen::ColMajor, kStrainSize<DIM>, DIM * kMaxElementNodes>;
+
+// element dof vector
+template <size_t DIM = 3, typename Scalar = Precision>
+using VectorElement = Eigen::Matrix<Scalar, Eigen::Dynamic, 1, Eigen::ColMajor, DIM * kMaxElementNodes, 1>;
+
 }  // namespace vulkan_fem
 
@@ -1,9 +1,29 @@
 #include "fem_application.h"
+#include "profiler.h"
+#include "vulkan_compute.h"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <utility>
+
+constexpr float kPanStep = 0.1F;  // clip space per key press
+constexpr float kZoomStep = 1.25F;
+// maxDrawIndirectCount guaranteed with multiDrawIndirect
+constexpr uint32_t kMaxDrawIndirectCount = 65535;
 
 void FEMApplication::PreInit() {
-  solver_ = std::make_shared<vulkan_fem::Solver<2>>();
+  solver_ = std::make_shared<vulkan_fem::Solver<2>>(GetSolverOptions());
+  async_solver_ = std::make_unique<vulkan_fem::AsyncSolver<2>>(solver_);
   model_ = vulkan_fem::ModelFactory::CreateRectangle2();
-  render_model_ = std::make_shared<vulkan_fem::VulkanModel<2>>(model_);
+  render_model_.SetModel(model_);
+}
+
+vulkan_fem::SolverOptions FEMApplication::GetSolverOptions() const {
+  vulkan_fem::SolverOptions options;
+  options.method_ = solve_on_device_ ? vulkan_fem::SolverMethod::kDeviceConjugateGradient : vulkan_fem::SolverMethod::kDirect;
+  options.memory_budget_ = memory_budget_;
+  return options;
 }
 
 bool FEMApplication::ProcessInput(GLFWindow *window, int key, int scancode, int action, int mods) {
@@ -14,19 +34,95 @@ bool FEMApplication::ProcessInput(GLFWindow *window, int key, int scancode, int
   if (action == GLFW_PRESS) {
     switch (key) {
       case GLFW_KEY_SPACE:
-        solver_->Solve(*model_);
-        needs_update_ = true;
+        if (!async_solver_->Start(*model_)) {
+          spdlog::warn("a solve is already running, C cancels it");
+        }
+        return false;
+      case GLFW_KEY_C:
+        async_solver_->Cancel();
         return false;
       case GLFW_KEY_1:
+        async_solver_->Cancel();
         model_ = vulkan_fem::ModelFactory::CreateRectangle();
-        render_model_ = std::make_shared<vulkan_fem::VulkanModel<2>>(model_);
-        needs_update_ = true;
+        render_model_.SetModel(model_);
+        ResetSolution();
         return false;
       case GLFW_KEY_2:
+        async_solver_->Cancel();
         model_ = vulkan_fem::ModelFactory::CreateRectangle2();
-        render_model_ = std::make_shared<vulkan_fem::VulkanModel<2>>(model_);
+        render_model_.SetModel(model_);
+        ResetSolution();
+        return false;
+      case GLFW_KEY_F:
+        field_ = field_ == ScalarField::kVonMises ? ScalarField::kDisplacement : ScalarField::kVonMises;
+        spdlog::info("showing {}", field_ == ScalarField::kVonMises ? "von Mises stress" : "displacement magnitude");
         needs_update_ = true;
         return false;
+      case GLFW_KEY_EQUAL:
+        deformation_scale_ *= 2.F;
+        spdlog::info("deformation scale {}", deformation_scale_);
+        return false;
+      case GLFW_KEY_MINUS:
+        deformation_scale_ /= 2.F;
+        spdlog::info("deformation scale {}", deformation_scale_);
+        return false;
+      case GLFW_KEY_A:
+        animate_ = !animate_;
+        return false;
+      case GLFW_KEY_K:
+        if (!culler_) {
+          return false;
+        }
+        culling_ = !culling_;
+        spdlog::info("cluster culling {}", culling_ ? "on" : "off");
+        return false;
+      case GLFW_KEY_LEFT:
+        pan_.x -= kPanStep;
+        return false;
+      case GLFW_KEY_RIGHT:
+        pan_.x += kPanStep;
+        return false;
+      case GLFW_KEY_UP:
+        pan_.y -= kPanStep;
+        return false;
+      case GLFW_KEY_DOWN:
+        pan_.y += kPanStep;
+        return false;
+      case GLFW_KEY_PAGE_UP:
+      case GLFW_KEY_PAGE_DOWN: {
+        // about the centre of the window
+        const float factor = key == GLFW_KEY_PAGE_UP ? kZoomStep : 1.F / kZoomStep;
+        zoom_ *= factor;
+        pan_ = {pan_.x * factor, pan_.y * factor};
+        return false;
+      }
+      case GLFW_KEY_HOME:
+        zoom_ = 1.F;
+        pan_ = {0.F, 0.F};
+        return false;
+      case GLFW_KEY_W:
+        if (wireframe_pipeline_ == VK_NULL_HANDLE) {
+          spdlog::warn("the device has no line polygon mode");
+          return false;
+        }
+        wireframe_ = !wireframe_;
+        return false;
+      case GLFW_KEY_G: {
+        if (!compute_) {
+          spdlog::warn("no compute device, staying on the host solver");
+          return false;
+        }
+        if (async_solver_->IsRunning()) {
+          spdlog::warn("a solve is running, switch the solver afterwards");
+          return false;
+        }
+        solve_on_device_ = !solve_on_device_;
+        solver_ = std::make_shared<vulkan_fem::Solver<2>>(GetSolverOptions());
+        solver_->SetDevice(compute_);
+        async_solver_ = std::make_unique<vulkan_fem::AsyncSolver<2>>(solver_);
+        spdlog::info("solving on the {}", solve_on_device_ ? "device" : "host");
+        return false;
+      }
     }
   }
 
@@ -34,51 +130,169 @@ bool FEMApplication::ProcessInput(GLFWindow *window, int key, int scancode, int
 }
 
 void FEMApplication::CrateBuffers() {
-  indices_ = render_model_->GetIndices();
-  const auto vertices = render_model_->GetVertices();
+  try {
+    culler_ = std::make_unique<vulkan_fem::ClusterCuller>(device_, pipeline_cache_->Get());
+  } catch (const std::exception &e) {
+    spdlog::warn("cluster culling unavailable, drawing every triangle: {}", e.what());
+    culling_ = false;
+  }
 
-  CreateIndexBuffer(index_buffer_, index_buffer_memory_, indices_);
-  CreateVertexBuffer(vertex_buffer_, vertex_buffer_memory_, vertices);
+  UploadGeometry();
+  if (culler_) {
+    culler_->Bind(cluster_buffer_.buffer_, draw_buffer_.buffer_);
+  }
 }
 
-void FEMApplication::PreDrawFrame(uint32_t /*image_index*/) {
-  if (!needs_update_) {
+bool FEMApplication::UploadGeometry() {
+  const vulkan_fem::ScopedTimer timer("upload geometry", "render");
+  const auto &field = GetField();
+  const auto range = std::minmax_element(field.begin(), field.end());
+  view_.min_value_ = field.empty() ? 0.F : *range.first;
+  view_.max_value_ = field.empty() ? 0.F : *range.second;
+
+  const VkDeviceSize vertex_size = sizeof(Vertex) * render_model_.GetVertexCount();
+  bool reallocated = ReserveBuffer(vertex_buffer_, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, vertex_size);
+  render_model_.WriteVertices(static_cast<Vertex *>(MapUpload(vertex_buffer_, 0, vertex_size)), displacements_, field);
+
+  const auto &indices = render_model_.GetIndices();
+  const VkDeviceSize index_size = sizeof(uint16_t) * indices.size();
+  const bool reallocated_indices = ReserveBuffer(index_buffer_, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, index_size);
+  if (reallocated_indices || uploaded_topology_ != render_model_.GetTopology()) {
+    UploadBuffer(index_buffer_, indices.data(), 0, index_size);
+    uploaded_topology_ = render_model_.GetTopology();
+    index_count_ = static_cast<uint32_t>(indices.size());
+  }
+
+  // the view changes every frame, the bounds only with the vertices
+  cluster_count_ = static_cast<uint32_t>(render_model_.GetClusterCount());
+  const VkDeviceSize cluster_size = sizeof(DrawCluster) * cluster_count_;
+  reallocated |= ReserveBuffer(cluster_buffer_, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, cluster_size);
+  reallocated |= ReserveBuffer(draw_buffer_, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                               sizeof(VkDrawIndexedIndirectCommand) * cluster_count_);
+  if (cluster_count_ > 0) {
+    render_model_.WriteClusters(static_cast<DrawCluster *>(MapUpload(cluster_buffer_, 0, cluster_size)), displacements_);
+  }
+
+  return reallocated || reallocated_indices;
+}
+
+void FEMApplication::TakeSolveResult() {
+  auto result = async_solver_->TakeResult();
+  if (!result) {
     return;
   }
 
-  SPDLOG_INFO("Updating");
+  if (!result->error_.empty()) {
+    spdlog::error("solve failed: {}", result->error_);
+    return;
+  }
+
+  // the job started from model_, which stays the reference the displacements are added to
+  render_model_.SetModel(model_);
+  model_ = result->model_;
+  displacements_ = std::move(result->displacements_);
+  fields_ = std::move(result->fields_);
+  needs_update_ = true;
+}
+
+const std::vector<vulkan_fem::Precision> &FEMApplication::GetField() {
+  if (displacements_.size() == 0 || field_ == ScalarField::kVonMises) {
+    return fields_.nodal_von_mises_;
+  }
+
+  magnitudes_.resize(static_cast<size_t>(displacements_.size() / 2));
+  for (size_t i = 0; i < magnitudes_.size(); ++i) {
+    magnitudes_[i] = displacements_.segment<2>(static_cast<Eigen::Index>(2 * i)).norm();
+  }
+  return magnitudes_;
+}
+
+void FEMApplication::ResetSolution() {
+  displacements_.resize(0);
+  fields_ = {};
+  needs_update_ = true;
+}
+
+void FEMApplication::ShowProgress() {
+  const int progress = async_solver_->IsRunning() ? static_cast<int>(100 * async_solver_->GetProgress()) : -1;
+  if (progress == shown_progress_) {
+    return;
+  }
+
+  shown_progress_ = progress;
+  const std::string title = progress < 0 ? std::string("Vulkan") : fmt::format("Vulkan - solving {}%", progress);
+  glfwSetWindowTitle(window_, title.c_str());
+}
+
+void FEMApplication::PreDrawFrame() {
+  TakeSolveResult();
+  ShowProgress();
 
-  const auto vertexes = render_model_->GetVertices();
-  const auto indices = render_model_->GetIndices();
+  if (needs_update_) {
+    UpdateGeometry();
+  }
 
-  vkDestroyBuffer(device_, index_buffer_, nullptr);
-  vkFreeMemory(device_, index_buffer_memory_, nullptr);
-  vkDestroyBuffer(device_, vertex_buffer_, nullptr);
-  vkFreeMemory(device_, vertex_buffer_memory_, nullptr);
+  // a cosine ramp of the load, two seconds per cycle
+  const float load = animate_ ? static_cast<float>(0.5 - 0.5 * std::cos(M_PI * glfwGetTime())) : 1.F;
+  view_.deformation_scale_ = deformation_scale_ * load;
+  view_.scale_ = {zoom_, zoom_};
+  view_.offset_ = pan_;
+  SetViewUniforms(view_);
+}
 
-  CreateVertexBuffer(vertex_buffer_, vertex_buffer_memory_, vertexes);
-  CreateIndexBuffer(index_buffer_, index_buffer_memory_, indices);
+void FEMApplication::UpdateGeometry() {
+  SPDLOG_INFO("Updating");
 
-  CreateCommandBuffers();
+  if (UploadGeometry()) {
+    DefragmentBuffers({&vertex_buffer_, &index_buffer_, &cluster_buffer_, &draw_buffer_});
+    allocator_->LogStats();
+    // the queue is idle after a reallocation or a move
+    if (culler_) {
+      culler_->Bind(cluster_buffer_.buffer_, draw_buffer_.buffer_);
+    }
+  }
 
   needs_update_ = false;
 }
 
+void FEMApplication::PreRenderPass(VkCommandBuffer command_buffer) {
+  if (culling_) {
+    gpu_timer_->BeginPass(command_buffer, "cull clusters");
+    culler_->Record(command_buffer, {view_.scale_, view_.offset_, view_.deformation_scale_, cluster_count_});
+    gpu_timer_->EndPass(command_buffer);
+  }
+}
+
 void FEMApplication::DrawRenderPass(VkCommandBuffer command_buffers) {
-  VkBuffer vertex_buffers[] = {vertex_buffer_};
+  VkBuffer vertex_buffers[] = {vertex_buffer_.buffer_};
   VkDeviceSize offsets[] = {0};
 
   vkCmdBindVertexBuffers(command_buffers, 0, 1, vertex_buffers, offsets);
-  vkCmdBindIndexBuffer(command_buffers, index_buffer_, 0, VK_INDEX_TYPE_UINT16);
+  vkCmdBindIndexBuffer(command_buffers, index_buffer_.buffer_, 0, VK_INDEX_TYPE_UINT16);
 
-  vkCmdDrawIndexed(command_buffers, static_cast<uint32_t>(indices_.size()), 1, 0, 0, 0);
+  if (!culling_) {
+    vkCmdDrawIndexed(command_buffers, index_count_, 1, 0, 0, 0);
+    return;
+  }
+
+  // culled clusters have no instances, without multiDrawIndirect each cluster is its own indirect draw
+  constexpr uint32_t kStride = sizeof(VkDrawIndexedIndirectCommand);
+  const uint32_t batch = multi_draw_indirect_ ? kMaxDrawIndirectCount : 1;
+  for (uint32_t first = 0; first < cluster_count_; first += batch) {
+    vkCmdDrawIndexedIndirect(command_buffers, draw_buffer_.buffer_, VkDeviceSize{first} * kStride, std::min(batch, cluster_count_ - first),
+                             kStride);
+  }
 }
 
 void FEMApplication::Cleanup() {
-  vkDestroyBuffer(device_, index_buffer_, nullptr);
-  vkFreeMemory(device_, index_buffer_memory_, nullptr);
-  vkDestroyBuffer(device_, vertex_buffer_, nullptr);
-  vkFreeMemory(device_, vertex_buffer_memory_, nullptr);
+  // the worker may still use the compute backend
+  async_solver_.reset();
+
+  culler_.reset();
+  DestroyBuffer(draw_buffer_);
+  DestroyBuffer(cluster_buffer_);
+  DestroyBuffer(index_buffer_);
+  DestroyBuffer(vertex_buffer_);
 
   Application::Cleanup();
 }
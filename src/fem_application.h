@@ -1,43 +1,83 @@
 #pragma once
 
+#include "async_solver.h"
+#include "cluster_culler.h"
 #include "model_factory.h"
 #include "solver.h"
 #include "vulcan.h"
 #include "vulkan_model.h"
 #include <cstddef>
+#include <cstdint>
 #include <iostream>
 #include <memory>
 #include <ostream>
 #include <vector>
 
 class FEMApplication final : public Application {
+ public:
+  // host bytes the solver may take, see SolverOptions::memory_budget_, set before Run
+  void SetMemoryBudget(size_t bytes) { memory_budget_ = bytes; }
+
  private:
-  VkBuffer vertex_buffer_{VK_NULL_HANDLE};
-  VkDeviceMemory vertex_buffer_memory_{VK_NULL_HANDLE};
-  VkBuffer index_buffer_{VK_NULL_HANDLE};
-  VkDeviceMemory index_buffer_memory_{VK_NULL_HANDLE};
+  DeviceBuffer vertex_buffer_;
+  DeviceBuffer index_buffer_;
+  // DrawClusters, written with the vertices, and the indirect draws generated from them every frame
+  DeviceBuffer cluster_buffer_;
+  DeviceBuffer draw_buffer_;
+  std::unique_ptr<vulkan_fem::ClusterCuller> culler_;
+  uint32_t cluster_count_ = 0;
+  bool culling_ = true;
 
-  std::vector<uint16_t> indices_;
+  // indices are uploaded again only when the topology changes
+  uint64_t uploaded_topology_ = 0;
+  uint32_t index_count_ = 0;
 
   std::shared_ptr<vulkan_fem::Solver<2>> solver_;
+  // runs solver_, which must not be touched while a solve is in flight
+  std::unique_ptr<vulkan_fem::AsyncSolver<2>> async_solver_;
+  int shown_progress_ = -1;
   std::shared_ptr<vulkan_fem::Model<2>> model_;
-  std::shared_ptr<vulkan_fem::VulkanModel<2>> render_model_;
+  // geometry the last solve started from, drawn with its displacements added in the vertex shader
+  vulkan_fem::VulkanModel<2> render_model_;
+  vulkan_fem::VectorX displacements_;
+  vulkan_fem::RecoveredFields<2> fields_;
+  std::vector<vulkan_fem::Precision> magnitudes_;  // displacement magnitude per vertex, reused
+
+  enum class ScalarField { kVonMises, kDisplacement };
+  ScalarField field_ = ScalarField::kVonMises;
+  ViewUniforms view_;
+  float deformation_scale_ = 1.F;
+  float zoom_ = 1.F;
+  glm::vec2 pan_{0.F, 0.F};  // clip space
+  bool animate_ = false;  // load scale from 0 to deformation_scale_ and back, uniforms only
 
   bool needs_update_ = false;
+  bool solve_on_device_ = false;
+  size_t memory_budget_ = 0;
 
  protected:
   void PreInit() final;
+  // direct on the host or CG on the device, within the memory budget
+  [[nodiscard]] vulkan_fem::SolverOptions GetSolverOptions() const;
 
   bool ProcessInput(GLFWindow *window, int key, int scancode, int action, int mods) final;
 
-  static std::vector<Vertex> ToVertices(const std::vector<vulkan_fem::Vertex3> &data);
-
   void CrateBuffers() final;
 
-  void UpdateBuffer(VkBuffer &buffer, const void *data, VkDeviceSize data_size);
+  // vertices written straight into staging memory, true when a buffer was reallocated
+  bool UploadGeometry();
+
+  // nodal values of field_, empty before the first solve
+  const std::vector<vulkan_fem::Precision> &GetField();
+  void ResetSolution();
 
-  void PreDrawFrame(uint32_t /*image_index*/) final;
+  void PreDrawFrame() final;
+  // vertices, indices and colormap range after a solve or a change of model or field
+  void UpdateGeometry();
+  void TakeSolveResult();
+  void ShowProgress();
 
+  void PreRenderPass(VkCommandBuffer command_buffer) final;
   void DrawRenderPass(VkCommandBuffer command_buffers) final;
 
   void Cleanup() final;
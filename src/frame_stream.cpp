@@ -0,0 +1,54 @@
+#include "frame_stream.h"
+#include <utility>
+
+namespace vulkan_fem {
+
+FrameStream::FrameStream(Callback callback, uint32_t max_pending)
+    : callback_(std::move(callback)), max_pending_(max_pending), thread_([this] { Run(); }) {}
+
+FrameStream::~FrameStream() { Close(); }
+
+bool FrameStream::Push(ExplicitFrame frame) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (closed_ || frames_.size() >= max_pending_) {
+      return false;
+    }
+    frames_.push_back(std::move(frame));
+  }
+  ready_.notify_one();
+  return true;
+}
+
+void FrameStream::Close() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+  }
+  ready_.notify_one();
+
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+void FrameStream::Run() {
+  for (;;) {
+    ExplicitFrame frame;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      ready_.wait(lock, [this] { return closed_ || !frames_.empty(); });
+      if (frames_.empty()) {
+        return;  // closed and drained
+      }
+      frame = std::move(frames_.front());
+      frames_.pop_front();
+    }
+
+    if (callback_) {
+      callback_(frame);
+    }
+  }
+}
+
+}  // namespace vulkan_fem
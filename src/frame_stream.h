@@ -0,0 +1,53 @@
+#pragma once
+
+#include "fem.h"
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace vulkan_fem {
+
+// state of a transient analysis at one output step
+struct ExplicitFrame {
+  uint32_t step_ = 0;
+  Precision time_ = 0.;
+  VectorX displacements_;
+  VectorX velocities_;
+};
+
+// Hands frames to a callback on a background thread, so writing or rendering results never stalls the time loop.
+class FrameStream {
+ public:
+  using Callback = std::function<void(const ExplicitFrame &)>;
+
+  // max_pending - frames queued before Push starts dropping them
+  FrameStream(Callback callback, uint32_t max_pending);
+  ~FrameStream();
+
+  FrameStream(const FrameStream &) = delete;
+  FrameStream &operator=(const FrameStream &) = delete;
+
+  // false when the queue is full and the frame was dropped
+  bool Push(ExplicitFrame frame);
+
+  // delivers the queued frames and stops the thread
+  void Close();
+
+ private:
+  void Run();
+
+  Callback callback_;
+  const uint32_t max_pending_;
+
+  std::mutex mutex_;
+  std::condition_variable ready_;
+  std::deque<ExplicitFrame> frames_;
+  bool closed_ = false;
+
+  std::thread thread_;
+};
+
+}  // namespace vulkan_fem
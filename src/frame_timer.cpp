@@ -0,0 +1,84 @@
+#include "frame_timer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <numeric>
+
+namespace vulkan_fem {
+namespace {
+
+constexpr size_t kReservedFrames = 1024;  // a few seconds at high refresh rates before the vector grows
+
+double ToMilliseconds(std::chrono::steady_clock::duration duration) {
+  return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+}  // namespace
+
+FrameTimer::FrameTimer(double report_interval_s)
+    : report_interval_(std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(report_interval_s))) {
+  intervals_ms_.reserve(kReservedFrames);
+}
+
+void FrameTimer::BeginFrame() {
+  const Clock::time_point now = Clock::now();
+  if (started_) {
+    intervals_ms_.push_back(ToMilliseconds(now - frame_start_));
+  } else {
+    interval_start_ = now;
+    started_ = true;
+  }
+  frame_start_ = now;
+  wait_end_ = now;
+}
+
+void FrameTimer::EndWait() {
+  wait_end_ = Clock::now();
+  wait_ms_ += ToMilliseconds(wait_end_ - frame_start_);
+}
+
+bool FrameTimer::EndFrame() {
+  const Clock::time_point now = Clock::now();
+  cpu_ms_ += ToMilliseconds(now - wait_end_);
+  ++frames_;
+
+  if (now - interval_start_ < report_interval_ || intervals_ms_.empty()) {
+    return false;
+  }
+  Summarize();
+  interval_start_ = now;
+  return true;
+}
+
+void FrameTimer::Reset() {
+  started_ = false;
+  intervals_ms_.clear();
+  wait_ms_ = 0.0;
+  cpu_ms_ = 0.0;
+  frames_ = 0;
+}
+
+void FrameTimer::Summarize() {
+  const size_t count = intervals_ms_.size();
+  stats_.frames_ = frames_;
+  stats_.average_ms_ = std::accumulate(intervals_ms_.begin(), intervals_ms_.end(), 0.0) / static_cast<double>(count);
+  stats_.wait_ms_ = wait_ms_ / frames_;
+  stats_.cpu_ms_ = cpu_ms_ / frames_;
+
+  // partial sorts, the samples are dropped afterwards anyway
+  const auto percentile = [&](double fraction) {
+    const auto rank = std::min(count - 1, static_cast<size_t>(std::ceil(fraction * static_cast<double>(count))) - 1);
+    std::nth_element(intervals_ms_.begin(), intervals_ms_.begin() + static_cast<std::ptrdiff_t>(rank), intervals_ms_.end());
+    return intervals_ms_[rank];
+  };
+  stats_.median_ms_ = percentile(0.5);
+  stats_.p99_ms_ = percentile(0.99);
+  stats_.max_ms_ = *std::max_element(intervals_ms_.begin(), intervals_ms_.end());
+
+  intervals_ms_.clear();
+  wait_ms_ = 0.0;
+  cpu_ms_ = 0.0;
+  frames_ = 0;
+}
+
+}  // namespace vulkan_fem
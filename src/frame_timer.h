@@ -0,0 +1,57 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+namespace vulkan_fem {
+
+// frame to frame statistics over one report interval, in milliseconds
+struct FrameStats {
+  uint32_t frames_ = 0;
+  double average_ms_ = 0.0;
+  double median_ms_ = 0.0;
+  double p99_ms_ = 0.0;
+  double max_ms_ = 0.0;
+  double wait_ms_ = 0.0;  // mean time blocked on the frame fence and image acquisition
+  double cpu_ms_ = 0.0;   // mean time spent updating, recording, submitting and presenting
+};
+
+// Measures the time between the starts of consecutive frames and splits every frame into waiting
+// and CPU work, so stutter can be told apart from a slow render loop. Samples are collected into a
+// vector reserved up front and summarized once per interval.
+class FrameTimer {
+ public:
+  explicit FrameTimer(double report_interval_s = 2.0);
+
+  void BeginFrame();
+  // the frame's resources and swap chain image are available
+  void EndWait();
+  // true when an interval was completed, its statistics are then returned by GetStats
+  bool EndFrame();
+
+  // skips the interval containing a stall that is not the render loop's, such as a swap chain recreation
+  void Reset();
+
+  [[nodiscard]] const FrameStats &GetStats() const { return stats_; }
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  void Summarize();
+
+  Clock::duration report_interval_;
+  Clock::time_point interval_start_;
+  Clock::time_point frame_start_;
+  Clock::time_point wait_end_;
+  bool started_ = false;
+
+  std::vector<double> intervals_ms_;
+  double wait_ms_ = 0.0;
+  double cpu_ms_ = 0.0;
+  uint32_t frames_ = 0;
+
+  FrameStats stats_;
+};
+
+}  // namespace vulkan_fem
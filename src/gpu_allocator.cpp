@@ -0,0 +1,390 @@
+#include "gpu_allocator.h"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <stdexcept>
+
+namespace vulkan_fem {
+namespace {
+
+constexpr double kMiB = 1024. * 1024.;
+
+VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment) { return (value + alignment - 1) / alignment * alignment; }
+
+VkDeviceSize RoundDownToPowerOfTwo(VkDeviceSize value) {
+  VkDeviceSize result = 1;
+  while (result * 2 <= value) {
+    result *= 2;
+  }
+  return result;
+}
+
+}  // namespace
+
+GpuAllocator::GpuAllocator(VkPhysicalDevice physical_device, VkDevice device, VkDeviceSize block_size)
+    : device_(device), block_size_(RoundDownToPowerOfTwo(std::max(block_size, kMinBuddySize))) {
+  vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties_);
+
+  // staging and readback memory is short lived and written front to back, device memory holds long lived data
+  pools_.resize(memory_properties_.memoryTypeCount);
+  for (uint32_t i = 0; i < memory_properties_.memoryTypeCount; i++) {
+    const VkMemoryPropertyFlags flags = memory_properties_.memoryTypes[i].propertyFlags;
+    const bool host_only = (flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0U && (flags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) == 0U;
+    pools_[i].strategy_ = host_only ? AllocationStrategy::kLinear : AllocationStrategy::kBuddy;
+  }
+}
+
+GpuAllocator::~GpuAllocator() {
+  const GpuAllocatorStats stats = GetStats();
+  if (stats.allocation_count_ > 0) {
+    spdlog::warn("{} GPU allocations still alive on shutdown", stats.allocation_count_);
+  }
+
+  for (uint32_t memory_type = 0; memory_type < pools_.size(); memory_type++) {
+    for (uint32_t block = 0; block < pools_[memory_type].blocks_.size(); block++) {
+      ReleaseBlock(memory_type, block);
+    }
+  }
+}
+
+void GpuAllocator::SetStrategy(uint32_t memory_type, AllocationStrategy strategy) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  pools_.at(memory_type).strategy_ = strategy;
+}
+
+GpuAllocation GpuAllocator::Allocate(const VkMemoryRequirements &requirements, VkMemoryPropertyFlags properties) {
+  const uint32_t memory_type = FindMemoryType(requirements.memoryTypeBits, properties);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  return AllocateLocked(memory_type, requirements, {});
+}
+
+void GpuAllocator::Free(GpuAllocation &allocation) {
+  if (allocation.memory_ == VK_NULL_HANDLE) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  Pool &pool = pools_[allocation.memory_type_];
+  Block &block = pool.blocks_[allocation.block_];
+
+  block.allocation_count_--;
+  block.allocated_bytes_ -= allocation.size_;
+  block.requested_bytes_ -= allocation.requested_;
+
+  if (block.strategy_ == AllocationStrategy::kBuddy && !block.dedicated_) {
+    // merge with the buddy as long as it is free as well
+    VkDeviceSize offset = allocation.offset_;
+    uint32_t order = GetOrder(allocation.size_);
+    const auto max_order = static_cast<uint32_t>(block.free_offsets_.size() - 1);
+    while (order < max_order) {
+      const VkDeviceSize buddy = offset ^ (kMinBuddySize << order);
+      auto found = block.free_offsets_[order].find(buddy);
+      if (found == block.free_offsets_[order].end()) {
+        break;
+      }
+      block.free_offsets_[order].erase(found);
+      offset = std::min(offset, buddy);
+      order++;
+    }
+    block.free_offsets_[order].insert(offset);
+  } else if (block.allocation_count_ == 0) {
+    block.linear_offset_ = 0;
+  }
+
+  // empty blocks go back to the driver, one shared block per type is kept to avoid churn
+  if (block.allocation_count_ == 0) {
+    const bool other_shared_block = std::any_of(pool.blocks_.begin(), pool.blocks_.end(), [&](const Block &other) {
+      return &other != &block && other.memory_ != VK_NULL_HANDLE && !other.dedicated_;
+    });
+    if (block.dedicated_ || other_shared_block) {
+      ReleaseBlock(allocation.memory_type_, allocation.block_);
+    }
+  }
+
+  allocation = GpuAllocation{};
+}
+
+VkBuffer GpuAllocator::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties,
+                                    GpuAllocation &allocation, const std::vector<uint32_t> &queue_families) {
+  VkBufferCreateInfo buffer_info{};
+  buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  buffer_info.size = size;
+  buffer_info.usage = usage;
+  buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  if (queue_families.size() > 1) {
+    buffer_info.sharingMode = VK_SHARING_MODE_CONCURRENT;
+    buffer_info.queueFamilyIndexCount = static_cast<uint32_t>(queue_families.size());
+    buffer_info.pQueueFamilyIndices = queue_families.data();
+  }
+
+  VkBuffer buffer;
+  if (vkCreateBuffer(device_, &buffer_info, nullptr, &buffer) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create buffer!");
+  }
+
+  VkMemoryRequirements requirements;
+  vkGetBufferMemoryRequirements(device_, buffer, &requirements);
+
+  try {
+    allocation = Allocate(requirements, properties);
+  } catch (...) {
+    vkDestroyBuffer(device_, buffer, nullptr);
+    throw;
+  }
+
+  vkBindBufferMemory(device_, buffer, allocation.memory_, allocation.offset_);
+  return buffer;
+}
+
+void GpuAllocator::DestroyBuffer(VkBuffer buffer, GpuAllocation &allocation) {
+  vkDestroyBuffer(device_, buffer, nullptr);
+  Free(allocation);
+}
+
+std::vector<DefragmentationMove> GpuAllocator::PlanDefragmentation(const std::vector<GpuAllocation> &allocations) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<DefragmentationMove> moves;
+
+  for (uint32_t memory_type = 0; memory_type < pools_.size(); memory_type++) {
+    Pool &pool = pools_[memory_type];
+
+    // sparse buddy blocks are sources, the fullest block always stays a destination
+    std::vector<bool> sources(pool.blocks_.size(), false);
+    uint32_t fullest = 0;
+    double fullest_fill = -1.;
+    uint32_t source_count = 0;
+    for (uint32_t block = 0; block < pool.blocks_.size(); block++) {
+      const Block &candidate = pool.blocks_[block];
+      if (candidate.memory_ == VK_NULL_HANDLE || candidate.dedicated_ || candidate.strategy_ != AllocationStrategy::kBuddy) {
+        continue;
+      }
+      const double fill = static_cast<double>(candidate.allocated_bytes_) / static_cast<double>(candidate.size_);
+      if (fill < kDefragmentationThreshold) {
+        sources[block] = true;
+        source_count++;
+      }
+      if (fill > fullest_fill) {
+        fullest = block;
+        fullest_fill = fill;
+      }
+    }
+    if (source_count == 0) {
+      continue;
+    }
+    if (sources[fullest]) {
+      sources[fullest] = false;
+      if (--source_count == 0) {
+        continue;
+      }
+    }
+
+    for (size_t i = 0; i < allocations.size(); i++) {
+      const GpuAllocation &allocation = allocations[i];
+      if (allocation.memory_ == VK_NULL_HANDLE || allocation.memory_type_ != memory_type || !sources[allocation.block_]) {
+        continue;
+      }
+
+      // buddy sizes are powers of two at least as large as the original alignment
+      VkMemoryRequirements requirements{};
+      requirements.size = allocation.size_;
+      requirements.alignment = allocation.size_;
+      requirements.memoryTypeBits = 1U << memory_type;
+
+      GpuAllocation destination = AllocateLocked(memory_type, requirements, sources);
+      if (destination.memory_ != VK_NULL_HANDLE) {
+        pool.blocks_[destination.block_].requested_bytes_ -= destination.requested_ - allocation.requested_;
+        destination.requested_ = allocation.requested_;
+        moves.push_back({i, destination});
+      }
+    }
+  }
+
+  return moves;
+}
+
+GpuAllocatorStats GpuAllocator::GetStats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  GpuAllocatorStats stats;
+  for (const Pool &pool : pools_) {
+    for (const Block &block : pool.blocks_) {
+      if (block.memory_ == VK_NULL_HANDLE) {
+        continue;
+      }
+      stats.block_count_++;
+      stats.dedicated_count_ += block.dedicated_ ? 1 : 0;
+      stats.allocation_count_ += block.allocation_count_;
+      stats.reserved_bytes_ += block.size_;
+      stats.allocated_bytes_ += block.allocated_bytes_;
+      stats.requested_bytes_ += block.requested_bytes_;
+    }
+  }
+  return stats;
+}
+
+void GpuAllocator::LogStats() const {
+  const GpuAllocatorStats stats = GetStats();
+  spdlog::info("GPU memory: {} blocks ({} dedicated), {} allocations, {:.1f} MiB requested, {:.1f} MiB allocated, {:.1f} MiB reserved",
+               stats.block_count_, stats.dedicated_count_, stats.allocation_count_, static_cast<double>(stats.requested_bytes_) / kMiB,
+               static_cast<double>(stats.allocated_bytes_) / kMiB, static_cast<double>(stats.reserved_bytes_) / kMiB);
+}
+
+uint32_t GpuAllocator::FindMemoryType(uint32_t type_filter, VkMemoryPropertyFlags properties) const {
+  for (uint32_t i = 0; i < memory_properties_.memoryTypeCount; i++) {
+    if (((type_filter & (1U << i)) != 0U) && (memory_properties_.memoryTypes[i].propertyFlags & properties) == properties) {
+      return i;
+    }
+  }
+
+  throw std::runtime_error("failed to find suitable memory type!");
+}
+
+uint32_t GpuAllocator::CreateBlock(uint32_t memory_type, VkDeviceSize size, bool dedicated) {
+  Pool &pool = pools_[memory_type];
+
+  VkMemoryAllocateInfo alloc_info{};
+  alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  alloc_info.allocationSize = size;
+  alloc_info.memoryTypeIndex = memory_type;
+
+  Block block;
+  if (vkAllocateMemory(device_, &alloc_info, nullptr, &block.memory_) != VK_SUCCESS) {
+    throw std::runtime_error("failed to allocate buffer memory!");
+  }
+
+  block.size_ = size;
+  block.dedicated_ = dedicated;
+  block.strategy_ = pool.strategy_;
+  if ((memory_properties_.memoryTypes[memory_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0U) {
+    vkMapMemory(device_, block.memory_, 0, VK_WHOLE_SIZE, 0, &block.mapped_);
+  }
+  if (!dedicated && block.strategy_ == AllocationStrategy::kBuddy) {
+    block.free_offsets_.resize(GetOrder(size) + 1);
+    block.free_offsets_.back().insert(0);
+  }
+
+  // reuse a released slot, allocations only refer to blocks by index
+  for (uint32_t i = 0; i < pool.blocks_.size(); i++) {
+    if (pool.blocks_[i].memory_ == VK_NULL_HANDLE) {
+      pool.blocks_[i] = std::move(block);
+      return i;
+    }
+  }
+  pool.blocks_.push_back(std::move(block));
+  return static_cast<uint32_t>(pool.blocks_.size() - 1);
+}
+
+void GpuAllocator::ReleaseBlock(uint32_t memory_type, uint32_t block) {
+  Block &released = pools_[memory_type].blocks_[block];
+  if (released.memory_ != VK_NULL_HANDLE) {
+    vkFreeMemory(device_, released.memory_, nullptr);
+  }
+  released = Block{};
+}
+
+bool GpuAllocator::AllocateFromBlock(uint32_t memory_type, uint32_t block_index, const VkMemoryRequirements &requirements,
+                                    GpuAllocation &allocation) {
+  Block &block = pools_[memory_type].blocks_[block_index];
+  VkDeviceSize offset = 0;
+  VkDeviceSize size = requirements.size;
+
+  if (block.strategy_ == AllocationStrategy::kBuddy) {
+    const uint32_t order = GetOrder(std::max(requirements.size, requirements.alignment));
+    uint32_t free_order = order;
+    while (free_order < block.free_offsets_.size() && block.free_offsets_[free_order].empty()) {
+      free_order++;
+    }
+    if (free_order >= block.free_offsets_.size()) {
+      return false;
+    }
+
+    offset = *block.free_offsets_[free_order].begin();
+    block.free_offsets_[free_order].erase(block.free_offsets_[free_order].begin());
+    // split down, the upper halves stay free
+    while (free_order > order) {
+      free_order--;
+      block.free_offsets_[free_order].insert(offset + (kMinBuddySize << free_order));
+    }
+    size = kMinBuddySize << order;
+  } else {
+    offset = AlignUp(block.linear_offset_, std::max<VkDeviceSize>(requirements.alignment, 1));
+    if (offset + size > block.size_) {
+      return false;
+    }
+    block.linear_offset_ = offset + size;
+  }
+
+  block.allocation_count_++;
+  block.allocated_bytes_ += size;
+  block.requested_bytes_ += requirements.size;
+
+  allocation.memory_ = block.memory_;
+  allocation.offset_ = offset;
+  allocation.size_ = size;
+  allocation.requested_ = requirements.size;
+  allocation.mapped_ = block.mapped_ != nullptr ? static_cast<char *>(block.mapped_) + offset : nullptr;
+  allocation.memory_type_ = memory_type;
+  allocation.block_ = block_index;
+  return true;
+}
+
+GpuAllocation GpuAllocator::AllocateLocked(uint32_t memory_type, const VkMemoryRequirements &requirements,
+                                           const std::vector<bool> &excluded) {
+  GpuAllocation allocation;
+  const VkDeviceSize block_size = GetBlockSize(memory_type);
+
+  if (requirements.size > block_size / 2) {
+    if (!excluded.empty()) {
+      return allocation;  // defragmentation never moves into new memory
+    }
+    const uint32_t block = CreateBlock(memory_type, requirements.size, true);
+    Block &dedicated = pools_[memory_type].blocks_[block];
+    dedicated.allocation_count_ = 1;
+    dedicated.allocated_bytes_ = requirements.size;
+    dedicated.requested_bytes_ = requirements.size;
+
+    allocation.memory_ = dedicated.memory_;
+    allocation.size_ = requirements.size;
+    allocation.requested_ = requirements.size;
+    allocation.mapped_ = dedicated.mapped_;
+    allocation.memory_type_ = memory_type;
+    allocation.block_ = block;
+    return allocation;
+  }
+
+  const auto &blocks = pools_[memory_type].blocks_;
+  for (uint32_t block = 0; block < blocks.size(); block++) {
+    if (blocks[block].memory_ == VK_NULL_HANDLE || blocks[block].dedicated_ || (block < excluded.size() && excluded[block])) {
+      continue;
+    }
+    if (AllocateFromBlock(memory_type, block, requirements, allocation)) {
+      return allocation;
+    }
+  }
+
+  if (!excluded.empty()) {
+    return allocation;
+  }
+
+  const uint32_t block = CreateBlock(memory_type, block_size, false);
+  if (!AllocateFromBlock(memory_type, block, requirements, allocation)) {
+    throw std::runtime_error("failed to sub-allocate from a new memory block!");
+  }
+  return allocation;
+}
+
+uint32_t GpuAllocator::GetOrder(VkDeviceSize size) const {
+  uint32_t order = 0;
+  while ((kMinBuddySize << order) < size) {
+    order++;
+  }
+  return order;
+}
+
+VkDeviceSize GpuAllocator::GetBlockSize(uint32_t memory_type) const {
+  // small heaps (e.g. 256 MiB of BAR memory) get proportionally smaller blocks
+  const VkDeviceSize heap_size = memory_properties_.memoryHeaps[memory_properties_.memoryTypes[memory_type].heapIndex].size;
+  return std::max(kMinBuddySize, std::min(block_size_, RoundDownToPowerOfTwo(heap_size / 8)));
+}
+
+}  // namespace vulkan_fem
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <vulkan/vulkan_core.h>
+#include <cstdint>
+#include <mutex>
+#include <set>
+#include <vector>
+
+namespace vulkan_fem {
+
+// how a memory type carves its blocks
+enum class AllocationStrategy {
+  kBuddy,   // power of two splits, any allocation can be freed and merged back
+  kLinear,  // bump pointer, a block is rewound once all of its allocations are freed
+};
+
+struct GpuAllocation {
+  VkDeviceMemory memory_ = VK_NULL_HANDLE;
+  VkDeviceSize offset_ = 0;
+  VkDeviceSize size_ = 0;  // reserved size, at least the requested one
+  VkDeviceSize requested_ = 0;
+  void *mapped_ = nullptr;  // host visible memory stays mapped for the lifetime of the block
+  uint32_t memory_type_ = 0;
+  uint32_t block_ = 0;
+};
+
+struct GpuAllocatorStats {
+  uint32_t block_count_ = 0;
+  uint32_t dedicated_count_ = 0;  // allocations too large to share a block
+  uint32_t allocation_count_ = 0;
+  VkDeviceSize reserved_bytes_ = 0;   // vkAllocateMemory total
+  VkDeviceSize allocated_bytes_ = 0;  // handed out, including rounding
+  VkDeviceSize requested_bytes_ = 0;
+};
+
+// allocation index into the list given to PlanDefragmentation and where it should go
+struct DefragmentationMove {
+  size_t index_ = 0;
+  GpuAllocation destination_;
+};
+
+// Sub-allocates buffers out of large VkDeviceMemory blocks, one pool of blocks per memory type.
+// Device local types use the buddy strategy, host only types the linear one, see SetStrategy.
+// Allocations above half a block get their own dedicated block.
+class GpuAllocator {
+ public:
+  GpuAllocator(VkPhysicalDevice physical_device, VkDevice device, VkDeviceSize block_size = kDefaultBlockSize);
+  ~GpuAllocator();
+
+  GpuAllocator(const GpuAllocator &) = delete;
+  GpuAllocator &operator=(const GpuAllocator &) = delete;
+
+  // only affects blocks created afterwards
+  void SetStrategy(uint32_t memory_type, AllocationStrategy strategy);
+
+  GpuAllocation Allocate(const VkMemoryRequirements &requirements, VkMemoryPropertyFlags properties);
+  void Free(GpuAllocation &allocation);
+
+  // buffer created, allocated and bound in one go, shared concurrently when more than one queue family is given
+  VkBuffer CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, GpuAllocation &allocation,
+                        const std::vector<uint32_t> &queue_families = {});
+  void DestroyBuffer(VkBuffer buffer, GpuAllocation &allocation);
+
+  // Moves that empty the least used buddy blocks into free space of the others. The destinations are allocated,
+  // the caller copies the contents, rebinds and frees the sources, after which the emptied blocks are released.
+  std::vector<DefragmentationMove> PlanDefragmentation(const std::vector<GpuAllocation> &allocations);
+
+  [[nodiscard]] GpuAllocatorStats GetStats() const;
+  void LogStats() const;
+
+  uint32_t FindMemoryType(uint32_t type_filter, VkMemoryPropertyFlags properties) const;
+
+ private:
+  static constexpr VkDeviceSize kDefaultBlockSize = VkDeviceSize{64} << 20;
+  static constexpr VkDeviceSize kMinBuddySize = 256;
+  // blocks filled below this fraction are emptied by defragmentation
+  static constexpr double kDefragmentationThreshold = 0.5;
+
+  struct Block {
+    VkDeviceMemory memory_ = VK_NULL_HANDLE;
+    VkDeviceSize size_ = 0;
+    void *mapped_ = nullptr;
+    bool dedicated_ = false;
+    AllocationStrategy strategy_ = AllocationStrategy::kBuddy;
+    uint32_t allocation_count_ = 0;
+    VkDeviceSize allocated_bytes_ = 0;
+    VkDeviceSize requested_bytes_ = 0;
+    std::vector<std::set<VkDeviceSize>> free_offsets_;  // buddy, per order
+    VkDeviceSize linear_offset_ = 0;                    // linear
+  };
+
+  struct Pool {
+    AllocationStrategy strategy_ = AllocationStrategy::kBuddy;
+    std::vector<Block> blocks_;  // released blocks keep their slot, indices stay valid
+  };
+
+  uint32_t CreateBlock(uint32_t memory_type, VkDeviceSize size, bool dedicated);
+  void ReleaseBlock(uint32_t memory_type, uint32_t block);
+  bool AllocateFromBlock(uint32_t memory_type, uint32_t block, const VkMemoryRequirements &requirements, GpuAllocation &allocation);
+  GpuAllocation AllocateLocked(uint32_t memory_type, const VkMemoryRequirements &requirements, const std::vector<bool> &excluded);
+
+  [[nodiscard]] uint32_t GetOrder(VkDeviceSize size) const;
+  [[nodiscard]] VkDeviceSize GetBlockSize(uint32_t memory_type) const;
+
+  VkDevice device_;
+  VkPhysicalDeviceMemoryProperties memory_properties_{};
+  VkDeviceSize block_size_;
+
+  mutable std::mutex mutex_;
+  std::vector<Pool> pools_;
+};
+
+}  // namespace vulkan_fem
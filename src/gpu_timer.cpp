@@ -0,0 +1,120 @@
+#include "gpu_timer.h"
+#include <spdlog/spdlog.h>
+#include <limits>
+#include <stdexcept>
+
+namespace vulkan_fem {
+namespace {
+
+constexpr uint32_t kNoPass = std::numeric_limits<uint32_t>::max();
+
+}  // namespace
+
+GpuTimer::GpuTimer(VkPhysicalDevice physical_device, VkDevice device, uint32_t queue_family, uint32_t frame_count)
+    : device_(device), frames_(frame_count) {
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physical_device, &properties);
+
+  uint32_t queue_family_count = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &queue_family_count, nullptr);
+  std::vector<VkQueueFamilyProperties> queue_families(queue_family_count);
+  vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &queue_family_count, queue_families.data());
+
+  const uint32_t valid_bits = queue_family < queue_family_count ? queue_families[queue_family].timestampValidBits : 0;
+  if (valid_bits == 0) {
+    spdlog::info("no timestamps on queue family {}, GPU passes are not timed", queue_family);
+    return;
+  }
+  valid_mask_ = valid_bits >= 64 ? ~uint64_t{0} : (uint64_t{1} << valid_bits) - 1;
+  period_ns_ = properties.limits.timestampPeriod;
+
+  VkQueryPoolCreateInfo pool_info{};
+  pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+  pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+  pool_info.queryCount = kQueriesPerFrame * frame_count;
+  if (vkCreateQueryPool(device_, &pool_info, nullptr, &query_pool_) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create timestamp query pool");
+  }
+}
+
+GpuTimer::~GpuTimer() { vkDestroyQueryPool(device_, query_pool_, nullptr); }
+
+void GpuTimer::Collect(uint32_t frame) {
+  Frame &timed = frames_[frame];
+  if (!timed.pending_) {
+    return;
+  }
+  timed.pending_ = false;
+
+  std::vector<uint64_t> ticks(timed.used_);
+  // no wait, a frame whose queries are not all written is skipped
+  if (vkGetQueryPoolResults(device_, query_pool_, frame * kQueriesPerFrame, timed.used_, ticks.size() * sizeof(uint64_t), ticks.data(),
+                            sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) {
+    return;
+  }
+
+  // the first pass starts at the submission, the GPU clock is not calibrated against the host's
+  const uint64_t origin = ticks[timed.passes_.front().begin_];
+  for (const Pass &pass : timed.passes_) {
+    const double offset_ns = static_cast<double>((ticks[pass.begin_] - origin) & valid_mask_) * period_ns_;
+    const double duration_ns = static_cast<double>((ticks[pass.end_] - ticks[pass.begin_]) & valid_mask_) * period_ns_;
+    const auto offset = std::chrono::duration_cast<Profiler::Clock::duration>(std::chrono::duration<double, std::nano>(offset_ns));
+    Profiler::Get().AddGpuSpan(pass.name_, timed.submitted_ + offset, duration_ns / 1e6);
+  }
+}
+
+void GpuTimer::BeginFrame(VkCommandBuffer command_buffer, uint32_t frame) {
+  current_ = nullptr;
+  if (query_pool_ == VK_NULL_HANDLE || !Profiler::IsEnabled()) {
+    return;
+  }
+
+  Frame &timed = frames_[frame];
+  timed.passes_.clear();
+  timed.open_.clear();
+  timed.used_ = 0;
+  timed.pending_ = false;
+  vkCmdResetQueryPool(command_buffer, query_pool_, frame * kQueriesPerFrame, kQueriesPerFrame);
+  current_ = &timed;
+  current_index_ = frame;
+}
+
+void GpuTimer::BeginPass(VkCommandBuffer command_buffer, const char *name) {
+  if (current_ == nullptr) {
+    return;
+  }
+  // both queries are taken now, a pass that does not fit is left out
+  if (current_->used_ + 2 > kQueriesPerFrame) {
+    current_->open_.push_back(kNoPass);
+    return;
+  }
+
+  current_->open_.push_back(static_cast<uint32_t>(current_->passes_.size()));
+  current_->passes_.push_back({name, current_->used_, current_->used_ + 1});
+  current_->used_ += 2;
+  vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, query_pool_,
+                      current_index_ * kQueriesPerFrame + current_->passes_.back().begin_);
+}
+
+void GpuTimer::EndPass(VkCommandBuffer command_buffer) {
+  if (current_ == nullptr || current_->open_.empty()) {
+    return;
+  }
+  const uint32_t pass = current_->open_.back();
+  current_->open_.pop_back();
+  if (pass != kNoPass) {
+    vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, query_pool_,
+                        current_index_ * kQueriesPerFrame + current_->passes_[pass].end_);
+  }
+}
+
+void GpuTimer::Submitted(uint32_t frame) {
+  if (current_ == nullptr || current_index_ != frame) {
+    return;
+  }
+  current_->submitted_ = Profiler::Clock::now();
+  current_->pending_ = current_->open_.empty() && !current_->passes_.empty();
+  current_ = nullptr;
+}
+
+}  // namespace vulkan_fem
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "profiler.h"
+#include <vulkan/vulkan_core.h>
+#include <cstdint>
+#include <vector>
+
+namespace vulkan_fem {
+
+// Timestamp queries around GPU passes, one query range per frame in flight. A frame's passes are read back
+// once its fence signalled, and placed on the Profiler's timeline relative to when the frame was submitted.
+// Records nothing while profiling is disabled or the queue family has no timestamps.
+class GpuTimer {
+ public:
+  GpuTimer(VkPhysicalDevice physical_device, VkDevice device, uint32_t queue_family, uint32_t frame_count);
+  ~GpuTimer();
+
+  GpuTimer(const GpuTimer &) = delete;
+  GpuTimer &operator=(const GpuTimer &) = delete;
+
+  // the frame's fence signalled: hands its passes to the Profiler
+  void Collect(uint32_t frame);
+  // first command of the frame, resets its queries
+  void BeginFrame(VkCommandBuffer command_buffer, uint32_t frame);
+  // name must be a literal, passes may nest but not interleave
+  void BeginPass(VkCommandBuffer command_buffer, const char *name);
+  void EndPass(VkCommandBuffer command_buffer);
+  void Submitted(uint32_t frame);
+
+ private:
+  static constexpr uint32_t kQueriesPerFrame = 32;
+
+  struct Pass {
+    const char *name_;
+    uint32_t begin_;  // query indices relative to the frame
+    uint32_t end_;
+  };
+
+  struct Frame {
+    std::vector<Pass> passes_;
+    std::vector<uint32_t> open_;  // passes begun and not ended yet
+    uint32_t used_ = 0;
+    bool recording_ = false;
+    bool pending_ = false;
+    Profiler::Clock::time_point submitted_;
+  };
+
+  VkDevice device_;
+  VkQueryPool query_pool_ = VK_NULL_HANDLE;
+  double period_ns_ = 0.0;
+  uint64_t valid_mask_ = 0;
+  std::vector<Frame> frames_;
+  Frame *current_ = nullptr;
+  uint32_t current_index_ = 0;
+};
+
+}  // namespace vulkan_fem
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "fem.h"
+#include "material.h"
+#include "strain_displacement.h"
+#include <Eigen/Dense>
+#include <cmath>
+
+namespace vulkan_fem {
+
+// The 2D models make different out of plane assumptions. Saint Venant-Kirchhoff uses the D of LinearMaterial<2> and
+// so is plane stress like the linear solver, neo-Hookean takes F_zz = 1 and is plane strain. At small strains in 2D
+// neo-Hookean is therefore stiffer than the other two, in 3D all three agree.
+enum class HyperelasticModel {
+  kSaintVenantKirchhoff,  // S = D * E, the linear material applied to the Green strain, plane stress in 2D
+  kNeoHookean,            // compressible, plane strain in 2D
+};
+
+// Second Piola-Kirchhoff stress and material tangent dS/dE for a deformation gradient F = I + H.
+// Both are in Voigt notation, shear strains are engineering strains.
+template <uint32_t DIM = 3>
+class Hyperelastic {
+ public:
+  Hyperelastic(HyperelasticModel type, LinearMaterial<DIM> material)
+      : type_(type),
+        lambda_(static_cast<Precision>(material.GetYoungsModulus() * material.GetPoissonRatio() / (1. + material.GetPoissonRatio()) /
+                                       (1. - 2. * material.GetPoissonRatio()))),
+        mu_(static_cast<Precision>(material.GetYoungsModulus() / 2. / (1. + material.GetPoissonRatio()))),
+        d_matrix_(material.GetStiffnessMatrix()) {}
+
+  [[nodiscard]] HyperelasticModel GetType() const { return type_; }
+
+  // Takes the displacement gradient H = F - I, false when F is inverted, stress and tangent are not touched then.
+  // Evaluated in double: in float, forming C - I, C^-1 and ln J from F cancels most digits of small strains.
+  bool Evaluate(const MatrixDim<DIM> &displacement_gradient, VoigtVector<DIM> &stress, MatrixConstitutive<DIM> *tangent) const {
+    using Matrix = MatrixDim<DIM, double>;
+    const Matrix h = displacement_gradient.template cast<double>();
+    const double jacobian = (Matrix::Identity() + h).determinant();
+    if (jacobian <= 0) {
+      return false;
+    }
+
+    // E = (H + H^T + H^T * H) / 2, without the identity that C = F^T * F carries
+    const Matrix green_strain = (h + h.transpose() + h.transpose() * h) / 2;
+
+    if (type_ == HyperelasticModel::kSaintVenantKirchhoff) {
+      VoigtVector<DIM, double> strain;
+      for (int k = 0; k < kStrainSize<DIM>; ++k) {
+        const auto [i, j] = StrainPattern<DIM>::kVoigt[k];
+        strain[k] = i == j ? green_strain(i, j) : 2 * green_strain(i, j);
+      }
+
+      stress = (d_matrix_.template cast<double>() * strain).template cast<Precision>();
+      if (tangent != nullptr) {
+        *tangent = d_matrix_;
+      }
+      return true;
+    }
+
+    // S = mu * (I - C^-1) + lambda * ln J * C^-1
+    // dS/dE = lambda * C^-1 x C^-1 + (mu - lambda * ln J) * (C^-1_ik * C^-1_jl + C^-1_il * C^-1_jk)
+    const Matrix inverse = (Matrix::Identity() + 2 * green_strain).inverse();
+    const double log_jacobian = std::log1p(jacobian - 1);
+    const double lambda = lambda_;
+    const double mu = mu_;
+    const Matrix tensor_stress = mu * (Matrix::Identity() - inverse) + lambda * log_jacobian * inverse;
+
+    for (int k = 0; k < kStrainSize<DIM>; ++k) {
+      const auto [i, j] = StrainPattern<DIM>::kVoigt[k];
+      stress[k] = static_cast<Precision>(tensor_stress(i, j));
+    }
+
+    if (tangent != nullptr) {
+      const double shear = mu - lambda * log_jacobian;
+      for (int a = 0; a < kStrainSize<DIM>; ++a) {
+        const auto [i, j] = StrainPattern<DIM>::kVoigt[a];
+        for (int b = 0; b < kStrainSize<DIM>; ++b) {
+          const auto [k, l] = StrainPattern<DIM>::kVoigt[b];
+          (*tangent)(a, b) = static_cast<Precision>(lambda * inverse(i, j) * inverse(k, l) +
+                                                    shear * (inverse(i, k) * inverse(j, l) + inverse(i, l) * inverse(j, k)));
+        }
+      }
+    }
+    return true;
+  }
+
+ private:
+  HyperelasticModel type_;
+  Precision lambda_;
+  Precision mu_;
+  MatrixConstitutive<DIM> d_matrix_;
+};
+
+}  // namespace vulkan_fem
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "fem.h"
+#include <cmath>
+#include <cstdint>
+#include <functional>
+
+namespace vulkan_fem {
+
+struct IterativeResult {
+  uint32_t iterations_ = 0;
+  Precision relative_residual_ = 0.;
+  bool converged_ = false;
+};
+
+// called once per iteration with the current state, may throw to abort the iteration
+using IterationMonitor = std::function<void(const IterativeResult &)>;
+
+// Preconditioned conjugate gradient for symmetric positive definite operators.
+// apply(x, y)       - y = A * x
+// precondition(r, z) - z = M^-1 * r
+// x holds the initial guess on entry and the solution on exit.
+template <typename Operator, typename Preconditioner>
+IterativeResult ConjugateGradient(const Operator &apply, const Preconditioner &precondition, const VectorX &b, VectorX &x,
+                                  uint32_t max_iterations, Precision tolerance, const IterationMonitor &monitor = {}) {
+  IterativeResult result;
+
+  const Precision b_norm = b.norm();
+  if (b_norm == 0) {
+    x.setZero(b.size());
+    result.converged_ = true;
+    return result;
+  }
+
+  if (x.size() != b.size()) {
+    x.setZero(b.size());
+  }
+
+  VectorX r(b.size());
+  VectorX z(b.size());
+  VectorX p(b.size());
+  VectorX q(b.size());
+
+  apply(x, q);
+  r = b - q;
+  precondition(r, z);
+  p = z;
+  Precision rz = r.dot(z);
+
+  for (; result.iterations_ < max_iterations; ++result.iterations_) {
+    result.relative_residual_ = r.norm() / b_norm;
+    if (result.relative_residual_ <= tolerance) {
+      result.converged_ = true;
+      return result;
+    }
+    if (monitor) {
+      monitor(result);
+    }
+
+    apply(p, q);
+    const Precision alpha = rz / p.dot(q);
+    x += alpha * p;
+    r -= alpha * q;
+
+    precondition(r, z);
+    const Precision rz_next = r.dot(z);
+    p = z + (rz_next / rz) * p;
+    rz = rz_next;
+  }
+
+  result.relative_residual_ = r.norm() / b_norm;
+  result.converged_ = result.relative_residual_ <= tolerance;
+  return result;
+}
+
+}  // namespace vulkan_fem
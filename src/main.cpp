@@ -1,16 +1,76 @@
-
+#include "batch_render.h"
+#include "compute_validation.h"
+#include "distributed_benchmark.h"
 #include "fem_application.h"
+#include "profiler.h"
+#include "restart_benchmark.h"
 #include <spdlog/sinks/stdout_color_sinks.h>
 #include <spdlog/spdlog.h>
 #include <cstdlib>
+#include <cstring>
 #include <exception>
 #include <iostream>
+#include <thread>
 
-int main(const int /*argc*/, const char ** /*argv[]*/) {
+int main(const int argc, const char **argv) {
   spdlog::info("Start");
 
+  // spans and counters of the whole run, summarized and written as a Chrome trace on exit
+  const vulkan_fem::ProfileSession profile(std::getenv("VULKAN_FEM_PROFILE"));
+
+  // headless check of the compute kernels against Eigen, for CI on lavapipe
+  if (argc > 1 && std::strcmp(argv[1], "--validate-compute") == 0) {
+    return vulkan_fem::ValidateCompute();
+  }
+
+  // headless PNG export of the sample models
+  if (argc > 2 && std::strcmp(argv[1], "--render") == 0) {
+    return vulkan_fem::RenderReports(argv[2]);
+  }
+
+  // scaling of the distributed solver over thread ranks, or over the processes of mpirun in an MPI build
+  if (argc > 1 && std::strcmp(argv[1], "--distributed") == 0) {
+    const auto ranks = argc > 2 ? static_cast<uint32_t>(std::strtoul(argv[2], nullptr, 10)) : std::thread::hardware_concurrency();
+    const auto elements = argc > 3 ? static_cast<uint32_t>(std::strtoul(argv[3], nullptr, 10)) : 48U;
+    return vulkan_fem::RunDistributedBenchmark(ranks, elements);
+  }
+
+  // checkpoint of a transient run and a restart from it, compressed with lz4 or zstd when built with them
+  if (argc > 2 && std::strcmp(argv[1], "--restart") == 0) {
+    vulkan_fem::Compression compression = vulkan_fem::Compression::kNone;
+    if (argc > 3 && std::strcmp(argv[3], "lz4") == 0) {
+      compression = vulkan_fem::Compression::kLz4;
+    } else if (argc > 3 && std::strcmp(argv[3], "zstd") == 0) {
+      compression = vulkan_fem::Compression::kZstd;
+    } else if (argc > 3 && std::strcmp(argv[3], "none") != 0) {
+      std::cerr << "unknown compression " << argv[3] << ", expected none, lz4 or zstd" << std::endl;
+      return EXIT_FAILURE;
+    }
+    const auto elements = argc > 4 ? static_cast<uint32_t>(std::strtoul(argv[4], nullptr, 10)) : 24U;
+    return vulkan_fem::RunRestartBenchmark(argv[2], compression, elements);
+  }
+
   FEMApplication app;
 
+  // direct solves that would not fit fall back to CG
+  if (const char *budget = std::getenv("VULKAN_FEM_MEMORY_BUDGET_MB"); budget != nullptr && *budget != '\0') {
+    app.SetMemoryBudget(static_cast<size_t>(std::strtoull(budget, nullptr, 10)) << 20);
+  }
+
+  // FIFO is vsync, mailbox presents the newest frame without tearing, immediate does not wait at all
+  if (argc > 2 && std::strcmp(argv[1], "--present-mode") == 0) {
+    if (std::strcmp(argv[2], "fifo") == 0) {
+      app.SetPresentMode(VK_PRESENT_MODE_FIFO_KHR);
+    } else if (std::strcmp(argv[2], "mailbox") == 0) {
+      app.SetPresentMode(VK_PRESENT_MODE_MAILBOX_KHR);
+    } else if (std::strcmp(argv[2], "immediate") == 0) {
+      app.SetPresentMode(VK_PRESENT_MODE_IMMEDIATE_KHR);
+    } else {
+      std::cerr << "unknown present mode " << argv[2] << ", expected fifo, mailbox or immediate" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
   try {
     app.Run();
   } catch (const std::exception &e) {
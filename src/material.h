@@ -6,6 +6,16 @@
 namespace vulkan_fem {
 class Material {
  public:
+  Material(double e, double nu, double density) : e_(e), nu_(nu), density_(density) {}
+
+  [[nodiscard]] double GetYoungsModulus() const { return e_; }
+  [[nodiscard]] double GetPoissonRatio() const { return nu_; }
+  [[nodiscard]] double GetDensity() const { return density_; }
+
+ private:
+  double e_;
+  double nu_;
+  double density_;
 };
 
 template <uint32_t DIM>
@@ -14,8 +24,8 @@ class LinearMaterial {};
 template <>
 class LinearMaterial<3> : public Material {
  public:
-  LinearMaterial(double e, double nu) {
-    const auto lambda = static_cast<Precision>(e * nu / (1. + nu) / (1. + 2. * nu));
+  LinearMaterial(double e, double nu, double density = 1.) : Material(e, nu, density) {
+    const auto lambda = static_cast<Precision>(e * nu / (1. + nu) / (1. - 2. * nu));
     const auto mu = static_cast<Precision>(e / 2 / (1. + nu));
 
     const auto c1 = static_cast<Precision>(lambda + 2. * mu);
@@ -24,25 +34,25 @@ class LinearMaterial<3> : public Material {
         .0, .0, .0, .0, .0, mu, .0, .0, .0, .0, .0, .0, mu;
   }
 
-  virtual Eigen::Matrix<Precision, 6, 6> GetStiffnessMatrix() { return stiffnes_matrix_; }
+  virtual MatrixConstitutive<3> GetStiffnessMatrix() { return stiffnes_matrix_; }
 
  private:
-  Eigen::Matrix<Precision, 6, 6> stiffnes_matrix_;
+  MatrixConstitutive<3> stiffnes_matrix_;
 };
 
 template <>
 class LinearMaterial<2> : public Material {
  public:
-  LinearMaterial(double e, double nu) {
+  LinearMaterial(double e, double nu, double density = 1.) : Material(e, nu, density) {
     stiffnes_matrix_ << 1.0, static_cast<Precision>(nu), .0, static_cast<Precision>(nu), 1.0, .0, 0.0, 0.0,
         static_cast<Precision>((1.0 - nu) / 2.);
 
     stiffnes_matrix_ *= static_cast<Precision>(e / (1.0 - pow(nu, 2.)));
   }
 
-  virtual Eigen::Matrix<Precision, 3, 3> GetStiffnessMatrix() { return stiffnes_matrix_; }
+  virtual MatrixConstitutive<2> GetStiffnessMatrix() { return stiffnes_matrix_; }
 
  private:
-  Eigen::Matrix<Precision, 3, 3> stiffnes_matrix_;
+  MatrixConstitutive<2> stiffnes_matrix_;
 };
 }  // namespace vulkan_fem
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "fem.h"
+#include "model.h"
+#include <Eigen/OrderingMethods>
+#include <Eigen/Sparse>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace vulkan_fem {
+
+// Host bytes of the large objects of a static solve, from the connectivity alone before anything is assembled
+struct SolveMemoryEstimate {
+  size_t triplet_bytes_ = 0;  // upper triangle assembly triplets
+  size_t matrix_bytes_ = 0;   // constrained K in upper storage
+  size_t factor_bytes_ = 0;   // its LDLT factor under the AMD ordering SimplicialLDLT uses
+  size_t block_bytes_ = 0;    // K as block sparse rows, assembled without triplets
+  size_t gradient_bytes_ = 0;  // shape function gradients cached by the model, whatever the method
+  size_t matrix_free_bytes_ = 0;  // diagonal and constraint flags of the matrix-free operator, hexahedra only
+
+  // setFromTriplets holds the triplets, a transposed copy and the result at once
+  [[nodiscard]] size_t GetAssemblyBytes() const { return triplet_bytes_ + 2 * matrix_bytes_; }
+};
+
+// Node adjacency gives the nonzeros of K. The factor fill comes from a symbolic LDLT of the node graph,
+// one node block standing for DIM x DIM scalars, which is what the scalar factorization of interleaved
+// dofs comes close to.
+template <uint32_t DIM>
+SolveMemoryEstimate EstimateSolveMemory(const Model<DIM> &model) {
+  const auto &indices = model.GetIndices();
+  const uint32_t node_count = static_cast<uint32_t>(model.GetVertices().size());
+  const uint32_t element_nodes = model.GetElementType()->GetElementCount();
+  const size_t element_count = indices.size() / element_nodes;
+
+  std::vector<std::vector<uint32_t>> adjacency(node_count);
+  for (size_t index = 0; index + element_nodes <= indices.size(); index += element_nodes) {
+    for (uint32_t i = 0; i < element_nodes; ++i) {
+      for (uint32_t j = 0; j < element_nodes; ++j) {
+        adjacency[indices[index + i]].push_back(indices[index + j]);
+      }
+    }
+  }
+
+  // full symmetric node pattern, column major as the orderings expect
+  using NodePattern = Eigen::SparseMatrix<Precision, Eigen::ColMajor, int>;
+  NodePattern pattern(node_count, node_count);
+  Eigen::VectorXi column_sizes(node_count);
+  for (uint32_t node = 0; node < node_count; ++node) {
+    auto &column = adjacency[node];
+    std::sort(column.begin(), column.end());
+    column.erase(std::unique(column.begin(), column.end()), column.end());
+    column_sizes[node] = static_cast<int>(column.size());
+  }
+  pattern.reserve(column_sizes);
+  for (uint32_t node = 0; node < node_count; ++node) {
+    for (const uint32_t row : adjacency[node]) {
+      pattern.insert(static_cast<Eigen::Index>(row), node) = 1;
+    }
+    std::vector<uint32_t>().swap(adjacency[node]);
+  }
+  pattern.makeCompressed();
+  const size_t node_pairs = static_cast<size_t>(pattern.nonZeros());
+
+  Eigen::PermutationMatrix<Eigen::Dynamic, Eigen::Dynamic, int> inverse_permutation;
+  Eigen::AMDOrdering<int>()(pattern, inverse_permutation);
+  NodePattern permuted;
+  permuted = pattern.twistedBy(inverse_permutation.inverse());
+
+  // column counts of L from the elimination tree, without forming L (ldl_symbolic)
+  std::vector<int> parent(node_count, -1);
+  std::vector<int> flag(node_count, -1);
+  size_t factor_node_pairs = 0;
+  for (int k = 0; k < static_cast<int>(node_count); ++k) {
+    flag[k] = k;
+    for (NodePattern::InnerIterator it(permuted, k); it; ++it) {
+      for (int i = static_cast<int>(it.row()); i < k && flag[i] != k; i = parent[i]) {
+        if (parent[i] == -1) {
+          parent[i] = k;
+        }
+        ++factor_node_pairs;
+        flag[i] = k;
+      }
+    }
+  }
+
+  constexpr size_t kEntryBytes = sizeof(Precision) + sizeof(int);
+  const size_t dofs = size_t{node_count} * DIM;
+
+  SolveMemoryEstimate estimate;
+  const size_t upper_triplets = element_count * (element_nodes * DIM * (DIM + 1) / 2 + element_nodes * (element_nodes - 1) / 2 * DIM * DIM);
+  estimate.triplet_bytes_ = upper_triplets * sizeof(Eigen::Triplet<Precision>);
+  estimate.matrix_bytes_ = (node_pairs * DIM * DIM + dofs) / 2 * kEntryBytes + (dofs + 1) * sizeof(int);
+  const size_t factor_entries = factor_node_pairs * DIM * DIM + size_t{node_count} * DIM * (DIM - 1) / 2;
+  estimate.factor_bytes_ = factor_entries * kEntryBytes + (dofs + 1) * sizeof(int) + dofs * (sizeof(Precision) + 2 * sizeof(int));
+  const size_t point_count = model.GetElementType()->GetIntegrationPoints().size();
+  estimate.gradient_bytes_ = element_count * point_count * (DIM * element_nodes + 1) * sizeof(Precision);
+  estimate.matrix_free_bytes_ = dofs * (sizeof(Precision) + sizeof(uint8_t));
+  estimate.block_bytes_ = node_pairs * (DIM * DIM * sizeof(Precision) + sizeof(uint32_t)) + (size_t{node_count} + 1) * sizeof(uint32_t);
+  return estimate;
+}
+
+}  // namespace vulkan_fem
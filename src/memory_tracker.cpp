@@ -0,0 +1,30 @@
+#include "memory_tracker.h"
+#include <algorithm>
+
+namespace vulkan_fem {
+namespace {
+
+void RaisePeak(std::atomic<size_t> &peak, size_t bytes) {
+  size_t seen = peak.load(std::memory_order_relaxed);
+  while (bytes > seen && !peak.compare_exchange_weak(seen, bytes, std::memory_order_relaxed)) {
+  }
+}
+
+}  // namespace
+
+std::atomic<size_t> MemoryTracker::current_{0};
+std::atomic<size_t> MemoryTracker::peak_{0};
+
+void MemoryTracker::Allocate(size_t bytes) { RaisePeak(peak_, current_.fetch_add(bytes, std::memory_order_relaxed) + bytes); }
+
+void MemoryTracker::Release(size_t bytes) { current_.fetch_sub(bytes, std::memory_order_relaxed); }
+
+size_t MemoryTracker::BeginPhase() { return peak_.exchange(current_.load(std::memory_order_relaxed), std::memory_order_relaxed); }
+
+size_t MemoryTracker::EndPhase(size_t outer_peak) {
+  const size_t phase_peak = peak_.load(std::memory_order_relaxed);
+  RaisePeak(peak_, std::max(outer_peak, phase_peak));
+  return phase_peak;
+}
+
+}  // namespace vulkan_fem
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace vulkan_fem {
+
+// Host bytes held by what the solvers build in bulk: assembly triplets, sparse and block matrices, factors and
+// the gradient cache. Containers count through TrackingAllocator, Eigen matrices through TrackedBytes. Eigen's
+// internal temporaries, e.g. the transposed copy in setFromTriplets, are not seen.
+class MemoryTracker {
+ public:
+  static void Allocate(size_t bytes);
+  static void Release(size_t bytes);
+
+  [[nodiscard]] static size_t GetCurrentBytes() { return current_.load(std::memory_order_relaxed); }
+  [[nodiscard]] static size_t GetPeakBytes() { return peak_.load(std::memory_order_relaxed); }
+
+  // Restarts the peak from the current bytes for a phase, returns the peak so far for EndPhase.
+  // Phases nest, concurrent phases on other threads see each other's bytes.
+  static size_t BeginPhase();
+  // peak bytes of the phase, the enclosing peak continues from the larger of both
+  static size_t EndPhase(size_t outer_peak);
+
+ private:
+  static std::atomic<size_t> current_;
+  static std::atomic<size_t> peak_;
+};
+
+// std::allocator_traits compatible allocator counting into the MemoryTracker
+template <typename T, typename Base = std::allocator<T>>
+class TrackingAllocator : public Base {
+ public:
+  using value_type = T;
+
+  template <typename U>
+  struct rebind {
+    using other = TrackingAllocator<U, typename std::allocator_traits<Base>::template rebind_alloc<U>>;
+  };
+
+  TrackingAllocator() = default;
+  template <typename U, typename B>
+  TrackingAllocator(const TrackingAllocator<U, B> &other) : Base(other) {}  // NOLINT(google-explicit-constructor)
+
+  T *allocate(size_t n) {
+    T *p = std::allocator_traits<Base>::allocate(*this, n);
+    MemoryTracker::Allocate(n * sizeof(T));
+    return p;
+  }
+
+  void deallocate(T *p, size_t n) {
+    MemoryTracker::Release(n * sizeof(T));
+    std::allocator_traits<Base>::deallocate(*this, p, n);
+  }
+
+  template <typename U, typename B>
+  bool operator==(const TrackingAllocator<U, B> & /*other*/) const {
+    return true;
+  }
+  template <typename U, typename B>
+  bool operator!=(const TrackingAllocator<U, B> & /*other*/) const {
+    return false;
+  }
+};
+
+template <typename T>
+using TrackedVector = std::vector<T, TrackingAllocator<T>>;
+
+// Bytes of an object that allocates on its own, accounted until changed or destroyed
+class TrackedBytes {
+ public:
+  TrackedBytes() = default;
+  ~TrackedBytes() { Set(0); }
+
+  TrackedBytes(const TrackedBytes &other) { Set(other.bytes_); }
+  TrackedBytes &operator=(const TrackedBytes &other) {
+    Set(other.bytes_);
+    return *this;
+  }
+
+  void Set(size_t bytes) {
+    if (bytes > bytes_) {
+      MemoryTracker::Allocate(bytes - bytes_);
+    } else {
+      MemoryTracker::Release(bytes_ - bytes);
+    }
+    bytes_ = bytes;
+  }
+
+  [[nodiscard]] size_t Get() const { return bytes_; }
+
+ private:
+  size_t bytes_ = 0;
+};
+
+// values, inner indices and outer starts of a compressed Eigen::SparseMatrix
+template <typename Matrix>
+size_t GetSparseBytes(const Matrix &matrix) {
+  using Scalar = typename Matrix::Scalar;
+  using Index = typename Matrix::StorageIndex;
+  return static_cast<size_t>(matrix.nonZeros()) * (sizeof(Scalar) + sizeof(Index)) + static_cast<size_t>(matrix.outerSize() + 1) * sizeof(Index);
+}
+
+// L, D and the fill reducing permutations of a simplicial factorization
+template <typename Factorization>
+size_t GetFactorBytes(const Factorization &factorization) {
+  using Scalar = typename Factorization::Scalar;
+  using Index = typename Factorization::StorageIndex;
+  const auto size = static_cast<size_t>(factorization.rows());
+  return GetSparseBytes(factorization.matrixL().nestedExpression()) + size * (sizeof(Scalar) + 2 * sizeof(Index));
+}
+
+}  // namespace vulkan_fem
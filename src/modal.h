@@ -0,0 +1,210 @@
+#pragma once
+
+#include "fem.h"
+#include "model.h"
+#include "solver.h"
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+
+namespace vulkan_fem {
+
+struct ModalOptions {
+  uint32_t mode_count_ = 6;
+  // number of vectors advanced together, the inverse operator is applied to the whole block at once
+  uint32_t block_size_ = 4;
+  uint32_t max_blocks_ = 64;
+  Precision tolerance_ = 1e-4;
+  // eigenvalues closest to the shift are found first, 0 reuses the cached factorization of K
+  Precision shift_ = 0.;
+  MassType mass_type_ = MassType::kConsistent;
+};
+
+struct ModalResult {
+  VectorX eigenvalues_;          // omega^2, ascending
+  VectorX frequencies_;          // natural frequencies in Hz
+  Eigen::MatrixXf mode_shapes_;  // one M-normalized column per mode
+  uint32_t blocks_ = 0;          // Lanczos blocks used
+  bool converged_ = false;
+};
+
+// Lowest natural frequencies of K * phi = omega^2 * M * phi.
+// Shift-invert block Lanczos with full M-orthogonal reorthogonalization: every step applies
+// (K - shift * M)^-1 * M to a block of vectors, and Ritz pairs are extracted by Rayleigh-Ritz.
+template <uint32_t DIM = 3>
+class ModalAnalysis {
+ public:
+  using ElementMatrix = typename Model<DIM>::ElementMatrix;
+
+  ModalAnalysis() = default;
+  explicit ModalAnalysis(ModalOptions options) : options_(options) {}
+
+  ModalResult Solve(Model<DIM> &model, Solver<DIM> &solver) {
+    const ElementMatrix mass = BuildMass(model);
+    const auto n = static_cast<Eigen::Index>(mass.rows());
+
+    // constrained dofs carry no mass and stay out of the Krylov space
+    VectorX free = VectorX::Ones(n);
+    for (const auto dof : model.GetConstrainedDofs()) {
+      free[dof] = 0.;
+    }
+    const auto free_count = static_cast<Eigen::Index>(free.sum());
+    const auto mode_count = std::min<Eigen::Index>(options_.mode_count_, free_count);
+    const auto block_size = std::min<Eigen::Index>(std::max<uint32_t>(options_.block_size_, 1), free_count);
+    const auto capacity = std::min<Eigen::Index>(free_count, static_cast<Eigen::Index>(options_.max_blocks_) * block_size);
+
+    if (mode_count == 0) {
+      throw std::runtime_error("model has no free dofs");
+    }
+
+    // (K - shift * M)^-1
+    std::unique_ptr<typename Solver<DIM>::Factorization> shifted;
+    if (options_.shift_ != 0) {
+      ElementMatrix shifted_stiffness = solver.AssembleStiffness(model) - options_.shift_ * mass;
+      shifted = std::make_unique<typename Solver<DIM>::Factorization>(shifted_stiffness);
+      if (shifted->info() != Eigen::Success) {
+        throw std::runtime_error("factorization of the shifted stiffness matrix failed");
+      }
+    }
+    const auto &factorization = shifted ? *shifted : solver.Factorize(model);
+
+    Eigen::MatrixXf basis(n, capacity);           // Q, M-orthonormal
+    Eigen::MatrixXf mass_basis(n, capacity);      // M * Q
+    Eigen::MatrixXf operator_basis(n, capacity);  // (K - shift * M)^-1 * M * Q
+    Eigen::Index size = 0;
+
+    Eigen::MatrixXf block = Eigen::MatrixXf::Random(n, block_size);
+    block = free.asDiagonal() * block;
+
+    ModalResult result;
+    Eigen::SelfAdjointEigenSolver<Eigen::MatrixXf> ritz;
+    while (size < capacity) {
+      const Eigen::Index added = Orthonormalize(mass, basis.leftCols(size), mass_basis.leftCols(size), block);
+      if (added == 0) {
+        break;  // invariant subspace found
+      }
+
+      const Eigen::Index width = std::min(added, capacity - size);
+      basis.middleCols(size, width) = block.leftCols(width);
+      mass_basis.middleCols(size, width) = mass.template selfadjointView<Eigen::Upper>() * block.leftCols(width);
+      operator_basis.middleCols(size, width) = factorization.solve(mass_basis.middleCols(size, width));
+      block = operator_basis.middleCols(size, width);
+      size += width;
+      ++result.blocks_;
+
+      if (size < std::min<Eigen::Index>(2 * mode_count, capacity) && size < capacity) {
+        continue;
+      }
+
+      // Rayleigh-Ritz, H = Q^T * M * (K - shift * M)^-1 * M * Q
+      const Eigen::MatrixXf projected = mass_basis.leftCols(size).transpose() * operator_basis.leftCols(size);
+      ritz.compute((projected + projected.transpose()) / 2);
+
+      result.converged_ = true;
+      const std::vector<Eigen::Index> columns = SortByMagnitude(ritz.eigenvalues());
+      for (Eigen::Index k = 0; k < mode_count; ++k) {
+        const Eigen::Index column = columns[k];
+        const Precision theta = ritz.eigenvalues()[column];
+        const VectorX residual =
+            operator_basis.leftCols(size) * ritz.eigenvectors().col(column) - theta * basis.leftCols(size) * ritz.eigenvectors().col(column);
+        if (residual.norm() > options_.tolerance_ * std::abs(theta)) {
+          result.converged_ = false;
+          break;
+        }
+      }
+
+      if (result.converged_) {
+        break;
+      }
+    }
+
+    if (size == 0) {
+      throw std::runtime_error("modal analysis failed to build a Krylov basis");
+    }
+
+    const Eigen::MatrixXf projected = mass_basis.leftCols(size).transpose() * operator_basis.leftCols(size);
+    ritz.compute((projected + projected.transpose()) / 2);
+
+    const Eigen::Index found = std::min(mode_count, size);
+    const std::vector<Eigen::Index> columns = SortByMagnitude(ritz.eigenvalues());
+    result.eigenvalues_.resize(found);
+    result.mode_shapes_.resize(n, found);
+    for (Eigen::Index k = 0; k < found; ++k) {
+      const Eigen::Index column = columns[k];
+      result.eigenvalues_[k] = options_.shift_ + 1 / ritz.eigenvalues()[column];
+      result.mode_shapes_.col(k) = basis.leftCols(size) * ritz.eigenvectors().col(column);
+    }
+
+    // the Ritz values closest to the shift are not necessarily ascending when shift > 0
+    std::vector<Eigen::Index> order(found);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](auto a, auto b) { return result.eigenvalues_[a] < result.eigenvalues_[b]; });
+
+    ModalResult sorted = result;
+    for (Eigen::Index k = 0; k < found; ++k) {
+      sorted.eigenvalues_[k] = result.eigenvalues_[order[k]];
+      sorted.mode_shapes_.col(k) = result.mode_shapes_.col(order[k]);
+    }
+
+    sorted.frequencies_ = sorted.eigenvalues_.cwiseMax(0).cwiseSqrt() / static_cast<Precision>(2. * M_PI);
+    return sorted;
+  }
+
+ private:
+  // Ritz columns by decreasing |theta|. theta = 1 / (lambda - shift) is negative for eigenvalues below the shift,
+  // the largest magnitude on either side is the eigenvalue closest to the shift.
+  static std::vector<Eigen::Index> SortByMagnitude(const VectorX &theta) {
+    std::vector<Eigen::Index> columns(static_cast<size_t>(theta.size()));
+    std::iota(columns.begin(), columns.end(), 0);
+    std::sort(columns.begin(), columns.end(), [&](auto a, auto b) { return std::abs(theta[a]) > std::abs(theta[b]); });
+    return columns;
+  }
+
+  ElementMatrix BuildMass(Model<DIM> &model) {
+    ElementMatrix mass = model.BuildGlobalMassMatrix(StiffnessStorage::kUpper, options_.mass_type_);
+    model.ApplyConstraints(mass, 0.0F);
+    mass.makeCompressed();
+    return mass;
+  }
+
+  // M-orthonormalizes block against the current basis and itself, dropping dependent columns.
+  // Returns the number of columns kept, they are moved to the front of block.
+  static Eigen::Index Orthonormalize(const ElementMatrix &mass, const Eigen::Ref<const Eigen::MatrixXf> &basis,
+                                     const Eigen::Ref<const Eigen::MatrixXf> &mass_basis, Eigen::MatrixXf &block) {
+    // two passes of block classical Gram-Schmidt against the basis
+    for (int pass = 0; pass < 2 && basis.cols() > 0; ++pass) {
+      block -= basis * (mass_basis.transpose() * block);
+    }
+
+    Eigen::Index kept = 0;
+    for (Eigen::Index c = 0; c < block.cols(); ++c) {
+      VectorX v = block.col(c);
+      const Precision initial_norm = std::sqrt(std::max<Precision>(v.dot(mass.template selfadjointView<Eigen::Upper>() * v), 0));
+
+      for (int pass = 0; pass < 2; ++pass) {
+        for (Eigen::Index k = 0; k < kept; ++k) {
+          v -= block.col(k) * block.col(k).dot(mass.template selfadjointView<Eigen::Upper>() * v);
+        }
+      }
+
+      const Precision norm = std::sqrt(std::max<Precision>(v.dot(mass.template selfadjointView<Eigen::Upper>() * v), 0));
+      if (initial_norm == 0 || norm <= 1e-4F * initial_norm) {
+        continue;
+      }
+
+      block.col(kept++) = v / norm;
+    }
+
+    block.conservativeResize(Eigen::NoChange, kept);
+    return kept;
+  }
+
+  ModalOptions options_;
+};
+
+}  // namespace vulkan_fem
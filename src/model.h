@@ -1,12 +1,22 @@
 #pragma once
 
+#include "archive.h"
+#include "block_sparse.h"
+#include "element_gradients.h"
 #include "elements.h"
 #include "enumerate.h"
 #include "fem.h"
 #include "material.h"
+#include "memory_tracker.h"
+#include "profiler.h"
+#include "reference_element.h"
 #include "spdlog/fmt/ostr.h"
+#include "strain_displacement.h"
 #include <spdlog/spdlog.h>
+#include <algorithm>
+#include <atomic>
 #include <iostream>
+#include <memory>
 #include <stdexcept>
 #include <utility>
 #include <vector>
@@ -34,6 +44,17 @@ struct DimentionHelper;
 template <>
 struct DimentionHelper<2> {};
 
+// how the symmetric global stiffness matrix is stored
+enum class StiffnessStorage {
+  kFull,   // every (i, j) entry
+  kUpper,  // only i <= j, to be used through selfadjointView<Eigen::Upper>()
+};
+
+enum class MassType {
+  kConsistent,  // integral of rho * N^T * N
+  kLumped,      // diagonal, HRZ scaling of the consistent diagonal
+};
+
 template <uint32_t DIM = 3>
 class Model {
  public:
@@ -41,13 +62,16 @@ class Model {
   using Loads = Eigen::Matrix<Precision, 1, Eigen::Dynamic>;
 
   Model(std::shared_ptr<Element<DIM>> element_type, std::vector<Vertex3> vertices, std::vector<uint16_t> indices,
-        std::vector<Constraint> constraints, const std::vector<Load<DIM>> &loads, double e, double mu)
+        std::vector<Constraint> constraints, const std::vector<Load<DIM>> &loads, double e, double mu, double density = 1.)
       : element_type_(std::move(element_type)),
-        material_(e, mu),
+        reference_element_(std::make_shared<const ReferenceElement<DIM>>(*element_type_)),
+        material_(e, mu, density),
         elements_(std::move(vertices)),
         element_indices_(std::move(indices)),
         constraints_(std::move(constraints)),
-        loads_(BuildLoadsVector(loads)) {}
+        loads_(BuildLoadsVector(loads)),
+        revision_(NextRevision()),
+        topology_(NextRevision()) {}
 
   [[nodiscard]] const std::vector<Vertex3> &GetVertices() const { return elements_; }
 
@@ -57,7 +81,15 @@ class Model {
 
   [[nodiscard]] std::shared_ptr<Element<DIM>> GetElementType() const { return element_type_; }
 
+  [[nodiscard]] const LinearMaterial<DIM> &GetMaterial() const { return material_; }
+
+  // changes whenever the geometry changes and is unique across models, cached matrices of another revision are stale
+  [[nodiscard]] uint64_t GetRevision() const { return revision_; }
+  // identifies the element connectivity, shared by copies and kept when vertices move
+  [[nodiscard]] uint64_t GetTopology() const { return topology_; }
+
   void AccountDisplacements(const Eigen::VectorXf &displacements) {
+    const ScopedTimer timer("update displacements", "model");
     if (displacements.size() / DIM != elements_.size()) {
       throw std::runtime_error("displacements.size() / DIM != elements_.size()");
     }
@@ -81,71 +113,131 @@ class Model {
       }
       ++current;
     }
+
+    revision_ = NextRevision();
   }
 
-  ElementMatrix BuildGlobalStiffnessMatrix() {
+  ElementMatrix BuildGlobalStiffnessMatrix(StiffnessStorage storage = StiffnessStorage::kFull) {
+    const ScopedTimer timer("assemble stiffness", "model");
     const uint32_t element_count = element_type_->GetElementCount();
     const uint32_t number_of_elements = element_indices_.size() / element_count;
-
-    // const uint32_t order = element_type_->GetOrder();
+    const bool upper_only = storage == StiffnessStorage::kUpper;
 
     using T = Eigen::Triplet<Precision>;
-    std::vector<T> triplets;
-    triplets.reserve(element_count * element_count * number_of_elements);
-
-    const auto d_matrix = material_.GetStiffnessMatrix();
-    spdlog::info("\\nD: {}", d_matrix);
-
-    MatrixFixedCols<DIM> elem_transform(element_count, DIM);
-    elem_transform.setZero();
-    for (uint32_t index = 0; index < element_indices_.size();) {
-      // put all vertex transforms into matrix
-      for (uint16_t sub_index = 0; sub_index < element_count && index + sub_index < element_indices_.size(); ++sub_index) {
-        const uint16_t sub_element_index = element_indices_[index + sub_index];
-        const Vertex3 &sub_element_vertex = elements_[sub_element_index];
-
-        for (int i = 0; i < DIM; ++i) {
-          elem_transform.row(sub_index)[i] = sub_element_vertex[i];
-        }
+    TrackedVector<T> triplets;
+    triplets.reserve((upper_only ? element_count * (element_count + 1) / 2 : element_count * element_count) * DIM * DIM *
+                     number_of_elements);
+
+    ForEachElementStiffness(upper_only, [&](uint32_t index, const auto &element_stiffness_matrix) {
+      if (upper_only) {
+        ScatterUpper(index, element_stiffness_matrix, triplets);
+        return;
       }
 
-      spdlog::info("\nelem_transform: {}", elem_transform);
-      Eigen::Matrix<Precision, Eigen::Dynamic, Eigen::Dynamic> element_stiffness_matrix;
-      element_stiffness_matrix.setZero(element_count * DIM, element_count * DIM);
-      for (const auto &[elem_matrix, w, J_det] : CalcElementMatrix(element_type_, elem_transform)) {
-        const auto b_matrix = element_type_->MakeStrainMatrix(element_count, elem_matrix);
-        spdlog::info("\nB: {}", b_matrix);
-
-        element_stiffness_matrix += b_matrix.transpose() * d_matrix * b_matrix * J_det * w;
-      }
-
-      spdlog::info("\\nK: {}", element_stiffness_matrix);
-
       for (uint32_t i = 0; i < element_count; ++i) {
         for (uint32_t j = 0; j < element_count; ++j) {
           const uint16_t global_index_i = element_indices_[index + i];
           const uint16_t global_index_j = element_indices_[index + j];
 
-          // x coords
-          triplets.emplace_back(DIM * global_index_i + 0, DIM * global_index_j + 0, element_stiffness_matrix(DIM * i + 0, DIM * j + 0));
-          triplets.emplace_back(DIM * global_index_i + 0, DIM * global_index_j + 1, element_stiffness_matrix(DIM * i + 0, DIM * j + 1));
-
-          // y coords
-          triplets.emplace_back(DIM * global_index_i + 1, 2 * global_index_j + 0, element_stiffness_matrix(DIM * i + 1, DIM * j + 0));
-          triplets.emplace_back(DIM * global_index_i + 1, 2 * global_index_j + 1, element_stiffness_matrix(DIM * i + 1, DIM * j + 1));
+          // DIM x DIM block coupling node i and node j
+          for (uint32_t di = 0; di < DIM; ++di) {
+            for (uint32_t dj = 0; dj < DIM; ++dj) {
+              triplets.emplace_back(DIM * global_index_i + di, DIM * global_index_j + dj,
+                                    element_stiffness_matrix(DIM * i + di, DIM * j + dj));
+            }
+          }
         }
       }
-
-      index += element_count;
-    }
+    });
 
     ElementMatrix global_stiffness_matrix(elements_.size() * DIM, elements_.size() * DIM);
     global_stiffness_matrix.setZero();
     global_stiffness_matrix.setFromTriplets(triplets.begin(), triplets.end());
+    ProfileCount("assembled elements", number_of_elements);
+    ProfileCount("stiffness nonzeros", static_cast<double>(global_stiffness_matrix.nonZeros()));
     return global_stiffness_matrix;
   }
 
-  void ApplyConstraints(ElementMatrix &global_stiffnes_matrix) {
+  // assembles straight into per-node DIM x DIM blocks, no triplets
+  BlockSparseMatrix<DIM> BuildGlobalStiffnessBlockMatrix() {
+    const ScopedTimer timer("assemble block stiffness", "model");
+    const uint32_t element_count = element_type_->GetElementCount();
+    BlockSparseMatrix<DIM> global_stiffness_matrix(elements_.size(), element_indices_, element_count);
+
+    ForEachElementStiffness(false, [&](uint32_t index, const auto &element_stiffness_matrix) {
+      for (uint32_t i = 0; i < element_count; ++i) {
+        for (uint32_t j = 0; j < element_count; ++j) {
+          global_stiffness_matrix.AddBlock(element_indices_[index + i], element_indices_[index + j],
+                                           element_stiffness_matrix.template block<DIM, DIM>(DIM * i, DIM * j));
+        }
+      }
+    });
+
+    ProfileCount("assembled elements", static_cast<double>(element_indices_.size() / element_count));
+    return global_stiffness_matrix;
+  }
+
+  // consistent mass matrix, the same scalar element mass is used for every displacement component,
+  // or the lumped one as a diagonal sparse matrix
+  ElementMatrix BuildGlobalMassMatrix(StiffnessStorage storage = StiffnessStorage::kFull, MassType type = MassType::kConsistent) {
+    const ScopedTimer timer("assemble mass", "model");
+    if (type == MassType::kLumped) {
+      const VectorX lumped_mass = BuildLumpedMassVector();
+      ElementMatrix global_mass_matrix(lumped_mass.size(), lumped_mass.size());
+      global_mass_matrix.reserve(Eigen::VectorXi::Ones(lumped_mass.size()));
+      for (Eigen::Index i = 0; i < lumped_mass.size(); ++i) {
+        global_mass_matrix.insert(i, i) = lumped_mass[i];
+      }
+      global_mass_matrix.makeCompressed();
+      return global_mass_matrix;
+    }
+
+    const uint32_t element_count = element_type_->GetElementCount();
+    const bool upper_only = storage == StiffnessStorage::kUpper;
+
+    TrackedVector<Eigen::Triplet<Precision>> triplets;
+    triplets.reserve(element_count * element_count * DIM * (element_indices_.size() / element_count));
+
+    ForEachElementMass([&](uint32_t index, const auto &element_mass_matrix) {
+      for (uint32_t i = 0; i < element_count; ++i) {
+        for (uint32_t j = 0; j < element_count; ++j) {
+          const uint32_t global_index_i = element_indices_[index + i];
+          const uint32_t global_index_j = element_indices_[index + j];
+          if (upper_only && global_index_i > global_index_j) {
+            continue;
+          }
+
+          for (uint32_t d = 0; d < DIM; ++d) {
+            triplets.emplace_back(DIM * global_index_i + d, DIM * global_index_j + d, element_mass_matrix(i, j));
+          }
+        }
+      }
+    });
+
+    ElementMatrix global_mass_matrix(elements_.size() * DIM, elements_.size() * DIM);
+    global_mass_matrix.setFromTriplets(triplets.begin(), triplets.end());
+    return global_mass_matrix;
+  }
+
+  // diagonal of the lumped mass matrix. The consistent diagonal is scaled to preserve the element mass (HRZ),
+  // which keeps all entries positive for quadratic elements too.
+  VectorX BuildLumpedMassVector() {
+    const uint32_t element_count = element_type_->GetElementCount();
+
+    VectorX lumped_mass = VectorX::Zero(elements_.size() * DIM);
+    ForEachElementMass([&](uint32_t index, const auto &element_mass_matrix) {
+      const Precision scale = element_mass_matrix.sum() / element_mass_matrix.diagonal().sum();
+      for (uint32_t i = 0; i < element_count; ++i) {
+        const uint32_t global_index = element_indices_[index + i];
+        lumped_mass.template segment<DIM>(DIM * global_index).array() += element_mass_matrix(i, i) * scale;
+      }
+    });
+
+    return lumped_mass;
+  }
+
+  // global indices of all dofs fixed by constraints
+  [[nodiscard]] std::vector<int> GetConstrainedDofs() const {
     std::vector<int> indices_to_constraint;
 
     for (const auto contraint : constraints_) {
@@ -167,18 +259,157 @@ class Model {
       }
     }
 
+    return indices_to_constraint;
+  }
+
+  // zero rows and columns of constrained dofs, diagonal is 1 for stiffness and 0 for mass matrices
+  void ApplyConstraints(ElementMatrix &global_stiffnes_matrix, Precision diagonal = 1.0F) {
+    const ScopedTimer timer("apply constraints", "model");
+    const std::vector<int> indices_to_constraint = GetConstrainedDofs();
+
     for (int k = 0; k < global_stiffnes_matrix.outerSize(); ++k) {
       for (ElementMatrix::InnerIterator it(global_stiffnes_matrix, k); it; ++it) {
         for (auto index : indices_to_constraint) {
           if (it.row() == index || it.col() == index) {
-            it.valueRef() = it.row() == it.col() ? 1.0F : 0.0F;
+            it.valueRef() = it.row() == it.col() ? diagonal : 0.0F;
+          }
+        }
+      }
+    }
+  }
+
+  void ApplyConstraints(BlockSparseMatrix<DIM> &global_stiffnes_matrix) {
+    const ScopedTimer timer("apply constraints", "model");
+    global_stiffnes_matrix.ApplyConstraints(GetConstrainedDofs());
+  }
+
+  // scatter element node blocks (i, j), i <= j into the upper triangle of the global matrix,
+  // blocks that land below the diagonal are stored transposed
+  template <typename Derived, typename Triplets>
+  void ScatterUpper(uint32_t index, const Eigen::MatrixBase<Derived> &element_stiffness_matrix, Triplets &triplets) const {
+    const uint32_t element_count = element_type_->GetElementCount();
+
+    for (uint32_t j = 0; j < element_count; ++j) {
+      for (uint32_t i = 0; i <= j; ++i) {
+        const uint16_t global_index_i = element_indices_[index + i];
+        const uint16_t global_index_j = element_indices_[index + j];
+
+        for (uint32_t di = 0; di < DIM; ++di) {
+          // diagonal blocks are symmetric themselves
+          for (uint32_t dj = i == j ? di : 0; dj < DIM; ++dj) {
+            const uint32_t row = DIM * global_index_i + di;
+            const uint32_t col = DIM * global_index_j + dj;
+            triplets.emplace_back(std::min(row, col), std::max(row, col), element_stiffness_matrix(DIM * i + di, DIM * j + dj));
           }
         }
       }
     }
   }
 
+  // K_e of one element straight from the geometry, without the gradients cache, for assembling a part of the mesh
+  void CalcElementStiffness(uint32_t element, const MatrixConstitutive<DIM> &d_matrix, MatrixElementStiffness<DIM> &element_stiffness_matrix) const {
+    const ReferenceElement<DIM> &reference = *reference_element_;
+    const uint32_t element_count = reference.node_count_;
+
+    MatrixElementNodes<DIM> elem_transform(element_count, DIM);
+    GatherElementTransform(element * element_count, elem_transform);
+
+    MatrixElementGradient<DIM> gradient(DIM, element_count);
+    element_stiffness_matrix.setZero(element_count * DIM, element_count * DIM);
+    for (uint32_t p = 0; p < reference.point_count_; ++p) {
+      const auto dshape = reference.GetDShape(p);
+      const MatrixDim<DIM> jacobian = dshape.lazyProduct(elem_transform);
+      gradient.noalias() = jacobian.inverse().lazyProduct(dshape);
+      AddStrainStiffness<DIM>(gradient, d_matrix, reference.weights_[p] * jacobian.determinant(), element_stiffness_matrix);
+    }
+  }
+
+  // shape function gradients of the current geometry, shared with the stiffness assembly of the same revision
+  std::shared_ptr<const ElementGradients<DIM>> GetElementGradients() {
+    if (!element_gradients_ || element_gradients_->revision_ != revision_) {
+      element_gradients_ = CalcElementGradients();
+    }
+    return element_gradients_;
+  }
+
+  // current node coordinates and the connectivity they belong to
+  void Save(Archive &archive) const {
+    std::vector<Precision> coordinates;
+    coordinates.reserve(elements_.size() * 3);
+    for (const auto &vertex : elements_) {
+      coordinates.insert(coordinates.end(), vertex.data(), vertex.data() + 3);
+    }
+    archive.PutArray("model.coordinates", coordinates);
+    archive.PutArray("model.indices", element_indices_);
+  }
+
+  // node coordinates of a model saved with the same mesh, cached matrices of the current geometry become stale
+  void Restore(const Archive &archive) {
+    const auto coordinates = archive.GetArray<Precision>("model.coordinates");
+    if (archive.GetArray<uint16_t>("model.indices") != element_indices_ || coordinates.size() != elements_.size() * 3) {
+      throw std::runtime_error("archived model has another mesh");
+    }
+    for (size_t node = 0; node < elements_.size(); ++node) {
+      elements_[node] = Eigen::Map<const Vertex3>(coordinates.data() + 3 * node);
+    }
+    revision_ = NextRevision();
+  }
+
+  // calls f(index, K_e) for every element, index is the offset of its first node in element_indices_.
+  // Allocates nothing once the gradients are cached, see tests/assembly_allocation_test.cpp
+  template <typename F>
+  void ForEachElementStiffness(bool upper_only, F &&f) {
+    const uint32_t element_count = element_type_->GetElementCount();
+
+    const MatrixConstitutive<DIM> d_matrix = material_.GetStiffnessMatrix();
+    spdlog::debug("\\nD: {}", d_matrix);
+
+    const auto gradients = GetElementGradients();
+    MatrixElementStiffness<DIM> element_stiffness_matrix;
+    for (size_t element = 0; element < gradients->GetElementCount(); ++element) {
+      element_stiffness_matrix.setZero(element_count * DIM, element_count * DIM);
+      for (uint32_t p = 0; p < gradients->point_count_; ++p) {
+        const size_t point = element * gradients->point_count_ + p;
+        AddStrainStiffness<DIM>(gradients->GetGradient(point), d_matrix, gradients->GetScale(point), element_stiffness_matrix, upper_only);
+      }
+
+      spdlog::debug("\\nK: {}", element_stiffness_matrix);
+
+      f(static_cast<uint32_t>(element * element_count), element_stiffness_matrix);
+    }
+  }
+
+  // calls f(index, M_e) for every element with the scalar element mass matrix, one row per node
+  template <typename F>
+  void ForEachElementMass(F &&f) {
+    const uint32_t element_count = element_type_->GetElementCount();
+    const auto density = static_cast<Precision>(material_.GetDensity());
+    const ReferenceElement<DIM> &reference = *reference_element_;
+
+    MatrixElementNodes<DIM> elem_transform(element_count, DIM);
+    MatrixElementScalar<> element_mass_matrix;
+    for (uint32_t index = 0; index + element_count <= element_indices_.size(); index += element_count) {
+      GatherElementTransform(index, elem_transform);
+
+      element_mass_matrix.setZero(element_count, element_count);
+      for (uint32_t p = 0; p < reference.point_count_; ++p) {
+        const MatrixDim<DIM> jacobian = reference.GetDShape(p).lazyProduct(elem_transform);
+        const auto n = reference.GetShape(p);
+        const Precision scale = density * jacobian.determinant() * reference.weights_[p];
+
+        element_mass_matrix.noalias() += scale * n.lazyProduct(n.transpose());
+      }
+
+      f(index, element_mass_matrix);
+    }
+  }
+
  private:
+  static uint64_t NextRevision() {
+    static std::atomic<uint64_t> counter{0};
+    return ++counter;
+  }
+
   Loads BuildLoadsVector(const std::vector<Load<DIM>> &loads) {
     Loads load_vector = Loads::Zero(elements_.size() * DIM);
     for (auto load : loads) {
@@ -189,38 +420,52 @@ class Model {
     return load_vector;
   }
 
-  // N matrix
-  // [ Ni 0
-  // [ 0  Ni
-  // [ Ni Ni
-  std::vector<std::tuple<MatrixFixedRows<DIM>, Precision, Precision>> CalcElementMatrix(std::shared_ptr<Element<DIM>> element_type,
-                                                                                        const MatrixFixedCols<DIM> &elem_transform) {
-    std::vector<std::tuple<MatrixFixedRows<DIM>, Precision, Precision>> result;
+  // put all vertex transforms of the element starting at index into matrix
+  void GatherElementTransform(uint32_t index, MatrixElementNodes<DIM> &elem_transform) const {
+    const uint32_t element_count = element_type_->GetElementCount();
+    for (uint16_t sub_index = 0; sub_index < element_count && index + sub_index < element_indices_.size(); ++sub_index) {
+      const uint16_t sub_element_index = element_indices_[index + sub_index];
+      const Vertex3 &sub_element_vertex = elements_[sub_element_index];
 
-    for (const auto &[i, ip] : Enumerate(element_type->GetIntegrationPoints())) {
-      const auto dshape = element_type->CalcDShape(ip);
+      for (int i = 0; i < DIM; ++i) {
+        elem_transform.row(sub_index)[i] = sub_element_vertex[i];
+      }
+    }
+  }
 
-      // build jacobian (d(x, y, z)/d(xi, eta, zeta))
-      const MatrixDim<DIM> jacobian = dshape * elem_transform;
-      const Precision jacobian_det = jacobian.determinant();
-      const MatrixDim<DIM> inverse_jacobian = jacobian.inverse();
+  // dN/dx = J^-1 * dN/dxi and w * det J at every integration point of every element,
+  // written in place into storage sized once for the whole model
+  std::shared_ptr<ElementGradients<DIM>> CalcElementGradients() const {
+    const ReferenceElement<DIM> &reference = *reference_element_;
+    const uint32_t element_count = reference.node_count_;
 
-      // element matrix
-      const auto element_matrix = inverse_jacobian * dshape;
+    auto gradients = std::make_shared<ElementGradients<DIM>>();
+    gradients->revision_ = revision_;
+    gradients->Resize(element_indices_.size() / element_count, element_count, reference.point_count_);
 
-      spdlog::info("\\ndshape: {}", dshape);
-      spdlog::info("\\nJac: {}", jacobian);
-      spdlog::info("\\nJDet: {}", jacobian_det);
-      spdlog::info("\\nInvJ: {}", inverse_jacobian);
-      spdlog::info("\\nE: {}", element_matrix);
+    MatrixElementNodes<DIM> elem_transform(element_count, DIM);
+    size_t point = 0;
+    for (uint32_t index = 0; index + element_count <= element_indices_.size(); index += element_count) {
+      GatherElementTransform(index, elem_transform);
+      spdlog::debug("\nelem_transform: {}", elem_transform);
 
-      result.push_back(std::make_tuple(element_matrix, element_type->GetIntegrationWeight(i), jacobian_det));
+      for (uint32_t p = 0; p < reference.point_count_; ++p, ++point) {
+        const auto dshape = reference.GetDShape(p);
+
+        // build jacobian (d(x, y, z)/d(xi, eta, zeta))
+        const MatrixDim<DIM> jacobian = dshape.lazyProduct(elem_transform);
+        const MatrixDim<DIM> inverse_jacobian = jacobian.inverse();
+
+        gradients->GetGradient(point).noalias() = inverse_jacobian.lazyProduct(dshape);
+        gradients->scales_[point] = reference.weights_[p] * jacobian.determinant();
+      }
     }
 
-    return result;
+    return gradients;
   }
 
   std::shared_ptr<Element<DIM>> element_type_;
+  std::shared_ptr<const ReferenceElement<DIM>> reference_element_;
 
   LinearMaterial<DIM> material_;
   std::vector<Vertex3> elements_;
@@ -228,6 +473,9 @@ class Model {
   std::vector<ElementTransformations<DIM>> element_transformations_;
   std::vector<Constraint> constraints_;
   Loads loads_;
+  uint64_t revision_;
+  uint64_t topology_;
+  std::shared_ptr<ElementGradients<DIM>> element_gradients_;
 };
 
 }  // namespace vulkan_fem
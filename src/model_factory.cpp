@@ -4,6 +4,8 @@
 #define USE_MATH_DEFINES
 #include "model.h"
 #include <cmath>
+#include <limits>
+#include <string>
 #include <tuple>
 
 namespace vulkan_fem {
@@ -83,6 +85,51 @@ std::shared_ptr<Model<2>> ModelFactory::CreateRectangle2() {
                                     0.3);  // 200GPa, 0.3 Young, Poisson's for steel
 }
 
+std::shared_ptr<Model<3>> ModelFactory::CreateBlock(uint32_t nx, uint32_t ny, uint32_t nz, Precision load) {
+  constexpr Precision kSize = 0.25;
+
+  // node ids are stored as uint16_t
+  const uint64_t node_count = uint64_t{nx + 1} * (ny + 1) * (nz + 1);
+  if (node_count > std::numeric_limits<uint16_t>::max()) {
+    throw std::runtime_error("block of " + std::to_string(node_count) + " nodes exceeds the uint16_t node index range");
+  }
+
+  const auto node = [&](uint32_t i, uint32_t j, uint32_t k) { return static_cast<uint16_t>(i + (nx + 1) * (j + (ny + 1) * k)); };
+
+  std::vector<Vertex3> vertices;
+  vertices.reserve((nx + 1) * (ny + 1) * (nz + 1));
+  for (uint32_t k = 0; k <= nz; ++k) {
+    for (uint32_t j = 0; j <= ny; ++j) {
+      for (uint32_t i = 0; i <= nx; ++i) {
+        vertices.emplace_back(kSize * static_cast<Precision>(i), kSize * static_cast<Precision>(j), kSize * static_cast<Precision>(k));
+      }
+    }
+  }
+
+  std::vector<uint16_t> indices;
+  indices.reserve(8 * nx * ny * nz);
+  for (uint32_t k = 0; k < nz; ++k) {
+    for (uint32_t j = 0; j < ny; ++j) {
+      for (uint32_t i = 0; i < nx; ++i) {
+        for (const auto &[di, dj, dk] : HexahedronElement::GetNodeLattice()) {
+          indices.push_back(node(i + di, j + dj, k + dk));
+        }
+      }
+    }
+  }
+
+  std::vector<Constraint> constraints;
+  for (uint32_t k = 0; k <= nz; ++k) {
+    for (uint32_t j = 0; j <= ny; ++j) {
+      constraints.push_back({node(0, j, k), Constraint::kUxyz});
+    }
+  }
+  std::vector<Load<3>> loads = {{node(nx, ny, nz), {0.0, 0.0, load}}};
+
+  return std::make_shared<Model<3>>(std::make_shared<HexahedronElement>(), vertices, indices, constraints, loads, 0.2e4,
+                                    0.3);  // 200GPa, 0.3 Young, Poisson's for steel
+}
+
 //  std::shared_ptr<Model<3>> ModelFactory::CreateCylinderModel(const precision r,
 // const precision h)
 //{
@@ -17,6 +17,10 @@ class ModelFactory {
   static std::shared_ptr<Model<2>> CreateRectangle();
   static std::shared_ptr<Model<2>> CreateRectangle2();
 
+  // block of nx * ny * nz trilinear hexahedra, fixed at x = 0 and loaded in z at the far top corner.
+  // Throws when the block has more nodes than uint16_t indices can address
+  static std::shared_ptr<Model<3>> CreateBlock(uint32_t nx, uint32_t ny, uint32_t nz, Precision load = -50.);
+
   // static std::shared_ptr<Model<3>> CreateCylinderModel(const precision r,
   // const precision h)
   //{
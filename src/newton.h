@@ -0,0 +1,320 @@
+#pragma once
+
+#include "archive.h"
+#include "fem.h"
+#include "hyperelastic.h"
+#include "memory_tracker.h"
+#include "model.h"
+#include "solver.h"
+#include "strain_displacement.h"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace vulkan_fem {
+
+struct NewtonOptions {
+  HyperelasticModel material_ = HyperelasticModel::kSaintVenantKirchhoff;
+  // the load is applied in equal increments
+  uint32_t load_steps_ = 10;
+  uint32_t max_iterations_ = 30;
+  // |f_ext - f_int| <= tolerance_ * |f_ext| on the free dofs
+  Precision tolerance_ = 1e-5;
+  bool line_search_ = true;
+  // keep the tangent factorization of the first iteration of every load step while the residual keeps dropping fast
+  bool modified_newton_ = false;
+  // interval_ counts converged load steps
+  CheckpointOptions checkpoint_;
+};
+
+struct NewtonResult {
+  bool converged_ = false;  // false when a load step ran out of iterations or inverted an element
+  uint32_t load_steps_ = 0;
+  uint32_t iterations_ = 0;
+  uint32_t factorizations_ = 0;
+  Precision relative_residual_ = 0.;
+  VectorX displacements_;
+
+  // the converged state after load_steps_, what Resume continues from
+  void Save(Archive &archive) const {
+    archive.PutValue("newton.load_steps", load_steps_);
+    archive.PutValue("newton.iterations", iterations_);
+    archive.PutValue("newton.factorizations", factorizations_);
+    archive.PutVector("newton.displacements", displacements_);
+  }
+
+  void Restore(const Archive &archive) {
+    load_steps_ = archive.GetValue<uint32_t>("newton.load_steps");
+    iterations_ = archive.GetValue<uint32_t>("newton.iterations");
+    factorizations_ = archive.GetValue<uint32_t>("newton.factorizations");
+    displacements_ = archive.GetVector("newton.displacements");
+  }
+};
+
+// Total Lagrangian Newton-Raphson for hyperelastic materials.
+// Internal forces and the tangent are integrated over the reference configuration in a single pass over the elements.
+template <uint32_t DIM = 3>
+class NewtonSolver {
+ public:
+  using ElementMatrix = typename Model<DIM>::ElementMatrix;
+  using Factorization = typename Solver<DIM>::Factorization;
+
+  NewtonSolver() = default;
+  explicit NewtonSolver(NewtonOptions options) : options_(options) {}
+
+  // solves for the loads of the model, the converged displacements are added to the vertices
+  NewtonResult Solve(Model<DIM> &model) { return Run(model, NewtonResult{}); }
+
+  // continues from the converged load steps of state, e.g. a checkpoint of the same options and undeformed model
+  NewtonResult Resume(Model<DIM> &model, NewtonResult state) {
+    if (state.displacements_.size() != static_cast<Eigen::Index>(DIM * model.GetVertices().size())) {
+      throw std::runtime_error("Newton state does not match the model");
+    }
+    return Run(model, std::move(state));
+  }
+
+ private:
+  // load steps after the converged ones of result, from zero displacements when it has none
+  NewtonResult Run(Model<DIM> &model, NewtonResult result) {
+    Prepare(model);
+
+    const auto dof_count = static_cast<Eigen::Index>(DIM * model.GetVertices().size());
+    VectorX free = VectorX::Ones(dof_count);
+    for (const auto dof : model.GetConstrainedDofs()) {
+      free[dof] = 0.;
+    }
+    const VectorX loads = model.GetLoads().cwiseProduct(free);
+
+    VectorX &u = result.displacements_;
+    if (u.size() == 0) {
+      u.setZero(dof_count);
+    }
+    result.converged_ = false;
+
+    VectorX internal_forces;
+    VectorX residual;
+    VectorX du;
+    ElementMatrix tangent;
+    Factorization factorization;
+    bool pattern_analyzed = false;
+
+    const uint32_t load_steps = std::max(options_.load_steps_, 1U);
+    for (uint32_t load_step = result.load_steps_ + 1; load_step <= load_steps; ++load_step) {
+      const VectorX external_forces = loads * (static_cast<Precision>(load_step) / load_steps);
+      const Precision reference = std::max(external_forces.norm(), std::numeric_limits<Precision>::min());
+
+      bool converged = false;
+      bool refactorize = true;
+      Precision previous_norm = std::numeric_limits<Precision>::max();
+      for (uint32_t iteration = 0; iteration < options_.max_iterations_; ++iteration) {
+        // forces and, when needed, the tangent of the current state in one element pass
+        if (!Assemble(model, u, internal_forces, refactorize ? &tangent : nullptr)) {
+          // the line search keeps steps admissible, a full step without it can invert an element
+          spdlog::error("Newton-Raphson stopped, element inverted at load step {}, iteration {}", load_step, iteration);
+          return result;
+        }
+
+        residual = (external_forces - internal_forces).cwiseProduct(free);
+        result.relative_residual_ = residual.norm() / reference;
+        spdlog::info("load step {}/{}, iteration {}: relative residual {}", load_step, load_steps, iteration, result.relative_residual_);
+        if (result.relative_residual_ <= options_.tolerance_) {
+          converged = true;
+          break;
+        }
+
+        // modified Newton falls back to a fresh tangent when the old one reduces the residual too slowly
+        if (!refactorize && result.relative_residual_ > kModifiedNewtonRate * previous_norm) {
+          refactorize = true;
+          --iteration;
+          continue;
+        }
+        previous_norm = result.relative_residual_;
+
+        if (refactorize) {
+          model.ApplyConstraints(tangent);
+          if (!pattern_analyzed) {
+            factorization.analyzePattern(tangent);
+            pattern_analyzed = true;
+          }
+          factorization.factorize(tangent);
+          if (factorization.info() != Eigen::Success) {
+            throw std::runtime_error("factorization of the tangent stiffness matrix failed");
+          }
+          ++result.factorizations_;
+          refactorize = !options_.modified_newton_;
+        }
+
+        du = factorization.solve(residual);
+        u += LineSearch(model, u, du, residual, external_forces, free) * du;
+        ++result.iterations_;
+      }
+
+      if (!converged) {
+        spdlog::error("Newton-Raphson did not converge in load step {}", load_step);
+        return result;
+      }
+
+      result.load_steps_ = load_step;
+      if (options_.checkpoint_.IsDue(load_step)) {
+        const ScopedTimer timer("checkpoint", "solver");
+        Archive archive;
+        model.Save(archive);
+        result.Save(archive);
+        options_.checkpoint_.writer_->Submit(options_.checkpoint_.path_, std::move(archive));
+      }
+    }
+
+    result.converged_ = true;
+    model.AccountDisplacements(u);
+    return result;
+  }
+
+  // shape function gradients of the reference configuration
+  void Prepare(Model<DIM> &model) {
+    hyperelastic_ = std::make_unique<Hyperelastic<DIM>>(options_.material_, model.GetMaterial());
+    node_count_ = model.GetElementType()->GetElementCount();
+    gradients_ = model.GetElementGradients();
+  }
+
+  // f_int = sum B^T * S, K_t = sum B^T * C * B + G^T * S * G, both from one evaluation of F per integration point.
+  // tangent is skipped when null. Returns false when an element is inverted.
+  bool Assemble(const Model<DIM> &model, const VectorX &u, VectorX &internal_forces, ElementMatrix *tangent) const {
+    const auto &indices = model.GetIndices();
+    const auto element_dofs = static_cast<Eigen::Index>(DIM * node_count_);
+
+    internal_forces.setZero(u.size());
+    TrackedVector<Eigen::Triplet<Precision>> triplets;
+    if (tangent != nullptr) {
+      triplets.reserve(indices.size() / node_count_ * element_dofs * (element_dofs + DIM) / 2);
+    }
+
+    VectorElement<DIM> element_displacements(element_dofs);
+    VectorElement<DIM> element_forces(element_dofs);
+    MatrixElementStiffness<DIM> element_tangent;
+    MatrixElementStrain<DIM> strain_matrix(kStrainSize<DIM>, element_dofs);
+    MatrixElementStrain<DIM> tangent_strain(kStrainSize<DIM>, element_dofs);
+    VoigtVector<DIM> stress;
+    MatrixConstitutive<DIM> material_tangent;
+
+    for (size_t element = 0; element * node_count_ < indices.size(); ++element) {
+      const uint16_t *nodes = indices.data() + element * node_count_;
+      for (uint32_t a = 0; a < node_count_; ++a) {
+        element_displacements.template segment<DIM>(DIM * a) = u.template segment<DIM>(DIM * nodes[a]);
+      }
+
+      element_forces.setZero();
+      if (tangent != nullptr) {
+        element_tangent.setZero(element_dofs, element_dofs);
+      }
+
+      for (uint32_t p = 0; p < gradients_->point_count_; ++p) {
+        const size_t point = element * gradients_->point_count_ + p;
+        const auto dshape = gradients_->GetGradient(point);
+
+        // H = sum u_a x dN_a/dX, F = I + H. The material takes H, small strains do not survive the identity in float
+        const MatrixDim<DIM> displacement_gradient =
+            Eigen::Map<const MatrixFixedRows<DIM>>(element_displacements.data(), DIM, node_count_).lazyProduct(dshape.transpose());
+        const MatrixDim<DIM> deformation_gradient = MatrixDim<DIM>::Identity() + displacement_gradient;
+
+        if (!hyperelastic_->Evaluate(displacement_gradient, stress, tangent != nullptr ? &material_tangent : nullptr)) {
+          return false;
+        }
+
+        // B_a, the variation of the Green strain: dE_ij = (F_ki * dN_a/dX_j + F_kj * dN_a/dX_i) / 2 * du_ak
+        for (uint32_t a = 0; a < node_count_; ++a) {
+          for (int k = 0; k < kStrainSize<DIM>; ++k) {
+            const auto [i, j] = StrainPattern<DIM>::kVoigt[k];
+            for (uint32_t c = 0; c < DIM; ++c) {
+              strain_matrix(k, DIM * a + c) = i == j ? deformation_gradient(c, i) * dshape(i, a)
+                                                     : deformation_gradient(c, i) * dshape(j, a) + deformation_gradient(c, j) * dshape(i, a);
+            }
+          }
+        }
+
+        const Precision scale = gradients_->GetScale(point);
+        element_forces.noalias() += strain_matrix.transpose() * (stress * scale);
+
+        if (tangent != nullptr) {
+          tangent_strain.noalias() = (material_tangent * scale) * strain_matrix;
+          element_tangent.noalias() += strain_matrix.transpose() * tangent_strain;
+
+          // geometric stiffness dN_a/dX^T * S * dN_b/dX on the diagonal of every node block
+          MatrixDim<DIM> tensor_stress;
+          for (int k = 0; k < kStrainSize<DIM>; ++k) {
+            const auto [i, j] = StrainPattern<DIM>::kVoigt[k];
+            tensor_stress(i, j) = tensor_stress(j, i) = stress[k] * scale;
+          }
+          for (uint32_t b = 0; b < node_count_; ++b) {
+            const Eigen::Matrix<Precision, DIM, 1> stress_dshape_b = tensor_stress * dshape.col(b);
+            for (uint32_t a = 0; a < node_count_; ++a) {
+              element_tangent.template block<DIM, DIM>(DIM * a, DIM * b).diagonal().array() += dshape.col(a).dot(stress_dshape_b);
+            }
+          }
+        }
+      }
+
+      for (uint32_t a = 0; a < node_count_; ++a) {
+        internal_forces.template segment<DIM>(DIM * nodes[a]) += element_forces.template segment<DIM>(DIM * a);
+      }
+      if (tangent != nullptr) {
+        model.ScatterUpper(static_cast<uint32_t>(element * node_count_), element_tangent, triplets);
+      }
+    }
+
+    if (tangent != nullptr) {
+      tangent->resize(u.size(), u.size());
+      tangent->setFromTriplets(triplets.begin(), triplets.end());
+    }
+    return true;
+  }
+
+  // step length s along du that makes the residual orthogonal to du, by secant steps on g(s) = du . r(u + s * du).
+  // Trial steps that invert an element are halved, the last admissible one is returned.
+  Precision LineSearch(const Model<DIM> &model, const VectorX &u, const VectorX &du, const VectorX &residual, const VectorX &external_forces,
+                       const VectorX &free) const {
+    if (!options_.line_search_) {
+      return 1.;
+    }
+
+    VectorX internal_forces;
+    const Precision g0 = du.dot(residual);
+    Precision step = 1.;
+    Precision accepted = 0.;
+    for (int trial = 0; trial < 8; ++trial) {
+      if (!Assemble(model, u + step * du, internal_forces, nullptr)) {
+        step /= 2;
+        continue;
+      }
+      accepted = step;
+
+      const Precision g = du.dot((external_forces - internal_forces).cwiseProduct(free));
+      if (std::abs(g) <= kLineSearchTolerance * std::abs(g0)) {
+        break;
+      }
+
+      // secant through g(0) = g0 and g(step) = g, kept within [0.1, 1]
+      const Precision next = std::clamp(step * g0 / (g0 - g), Precision(0.1), Precision(1.));
+      if (std::abs(next - step) < Precision(1e-2)) {
+        break;
+      }
+      step = next;
+    }
+    return accepted;
+  }
+
+  static constexpr Precision kLineSearchTolerance = 0.5;
+  static constexpr Precision kModifiedNewtonRate = 0.5;
+
+  NewtonOptions options_;
+
+  std::unique_ptr<Hyperelastic<DIM>> hyperelastic_;
+  uint32_t node_count_ = 0;
+  std::shared_ptr<const ElementGradients<DIM>> gradients_;
+};
+
+}  // namespace vulkan_fem
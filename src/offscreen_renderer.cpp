@@ -0,0 +1,664 @@
+#include "offscreen_renderer.h"
+#include "png_writer.h"
+#include "shader_library.h"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <future>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+namespace vulkan_fem {
+namespace {
+
+constexpr float kMargin = 0.05F;  // of the image on every side
+constexpr VkClearColorValue kBackground = {{1.F, 1.F, 1.F, 1.F}};
+constexpr uint32_t kEdgeMode = 2;  // contour.frag, dark lines
+
+struct ViewParameters {
+  float scale_[2];
+  float offset_[2];
+  float min_value_;
+  float max_value_;
+  uint32_t mode_;
+};
+
+bool HasExtension(const std::vector<VkExtensionProperties> &extensions, const char *name) {
+  return std::any_of(extensions.begin(), extensions.end(),
+                     [&](const VkExtensionProperties &extension) { return std::strcmp(extension.extensionName, name) == 0; });
+}
+
+// uniform scale that fits the bounding box of the mesh into the image, y pointing up
+ViewParameters FitView(const RenderMesh &mesh, uint32_t width, uint32_t height) {
+  float min_x = std::numeric_limits<float>::max();
+  float min_y = std::numeric_limits<float>::max();
+  float max_x = std::numeric_limits<float>::lowest();
+  float max_y = std::numeric_limits<float>::lowest();
+  for (const auto &vertex : mesh.vertices_) {
+    min_x = std::min(min_x, vertex.x_);
+    min_y = std::min(min_y, vertex.y_);
+    max_x = std::max(max_x, vertex.x_);
+    max_y = std::max(max_y, vertex.y_);
+  }
+
+  const float aspect = static_cast<float>(width) / static_cast<float>(height);
+  const float extent = std::max((max_x - min_x) / aspect, max_y - min_y);
+  const float scale = extent > 0.F ? 2.F * (1.F - 2.F * kMargin) / extent : 1.F;
+
+  ViewParameters view{};
+  view.scale_[0] = scale / aspect;
+  view.scale_[1] = -scale;
+  view.offset_[0] = -(min_x + max_x) / 2.F * view.scale_[0];
+  view.offset_[1] = -(min_y + max_y) / 2.F * view.scale_[1];
+  view.min_value_ = mesh.min_value_;
+  view.max_value_ = mesh.max_value_;
+  view.mode_ = static_cast<uint32_t>(mesh.mode_);
+  return view;
+}
+
+}  // namespace
+
+OffscreenRenderer::OffscreenRenderer(uint32_t width, uint32_t height, uint32_t frames_in_flight)
+    : width_(width), height_(height), frames_(std::max(frames_in_flight, 1U)) {
+  try {
+    CreateInstance();
+    PickPhysicalDevice();
+    CreateDevice();
+
+    allocator_ = std::make_unique<GpuAllocator>(physical_device_, device_);
+    pipeline_cache_ = std::make_unique<PipelineCache>(physical_device_, device_);
+
+    VkCommandPoolCreateInfo pool_info{};
+    pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    pool_info.queueFamilyIndex = queue_family_;
+    if (vkCreateCommandPool(device_, &pool_info, nullptr, &command_pool_) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create offscreen command pool");
+    }
+
+    CreateRenderPass();
+
+    VkPushConstantRange push_constant_range{};
+    push_constant_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+    push_constant_range.offset = 0;
+    push_constant_range.size = sizeof(ViewParameters);
+
+    VkPipelineLayoutCreateInfo layout_info{};
+    layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layout_info.pushConstantRangeCount = 1;
+    layout_info.pPushConstantRanges = &push_constant_range;
+    if (vkCreatePipelineLayout(device_, &layout_info, nullptr, &pipeline_layout_) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create offscreen pipeline layout");
+    }
+
+    std::future<VkPipeline> fill_pipeline = std::async(std::launch::async, [this] { return CreatePipeline(VK_POLYGON_MODE_FILL); });
+    if (line_mode_) {
+      try {
+        line_pipeline_ = CreatePipeline(VK_POLYGON_MODE_LINE);
+      } catch (...) {
+        fill_pipeline.wait();
+        throw;
+      }
+    }
+    fill_pipeline_ = fill_pipeline.get();
+
+    for (auto &frame : frames_) {
+      CreateFrame(frame);
+    }
+  } catch (...) {
+    Release();
+    throw;
+  }
+
+  spdlog::info("offscreen rendering {}x{} on {}, {} frames in flight", width_, height_, GetName(), frames_.size());
+}
+
+OffscreenRenderer::~OffscreenRenderer() {
+  try {
+    Finish();
+  } catch (const std::exception &e) {
+    spdlog::error("offscreen rendering: {}", e.what());
+  }
+  Release();
+}
+
+std::string OffscreenRenderer::GetName() const {
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physical_device_, &properties);
+  return properties.deviceName;
+}
+
+void OffscreenRenderer::CreateInstance() {
+  VkApplicationInfo app_info{};
+  app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+  app_info.pApplicationName = "vulkan_fem offscreen";
+  app_info.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
+  app_info.pEngineName = "No Engine";
+  app_info.engineVersion = VK_MAKE_VERSION(1, 0, 0);
+  app_info.apiVersion = VK_API_VERSION_1_1;
+
+  VkInstanceCreateInfo create_info{};
+  create_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+  create_info.pApplicationInfo = &app_info;
+
+  std::vector<const char *> extensions;
+#ifdef VK_KHR_portability_enumeration
+  uint32_t extension_count = 0;
+  vkEnumerateInstanceExtensionProperties(nullptr, &extension_count, nullptr);
+  std::vector<VkExtensionProperties> available(extension_count);
+  vkEnumerateInstanceExtensionProperties(nullptr, &extension_count, available.data());
+  if (HasExtension(available, VK_KHR_PORTABILITY_ENUMERATION_EXTENSION_NAME)) {
+    extensions.push_back(VK_KHR_PORTABILITY_ENUMERATION_EXTENSION_NAME);
+    create_info.flags |= VK_INSTANCE_CREATE_ENUMERATE_PORTABILITY_BIT_KHR;
+  }
+#endif
+  create_info.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+  create_info.ppEnabledExtensionNames = extensions.data();
+
+  if (vkCreateInstance(&create_info, nullptr, &instance_) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create a Vulkan 1.1 instance");
+  }
+}
+
+void OffscreenRenderer::PickPhysicalDevice() {
+  uint32_t device_count = 0;
+  vkEnumeratePhysicalDevices(instance_, &device_count, nullptr);
+  std::vector<VkPhysicalDevice> devices(device_count);
+  vkEnumeratePhysicalDevices(instance_, &device_count, devices.data());
+
+  int best_score = -1;
+  for (auto *device : devices) {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(device, &properties);
+    if (properties.apiVersion < VK_API_VERSION_1_1) {
+      continue;
+    }
+
+    uint32_t family_count = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(device, &family_count, nullptr);
+    std::vector<VkQueueFamilyProperties> families(family_count);
+    vkGetPhysicalDeviceQueueFamilyProperties(device, &family_count, families.data());
+
+    const auto family = std::find_if(families.begin(), families.end(),
+                                     [](const VkQueueFamilyProperties &queue_family) { return (queue_family.queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0U; });
+    if (family == families.end()) {
+      continue;
+    }
+
+    int score = 0;
+    switch (properties.deviceType) {
+      case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+        score = 3;
+        break;
+      case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+        score = 2;
+        break;
+      case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+        score = 1;
+        break;
+      default:
+        break;
+    }
+
+    if (score > best_score) {
+      best_score = score;
+      physical_device_ = device;
+      queue_family_ = static_cast<uint32_t>(family - families.begin());
+    }
+  }
+
+  if (physical_device_ == VK_NULL_HANDLE) {
+    throw std::runtime_error("failed to find a Vulkan 1.1 device with a graphics queue");
+  }
+}
+
+void OffscreenRenderer::CreateDevice() {
+  const float queue_priority = 1.0F;
+  VkDeviceQueueCreateInfo queue_create_info{};
+  queue_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+  queue_create_info.queueFamilyIndex = queue_family_;
+  queue_create_info.queueCount = 1;
+  queue_create_info.pQueuePriorities = &queue_priority;
+
+  uint32_t extension_count = 0;
+  vkEnumerateDeviceExtensionProperties(physical_device_, nullptr, &extension_count, nullptr);
+  std::vector<VkExtensionProperties> available(extension_count);
+  vkEnumerateDeviceExtensionProperties(physical_device_, nullptr, &extension_count, available.data());
+
+  std::vector<const char *> extensions;
+  if (HasExtension(available, "VK_KHR_portability_subset")) {
+    extensions.push_back("VK_KHR_portability_subset");
+  }
+
+  // edges are drawn as a line polygon mode pass when the device can
+  VkPhysicalDeviceFeatures supported_features;
+  vkGetPhysicalDeviceFeatures(physical_device_, &supported_features);
+  line_mode_ = supported_features.fillModeNonSolid == VK_TRUE;
+
+  VkPhysicalDeviceFeatures device_features{};
+  device_features.fillModeNonSolid = supported_features.fillModeNonSolid;
+
+  VkDeviceCreateInfo create_info{};
+  create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+  create_info.queueCreateInfoCount = 1;
+  create_info.pQueueCreateInfos = &queue_create_info;
+  create_info.pEnabledFeatures = &device_features;
+  create_info.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+  create_info.ppEnabledExtensionNames = extensions.data();
+
+  if (vkCreateDevice(physical_device_, &create_info, nullptr, &device_) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create offscreen device");
+  }
+
+  vkGetDeviceQueue(device_, queue_family_, 0, &queue_);
+}
+
+void OffscreenRenderer::CreateRenderPass() {
+  VkAttachmentDescription color_attachment{};
+  color_attachment.format = kFormat;
+  color_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+  color_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+  color_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  color_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  color_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  // ready for the copy into the readback buffer
+  color_attachment.finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+  VkAttachmentReference color_attachment_ref{};
+  color_attachment_ref.attachment = 0;
+  color_attachment_ref.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+  VkSubpassDescription subpass{};
+  subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+  subpass.colorAttachmentCount = 1;
+  subpass.pColorAttachments = &color_attachment_ref;
+
+  std::array<VkSubpassDependency, 2> dependencies{};
+  dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+  dependencies[0].dstSubpass = 0;
+  dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  dependencies[0].srcAccessMask = 0;
+  dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+  dependencies[1].srcSubpass = 0;
+  dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+  dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  dependencies[1].dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+  dependencies[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+  VkRenderPassCreateInfo render_pass_info{};
+  render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+  render_pass_info.attachmentCount = 1;
+  render_pass_info.pAttachments = &color_attachment;
+  render_pass_info.subpassCount = 1;
+  render_pass_info.pSubpasses = &subpass;
+  render_pass_info.dependencyCount = static_cast<uint32_t>(dependencies.size());
+  render_pass_info.pDependencies = dependencies.data();
+
+  if (vkCreateRenderPass(device_, &render_pass_info, nullptr, &render_pass_) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create offscreen render pass");
+  }
+}
+
+VkPipeline OffscreenRenderer::CreatePipeline(VkPolygonMode mode) {
+  const std::vector<char> vert_code = LoadShader("contour.vert");
+  const std::vector<char> frag_code = LoadShader("contour.frag");
+
+  std::array<VkShaderModule, 2> modules{};
+  const std::array<const std::vector<char> *, 2> codes = {&vert_code, &frag_code};
+  for (size_t i = 0; i < modules.size(); ++i) {
+    VkShaderModuleCreateInfo module_info{};
+    module_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    module_info.codeSize = codes[i]->size();
+    module_info.pCode = reinterpret_cast<const uint32_t *>(codes[i]->data());
+    if (vkCreateShaderModule(device_, &module_info, nullptr, &modules[i]) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create shader module");
+    }
+  }
+
+  std::array<VkPipelineShaderStageCreateInfo, 2> shader_stages{};
+  shader_stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  shader_stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+  shader_stages[0].module = modules[0];
+  shader_stages[0].pName = "main";
+  shader_stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  shader_stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+  shader_stages[1].module = modules[1];
+  shader_stages[1].pName = "main";
+
+  VkVertexInputBindingDescription binding_description{};
+  binding_description.binding = 0;
+  binding_description.stride = sizeof(ContourVertex);
+  binding_description.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+  std::array<VkVertexInputAttributeDescription, 2> attribute_descriptions{};
+  attribute_descriptions[0].binding = 0;
+  attribute_descriptions[0].location = 0;
+  attribute_descriptions[0].format = VK_FORMAT_R32G32_SFLOAT;
+  attribute_descriptions[0].offset = offsetof(ContourVertex, x_);
+  attribute_descriptions[1].binding = 0;
+  attribute_descriptions[1].location = 1;
+  attribute_descriptions[1].format = VK_FORMAT_R32_SFLOAT;
+  attribute_descriptions[1].offset = offsetof(ContourVertex, value_);
+
+  VkPipelineVertexInputStateCreateInfo vertex_input_info{};
+  vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+  vertex_input_info.vertexBindingDescriptionCount = 1;
+  vertex_input_info.pVertexBindingDescriptions = &binding_description;
+  vertex_input_info.vertexAttributeDescriptionCount = static_cast<uint32_t>(attribute_descriptions.size());
+  vertex_input_info.pVertexAttributeDescriptions = attribute_descriptions.data();
+
+  VkPipelineInputAssemblyStateCreateInfo input_assembly{};
+  input_assembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+  input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+  input_assembly.primitiveRestartEnable = VK_FALSE;
+
+  VkViewport viewport{};
+  viewport.width = static_cast<float>(width_);
+  viewport.height = static_cast<float>(height_);
+  viewport.minDepth = 0.0F;
+  viewport.maxDepth = 1.0F;
+
+  VkRect2D scissor{};
+  scissor.extent = {width_, height_};
+
+  VkPipelineViewportStateCreateInfo viewport_state{};
+  viewport_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+  viewport_state.viewportCount = 1;
+  viewport_state.pViewports = &viewport;
+  viewport_state.scissorCount = 1;
+  viewport_state.pScissors = &scissor;
+
+  // element winding is not consistent across the model factories, nothing is culled
+  VkPipelineRasterizationStateCreateInfo rasterizer{};
+  rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+  rasterizer.polygonMode = mode;
+  rasterizer.lineWidth = 1.0F;
+  rasterizer.cullMode = VK_CULL_MODE_NONE;
+  rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
+
+  VkPipelineMultisampleStateCreateInfo multisampling{};
+  multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+  multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+  VkPipelineColorBlendAttachmentState color_blend_attachment{};
+  color_blend_attachment.colorWriteMask =
+      VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+  color_blend_attachment.blendEnable = VK_FALSE;
+
+  VkPipelineColorBlendStateCreateInfo color_blending{};
+  color_blending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+  color_blending.attachmentCount = 1;
+  color_blending.pAttachments = &color_blend_attachment;
+
+  VkGraphicsPipelineCreateInfo pipeline_info{};
+  pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+  pipeline_info.stageCount = static_cast<uint32_t>(shader_stages.size());
+  pipeline_info.pStages = shader_stages.data();
+  pipeline_info.pVertexInputState = &vertex_input_info;
+  pipeline_info.pInputAssemblyState = &input_assembly;
+  pipeline_info.pViewportState = &viewport_state;
+  pipeline_info.pRasterizationState = &rasterizer;
+  pipeline_info.pMultisampleState = &multisampling;
+  pipeline_info.pColorBlendState = &color_blending;
+  pipeline_info.layout = pipeline_layout_;
+  pipeline_info.renderPass = render_pass_;
+  pipeline_info.subpass = 0;
+
+  VkPipeline pipeline = VK_NULL_HANDLE;
+  const VkResult result = vkCreateGraphicsPipelines(device_, pipeline_cache_->Get(), 1, &pipeline_info, nullptr, &pipeline);
+
+  for (auto *shader_module : modules) {
+    vkDestroyShaderModule(device_, shader_module, nullptr);
+  }
+
+  if (result != VK_SUCCESS) {
+    throw std::runtime_error("failed to create offscreen pipeline");
+  }
+  return pipeline;
+}
+
+void OffscreenRenderer::CreateFrame(Frame &frame) {
+  VkImageCreateInfo image_info{};
+  image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  image_info.imageType = VK_IMAGE_TYPE_2D;
+  image_info.format = kFormat;
+  image_info.extent = {width_, height_, 1};
+  image_info.mipLevels = 1;
+  image_info.arrayLayers = 1;
+  image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+  image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+  image_info.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+  image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  if (vkCreateImage(device_, &image_info, nullptr, &frame.image_) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create offscreen image");
+  }
+
+  // an optimal tiling image must not share a bufferImageGranularity page with buffers
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physical_device_, &properties);
+  const VkDeviceSize granularity = properties.limits.bufferImageGranularity;
+  VkMemoryRequirements requirements;
+  vkGetImageMemoryRequirements(device_, frame.image_, &requirements);
+  requirements.alignment = std::max(requirements.alignment, granularity);
+  requirements.size = (requirements.size + granularity - 1) / granularity * granularity;
+  frame.image_allocation_ = allocator_->Allocate(requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  vkBindImageMemory(device_, frame.image_, frame.image_allocation_.memory_, frame.image_allocation_.offset_);
+
+  VkImageViewCreateInfo view_info{};
+  view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+  view_info.image = frame.image_;
+  view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+  view_info.format = kFormat;
+  view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  view_info.subresourceRange.levelCount = 1;
+  view_info.subresourceRange.layerCount = 1;
+  if (vkCreateImageView(device_, &view_info, nullptr, &frame.view_) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create offscreen image view");
+  }
+
+  VkFramebufferCreateInfo framebuffer_info{};
+  framebuffer_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+  framebuffer_info.renderPass = render_pass_;
+  framebuffer_info.attachmentCount = 1;
+  framebuffer_info.pAttachments = &frame.view_;
+  framebuffer_info.width = width_;
+  framebuffer_info.height = height_;
+  framebuffer_info.layers = 1;
+  if (vkCreateFramebuffer(device_, &framebuffer_info, nullptr, &frame.framebuffer_) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create offscreen framebuffer");
+  }
+
+  frame.readback_buffer_ = allocator_->CreateBuffer(VkDeviceSize{4} * width_ * height_, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                                    frame.readback_allocation_);
+
+  VkCommandBufferAllocateInfo alloc_info{};
+  alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  alloc_info.commandPool = command_pool_;
+  alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  alloc_info.commandBufferCount = 1;
+  if (vkAllocateCommandBuffers(device_, &alloc_info, &frame.command_buffer_) != VK_SUCCESS) {
+    throw std::runtime_error("failed to allocate offscreen command buffer");
+  }
+
+  VkFenceCreateInfo fence_info{};
+  fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+  if (vkCreateFence(device_, &fence_info, nullptr, &frame.fence_) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create offscreen fence");
+  }
+}
+
+void OffscreenRenderer::DestroyFrame(Frame &frame) {
+  vkDestroyFence(device_, frame.fence_, nullptr);
+  vkDestroyFramebuffer(device_, frame.framebuffer_, nullptr);
+  vkDestroyImageView(device_, frame.view_, nullptr);
+  vkDestroyImage(device_, frame.image_, nullptr);
+  allocator_->Free(frame.image_allocation_);
+  for (auto [buffer, allocation] : {std::make_pair(&frame.vertex_buffer_, &frame.vertex_allocation_),
+                                    std::make_pair(&frame.index_buffer_, &frame.index_allocation_),
+                                    std::make_pair(&frame.readback_buffer_, &frame.readback_allocation_)}) {
+    if (*buffer != VK_NULL_HANDLE) {
+      allocator_->DestroyBuffer(*buffer, *allocation);
+    }
+  }
+  frame = Frame{};
+}
+
+void OffscreenRenderer::Release() {
+  if (device_ != VK_NULL_HANDLE) {
+    vkDeviceWaitIdle(device_);
+    if (allocator_) {
+      for (auto &frame : frames_) {
+        DestroyFrame(frame);
+      }
+    }
+    vkDestroyPipeline(device_, line_pipeline_, nullptr);
+    vkDestroyPipeline(device_, fill_pipeline_, nullptr);
+    vkDestroyPipelineLayout(device_, pipeline_layout_, nullptr);
+    vkDestroyRenderPass(device_, render_pass_, nullptr);
+    vkDestroyCommandPool(device_, command_pool_, nullptr);
+    pipeline_cache_.reset();
+    allocator_.reset();
+    vkDestroyDevice(device_, nullptr);
+    device_ = VK_NULL_HANDLE;
+  }
+  if (instance_ != VK_NULL_HANDLE) {
+    vkDestroyInstance(instance_, nullptr);
+    instance_ = VK_NULL_HANDLE;
+  }
+}
+
+void OffscreenRenderer::Reserve(VkBuffer &buffer, GpuAllocation &allocation, VkBufferUsageFlags usage, VkDeviceSize size) {
+  if (buffer != VK_NULL_HANDLE && allocation.requested_ >= size) {
+    return;
+  }
+  if (buffer != VK_NULL_HANDLE) {
+    allocator_->DestroyBuffer(buffer, allocation);
+  }
+  // headroom so that a sequence of slightly different meshes does not reallocate every frame
+  buffer = allocator_->CreateBuffer(size + size / 2, usage, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                    allocation);
+}
+
+void OffscreenRenderer::Render(const RenderMesh &mesh, const std::string &path) {
+  if (mesh.vertices_.empty() || mesh.indices_.empty()) {
+    throw std::runtime_error("nothing to render into " + path);
+  }
+
+  Frame &frame = frames_[next_frame_];
+  next_frame_ = (next_frame_ + 1) % static_cast<uint32_t>(frames_.size());
+  Collect(frame);
+
+  const VkDeviceSize vertex_size = sizeof(ContourVertex) * mesh.vertices_.size();
+  const VkDeviceSize index_size = sizeof(uint16_t) * mesh.indices_.size();
+  Reserve(frame.vertex_buffer_, frame.vertex_allocation_, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, vertex_size);
+  Reserve(frame.index_buffer_, frame.index_allocation_, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, index_size);
+  memcpy(frame.vertex_allocation_.mapped_, mesh.vertices_.data(), static_cast<size_t>(vertex_size));
+  memcpy(frame.index_allocation_.mapped_, mesh.indices_.data(), static_cast<size_t>(index_size));
+
+  Record(frame, mesh);
+
+  VkSubmitInfo submit_info{};
+  submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submit_info.commandBufferCount = 1;
+  submit_info.pCommandBuffers = &frame.command_buffer_;
+  vkResetFences(device_, 1, &frame.fence_);
+  if (vkQueueSubmit(queue_, 1, &submit_info, frame.fence_) != VK_SUCCESS) {
+    throw std::runtime_error("failed to submit offscreen frame");
+  }
+  frame.pending_ = path;
+}
+
+void OffscreenRenderer::Record(Frame &frame, const RenderMesh &mesh) {
+  VkCommandBuffer command_buffer = frame.command_buffer_;
+  vkResetCommandBuffer(command_buffer, 0);
+
+  VkCommandBufferBeginInfo begin_info{};
+  begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  if (vkBeginCommandBuffer(command_buffer, &begin_info) != VK_SUCCESS) {
+    throw std::runtime_error("failed to begin offscreen command buffer");
+  }
+
+  VkClearValue clear_color{};
+  clear_color.color = kBackground;
+
+  VkRenderPassBeginInfo render_pass_info{};
+  render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+  render_pass_info.renderPass = render_pass_;
+  render_pass_info.framebuffer = frame.framebuffer_;
+  render_pass_info.renderArea.extent = {width_, height_};
+  render_pass_info.clearValueCount = 1;
+  render_pass_info.pClearValues = &clear_color;
+  vkCmdBeginRenderPass(command_buffer, &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
+
+  ViewParameters view = FitView(mesh, width_, height_);
+  const VkDeviceSize offset = 0;
+  vkCmdBindVertexBuffers(command_buffer, 0, 1, &frame.vertex_buffer_, &offset);
+  vkCmdBindIndexBuffer(command_buffer, frame.index_buffer_, 0, VK_INDEX_TYPE_UINT16);
+  const auto index_count = static_cast<uint32_t>(mesh.indices_.size());
+
+  vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, fill_pipeline_);
+  vkCmdPushConstants(command_buffer, pipeline_layout_, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(view), &view);
+  vkCmdDrawIndexed(command_buffer, index_count, 1, 0, 0, 0);
+
+  if (mesh.edges_ && line_pipeline_ != VK_NULL_HANDLE) {
+    view.mode_ = kEdgeMode;
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, line_pipeline_);
+    vkCmdPushConstants(command_buffer, pipeline_layout_, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(view), &view);
+    vkCmdDrawIndexed(command_buffer, index_count, 1, 0, 0, 0);
+  }
+
+  vkCmdEndRenderPass(command_buffer);
+
+  // the render pass leaves the image in TRANSFER_SRC_OPTIMAL, rows are copied tightly packed
+  VkBufferImageCopy region{};
+  region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  region.imageSubresource.layerCount = 1;
+  region.imageExtent = {width_, height_, 1};
+  vkCmdCopyImageToBuffer(command_buffer, frame.image_, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, frame.readback_buffer_, 1, &region);
+
+  VkBufferMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.buffer = frame.readback_buffer_;
+  barrier.size = VK_WHOLE_SIZE;
+  vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+  if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
+    throw std::runtime_error("failed to record offscreen command buffer");
+  }
+}
+
+void OffscreenRenderer::Collect(Frame &frame) {
+  if (frame.pending_.empty()) {
+    return;
+  }
+
+  vkWaitForFences(device_, 1, &frame.fence_, VK_TRUE, UINT64_MAX);
+  const auto *pixels = static_cast<const uint8_t *>(frame.readback_allocation_.mapped_);
+  const std::string path = std::move(frame.pending_);
+  frame.pending_.clear();
+  WritePng(path, width_, height_, std::vector<uint8_t>(pixels, pixels + VkDeviceSize{4} * width_ * height_));
+  spdlog::info("wrote {}", path);
+}
+
+void OffscreenRenderer::Finish() {
+  // oldest first, in submission order
+  for (size_t i = 0; i < frames_.size(); ++i) {
+    Collect(frames_[(next_frame_ + i) % frames_.size()]);
+  }
+}
+
+}  // namespace vulkan_fem
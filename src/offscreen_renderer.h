@@ -0,0 +1,112 @@
+#pragma once
+
+#include "gpu_allocator.h"
+#include "pipeline_cache.h"
+#include <vulkan/vulkan_core.h>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace vulkan_fem {
+
+struct ContourVertex {
+  float x_ = 0.F;
+  float y_ = 0.F;
+  float value_ = 0.F;  // mapped through the colormap between the mesh's min and max value
+};
+
+enum class RenderMode : uint32_t {
+  kContour = 0,  // banded colormap of the vertex values
+  kFlat = 1,     // single colour, for the deformed shape
+};
+
+struct RenderMesh {
+  std::vector<ContourVertex> vertices_;
+  std::vector<uint16_t> indices_;  // triangle list
+  RenderMode mode_ = RenderMode::kContour;
+  float min_value_ = 0.F;
+  float max_value_ = 1.F;
+  bool edges_ = true;  // element edges on top, needs fillModeNonSolid
+};
+
+// Renders 2D meshes into an RGBA image and writes them as PNG, without a window, surface or swapchain.
+// Owns a headless Vulkan 1.1 device like VulkanCompute, so it runs on lavapipe in CI. Every frame in flight
+// has its own image, buffers and fence. Render only waits when it reuses a frame, whose readback is then
+// written out, so rendering the next images overlaps the encoding of the previous ones.
+class OffscreenRenderer {
+ public:
+  OffscreenRenderer(uint32_t width, uint32_t height, uint32_t frames_in_flight = kDefaultFramesInFlight);
+  ~OffscreenRenderer();
+
+  OffscreenRenderer(const OffscreenRenderer &) = delete;
+  OffscreenRenderer &operator=(const OffscreenRenderer &) = delete;
+
+  [[nodiscard]] std::string GetName() const;
+
+  // submits the mesh, fitted into the image, the PNG is written by a later Render or Finish
+  void Render(const RenderMesh &mesh, const std::string &path);
+  // waits for all frames in flight and writes their images
+  void Finish();
+
+ private:
+  static constexpr uint32_t kDefaultFramesInFlight = 3;
+  static constexpr VkFormat kFormat = VK_FORMAT_R8G8B8A8_UNORM;
+
+  struct Frame {
+    VkImage image_ = VK_NULL_HANDLE;
+    GpuAllocation image_allocation_;
+    VkImageView view_ = VK_NULL_HANDLE;
+    VkFramebuffer framebuffer_ = VK_NULL_HANDLE;
+
+    // host visible, written directly, grown on demand
+    VkBuffer vertex_buffer_ = VK_NULL_HANDLE;
+    GpuAllocation vertex_allocation_;
+    VkBuffer index_buffer_ = VK_NULL_HANDLE;
+    GpuAllocation index_allocation_;
+
+    VkBuffer readback_buffer_ = VK_NULL_HANDLE;
+    GpuAllocation readback_allocation_;
+
+    VkCommandBuffer command_buffer_ = VK_NULL_HANDLE;
+    VkFence fence_ = VK_NULL_HANDLE;
+    std::string pending_;  // PNG path of the submitted image, empty when idle
+  };
+
+  void CreateInstance();
+  void PickPhysicalDevice();
+  void CreateDevice();
+  void CreateRenderPass();
+  VkPipeline CreatePipeline(VkPolygonMode mode);
+  void CreateFrame(Frame &frame);
+  void DestroyFrame(Frame &frame);
+  void Release();
+
+  void Reserve(VkBuffer &buffer, GpuAllocation &allocation, VkBufferUsageFlags usage, VkDeviceSize size);
+  void Record(Frame &frame, const RenderMesh &mesh);
+  // waits for the frame and writes its image
+  void Collect(Frame &frame);
+
+  uint32_t width_;
+  uint32_t height_;
+
+  VkInstance instance_ = VK_NULL_HANDLE;
+  VkPhysicalDevice physical_device_ = VK_NULL_HANDLE;
+  VkDevice device_ = VK_NULL_HANDLE;
+  VkQueue queue_ = VK_NULL_HANDLE;
+  uint32_t queue_family_ = 0;
+  bool line_mode_ = false;  // fillModeNonSolid
+
+  std::unique_ptr<GpuAllocator> allocator_;
+  std::unique_ptr<PipelineCache> pipeline_cache_;
+  VkCommandPool command_pool_ = VK_NULL_HANDLE;
+  VkRenderPass render_pass_ = VK_NULL_HANDLE;
+  VkPipelineLayout pipeline_layout_ = VK_NULL_HANDLE;
+  VkPipeline fill_pipeline_ = VK_NULL_HANDLE;
+  VkPipeline line_pipeline_ = VK_NULL_HANDLE;
+
+  std::vector<Frame> frames_;
+  uint32_t next_frame_ = 0;
+};
+
+}  // namespace vulkan_fem
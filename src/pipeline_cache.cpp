@@ -0,0 +1,125 @@
+#include "pipeline_cache.h"
+#include <spdlog/spdlog.h>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <system_error>
+#include <vector>
+
+namespace vulkan_fem {
+namespace {
+
+// VkPipelineCacheHeaderVersionOne: length, version, vendor, device, then the cache UUID
+constexpr size_t kHeaderSize = 16 + VK_UUID_SIZE;
+
+uint32_t ReadWord(const std::string &data, size_t offset) {
+  uint32_t word;
+  memcpy(&word, data.data() + offset, sizeof(word));
+  return word;
+}
+
+}  // namespace
+
+PipelineCache::PipelineCache(VkPhysicalDevice physical_device, VkDevice device, std::string path)
+    : physical_device_(physical_device), device_(device), path_(std::move(path)) {
+  if (path_.empty()) {
+    // one file per device, switching between a GPU and lavapipe does not throw either cache away
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physical_device_, &properties);
+    path_ = fmt::format("{}/pipeline_{:04x}_{:04x}.cache", GetDefaultDirectory(), properties.vendorID, properties.deviceID);
+  }
+
+  std::string data;
+  std::ifstream file(path_, std::ios::binary);
+  if (file.is_open()) {
+    data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    if (!IsCompatible(data)) {
+      spdlog::info("pipeline cache {} is from another device or driver, starting empty", path_);
+      data.clear();
+    }
+  }
+
+  VkPipelineCacheCreateInfo cache_info{};
+  cache_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+  cache_info.initialDataSize = data.size();
+  cache_info.pInitialData = data.empty() ? nullptr : data.data();
+  if (vkCreatePipelineCache(device_, &cache_info, nullptr, &cache_) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create pipeline cache!");
+  }
+
+  spdlog::info("pipeline cache {}, {} bytes loaded", path_, data.size());
+}
+
+PipelineCache::~PipelineCache() {
+  Save();
+  vkDestroyPipelineCache(device_, cache_, nullptr);
+}
+
+void PipelineCache::Save() const {
+  size_t size = 0;
+  if (vkGetPipelineCacheData(device_, cache_, &size, nullptr) != VK_SUCCESS) {
+    spdlog::warn("failed to read pipeline cache");
+    return;
+  }
+  std::vector<char> data(size);
+  if (vkGetPipelineCacheData(device_, cache_, &size, data.data()) != VK_SUCCESS) {
+    spdlog::warn("failed to read pipeline cache");
+    return;
+  }
+
+  // written next to the target and renamed, a crash never leaves a truncated cache behind
+  const std::filesystem::path path(path_);
+  const std::filesystem::path temporary = path.string() + ".tmp";
+  std::error_code error;
+  if (path.has_parent_path()) {
+    std::filesystem::create_directories(path.parent_path(), error);
+  }
+  {
+    std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+    file.write(data.data(), static_cast<std::streamsize>(size));
+    if (!file) {
+      spdlog::warn("failed to write pipeline cache {}", temporary.string());
+      return;
+    }
+  }
+  std::filesystem::rename(temporary, path, error);
+  if (error) {
+    spdlog::warn("failed to write pipeline cache {}: {}", path_, error.message());
+  }
+}
+
+std::string PipelineCache::GetDefaultDirectory() {
+  if (const char *directory = std::getenv("VULKAN_FEM_PIPELINE_CACHE"); directory != nullptr && *directory != '\0') {
+    return directory;
+  }
+
+#ifdef _WIN32
+  const char *base = std::getenv("LOCALAPPDATA");
+  const std::string directory = base != nullptr ? std::string(base) : std::string(".");
+#else
+  const char *xdg = std::getenv("XDG_CACHE_HOME");
+  const char *home = std::getenv("HOME");
+  const std::string directory = xdg != nullptr && *xdg != '\0' ? std::string(xdg)
+                                : home != nullptr             ? std::string(home) + "/.cache"
+                                                              : std::string(".");
+#endif
+  return directory + "/vulkan_fem";
+}
+
+bool PipelineCache::IsCompatible(const std::string &data) const {
+  if (data.size() < kHeaderSize) {
+    return false;
+  }
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physical_device_, &properties);
+  return ReadWord(data, 0) >= kHeaderSize && ReadWord(data, 4) == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+         ReadWord(data, 8) == properties.vendorID && ReadWord(data, 12) == properties.deviceID &&
+         memcmp(data.data() + 16, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+}  // namespace vulkan_fem
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <vulkan/vulkan_core.h>
+#include <string>
+
+namespace vulkan_fem {
+
+// VkPipelineCache persisted in a file across runs. Data from another driver version or device fails the header
+// check and the cache starts empty. Pipeline creation through the cache is internally synchronized, so the
+// same cache serves pipelines built on several threads.
+class PipelineCache {
+ public:
+  // an empty path selects a file per device in GetDefaultDirectory()
+  PipelineCache(VkPhysicalDevice physical_device, VkDevice device, std::string path = {});
+  // saves
+  ~PipelineCache();
+
+  PipelineCache(const PipelineCache &) = delete;
+  PipelineCache &operator=(const PipelineCache &) = delete;
+
+  [[nodiscard]] VkPipelineCache Get() const { return cache_; }
+
+  // failures are logged, a missing cache only costs compile time
+  void Save() const;
+
+  // $VULKAN_FEM_PIPELINE_CACHE, else vulkan_fem in the user cache directory
+  static std::string GetDefaultDirectory();
+
+ private:
+  [[nodiscard]] bool IsCompatible(const std::string &data) const;
+
+  VkPhysicalDevice physical_device_;
+  VkDevice device_;
+  std::string path_;
+  VkPipelineCache cache_ = VK_NULL_HANDLE;
+};
+
+}  // namespace vulkan_fem
@@ -0,0 +1,120 @@
+#include "png_writer.h"
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <fstream>
+#include <stdexcept>
+
+namespace vulkan_fem {
+namespace {
+
+constexpr size_t kMaxStoredBlock = 65535;  // deflate stored block length limit
+
+const std::array<uint32_t, 256> &CrcTable() {
+  static const std::array<uint32_t, 256> table = [] {
+    std::array<uint32_t, 256> result{};
+    for (uint32_t n = 0; n < 256; ++n) {
+      uint32_t c = n;
+      for (int k = 0; k < 8; ++k) {
+        c = (c & 1U) != 0U ? 0xEDB88320U ^ (c >> 1U) : c >> 1U;
+      }
+      result[n] = c;
+    }
+    return result;
+  }();
+  return table;
+}
+
+uint32_t Crc(const uint8_t *data, size_t size, uint32_t crc = 0xFFFFFFFFU) {
+  const auto &table = CrcTable();
+  for (size_t i = 0; i < size; ++i) {
+    crc = table[(crc ^ data[i]) & 0xFFU] ^ (crc >> 8U);
+  }
+  return crc;
+}
+
+void PutBigEndian(std::vector<uint8_t> &out, uint32_t value) {
+  for (int shift = 24; shift >= 0; shift -= 8) {
+    out.push_back(static_cast<uint8_t>(value >> shift));
+  }
+}
+
+void WriteChunk(std::ofstream &file, const char *type, const std::vector<uint8_t> &data) {
+  std::vector<uint8_t> chunk;
+  chunk.reserve(data.size() + 12);
+  PutBigEndian(chunk, static_cast<uint32_t>(data.size()));
+  chunk.insert(chunk.end(), type, type + 4);
+  chunk.insert(chunk.end(), data.begin(), data.end());
+  // over type and data
+  PutBigEndian(chunk, Crc(chunk.data() + 4, chunk.size() - 4) ^ 0xFFFFFFFFU);
+  file.write(reinterpret_cast<const char *>(chunk.data()), static_cast<std::streamsize>(chunk.size()));
+}
+
+// zlib stream of stored blocks
+std::vector<uint8_t> Deflate(const std::vector<uint8_t> &raw) {
+  std::vector<uint8_t> out = {0x78, 0x01};
+  out.reserve(raw.size() + raw.size() / kMaxStoredBlock * 5 + 16);
+
+  uint32_t a = 1;
+  uint32_t b = 0;
+  size_t offset = 0;
+  do {
+    const size_t length = std::min(kMaxStoredBlock, raw.size() - offset);
+    const bool last = offset + length == raw.size();
+    out.push_back(last ? 1 : 0);
+    out.push_back(static_cast<uint8_t>(length));
+    out.push_back(static_cast<uint8_t>(length >> 8U));
+    out.push_back(static_cast<uint8_t>(~length));
+    out.push_back(static_cast<uint8_t>(~length >> 8U));
+    out.insert(out.end(), raw.begin() + static_cast<std::ptrdiff_t>(offset), raw.begin() + static_cast<std::ptrdiff_t>(offset + length));
+
+    for (size_t i = offset; i < offset + length; ++i) {
+      a = (a + raw[i]) % 65521U;
+      b = (b + a) % 65521U;
+    }
+    offset += length;
+  } while (offset < raw.size());
+
+  PutBigEndian(out, (b << 16U) | a);
+  return out;
+}
+
+}  // namespace
+
+void WritePng(const std::string &path, uint32_t width, uint32_t height, const std::vector<uint8_t> &rgba) {
+  const size_t row_size = 4 * static_cast<size_t>(width);
+  if (rgba.size() != row_size * height) {
+    throw std::runtime_error("image data does not match its size");
+  }
+
+  // every row starts with filter type 0, none
+  std::vector<uint8_t> raw;
+  raw.reserve((row_size + 1) * height);
+  for (uint32_t y = 0; y < height; ++y) {
+    raw.push_back(0);
+    raw.insert(raw.end(), rgba.begin() + static_cast<std::ptrdiff_t>(y * row_size),
+               rgba.begin() + static_cast<std::ptrdiff_t>((y + 1) * row_size));
+  }
+
+  std::ofstream file(path, std::ios::binary);
+  if (!file.is_open()) {
+    throw std::runtime_error("failed to open " + path);
+  }
+
+  const uint8_t signature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+  file.write(reinterpret_cast<const char *>(signature), sizeof(signature));
+
+  std::vector<uint8_t> header;
+  PutBigEndian(header, width);
+  PutBigEndian(header, height);
+  header.insert(header.end(), {8, 6, 0, 0, 0});  // 8 bit depth, RGBA, deflate, no filter, no interlace
+  WriteChunk(file, "IHDR", header);
+  WriteChunk(file, "IDAT", Deflate(raw));
+  WriteChunk(file, "IEND", {});
+
+  if (!file) {
+    throw std::runtime_error("failed to write " + path);
+  }
+}
+
+}  // namespace vulkan_fem
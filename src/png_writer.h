@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace vulkan_fem {
+
+// Minimal PNG encoder for 8 bit RGBA images, rows top to bottom. The image data is stored
+// in uncompressed deflate blocks, so no zlib is needed at the cost of file size.
+void WritePng(const std::string &path, uint32_t width, uint32_t height, const std::vector<uint8_t> &rgba);
+
+}  // namespace vulkan_fem
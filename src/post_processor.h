@@ -0,0 +1,214 @@
+#pragma once
+
+#include "element_gradients.h"
+#include "fem.h"
+#include "model.h"
+#include "strain_displacement.h"
+#include "thread_pool.h"
+#include <Eigen/Dense>
+#include <array>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+namespace vulkan_fem {
+
+// equivalent stress, plane stress in 2D
+template <uint32_t DIM>
+Precision VonMises(const VoigtVector<DIM> &stress) {
+  if constexpr (DIM == 2) {
+    return std::sqrt(stress[0] * stress[0] - stress[0] * stress[1] + stress[1] * stress[1] + 3 * stress[2] * stress[2]);
+  } else {
+    const Precision normal = (stress[0] - stress[1]) * (stress[0] - stress[1]) + (stress[1] - stress[2]) * (stress[1] - stress[2]) +
+                             (stress[2] - stress[0]) * (stress[2] - stress[0]);
+    const Precision shear = stress[3] * stress[3] + stress[4] * stress[4] + stress[5] * stress[5];
+    return std::sqrt(normal / 2 + 3 * shear);
+  }
+}
+
+// Recovered fields as one contiguous array per component, laid out for direct upload to GPU buffers
+template <uint32_t DIM>
+struct RecoveredFields {
+  using Components = std::array<std::vector<Precision>, kStrainSize<DIM>>;
+
+  uint32_t point_count_ = 0;  // integration points per element
+
+  // Voigt components at integration points, point p of element e at e * point_count_ + p
+  Components point_strain_;
+  Components point_stress_;
+  std::vector<Precision> point_von_mises_;
+
+  // averaged to the vertices, one value per vertex
+  Components nodal_strain_;
+  Components nodal_stress_;
+  std::vector<Precision> nodal_von_mises_;
+};
+
+// Strain B * u, stress D * B * u and von Mises stress at integration points, smoothed to nodes.
+// Integration point values are extrapolated to the nodes of every element through the shape functions,
+// then averaged over the elements sharing a node, weighted by element volume.
+// Runs on the pool of the caller, which keeps its threads across post processors.
+template <uint32_t DIM = 3>
+class PostProcessor {
+ public:
+  PostProcessor(Model<DIM> &model, ThreadPool &pool)
+      : pool_(pool),
+        node_count_(model.GetElementType()->GetElementCount()),
+        vertex_count_(static_cast<uint32_t>(model.GetVertices().size())),
+        indices_(model.GetIndices()) {
+    LinearMaterial<DIM> material = model.GetMaterial();
+    d_matrix_ = material.GetStiffnessMatrix();
+
+    BuildExtrapolation(*model.GetElementType());
+    BuildVertexElements();
+  }
+
+  // gradients - of the geometry the displacements were computed on, see Solver::GetSolutionGradients
+  RecoveredFields<DIM> Run(const ElementGradients<DIM> &gradients, const VectorX &displacements) {
+    const size_t element_count = indices_.size() / node_count_;
+    const uint32_t point_count = gradients.point_count_;
+    if (gradients.GetElementCount() != element_count || gradients.node_count_ != node_count_ ||
+        point_count != static_cast<uint32_t>(extrapolation_.cols()) || displacements.size() != DIM * vertex_count_) {
+      throw std::runtime_error("post processing input does not match the model");
+    }
+
+    RecoveredFields<DIM> fields;
+    fields.point_count_ = point_count;
+    Resize(fields.point_strain_, element_count * point_count);
+    Resize(fields.point_stress_, element_count * point_count);
+    fields.point_von_mises_.resize(element_count * point_count);
+
+    // per element node values of every field: strain components, stress components, von Mises
+    element_values_.resize(kFieldCount * element_count * node_count_);
+    element_volumes_.resize(element_count);
+
+    pool_.ParallelFor(element_count, [&](size_t begin, size_t end, uint32_t /*thread*/) {
+      VectorX element_displacements(DIM * node_count_);
+      Eigen::Matrix<Precision, Eigen::Dynamic, kFieldCount> point_values(point_count, kFieldCount);
+
+      for (size_t element = begin; element < end; ++element) {
+        const uint16_t *nodes = indices_.data() + element * node_count_;
+        for (uint32_t a = 0; a < node_count_; ++a) {
+          element_displacements.template segment<DIM>(DIM * a) = displacements.template segment<DIM>(DIM * nodes[a]);
+        }
+
+        Precision volume = 0.;
+        for (uint32_t p = 0; p < point_count; ++p) {
+          const size_t point = element * point_count + p;
+          const VoigtVector<DIM> strain = MultiplyStrain<DIM>(gradients.GetGradient(point), element_displacements);
+          const VoigtVector<DIM> stress = d_matrix_ * strain;
+          const Precision von_mises = VonMises<DIM>(stress);
+
+          for (int k = 0; k < kStrainSize<DIM>; ++k) {
+            fields.point_strain_[k][point] = strain[k];
+            fields.point_stress_[k][point] = stress[k];
+          }
+          fields.point_von_mises_[point] = von_mises;
+
+          point_values.row(p) << strain.transpose(), stress.transpose(), von_mises;
+          volume += gradients.GetScale(point);
+        }
+
+        // node_count_ x kFieldCount, stored field major for the gather below
+        const Eigen::Matrix<Precision, Eigen::Dynamic, kFieldCount> node_values = extrapolation_ * point_values;
+        for (int field = 0; field < kFieldCount; ++field) {
+          Eigen::Map<VectorX>(element_values_.data() + (field * element_count + element) * node_count_, node_count_) = node_values.col(field);
+        }
+        element_volumes_[element] = std::abs(volume);
+      }
+    });
+
+    // gather per vertex, race free without atomics
+    Resize(fields.nodal_strain_, vertex_count_);
+    Resize(fields.nodal_stress_, vertex_count_);
+    fields.nodal_von_mises_.assign(vertex_count_, 0.);
+
+    pool_.ParallelFor(vertex_count_, [&](size_t begin, size_t end, uint32_t /*thread*/) {
+      std::array<Precision, kFieldCount> sums;
+      for (size_t vertex = begin; vertex < end; ++vertex) {
+        sums.fill(0.);
+        Precision weight = 0.;
+        for (uint32_t k = vertex_offsets_[vertex]; k < vertex_offsets_[vertex + 1]; ++k) {
+          const uint32_t slot = vertex_slots_[k];  // element * node_count_ + local node
+          const Precision volume = element_volumes_[slot / node_count_];
+          for (int field = 0; field < kFieldCount; ++field) {
+            sums[field] += volume * element_values_[field * element_count * node_count_ + slot];
+          }
+          weight += volume;
+        }
+
+        if (weight == 0) {
+          continue;  // vertex outside of every element
+        }
+        for (int k = 0; k < kStrainSize<DIM>; ++k) {
+          fields.nodal_strain_[k][vertex] = sums[k] / weight;
+          fields.nodal_stress_[k][vertex] = sums[kStrainSize<DIM> + k] / weight;
+        }
+        fields.nodal_von_mises_[vertex] = sums[2 * kStrainSize<DIM>] / weight;
+      }
+    });
+
+    return fields;
+  }
+
+ private:
+  static constexpr int kFieldCount = 2 * kStrainSize<DIM> + 1;
+
+  static void Resize(typename RecoveredFields<DIM>::Components &components, size_t size) {
+    for (auto &component : components) {
+      component.assign(size, 0.);
+    }
+  }
+
+  // nodes x points, least squares fit of the point values with the element shape functions.
+  // Elements with fewer points than nodes cannot be fitted and get the element mean instead.
+  void BuildExtrapolation(const Element<DIM> &element_type) {
+    const auto points = element_type.GetIntegrationPoints();
+    const auto point_count = static_cast<Eigen::Index>(points.size());
+
+    Eigen::MatrixXf shapes(point_count, node_count_);
+    for (Eigen::Index p = 0; p < point_count; ++p) {
+      const std::vector<Precision> shape = element_type.CalcShape(points[p]);
+      shapes.row(p) = Eigen::Map<const Eigen::RowVectorXf>(shape.data(), node_count_);
+    }
+
+    if (point_count >= node_count_) {
+      extrapolation_ = shapes.completeOrthogonalDecomposition().pseudoInverse();
+    } else {
+      extrapolation_ = Eigen::MatrixXf::Constant(node_count_, point_count, Precision(1.) / point_count);
+    }
+  }
+
+  // vertex -> (element, local node) slots in CSR form
+  void BuildVertexElements() {
+    vertex_offsets_.assign(vertex_count_ + 1, 0);
+    for (const auto vertex : indices_) {
+      ++vertex_offsets_[vertex + 1];
+    }
+    for (uint32_t vertex = 0; vertex < vertex_count_; ++vertex) {
+      vertex_offsets_[vertex + 1] += vertex_offsets_[vertex];
+    }
+
+    vertex_slots_.resize(indices_.size());
+    std::vector<uint32_t> fill(vertex_offsets_.begin(), vertex_offsets_.end() - 1);
+    for (uint32_t slot = 0; slot < indices_.size(); ++slot) {
+      vertex_slots_[fill[indices_[slot]]++] = slot;
+    }
+  }
+
+  ThreadPool &pool_;
+
+  const uint32_t node_count_;
+  const uint32_t vertex_count_;
+  const std::vector<uint16_t> indices_;
+  MatrixConstitutive<DIM> d_matrix_;
+
+  Eigen::MatrixXf extrapolation_;
+  std::vector<uint32_t> vertex_offsets_;
+  std::vector<uint32_t> vertex_slots_;
+
+  std::vector<Precision> element_values_;
+  std::vector<Precision> element_volumes_;
+};
+
+}  // namespace vulkan_fem
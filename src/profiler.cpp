@@ -0,0 +1,174 @@
+#include "profiler.h"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <fstream>
+
+namespace vulkan_fem {
+namespace {
+
+constexpr uint32_t kCpuProcess = 1;
+constexpr uint32_t kGpuProcess = 2;
+constexpr double kMegabyte = 1024.0 * 1024.0;
+
+// names are literals, quotes and backslashes are all that may need escaping
+std::string Escape(const char *text) {
+  std::string escaped;
+  for (const char *c = text; *c != '\0'; ++c) {
+    if (*c == '"' || *c == '\\') {
+      escaped += '\\';
+    }
+    escaped += *c;
+  }
+  return escaped;
+}
+
+}  // namespace
+
+std::atomic<bool> Profiler::enabled_{false};
+
+Profiler &Profiler::Get() {
+  static Profiler profiler;
+  return profiler;
+}
+
+uint32_t Profiler::GetThreadIndex() {
+  // 0 is the GPU track
+  static std::atomic<uint32_t> next{1};
+  thread_local const uint32_t index = next.fetch_add(1, std::memory_order_relaxed);
+  return index;
+}
+
+double Profiler::ToMicroseconds(Clock::time_point time) const {
+  return std::chrono::duration<double, std::micro>(time - epoch_).count();
+}
+
+void Profiler::Record(const Event &event) {
+  if (events_.size() < kMaxEvents) {
+    events_.push_back(event);
+  } else {
+    ++dropped_events_;
+  }
+}
+
+void Profiler::AddSpan(const char *name, const char *category, Clock::time_point start, Clock::time_point end, size_t peak_bytes) {
+  const double duration_ms = std::chrono::duration<double, std::milli>(end - start).count();
+  const Event event{name, category, 'X', GetThreadIndex(), ToMicroseconds(start), duration_ms * 1000.0, peak_bytes};
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  Record(event);
+  SpanTotals &totals = spans_[name];
+  ++totals.calls_;
+  totals.total_ms_ += duration_ms;
+  totals.max_ms_ = std::max(totals.max_ms_, duration_ms);
+  totals.peak_bytes_ = std::max(totals.peak_bytes_, peak_bytes);
+}
+
+void Profiler::AddGpuSpan(const char *name, Clock::time_point start, double duration_ms) {
+  const Event event{name, "gpu", 'X', kGpuThread, ToMicroseconds(start), duration_ms * 1000.0, 0};
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  Record(event);
+  SpanTotals &totals = spans_[name];
+  ++totals.calls_;
+  totals.total_ms_ += duration_ms;
+  totals.max_ms_ = std::max(totals.max_ms_, duration_ms);
+  totals.gpu_ = true;
+}
+
+void Profiler::Count(const char *name, double value) {
+  const double now_us = ToMicroseconds(Clock::now());
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  double &total = counters_[name];
+  total += value;
+  Record({name, "counter", 'C', GetThreadIndex(), now_us, total, 0});
+}
+
+bool Profiler::WriteChromeTrace(const std::string &path) const {
+  std::ofstream file(path);
+  if (!file.is_open()) {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+  file << R"({"name":"process_name","ph":"M","pid":)" << kCpuProcess << R"(,"tid":0,"args":{"name":"host"}},)" << '\n';
+  file << R"({"name":"process_name","ph":"M","pid":)" << kGpuProcess << R"(,"tid":0,"args":{"name":"GPU"}})";
+  for (const Event &event : events_) {
+    const uint32_t process = event.thread_ == kGpuThread ? kGpuProcess : kCpuProcess;
+    file << ",\n{\"name\":\"" << Escape(event.name_) << "\",\"cat\":\"" << Escape(event.category_) << "\",\"ph\":\"" << event.phase_
+         << "\",\"pid\":" << process << ",\"tid\":" << event.thread_ << ",\"ts\":" << fmt::format("{:.3f}", event.start_us_);
+    if (event.phase_ == 'X') {
+      file << ",\"dur\":" << fmt::format("{:.3f}", event.value_);
+      if (event.thread_ != kGpuThread) {
+        file << ",\"args\":{\"peak_bytes\":" << event.peak_bytes_ << '}';
+      }
+      file << '}';
+    } else {
+      file << ",\"args\":{\"total\":" << event.value_ << "}}";
+    }
+  }
+  file << "\n]}\n";
+  return file.good();
+}
+
+void Profiler::LogSummary() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (spans_.empty() && counters_.empty()) {
+    return;
+  }
+
+  // slowest first
+  std::vector<std::pair<const std::string *, const SpanTotals *>> rows;
+  rows.reserve(spans_.size());
+  for (const auto &[name, totals] : spans_) {
+    rows.emplace_back(&name, &totals);
+  }
+  std::sort(rows.begin(), rows.end(), [](const auto &a, const auto &b) { return a.second->total_ms_ > b.second->total_ms_; });
+
+  spdlog::info("{:<32} {:>4} {:>8} {:>12} {:>10} {:>10} {:>10}", "span", "on", "calls", "total ms", "mean ms", "max ms", "peak MB");
+  for (const auto &[name, totals] : rows) {
+    spdlog::info("{:<32} {:>4} {:>8} {:>12.3f} {:>10.3f} {:>10.3f} {:>10}", *name, totals->gpu_ ? "gpu" : "cpu", totals->calls_,
+                 totals->total_ms_, totals->total_ms_ / static_cast<double>(totals->calls_), totals->max_ms_,
+                 totals->gpu_ ? std::string("-") : fmt::format("{:.2f}", static_cast<double>(totals->peak_bytes_) / kMegabyte));
+  }
+  for (const auto &[name, total] : counters_) {
+    spdlog::info("{:<32} {:>14}", name, total);
+  }
+  spdlog::info("tracked host memory peak {:.2f} MB, {:.2f} MB held", static_cast<double>(MemoryTracker::GetPeakBytes()) / kMegabyte,
+               static_cast<double>(MemoryTracker::GetCurrentBytes()) / kMegabyte);
+  if (dropped_events_ > 0) {
+    spdlog::warn("{} trace events dropped beyond {}, they are counted above", dropped_events_, kMaxEvents);
+  }
+}
+
+void Profiler::Clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  events_.clear();
+  dropped_events_ = 0;
+  spans_.clear();
+  counters_.clear();
+}
+
+ProfileSession::ProfileSession(const char *trace_path) : trace_path_(trace_path != nullptr ? trace_path : "") {
+  if (!trace_path_.empty()) {
+    Profiler::SetEnabled(true);
+  }
+}
+
+ProfileSession::~ProfileSession() {
+  if (trace_path_.empty()) {
+    return;
+  }
+  Profiler::SetEnabled(false);
+
+  Profiler &profiler = Profiler::Get();
+  profiler.LogSummary();
+  if (profiler.WriteChromeTrace(trace_path_)) {
+    spdlog::info("trace written to {}", trace_path_);
+  } else {
+    spdlog::warn("failed to write trace {}", trace_path_);
+  }
+}
+
+}  // namespace vulkan_fem
@@ -0,0 +1,129 @@
+#pragma once
+
+#include "memory_tracker.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace vulkan_fem {
+
+// Process wide collector of timed spans and counters, written as a Chrome trace (chrome://tracing, Perfetto)
+// and summarized per name. Host spans carry the MemoryTracker peak reached during them. Disabled by default,
+// every instrumentation point then costs one relaxed load. Names and categories are not copied, they have to be
+// string literals.
+class Profiler {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  static Profiler &Get();
+
+  [[nodiscard]] static bool IsEnabled() { return enabled_.load(std::memory_order_relaxed); }
+  static void SetEnabled(bool enabled) { enabled_.store(enabled, std::memory_order_relaxed); }
+
+  // span on the calling thread's track
+  void AddSpan(const char *name, const char *category, Clock::time_point start, Clock::time_point end, size_t peak_bytes = 0);
+  // GPU pass on the GPU track, placed on the host timeline by the caller
+  void AddGpuSpan(const char *name, Clock::time_point start, double duration_ms);
+  // adds to the counter's running total, which is sampled into the trace
+  void Count(const char *name, double value);
+
+  // false when the file could not be written
+  bool WriteChromeTrace(const std::string &path) const;
+  // calls, total, mean and max time and the peak tracked bytes per span name, then the counter totals
+  void LogSummary() const;
+  void Clear();
+
+ private:
+  struct Event {
+    const char *name_;
+    const char *category_;
+    char phase_;       // 'X' complete span, 'C' counter sample
+    uint32_t thread_;  // kGpuThread for GPU passes
+    double start_us_;  // since epoch_
+    double value_;     // duration in microseconds, or the counter total
+    size_t peak_bytes_;
+  };
+
+  struct SpanTotals {
+    uint64_t calls_ = 0;
+    double total_ms_ = 0.0;
+    double max_ms_ = 0.0;
+    size_t peak_bytes_ = 0;
+    bool gpu_ = false;
+  };
+
+  static constexpr uint32_t kGpuThread = 0;
+  // about 48 MB of events, spans beyond it still count in the summary
+  static constexpr size_t kMaxEvents = size_t{1} << 20;
+
+  Profiler() : epoch_(Clock::now()) {}
+
+  static uint32_t GetThreadIndex();
+  void Record(const Event &event);
+  [[nodiscard]] double ToMicroseconds(Clock::time_point time) const;
+
+  static std::atomic<bool> enabled_;
+
+  const Clock::time_point epoch_;
+  mutable std::mutex mutex_;
+  std::vector<Event> events_;
+  size_t dropped_events_ = 0;
+  std::map<std::string, SpanTotals> spans_;
+  std::map<std::string, double> counters_;
+};
+
+// Times its scope into the Profiler, with the peak tracked bytes of the scope as a memory phase. Whether it
+// records is decided on construction, so a scope entered while profiling is disabled stays unrecorded.
+class ScopedTimer {
+ public:
+  explicit ScopedTimer(const char *name, const char *category = "cpu")
+      : name_(Profiler::IsEnabled() ? name : nullptr), category_(category) {
+    if (name_ != nullptr) {
+      outer_peak_ = MemoryTracker::BeginPhase();
+      start_ = Profiler::Clock::now();
+    }
+  }
+
+  ~ScopedTimer() {
+    if (name_ != nullptr) {
+      const Profiler::Clock::time_point end = Profiler::Clock::now();
+      Profiler::Get().AddSpan(name_, category_, start_, end, MemoryTracker::EndPhase(outer_peak_));
+    }
+  }
+
+  ScopedTimer(const ScopedTimer &) = delete;
+  ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+ private:
+  const char *name_;
+  const char *category_;
+  Profiler::Clock::time_point start_;
+  size_t outer_peak_ = 0;
+};
+
+// counter increment, nothing while profiling is disabled
+inline void ProfileCount(const char *name, double value) {
+  if (Profiler::IsEnabled()) {
+    Profiler::Get().Count(name, value);
+  }
+}
+
+// Enables profiling for its lifetime when given a trace path, then logs the summary and writes the trace.
+// Null or empty leaves profiling disabled.
+class ProfileSession {
+ public:
+  explicit ProfileSession(const char *trace_path);
+  ~ProfileSession();
+
+  ProfileSession(const ProfileSession &) = delete;
+  ProfileSession &operator=(const ProfileSession &) = delete;
+
+ private:
+  std::string trace_path_;
+};
+
+}  // namespace vulkan_fem
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "fem.h"
+#include <array>
+#include <stdexcept>
+#include <vector>
+
+namespace vulkan_fem {
+
+// Gauss-Legendre rule on [-1, 1] with N points, exact for polynomials up to 2N - 1
+template <uint32_t N>
+struct GaussLegendre;
+
+template <>
+struct GaussLegendre<1> {
+  static constexpr std::array<Precision, 1> kPoints{0.};
+  static constexpr std::array<Precision, 1> kWeights{2.};
+};
+
+template <>
+struct GaussLegendre<2> {
+  static constexpr std::array<Precision, 2> kPoints{-0.577350269189625764, 0.577350269189625764};
+  static constexpr std::array<Precision, 2> kWeights{1., 1.};
+};
+
+template <>
+struct GaussLegendre<3> {
+  static constexpr std::array<Precision, 3> kPoints{-0.774596669241483377, 0., 0.774596669241483377};
+  static constexpr std::array<Precision, 3> kWeights{5. / 9., 8. / 9., 5. / 9.};
+};
+
+template <>
+struct GaussLegendre<4> {
+  static constexpr std::array<Precision, 4> kPoints{-0.861136311594052575, -0.339981043584856265, 0.339981043584856265,
+                                                    0.861136311594052575};
+  static constexpr std::array<Precision, 4> kWeights{0.347854845137453857, 0.652145154862546143, 0.652145154862546143,
+                                                     0.347854845137453857};
+};
+
+// Tensor product of the 1D rule on [-1, 1]^DIM.
+// Points are ordered with the first coordinate running fastest, which is the layout
+// expected by the sum-factorization kernels.
+template <uint32_t DIM, uint32_t N>
+struct TensorGauss {
+  static constexpr uint32_t kPointCount = DIM == 1 ? N : (DIM == 2 ? N * N : N * N * N);
+
+  static const std::vector<std::vector<Precision>> &GetPoints() {
+    static const std::vector<std::vector<Precision>> kIntegrationPoints = [] {
+      std::vector<std::vector<Precision>> points;
+      points.reserve(kPointCount);
+      for (uint32_t p = 0; p < kPointCount; ++p) {
+        std::vector<Precision> point(DIM);
+        uint32_t rest = p;
+        for (uint32_t d = 0; d < DIM; ++d) {
+          point[d] = GaussLegendre<N>::kPoints[rest % N];
+          rest /= N;
+        }
+        points.push_back(point);
+      }
+      return points;
+    }();
+    return kIntegrationPoints;
+  }
+
+  static Precision GetWeight(uint32_t p) {
+    if (p >= kPointCount) {
+      throw std::out_of_range("integration point index out of range");
+    }
+
+    Precision weight = 1.;
+    for (uint32_t d = 0; d < DIM; ++d) {
+      weight *= GaussLegendre<N>::kWeights[p % N];
+      p /= N;
+    }
+    return weight;
+  }
+};
+
+}  // namespace vulkan_fem
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "elements.h"
+#include "enumerate.h"
+#include "fem.h"
+#include <Eigen/Dense>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+namespace vulkan_fem {
+
+// Shape functions of an element type and their local derivatives at its integration points. They do not depend
+// on the geometry, element loops read them from here instead of calling CalcShape / CalcDShape per element.
+template <uint32_t DIM>
+struct ReferenceElement {
+  uint32_t node_count_ = 0;
+  uint32_t point_count_ = 0;
+  std::vector<Precision> shapes_;   // N, node_count_ per point
+  std::vector<Precision> dshapes_;  // dN/dxi, DIM x node_count_ column major per point
+  std::vector<Precision> weights_;
+
+  explicit ReferenceElement(Element<DIM> &element) : node_count_(element.GetElementCount()) {
+    if (node_count_ > kMaxElementNodes) {
+      throw std::runtime_error("element has more than kMaxElementNodes nodes");
+    }
+
+    for (const auto &[p, ip] : Enumerate(element.GetIntegrationPoints())) {
+      const std::vector<Precision> shape = element.CalcShape(ip);
+      const MatrixFixedRows<DIM> dshape = element.CalcDShape(ip);
+      shapes_.insert(shapes_.end(), shape.begin(), shape.end());
+      dshapes_.insert(dshapes_.end(), dshape.data(), dshape.data() + dshape.size());
+      weights_.push_back(element.GetIntegrationWeight(static_cast<uint8_t>(p)));
+    }
+    point_count_ = static_cast<uint32_t>(weights_.size());
+  }
+
+  [[nodiscard]] Eigen::Map<const VectorX> GetShape(uint32_t point) const { return {shapes_.data() + point * node_count_, node_count_}; }
+
+  [[nodiscard]] Eigen::Map<const MatrixFixedRows<DIM>> GetDShape(uint32_t point) const {
+    return {dshapes_.data() + point * DIM * node_count_, DIM, node_count_};
+  }
+};
+
+}  // namespace vulkan_fem
@@ -0,0 +1,96 @@
+#include "restart_benchmark.h"
+#include "model_factory.h"
+#include "solver.h"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <memory>
+#include <utility>
+
+namespace vulkan_fem {
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr uint32_t kSteps = 100;
+// the only multiple of the checkpoint interval among the steps
+constexpr uint32_t kCheckpointStep = 60;
+
+double GetMilliseconds(Clock::time_point start, Clock::time_point end) {
+  return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+NewmarkOptions GetNewmarkOptions() {
+  NewmarkOptions options;
+  options.time_step_ = 1e-2;
+  options.end_time_ = kSteps * options.time_step_;
+  options.alpha_ = -0.1F;
+  return options;
+}
+
+}  // namespace
+
+int RunRestartBenchmark(const std::string &path, Compression compression, uint32_t elements) {
+  try {
+    // 16 bit indices bound the node count
+    elements = std::clamp(elements, 2U, 62U);
+
+    // from scratch, checkpointing once on the way
+    const auto model = ModelFactory::CreateBlock(elements, elements / 2, elements / 2);
+    spdlog::info("transient restart on {} nodes, {} steps", model->GetVertices().size(), kSteps);
+
+    NewmarkOptions options = GetNewmarkOptions();
+    const auto writer = std::make_shared<ArchiveWriter>(compression);
+    options.checkpoint_ = {writer, path, kCheckpointStep};
+
+    Solver<3> solver;
+    const Clock::time_point start = Clock::now();
+    Clock::time_point checkpoint_reached;
+    const TransientResult full = solver.SolveTransient(*model, options, [&](uint32_t step, Precision /*time*/, const VectorX & /*u*/) {
+      if (step == kCheckpointStep) {
+        checkpoint_reached = Clock::now();
+      }
+    });
+    const Clock::time_point solved = Clock::now();
+    writer->Flush();
+
+    // restart on a fresh model and solver, the rest of the run should not need to assemble or factorize
+    const auto restarted_model = ModelFactory::CreateBlock(elements, elements / 2, elements / 2);
+    Solver<3> restarted_solver;
+    const Clock::time_point restart_start = Clock::now();
+    const Archive archive = Archive::Read(path);
+    const Clock::time_point read = Clock::now();
+    restarted_model->Restore(archive);
+    restarted_solver.RestoreState(*restarted_model, archive);
+    TransientResult state;
+    state.Restore(archive);
+    const Clock::time_point restored = Clock::now();
+    const TransientResult resumed = restarted_solver.ResumeTransient(*restarted_model, GetNewmarkOptions(), std::move(state));
+    const Clock::time_point finished = Clock::now();
+
+    const auto file_bytes = std::filesystem::file_size(path);
+    spdlog::info("checkpoint at step {}: {} bytes, {} bytes uncompressed ({:.2f}x)", kCheckpointStep, file_bytes, archive.GetBytes(),
+                 static_cast<double>(archive.GetBytes()) / static_cast<double>(file_bytes));
+    spdlog::info("{:>28} {:>12}", "", "ms");
+    spdlog::info("{:>28} {:>12.1f}", "scratch to checkpoint", GetMilliseconds(start, checkpoint_reached));
+    spdlog::info("{:>28} {:>12.1f}", "read checkpoint", GetMilliseconds(restart_start, read));
+    spdlog::info("{:>28} {:>12.1f}", "restore checkpoint", GetMilliseconds(read, restored));
+    spdlog::info("{:>28} {:>12.1f}", "rest of the run, scratch", GetMilliseconds(checkpoint_reached, solved));
+    spdlog::info("{:>28} {:>12.1f}", "rest of the run, restarted", GetMilliseconds(restored, finished));
+
+    const Precision difference = (resumed.displacements_ - full.displacements_).cwiseAbs().maxCoeff();
+    if (resumed.steps_ != full.steps_ || difference != 0) {
+      spdlog::error("restarted run ends at step {} with displacements {} off the uninterrupted run", resumed.steps_, difference);
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+  } catch (const std::exception &e) {
+    spdlog::error("restart benchmark failed: {}", e.what());
+    return EXIT_FAILURE;
+  }
+}
+
+}  // namespace vulkan_fem
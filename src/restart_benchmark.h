@@ -0,0 +1,15 @@
+#pragma once
+
+#include "archive.h"
+#include <cstdint>
+#include <string>
+
+namespace vulkan_fem {
+
+// Runs a transient solve of a cantilever block of elements x elements/2 x elements/2 hexahedra that checkpoints to
+// path once on the way, then restarts a fresh model and solver from the checkpoint and finishes the run. Logs the
+// checkpoint size, the time to reach the checkpoint from scratch against the time to restore it, and returns a
+// non-zero exit code when the restarted run does not end in the same state.
+int RunRestartBenchmark(const std::string &path, Compression compression, uint32_t elements);
+
+}  // namespace vulkan_fem
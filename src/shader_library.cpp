@@ -0,0 +1,47 @@
+#include "shader_library.h"
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace vulkan_fem {
+
+// embedded_shaders.cpp, generated by shaders/embed_shaders.cmake
+extern const size_t kEmbeddedShaderCount;
+extern const char *const kEmbeddedShaderNames[];
+extern const unsigned char *const kEmbeddedShaderCode[];
+extern const size_t kEmbeddedShaderSizes[];
+
+namespace {
+
+std::vector<char> ReadShaderFile(const std::string &path) {
+  std::ifstream file(path, std::ios::ate | std::ios::binary);
+  if (!file.is_open()) {
+    throw std::runtime_error("failed to open shader " + path);
+  }
+
+  std::vector<char> code(static_cast<size_t>(file.tellg()));
+  file.seekg(0);
+  file.read(code.data(), static_cast<std::streamsize>(code.size()));
+  return code;
+}
+
+}  // namespace
+
+std::vector<char> LoadShader(const std::string &name) {
+  if (const char *directory = std::getenv("VULKAN_FEM_SHADER_DIR"); directory != nullptr && *directory != '\0') {
+    return ReadShaderFile(std::string(directory) + "/" + name + ".spv");
+  }
+
+  for (size_t i = 0; i < kEmbeddedShaderCount; ++i) {
+    if (std::strcmp(kEmbeddedShaderNames[i], name.c_str()) == 0) {
+      const auto *code = reinterpret_cast<const char *>(kEmbeddedShaderCode[i]);
+      return {code, code + kEmbeddedShaderSizes[i]};
+    }
+  }
+
+  throw std::runtime_error("shader " + name + " is not embedded, rebuild the shaders_build target");
+}
+
+}  // namespace vulkan_fem
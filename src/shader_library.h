@@ -0,0 +1,12 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace vulkan_fem {
+
+// SPIR-V of shaders/<name>, e.g. "shader.vert", compiled into the executable by the shaders_build target.
+// With VULKAN_FEM_SHADER_DIR set, <dir>/<name>.spv is read instead, to try shader changes without relinking.
+std::vector<char> LoadShader(const std::string &name);
+
+}  // namespace vulkan_fem
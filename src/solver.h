@@ -1,30 +1,643 @@
 #pragma once
 
+#include "archive.h"
+#include "device_solver.h"
+#include "element_gradients.h"
+#include "factorization.h"
 #include "fem.h"
+#include "iterative.h"
+#include "memory_estimate.h"
+#include "memory_tracker.h"
 #include "model.h"
-#include <iostream>
+#include "profiler.h"
+#include "sparse.h"
+#include "sum_factorization.h"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <utility>
 
 namespace vulkan_fem {
 
+enum class SolverMethod {
+  kDirect,                       // SimplicialLDLT on the upper triangle
+  kConjugateGradient,            // Jacobi preconditioned CG with symmetric SpMV
+  kBlockConjugateGradient,       // block Jacobi preconditioned CG on block sparse (BSR) storage
+  kDeviceConjugateGradient,      // Jacobi preconditioned CG on the compute device, kConjugateGradient without one
+  kMatrixFreeConjugateGradient,  // Jacobi preconditioned CG applying K per element by sum factorization, hexahedra only
+};
+
+struct SolverOptions {
+  SolverMethod method_ = SolverMethod::kDirect;
+  uint32_t max_iterations_ = 10000;
+  Precision tolerance_ = 1e-6;
+  // Host bytes a Solve may take, 0 for no limit. When the estimated peak of the method exceeds it, Solve falls back
+  // to kConjugateGradient, then to kBlockConjugateGradient, which assembles without triplets, and for hexahedra
+  // finally to kMatrixFreeConjugateGradient, which assembles nothing.
+  size_t memory_budget_ = 0;
+};
+
+// state of a long run handed to writer_ every interval_ steps, the writer compresses and writes it in the background
+struct CheckpointOptions {
+  std::shared_ptr<ArchiveWriter> writer_;
+  std::string path_;
+  uint32_t interval_ = 0;  // no checkpoints when 0
+
+  [[nodiscard]] bool IsDue(uint32_t step) const { return writer_ && interval_ > 0 && step % interval_ == 0; }
+};
+
+// Newmark-beta time integration with HHT-alpha numerical damping
+struct NewmarkOptions {
+  Precision time_step_ = 1e-3;
+  Precision end_time_ = 1.;
+  // HHT alpha in [-1/3, 0], 0 is the average acceleration scheme, negative values damp high frequencies
+  Precision alpha_ = 0.;
+  // Rayleigh damping C = mass_damping_ * M + stiffness_damping_ * K
+  Precision mass_damping_ = 0.;
+  Precision stiffness_damping_ = 0.;
+  MassType mass_type_ = MassType::kConsistent;
+  // loads are scaled by load_curve_(t), a step load when empty
+  std::function<Precision(Precision)> load_curve_;
+  CheckpointOptions checkpoint_;
+};
+
+struct TransientResult {
+  uint32_t steps_ = 0;
+  Precision time_ = 0.;
+  VectorX displacements_;
+  VectorX velocities_;
+  VectorX accelerations_;
+
+  void Save(Archive &archive) const {
+    archive.PutValue("transient.steps", steps_);
+    archive.PutValue("transient.time", time_);
+    archive.PutVector("transient.displacements", displacements_);
+    archive.PutVector("transient.velocities", velocities_);
+    archive.PutVector("transient.accelerations", accelerations_);
+  }
+
+  void Restore(const Archive &archive) {
+    steps_ = archive.GetValue<uint32_t>("transient.steps");
+    time_ = archive.GetValue<Precision>("transient.time");
+    displacements_ = archive.GetVector("transient.displacements");
+    velocities_ = archive.GetVector("transient.velocities");
+    accelerations_ = archive.GetVector("transient.accelerations");
+  }
+};
+
+// called after every step with (step, time, displacements)
+using TransientCallback = std::function<void(uint32_t, Precision, const VectorX &)>;
+
+// Shared between a running Solve and other threads. Progress and the cancel flag are polled between
+// the solve phases and on every CG iteration, a direct factorization runs to its end.
+struct SolveControl {
+  std::atomic<bool> cancel_{false};
+  std::atomic<float> progress_{0.F};  // 0 to 1
+};
+
+class SolveCancelled : public std::runtime_error {
+ public:
+  SolveCancelled() : std::runtime_error("solve cancelled") {}
+};
+
 template <uint32_t DIM = 3>
 class Solver {
  public:
+  Solver() = default;
+  explicit Solver(SolverOptions options) : options_(options) {}
+
+  using ElementMatrix = typename Model<DIM>::ElementMatrix;
+  using Factorization = RestorableLDLT<ElementMatrix, Eigen::Upper>;
+
   void Solve(Model<DIM> &model) {
-    auto global_stiffness_matrix = model.BuildGlobalStiffnessMatrix();  // K_global
-    std::cout << "global_stiffness_matrix: " << global_stiffness_matrix << std::endl;
+    const ScopedTimer timer("solve", "solver");
+    Checkpoint(0.F);
+    const SolverMethod method = ChooseMethod(model);
+    if (method == SolverMethod::kBlockConjugateGradient) {
+      displacements_ = SolveBlock(model);
+    } else if (method == SolverMethod::kMatrixFreeConjugateGradient) {
+      displacements_ = SolveMatrixFree(model);
+    } else {
+      displacements_ = SolveScalar(model, method);
+    }
+
+    spdlog::debug("displacements: {}", displacements_);
+
+    // gradients of the undeformed geometry, filled by the assembly, for stress recovery
+    solution_gradients_ = model.GetElementGradients();
+    model.AccountDisplacements(displacements_);
+
+    Checkpoint(1.F);
+  }
+
+  // progress and cancellation of Solve, may be null
+  void SetControl(std::shared_ptr<SolveControl> control) { control_ = std::move(control); }
+
+  // compute device for kDeviceConjugateGradient, may be null
+  void SetDevice(std::shared_ptr<DeviceSolver> device) { device_ = std::move(device); }
+
+  // displacements of the last Solve
+  [[nodiscard]] const VectorX &GetDisplacements() const { return displacements_; }
+  // shape function gradients of the geometry the last Solve was done on
+  [[nodiscard]] std::shared_ptr<const ElementGradients<DIM>> GetSolutionGradients() const { return solution_gradients_; }
+
+  // Transient response from rest. The effective stiffness is factorized once per time step size,
+  // every step is then two symmetric SpMVs and a back substitution. Model geometry is left unchanged.
+  TransientResult SolveTransient(Model<DIM> &model, const NewmarkOptions &options, const TransientCallback &callback = {}) {
+    return IntegrateTransient(model, options, TransientResult{}, callback);
+  }
+
+  // continues a transient run from state, e.g. a checkpoint restored with Model::Restore and RestoreState, up to the
+  // end time of options. With the same options the restored factorizations are used as they are.
+  TransientResult ResumeTransient(Model<DIM> &model, const NewmarkOptions &options, TransientResult state,
+                                  const TransientCallback &callback = {}) {
+    const auto dofs = static_cast<Eigen::Index>(DIM * model.GetVertices().size());
+    if (state.displacements_.size() != dofs || state.velocities_.size() != dofs || state.accelerations_.size() != dofs) {
+      throw std::runtime_error("transient state does not match the model");
+    }
+    return IntegrateTransient(model, options, std::move(state), callback);
+  }
+
+  // the matrices and factorizations cached for the current geometry of model and the last displacements, for a restart
+  void SaveState(const Model<DIM> &model, Archive &archive) const {
+    if (displacements_.size() > 0) {
+      archive.PutVector("solver.displacements", displacements_);
+    }
+    if (stiffness_revision_ == model.GetRevision()) {
+      archive.PutSparse("solver.stiffness", stiffness_);
+      if (factorization_) {
+        factorization_->Save(archive, "solver.factorization");
+      }
+    }
+    if (mass_revision_ == model.GetRevision()) {
+      archive.PutSparse("solver.mass", mass_);
+      archive.PutValue("solver.mass_type", mass_type_);
+    }
+    if (effective_factorization_ && std::get<0>(effective_key_) == model.GetRevision()) {
+      effective_factorization_->Save(archive, "solver.effective_factorization");
+      archive.PutValue("solver.effective_mass_type", std::get<1>(effective_key_));
+      const Precision scales[2] = {std::get<2>(effective_key_), std::get<3>(effective_key_)};
+      archive.PutArray("solver.effective_scales", scales, 2);
+    }
+  }
+
+  // what SaveState archived, for model already restored from the same archive
+  void RestoreState(const Model<DIM> &model, const Archive &archive) {
+    const ScopedTimer timer("restore solver state", "solver");
+    const auto dofs = static_cast<Eigen::Index>(DIM * model.GetVertices().size());
+    const auto check_size = [dofs](Eigen::Index rows, Eigen::Index cols) {
+      if (rows != dofs || cols != dofs) {
+        throw std::runtime_error("archived solver state does not match the model");
+      }
+    };
+
+    if (archive.Has("solver.displacements")) {
+      displacements_ = archive.GetVector("solver.displacements");
+    }
+    if (archive.Has("solver.stiffness.size")) {
+      stiffness_ = archive.GetSparse<ElementMatrix>("solver.stiffness");
+      check_size(stiffness_.rows(), stiffness_.cols());
+      stiffness_bytes_.Set(GetSparseBytes(stiffness_));
+      stiffness_revision_ = model.GetRevision();
+      factorization_.reset();
+      factorization_bytes_.Set(0);
+      if (archive.Has("solver.factorization.factor.size")) {
+        factorization_ = RestoreFactorization(archive, "solver.factorization", factorization_bytes_);
+        check_size(factorization_->rows(), factorization_->cols());
+      }
+    }
+    if (archive.Has("solver.mass.size")) {
+      mass_ = archive.GetSparse<ElementMatrix>("solver.mass");
+      check_size(mass_.rows(), mass_.cols());
+      mass_bytes_.Set(GetSparseBytes(mass_));
+      mass_revision_ = model.GetRevision();
+      mass_type_ = archive.GetValue<MassType>("solver.mass_type");
+    }
+    if (archive.Has("solver.effective_factorization.factor.size")) {
+      effective_factorization_.reset();
+      effective_factorization_bytes_.Set(0);
+      effective_factorization_ = RestoreFactorization(archive, "solver.effective_factorization", effective_factorization_bytes_);
+      check_size(effective_factorization_->rows(), effective_factorization_->cols());
+      const auto scales = archive.GetArray<Precision>("solver.effective_scales");
+      if (scales.size() != 2) {
+        throw std::runtime_error("archived effective stiffness scales are inconsistent");
+      }
+      effective_key_ = std::make_tuple(model.GetRevision(), archive.GetValue<MassType>("solver.effective_mass_type"), scales[0], scales[1]);
+    }
+  }
+
+  // constrained K in upper storage, rebuilt only when the model revision changes
+  const ElementMatrix &AssembleStiffness(Model<DIM> &model) {
+    if (stiffness_revision_ != model.GetRevision()) {
+      // K is symmetric, only the upper triangle is assembled and stored
+      stiffness_ = model.BuildGlobalStiffnessMatrix(StiffnessStorage::kUpper);  // K_global
+      stiffness_bytes_.Set(GetSparseBytes(stiffness_));
+      model.ApplyConstraints(stiffness_);
+      stiffness_revision_ = model.GetRevision();
+      factorization_.reset();
+      factorization_bytes_.Set(0);
+    }
+    return stiffness_;
+  }
+
+  // mass matrix in upper storage with zero rows and columns at constrained dofs, cached like K
+  const ElementMatrix &AssembleMass(Model<DIM> &model, MassType type) {
+    if (mass_revision_ != model.GetRevision() || mass_type_ != type) {
+      mass_ = model.BuildGlobalMassMatrix(StiffnessStorage::kUpper, type);
+      mass_bytes_.Set(GetSparseBytes(mass_));
+      model.ApplyConstraints(mass_, 0.0F);
+      mass_revision_ = model.GetRevision();
+      mass_type_ = type;
+    }
+    return mass_;
+  }
+
+  // LDLT factorization of the constrained K, cached for further solves on the same model revision
+  const Factorization &Factorize(Model<DIM> &model) {
+    AssembleStiffness(model);
+    if (!factorization_) {
+      const ScopedTimer timer("factorize", "solver");
+      factorization_ = std::make_unique<Factorization>(stiffness_);
+      if (factorization_->info() != Eigen::Success) {
+        factorization_.reset();
+        throw std::runtime_error("factorization of the stiffness matrix failed");
+      }
+      factorization_bytes_.Set(GetFactorBytes(*factorization_));
+    }
+    return *factorization_;
+  }
+
+ private:
+  // steps from the state in result, from rest when it is empty
+  TransientResult IntegrateTransient(Model<DIM> &model, const NewmarkOptions &options, TransientResult result,
+                                     const TransientCallback &callback) {
+    const ScopedTimer timer("transient solve", "solver");
+    const Precision dt = options.time_step_;
+    const Precision alpha = options.alpha_;
+    if (dt <= 0 || alpha > 0 || alpha < Precision(-1. / 3.)) {
+      throw std::runtime_error("invalid Newmark time step or HHT alpha");
+    }
+
+    // unconditionally stable for alpha in [-1/3, 0]
+    const Precision beta = (1 - alpha) * (1 - alpha) / 4;
+    const Precision gamma = (1 - 2 * alpha) / 2;
+
+    // a_n+1 = c0 * du - c2 * v_n - c3 * a_n, v_n+1 = c1 * du - c4 * v_n - c5 * a_n
+    const Precision c0 = 1 / (beta * dt * dt);
+    const Precision c1 = gamma / (beta * dt);
+    const Precision c2 = 1 / (beta * dt);
+    const Precision c3 = 1 / (2 * beta) - 1;
+    const Precision c4 = gamma / beta - 1;
+    const Precision c5 = dt * (gamma / (2 * beta) - 1);
+
+    const ElementMatrix &stiffness = AssembleStiffness(model);
+    const ElementMatrix &mass = AssembleMass(model, options.mass_type_);
+    const Factorization &effective = FactorizeEffective(
+        model, options, c0 + (1 + alpha) * c1 * options.mass_damping_, (1 + alpha) * (1 + c1 * options.stiffness_damping_));
+
+    VectorX constrained_mask = VectorX::Ones(stiffness.rows());
+    for (const auto dof : model.GetConstrainedDofs()) {
+      constrained_mask[dof] = 0.;
+    }
+
+    const VectorX loads = model.GetLoads().cwiseProduct(constrained_mask);
+    const auto load_scale = [&](Precision time) { return options.load_curve_ ? options.load_curve_(time) : Precision(1.); };
 
+    VectorX &u = result.displacements_;
+    VectorX &v = result.velocities_;
+    VectorX &a = result.accelerations_;
+    if (u.size() == 0) {
+      u.setZero(stiffness.rows());
+      v.setZero(stiffness.rows());
+
+      // M * a_0 = f(0), constrained rows of M carry a unit diagonal
+      ElementMatrix initial_mass = mass;
+      model.ApplyConstraints(initial_mass);
+      const Factorization mass_factorization(initial_mass);
+      a = mass_factorization.solve(VectorX(load_scale(0) * loads));
+    }
+
+    VectorX stiffness_product;
+    VectorX mass_product;
+    VectorX history;
+    VectorX rhs;
+    VectorX du;
+    VectorX next_accelerations;
+
+    const uint32_t first_step = result.steps_ + 1;
+    const auto steps = static_cast<uint32_t>(std::ceil(options.end_time_ / dt));
+    for (uint32_t step = first_step; step <= steps; ++step) {
+      const Precision time = step * dt;
+
+      // all K and M products of the step are folded into one vector each:
+      // rhs = F_n+1+alpha - K * u + M * (c2 * v + c3 * a) + C * h, C = a_m * M + a_k * K,
+      // h = (1 + alpha) * (c4 * v + c5 * a) + alpha * v from (1 + alpha) * C * v_n+1 - alpha * C * v_n
+      history = (1 + alpha) * (c4 * v + c5 * a) + alpha * v;
+      SymmetricMultiply(stiffness, VectorX(u - options.stiffness_damping_ * history), stiffness_product);
+      SymmetricMultiply(mass, VectorX(c2 * v + c3 * a + options.mass_damping_ * history), mass_product);
+
+      const Precision force_scale = (1 + alpha) * load_scale(time) - alpha * load_scale(time - dt);
+      rhs = (force_scale * loads - stiffness_product + mass_product).cwiseProduct(constrained_mask);
+
+      du = effective.solve(rhs);
+
+      next_accelerations = c0 * du - c2 * v - c3 * a;
+      v = c1 * du - c4 * v - c5 * a;
+      a.swap(next_accelerations);
+      u += du;
+      result.steps_ = step;
+      result.time_ = time;
+
+      if (callback) {
+        callback(step, time, u);
+      }
+      if (options.checkpoint_.IsDue(step)) {
+        SubmitCheckpoint(model, result, options.checkpoint_);
+      }
+    }
+
+    ProfileCount("time steps", steps >= first_step ? steps - first_step + 1 : 0);
+    return result;
+  }
+
+  // copies the state on this thread, compression and writing are left to the writer
+  void SubmitCheckpoint(const Model<DIM> &model, const TransientResult &result, const CheckpointOptions &checkpoint) const {
+    const ScopedTimer timer("checkpoint", "solver");
+    Archive archive;
+    model.Save(archive);
+    SaveState(model, archive);
+    result.Save(archive);
+    checkpoint.writer_->Submit(checkpoint.path_, std::move(archive));
+  }
+
+  // factorization of mass_scale * M + stiffness_scale * K, kept while the model and the scales stay the same
+  const Factorization &FactorizeEffective(Model<DIM> &model, const NewmarkOptions &options, Precision mass_scale, Precision stiffness_scale) {
+    const auto key = std::make_tuple(model.GetRevision(), options.mass_type_, mass_scale, stiffness_scale);
+    if (!effective_factorization_ || effective_key_ != key) {
+      const ScopedTimer timer("factorize effective stiffness", "solver");
+      const ElementMatrix effective_stiffness = mass_scale * AssembleMass(model, options.mass_type_) + stiffness_scale * AssembleStiffness(model);
+      TrackedBytes effective_stiffness_bytes;
+      effective_stiffness_bytes.Set(GetSparseBytes(effective_stiffness));
+      effective_factorization_.reset();
+      effective_factorization_bytes_.Set(0);
+      effective_factorization_ = std::make_unique<Factorization>(effective_stiffness);
+      if (effective_factorization_->info() != Eigen::Success) {
+        effective_factorization_.reset();
+        throw std::runtime_error("factorization of the effective stiffness matrix failed");
+      }
+      effective_factorization_bytes_.Set(GetFactorBytes(*effective_factorization_));
+      effective_key_ = key;
+    }
+    return *effective_factorization_;
+  }
+
+  static std::unique_ptr<Factorization> RestoreFactorization(const Archive &archive, const std::string &name, TrackedBytes &bytes) {
+    auto factorization = std::make_unique<Factorization>();
+    factorization->Restore(archive, name);
+    bytes.Set(GetFactorBytes(*factorization));
+    return factorization;
+  }
+
+  // the requested method, or the first one whose estimated peak fits into the memory budget
+  SolverMethod ChooseMethod(const Model<DIM> &model) const {
+    if (options_.memory_budget_ == 0) {
+      return options_.method_;
+    }
+
+    const ScopedTimer timer("estimate memory", "solver");
+    const SolveMemoryEstimate estimate = EstimateSolveMemory(model);
+    const auto peak_bytes = [&](SolverMethod method) {
+      switch (method) {
+        case SolverMethod::kDirect:
+          return estimate.gradient_bytes_ + std::max(estimate.GetAssemblyBytes(), estimate.matrix_bytes_ + estimate.factor_bytes_);
+        case SolverMethod::kDeviceConjugateGradient:
+          // both triangles are copied out for the device
+          return estimate.gradient_bytes_ + std::max(estimate.GetAssemblyBytes(), 3 * estimate.matrix_bytes_);
+        case SolverMethod::kConjugateGradient:
+          return estimate.gradient_bytes_ + estimate.GetAssemblyBytes();
+        case SolverMethod::kMatrixFreeConjugateGradient:
+          return estimate.gradient_bytes_ + estimate.matrix_free_bytes_;
+        case SolverMethod::kBlockConjugateGradient:
+        default:
+          return estimate.gradient_bytes_ + estimate.block_bytes_;
+      }
+    };
+    spdlog::info(
+        "estimated memory: {} bytes triplets, {} bytes K, {} bytes factor, {} bytes BSR, {} bytes matrix-free, {} bytes gradients, budget {} bytes",
+        estimate.triplet_bytes_, estimate.matrix_bytes_, estimate.factor_bytes_, estimate.block_bytes_, estimate.matrix_free_bytes_,
+        estimate.gradient_bytes_, options_.memory_budget_);
+
+    // the operator needs hexahedra, other meshes end with block CG
+    const bool matrix_free = IsMatrixFreeSupported(model);
+    const SolverMethod lowest = matrix_free ? SolverMethod::kMatrixFreeConjugateGradient : SolverMethod::kBlockConjugateGradient;
+    for (const SolverMethod method :
+         {options_.method_, SolverMethod::kConjugateGradient, SolverMethod::kBlockConjugateGradient, SolverMethod::kMatrixFreeConjugateGradient}) {
+      if (method == SolverMethod::kMatrixFreeConjugateGradient && !matrix_free) {
+        continue;
+      }
+      if (peak_bytes(method) <= options_.memory_budget_) {
+        if (method != options_.method_) {
+          spdlog::info("{} bytes estimated for the requested method, falling back to {} within the budget", peak_bytes(options_.method_),
+                       GetMethodName(method));
+        }
+        return method;
+      }
+    }
+    spdlog::warn("no method fits into the memory budget of {} bytes, using {} with {} bytes estimated", options_.memory_budget_,
+                 GetMethodName(lowest), peak_bytes(lowest));
+    return lowest;
+  }
+
+  static bool IsMatrixFreeSupported(const Model<DIM> &model) {
+    if constexpr (DIM == 3) {
+      return GetHexahedronOrder(model) != 0;
+    }
+    return false;
+  }
+
+  static const char *GetMethodName(SolverMethod method) {
+    switch (method) {
+      case SolverMethod::kConjugateGradient:
+        return "CG";
+      case SolverMethod::kBlockConjugateGradient:
+        return "block CG";
+      case SolverMethod::kMatrixFreeConjugateGradient:
+        return "matrix-free CG";
+      default:
+        return "the requested method";
+    }
+  }
+
+  VectorX SolveScalar(Model<DIM> &model, SolverMethod method) {
+    const VectorX loads = model.GetLoads();
+    VectorX displacements;
+
+    if (method == SolverMethod::kDirect) {
+      AssembleStiffness(model);
+      Checkpoint(kAssembledProgress);
+      const Factorization &factorization = Factorize(model);
+      Checkpoint(kFactorizedProgress);
+      const ScopedTimer timer("back substitution", "solver");
+      displacements = factorization.solve(loads);
+    } else if (method == SolverMethod::kDeviceConjugateGradient && device_) {
+      // the device takes both triangles in row major order
+      const CsrMatrix full_stiffness_matrix = AssembleStiffness(model).template selfadjointView<Eigen::Upper>();
+      TrackedBytes full_stiffness_bytes;
+      full_stiffness_bytes.Set(GetSparseBytes(full_stiffness_matrix));
+      Checkpoint(kAssembledProgress);
+      const ScopedTimer timer("device conjugate gradient", "solver");
+      const auto result = device_->ConjugateGradient(full_stiffness_matrix, loads, displacements, options_.max_iterations_, options_.tolerance_);
+      spdlog::info("device CG on {}", device_->GetName());
+      CheckConvergence(result);
+    } else {
+      const auto &global_stiffness_matrix = AssembleStiffness(model);
+      Checkpoint(kAssembledProgress);
+      const ScopedTimer timer("conjugate gradient", "solver");
+      const VectorX inverse_diagonal = global_stiffness_matrix.diagonal().cwiseInverse();
+      const auto result = ConjugateGradient([&](const VectorX &x, VectorX &y) { SymmetricMultiply(global_stiffness_matrix, x, y); },
+                                            [&](const VectorX &r, VectorX &z) { z = inverse_diagonal.cwiseProduct(r); }, loads,
+                                            displacements, options_.max_iterations_, options_.tolerance_, MonitorIterations());
+      CheckConvergence(result);
+    }
+
+    spdlog::debug("global_stiffness_matrix: {}", stiffness_);
+
+    VectorX residual;
+    SymmetricMultiply(stiffness_, displacements, residual);
+    residual -= loads;
+    spdlog::info("residual |K u - f|: {}", residual.norm());
+
+    return displacements;
+  }
+
+  VectorX SolveBlock(Model<DIM> &model) {
+    auto global_stiffness_matrix = model.BuildGlobalStiffnessBlockMatrix();
     model.ApplyConstraints(global_stiffness_matrix);
+    Checkpoint(kAssembledProgress);
+    spdlog::info("BSR: {} blocks, {} index bytes, {} value bytes", global_stiffness_matrix.GetBlockCount(),
+                 global_stiffness_matrix.GetIndexBytes(), global_stiffness_matrix.GetValueBytes());
+
+    const VectorX loads = model.GetLoads();
+    VectorX displacements;
+
+    const ScopedTimer timer("block conjugate gradient", "solver");
+    const auto inverse_diagonal = global_stiffness_matrix.InvertDiagonalBlocks();
+    const auto precondition = [&](const VectorX &r, VectorX &z) {
+      z.resize(r.size());
+      for (size_t node = 0; node < inverse_diagonal.size(); ++node) {
+        z.template segment<DIM>(DIM * node) = inverse_diagonal[node] * r.template segment<DIM>(DIM * node);
+      }
+    };
+
+    const auto result = ConjugateGradient([&](const VectorX &x, VectorX &y) { global_stiffness_matrix.Multiply(x, y); }, precondition,
+                                          loads, displacements, options_.max_iterations_, options_.tolerance_, MonitorIterations());
+    CheckConvergence(result);
+
+    VectorX residual;
+    global_stiffness_matrix.Multiply(displacements, residual);
+    residual -= loads;
+    spdlog::info("residual |K u - f|: {}", residual.norm());
+
+    return displacements;
+  }
+
+  // K is never assembled, the model has to consist of Lagrange hexahedra
+  VectorX SolveMatrixFree(const Model<DIM> &model) {
+    if constexpr (DIM == 3) {
+      switch (GetHexahedronOrder(model)) {
+        case 1:
+          return SolveWithOperator(model, HexStiffnessOperator<1>(model));
+        case 2:
+          return SolveWithOperator(model, HexStiffnessOperator<2>(model));
+        default:
+          break;
+      }
+    }
+    throw std::runtime_error("matrix-free CG needs a model of hexahedra");
+  }
 
-    Eigen::SimplicialLDLT<decltype(global_stiffness_matrix)> solver(global_stiffness_matrix);
-    std::cout << "global_stiffness_matrix: " << global_stiffness_matrix << std::endl;
-    Eigen::VectorXf displacements = solver.solve(model.GetLoads());
+  template <typename Operator>
+  VectorX SolveWithOperator(const Model<DIM> &model, const Operator &global_stiffness) {
+    Checkpoint(kAssembledProgress);
+    const VectorX loads = model.GetLoads();
+    VectorX displacements;
 
-    std::cout << "displacements: " << displacements << std::endl;
+    const ScopedTimer timer("matrix-free conjugate gradient", "solver");
+    const VectorX inverse_diagonal = global_stiffness.GetDiagonal().cwiseInverse();
+    const auto result = ConjugateGradient(global_stiffness, [&](const VectorX &r, VectorX &z) { z = inverse_diagonal.cwiseProduct(r); },
+                                          loads, displacements, options_.max_iterations_, options_.tolerance_, MonitorIterations());
+    CheckConvergence(result);
 
-    model.AccountDisplacements(displacements);
+    VectorX residual;
+    global_stiffness(displacements, residual);
+    residual -= loads;
+    spdlog::info("residual |K u - f|: {}", residual.norm());
 
-    std::cout << "new coords: " << model.GetVertices() << std::endl;
+    return displacements;
   }
+
+  static constexpr float kAssembledProgress = 0.2F;
+  static constexpr float kFactorizedProgress = 0.9F;
+
+  // throws SolveCancelled when cancellation was requested
+  void Checkpoint(float progress) {
+    if (!control_) {
+      return;
+    }
+    if (control_->cancel_.load(std::memory_order_relaxed)) {
+      throw SolveCancelled();
+    }
+    control_->progress_.store(progress, std::memory_order_relaxed);
+  }
+
+  // CG progress from the residual reduction, linear in digits gained towards the tolerance
+  IterationMonitor MonitorIterations() {
+    if (!control_) {
+      return {};
+    }
+    // the residual is not monotonic, the progress is
+    return [this, best = 0.F](const IterativeResult &result) mutable {
+      const float digits = std::log10(std::max(result.relative_residual_, options_.tolerance_)) / std::log10(options_.tolerance_);
+      best = std::max(best, std::clamp(digits, 0.F, 1.F));
+      Checkpoint(kAssembledProgress + (1.F - kAssembledProgress) * best);
+    };
+  }
+
+  static void CheckConvergence(const IterativeResult &result) {
+    spdlog::info("CG: {} iterations, relative residual {}", result.iterations_, result.relative_residual_);
+    ProfileCount("CG iterations", result.iterations_);
+    if (!result.converged_) {
+      throw std::runtime_error("conjugate gradient did not converge");
+    }
+  }
+
+  SolverOptions options_;
+  std::shared_ptr<DeviceSolver> device_;
+  std::shared_ptr<SolveControl> control_;
+
+  VectorX displacements_;
+  std::shared_ptr<const ElementGradients<DIM>> solution_gradients_;
+
+  ElementMatrix stiffness_;
+  TrackedBytes stiffness_bytes_;
+  uint64_t stiffness_revision_ = 0;
+  std::unique_ptr<Factorization> factorization_;
+  TrackedBytes factorization_bytes_;
+
+  ElementMatrix mass_;
+  TrackedBytes mass_bytes_;
+  uint64_t mass_revision_ = 0;
+  MassType mass_type_ = MassType::kConsistent;
+
+  std::unique_ptr<Factorization> effective_factorization_;
+  TrackedBytes effective_factorization_bytes_;
+  std::tuple<uint64_t, MassType, Precision, Precision> effective_key_;
 };
 
 }  // namespace vulkan_fem
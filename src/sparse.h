@@ -0,0 +1,36 @@
+#pragma once
+
+#include "fem.h"
+#include <Eigen/Sparse>
+#include <stdexcept>
+
+namespace vulkan_fem {
+
+// y = A * x for a symmetric A of which only the upper triangle is stored.
+// Every stored entry is read once and contributes to both y_i and y_j.
+template <typename Scalar, int Options, typename Index>
+void SymmetricMultiply(const Eigen::SparseMatrix<Scalar, Options, Index> &upper, const VectorX &x, VectorX &y) {
+  if (upper.rows() != upper.cols() || x.size() != upper.cols()) {
+    throw std::runtime_error("SymmetricMultiply: dimension mismatch");
+  }
+
+  using Matrix = Eigen::SparseMatrix<Scalar, Options, Index>;
+
+  y.setZero(upper.rows());
+  for (Index k = 0; k < upper.outerSize(); ++k) {
+    for (typename Matrix::InnerIterator it(upper, k); it; ++it) {
+      const Index row = it.row();
+      const Index col = it.col();
+      if (row > col) {
+        continue;  // lower part, not expected in upper storage
+      }
+
+      y[row] += it.value() * x[col];
+      if (row != col) {
+        y[col] += it.value() * x[row];
+      }
+    }
+  }
+}
+
+}  // namespace vulkan_fem
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "fem.h"
+#include <Eigen/Dense>
+#include <array>
+#include <utility>
+
+namespace vulkan_fem {
+
+// Non-zero layout of one node block of the B matrix.
+// For displacement component j the column has DIM entries (strain row, derivative direction).
+template <uint32_t DIM>
+struct StrainPattern;
+
+template <>
+struct StrainPattern<2> {
+  // tensor indices (i, j) of every Voigt component
+  static constexpr std::array<std::pair<int, int>, 3> kVoigt{{{0, 0}, {1, 1}, {0, 1}}};
+
+  static constexpr std::array<std::array<std::pair<int, int>, 2>, 2> kColumns{{
+      {{{0, 0}, {2, 1}}},  // ux: exx = Nix, gxy = Niy
+      {{{1, 1}, {2, 0}}},  // uy: eyy = Niy, gxy = Nix
+  }};
+};
+
+template <>
+struct StrainPattern<3> {
+  static constexpr std::array<std::pair<int, int>, 6> kVoigt{{{0, 0}, {1, 1}, {2, 2}, {0, 1}, {1, 2}, {2, 0}}};
+
+  static constexpr std::array<std::array<std::pair<int, int>, 3>, 3> kColumns{{
+      {{{0, 0}, {3, 1}, {5, 2}}},  // ux: exx = Nix, gxy = Niy, gzx = Niz
+      {{{1, 1}, {3, 0}, {4, 2}}},  // uy: eyy = Niy, gxy = Nix, gyz = Niz
+      {{{2, 2}, {4, 1}, {5, 0}}},  // uz: ezz = Niz, gyz = Niy, gzx = Nix
+  }};
+};
+
+// D * B_b for a single node b, touching only the DIM non-zeros of every B column
+template <uint32_t DIM, typename Derived>
+Eigen::Matrix<Precision, kStrainSize<DIM>, DIM> MultiplyStrainBlock(const MatrixConstitutive<DIM> &d_matrix,
+                                                                    const Eigen::MatrixBase<Derived> &dshape_b) {
+  Eigen::Matrix<Precision, kStrainSize<DIM>, DIM> db;
+  for (uint32_t j = 0; j < DIM; ++j) {
+    db.col(j).setZero();
+    for (const auto &[row, direction] : StrainPattern<DIM>::kColumns[j]) {
+      db.col(j) += d_matrix.col(row) * dshape_b[direction];
+    }
+  }
+  return db;
+}
+
+// B_a^T * (D * B_b) for a node pair, again only over the non-zeros of B_a
+template <uint32_t DIM, typename Derived>
+MatrixDim<DIM> MultiplyStrainBlockTransposed(const Eigen::MatrixBase<Derived> &dshape_a,
+                                             const Eigen::Matrix<Precision, kStrainSize<DIM>, DIM> &db) {
+  MatrixDim<DIM> block;
+  for (uint32_t i = 0; i < DIM; ++i) {
+    for (uint32_t j = 0; j < DIM; ++j) {
+      Precision sum = 0.;
+      for (const auto &[row, direction] : StrainPattern<DIM>::kColumns[i]) {
+        sum += dshape_a[direction] * db(row, j);
+      }
+      block(i, j) = sum;
+    }
+  }
+  return block;
+}
+
+// element_stiffness += B^T * D * B * scale, B is never formed
+// dshape - derivatives of shape functions in global coords, one column per node
+// upper_only - compute only node blocks (a, b) with a <= b, the rest is left untouched
+template <uint32_t DIM, typename DerivedShape, typename Derived>
+void AddStrainStiffness(const Eigen::MatrixBase<DerivedShape> &dshape, const MatrixConstitutive<DIM> &d_matrix, Precision scale,
+                        Eigen::MatrixBase<Derived> &element_stiffness, bool upper_only = false) {
+  const auto node_count = static_cast<uint32_t>(dshape.cols());
+
+  for (uint32_t b = 0; b < node_count; ++b) {
+    const Eigen::Matrix<Precision, kStrainSize<DIM>, DIM> db = MultiplyStrainBlock<DIM>(d_matrix, dshape.col(b)) * scale;
+
+    const uint32_t a_end = upper_only ? b + 1 : node_count;
+    for (uint32_t a = 0; a < a_end; ++a) {
+      element_stiffness.template block<DIM, DIM>(DIM * a, DIM * b) += MultiplyStrainBlockTransposed<DIM>(dshape.col(a), db);
+    }
+  }
+}
+
+// strain = B * u at one integration point
+// dshape - derivatives of shape functions in global coords, one column per node
+// u - element displacements, DIM per node
+template <uint32_t DIM, typename DerivedShape, typename DerivedU>
+Eigen::Matrix<Precision, kStrainSize<DIM>, 1> MultiplyStrain(const Eigen::MatrixBase<DerivedShape> &dshape,
+                                                             const Eigen::MatrixBase<DerivedU> &u) {
+  Eigen::Matrix<Precision, kStrainSize<DIM>, 1> strain = Eigen::Matrix<Precision, kStrainSize<DIM>, 1>::Zero();
+  for (Eigen::Index b = 0; b < dshape.cols(); ++b) {
+    for (uint32_t j = 0; j < DIM; ++j) {
+      for (const auto &[row, direction] : StrainPattern<DIM>::kColumns[j]) {
+        strain[row] += dshape(direction, b) * u[DIM * b + j];
+      }
+    }
+  }
+  return strain;
+}
+
+// forces += B^T * stress, the element internal force contribution of one integration point
+template <uint32_t DIM, typename DerivedShape, typename DerivedF>
+void AddStrainTransposed(const Eigen::MatrixBase<DerivedShape> &dshape, const Eigen::Matrix<Precision, kStrainSize<DIM>, 1> &stress,
+                         Eigen::MatrixBase<DerivedF> &forces) {
+  for (Eigen::Index a = 0; a < dshape.cols(); ++a) {
+    for (uint32_t i = 0; i < DIM; ++i) {
+      for (const auto &[row, direction] : StrainPattern<DIM>::kColumns[i]) {
+        forces[DIM * a + i] += dshape(direction, a) * stress[row];
+      }
+    }
+  }
+}
+
+}  // namespace vulkan_fem
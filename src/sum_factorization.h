@@ -0,0 +1,275 @@
+#pragma once
+
+#include "elements.h"
+#include "enumerate.h"
+#include "fem.h"
+#include "model.h"
+#include "profiler.h"
+#include <Eigen/Dense>
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+namespace vulkan_fem {
+
+// Matrix-free stiffness application for Lagrange hexahedra.
+// Gradients at the integration points are evaluated by three successive 1D contractions
+// (sum factorization), so one element costs O(n^4) instead of O(n^6) for a dense K_e.
+template <uint32_t ORDER>
+class HexStiffnessKernel {
+ public:
+  using ElementType = LagrangeHexahedronElement<ORDER>;
+
+  static constexpr uint32_t kN = ElementType::kNodes1D;
+  static constexpr uint32_t kNodeCount = ElementType::kNodeCount;
+
+  // node coordinates, one column per element node
+  using ElementCoords = Eigen::Matrix<Precision, 3, kNodeCount>;
+  // nodal values interleaved per node [ux0 uy0 uz0 ux1 ...]
+  using ElementVector = Eigen::Matrix<Precision, 3 * kNodeCount, 1>;
+
+  HexStiffnessKernel() {
+    for (uint32_t q = 0; q < kN; ++q) {
+      for (uint32_t n = 0; n < kN; ++n) {
+        const Precision x = GaussLegendre<kN>::kPoints[q];
+        basis_(q, n) = ElementType::CalcShape1D(n, x);
+        derivative_(q, n) = ElementType::CalcDShape1D(n, x);
+      }
+    }
+    basis_t_ = basis_.transpose();
+    derivative_t_ = derivative_.transpose();
+
+    for (const auto &[a, node] : Enumerate(ElementType::GetNodeLattice())) {
+      lattice_to_node_[node[0] + kN * node[1] + kN * kN * node[2]] = static_cast<uint32_t>(a);
+    }
+  }
+
+  // y = K_e * u without forming K_e
+  void Apply(const ElementCoords &coords, const MatrixConstitutive<3> &d_matrix, const ElementVector &u, ElementVector &y) const {
+    // reference gradients of geometry and displacement at the quadrature points
+    std::array<std::array<Tensor, 3>, 3> x_grad;
+    std::array<std::array<Tensor, 3>, 3> u_grad;
+    for (uint32_t c = 0; c < 3; ++c) {
+      Tensor x_values;
+      Tensor u_values;
+      for (uint32_t l = 0; l < kSize; ++l) {
+        x_values[l] = coords(c, lattice_to_node_[l]);
+        u_values[l] = u[3 * lattice_to_node_[l] + c];
+      }
+      Gradient(x_values, x_grad[c]);
+      Gradient(u_values, u_grad[c]);
+    }
+
+    // stress at every quadrature point, pulled back to reference directions
+    std::array<std::array<Tensor, 3>, 3> flux;
+    for (uint32_t q = 0; q < kSize; ++q) {
+      // jacobian (d(x, y, z)/d(xi, eta, zeta)), rows are reference directions
+      MatrixDim<3> jacobian;
+      MatrixDim<3> grad;
+      for (uint32_t r = 0; r < 3; ++r) {
+        for (uint32_t c = 0; c < 3; ++c) {
+          jacobian(r, c) = x_grad[c][r][q];
+          grad(r, c) = u_grad[c][r][q];
+        }
+      }
+
+      const Precision jacobian_det = jacobian.determinant();
+      const MatrixDim<3> inverse_jacobian = jacobian.inverse();
+
+      // du_c / dx_d
+      const MatrixDim<3> h = inverse_jacobian * grad;
+
+      Eigen::Matrix<Precision, 6, 1> strain;
+      strain << h(0, 0), h(1, 1), h(2, 2), h(0, 1) + h(1, 0), h(1, 2) + h(2, 1), h(2, 0) + h(0, 2);
+      const Eigen::Matrix<Precision, 6, 1> stress = d_matrix * strain;
+
+      MatrixDim<3> sigma;
+      sigma << stress[0], stress[3], stress[5],  //
+          stress[3], stress[1], stress[4],       //
+          stress[5], stress[4], stress[2];
+
+      const MatrixDim<3> t = inverse_jacobian.transpose() * sigma * (jacobian_det * Weight(q));
+      for (uint32_t r = 0; r < 3; ++r) {
+        for (uint32_t c = 0; c < 3; ++c) {
+          flux[c][r][q] = t(r, c);
+        }
+      }
+    }
+
+    for (uint32_t c = 0; c < 3; ++c) {
+      Tensor result;
+      GradientTranspose(flux[c], result);
+      for (uint32_t l = 0; l < kSize; ++l) {
+        y[3 * lattice_to_node_[l] + c] = result[l];
+      }
+    }
+  }
+
+ private:
+  static constexpr uint32_t kSize = kN * kN * kN;
+
+  // values on the kN^3 lattice, first index running fastest
+  using Tensor = std::array<Precision, kSize>;
+  using Matrix1D = Eigen::Matrix<Precision, kN, kN>;
+
+  static Precision Weight(uint32_t q) {
+    return GaussLegendre<kN>::kWeights[q % kN] * GaussLegendre<kN>::kWeights[(q / kN) % kN] * GaussLegendre<kN>::kWeights[q / (kN * kN)];
+  }
+
+  // out = a applied along one axis of in
+  template <uint32_t AXIS>
+  static void Contract(const Matrix1D &a, const Tensor &in, Tensor &out) {
+    constexpr uint32_t kStride = AXIS == 0 ? 1 : (AXIS == 1 ? kN : kN * kN);
+
+    for (uint32_t l = 0; l < kSize; ++l) {
+      const uint32_t i = (l / kStride) % kN;
+      const uint32_t base = l - i * kStride;
+
+      Precision sum = 0.;
+      for (uint32_t m = 0; m < kN; ++m) {
+        sum += a(i, m) * in[base + m * kStride];
+      }
+      out[l] = sum;
+    }
+  }
+
+  // reference gradient of a nodal field at the quadrature points
+  void Gradient(const Tensor &values, std::array<Tensor, 3> &grad) const {
+    Tensor b0;
+    Tensor d0;
+    Tensor tmp;
+    Contract<0>(basis_, values, b0);
+    Contract<0>(derivative_, values, d0);
+
+    Contract<1>(basis_, d0, tmp);
+    Contract<2>(basis_, tmp, grad[0]);
+
+    Contract<1>(derivative_, b0, tmp);
+    Contract<2>(basis_, tmp, grad[1]);
+
+    Contract<1>(basis_, b0, tmp);
+    Contract<2>(derivative_, tmp, grad[2]);
+  }
+
+  // transpose of Gradient, sums the three reference directions into nodal values
+  void GradientTranspose(const std::array<Tensor, 3> &flux, Tensor &values) const {
+    Tensor tmp;
+    Tensor tmp2;
+
+    Contract<2>(basis_t_, flux[0], tmp);
+    Contract<1>(basis_t_, tmp, tmp2);
+    Contract<0>(derivative_t_, tmp2, values);
+
+    Contract<2>(basis_t_, flux[1], tmp);
+    Contract<1>(derivative_t_, tmp, tmp2);
+    Contract<0>(basis_t_, tmp2, tmp);
+    for (uint32_t l = 0; l < kSize; ++l) {
+      values[l] += tmp[l];
+    }
+
+    Contract<2>(derivative_t_, flux[2], tmp);
+    Contract<1>(basis_t_, tmp, tmp2);
+    Contract<0>(basis_t_, tmp2, tmp);
+    for (uint32_t l = 0; l < kSize; ++l) {
+      values[l] += tmp[l];
+    }
+  }
+
+  // 1D shape functions and derivatives, rows are quadrature points
+  Matrix1D basis_;
+  Matrix1D derivative_;
+  Matrix1D basis_t_;
+  Matrix1D derivative_t_;
+
+  std::array<uint32_t, kSize> lattice_to_node_{};
+};
+
+// order of the Lagrange hexahedra of model, 0 for other elements
+inline uint32_t GetHexahedronOrder(const Model<3> &model) {
+  const Element<3> *element = model.GetElementType().get();
+  if (dynamic_cast<const LagrangeHexahedronElement<1> *>(element) != nullptr) {
+    return 1;
+  }
+  if (dynamic_cast<const LagrangeHexahedronElement<2> *>(element) != nullptr) {
+    return 2;
+  }
+  return 0;
+}
+
+// K of a hexahedral model applied element by element with HexStiffnessKernel, the global matrix is never formed.
+// Constrained dofs are identity rows and columns, as after Model::ApplyConstraints. Only the diagonal, for a
+// Jacobi preconditioner, and a flag per dof are stored besides the model.
+template <uint32_t ORDER>
+class HexStiffnessOperator {
+ public:
+  using Kernel = HexStiffnessKernel<ORDER>;
+
+  explicit HexStiffnessOperator(const Model<3> &model)
+      : model_(model), constrained_(model.GetConstrainedDofs()), fixed_(3 * model.GetVertices().size(), 0) {
+    if (GetHexahedronOrder(model) != ORDER) {
+      throw std::runtime_error("model elements do not match the order of the hexahedron operator");
+    }
+    const ScopedTimer timer("matrix-free diagonal", "solver");
+    LinearMaterial<3> material = model.GetMaterial();
+    d_matrix_ = material.GetStiffnessMatrix();
+
+    // one K_e at a time, only its diagonal is kept
+    const auto &indices = model.GetIndices();
+    diagonal_ = VectorX::Zero(static_cast<Eigen::Index>(fixed_.size()));
+    MatrixElementStiffness<3> element_stiffness_matrix;
+    for (size_t index = 0; index + Kernel::kNodeCount <= indices.size(); index += Kernel::kNodeCount) {
+      model.CalcElementStiffness(static_cast<uint32_t>(index / Kernel::kNodeCount), d_matrix_, element_stiffness_matrix);
+      for (uint32_t a = 0; a < Kernel::kNodeCount; ++a) {
+        diagonal_.template segment<3>(3 * indices[index + a]) += element_stiffness_matrix.diagonal().template segment<3>(3 * a);
+      }
+    }
+
+    for (const int dof : constrained_) {
+      fixed_[dof] = 1;
+      diagonal_[dof] = 1;
+    }
+  }
+
+  // y = K * x
+  void operator()(const VectorX &x, VectorX &y) const {
+    const auto &vertices = model_.GetVertices();
+    const auto &indices = model_.GetIndices();
+
+    typename Kernel::ElementCoords coords;
+    typename Kernel::ElementVector u;
+    typename Kernel::ElementVector element_y;
+    y.setZero(x.size());
+    for (size_t index = 0; index + Kernel::kNodeCount <= indices.size(); index += Kernel::kNodeCount) {
+      for (uint32_t a = 0; a < Kernel::kNodeCount; ++a) {
+        const uint32_t node = indices[index + a];
+        coords.col(a) = vertices[node];
+        for (uint32_t c = 0; c < 3; ++c) {
+          u[3 * a + c] = fixed_[3 * node + c] != 0 ? 0 : x[3 * node + c];
+        }
+      }
+
+      kernel_.Apply(coords, d_matrix_, u, element_y);
+
+      for (uint32_t a = 0; a < Kernel::kNodeCount; ++a) {
+        y.template segment<3>(3 * indices[index + a]) += element_y.template segment<3>(3 * a);
+      }
+    }
+
+    for (const int dof : constrained_) {
+      y[dof] = x[dof];
+    }
+  }
+
+  [[nodiscard]] const VectorX &GetDiagonal() const { return diagonal_; }
+
+ private:
+  const Model<3> &model_;
+  Kernel kernel_;
+  MatrixConstitutive<3> d_matrix_;
+  std::vector<int> constrained_;
+  std::vector<uint8_t> fixed_;
+  VectorX diagonal_;
+};
+
+}  // namespace vulkan_fem
@@ -0,0 +1,84 @@
+#include "thread_pool.h"
+#include <algorithm>
+
+namespace vulkan_fem {
+
+ThreadPool::ThreadPool(uint32_t thread_count) {
+  if (thread_count == 0) {
+    thread_count = std::max(std::thread::hardware_concurrency(), 1U);
+  }
+
+  workers_.reserve(thread_count - 1);
+  for (uint32_t thread = 1; thread < thread_count; ++thread) {
+    workers_.emplace_back([this, thread] { WorkerLoop(thread); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  start_.notify_all();
+
+  for (auto &worker : workers_) {
+    worker.join();
+  }
+}
+
+void ThreadPool::ParallelFor(size_t count, const Task &task) {
+  if (workers_.empty() || count < 2) {
+    task(0, count, 0);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    task_ = &task;
+    count_ = count;
+    pending_ = static_cast<uint32_t>(workers_.size());
+    ++generation_;
+  }
+  start_.notify_all();
+
+  // the calling thread takes the first range
+  RunRange(0);
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_.wait(lock, [this] { return pending_ == 0; });
+  task_ = nullptr;
+}
+
+void ThreadPool::WorkerLoop(uint32_t thread) {
+  uint64_t seen = 0;
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      start_.wait(lock, [&] { return stop_ || generation_ != seen; });
+      if (stop_) {
+        return;
+      }
+      seen = generation_;
+    }
+
+    RunRange(thread);
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (--pending_ == 0) {
+        done_.notify_one();
+      }
+    }
+  }
+}
+
+void ThreadPool::RunRange(uint32_t thread) {
+  const size_t thread_count = GetThreadCount();
+  const size_t begin = count_ * thread / thread_count;
+  const size_t end = count_ * (thread + 1) / thread_count;
+  if (begin < end) {
+    (*task_)(begin, end, thread);
+  }
+}
+
+}  // namespace vulkan_fem
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace vulkan_fem {
+
+// Persistent worker threads for data parallel loops.
+// Workers sleep between calls, so a loop per time step does not pay for thread creation.
+class ThreadPool {
+ public:
+  // f(begin, end, thread) - process items [begin, end), thread < GetThreadCount() selects per-thread scratch
+  using Task = std::function<void(size_t, size_t, uint32_t)>;
+
+  // thread_count 0 - one thread per hardware core
+  explicit ThreadPool(uint32_t thread_count = 0);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  // number of threads taking part in ParallelFor, the calling thread included
+  [[nodiscard]] uint32_t GetThreadCount() const { return static_cast<uint32_t>(workers_.size()) + 1; }
+
+  // splits [0, count) into one contiguous range per thread and blocks until all of them are done
+  void ParallelFor(size_t count, const Task &task);
+
+ private:
+  void WorkerLoop(uint32_t thread);
+  void RunRange(uint32_t thread);
+
+  std::vector<std::thread> workers_;
+
+  std::mutex mutex_;
+  std::condition_variable start_;
+  std::condition_variable done_;
+
+  const Task *task_ = nullptr;
+  size_t count_ = 0;
+  uint64_t generation_ = 0;
+  uint32_t pending_ = 0;
+  bool stop_ = false;
+};
+
+}  // namespace vulkan_fem
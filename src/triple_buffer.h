@@ -0,0 +1,40 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace vulkan_fem {
+
+// Lock free single producer, single consumer handoff of the latest value.
+// The writer fills its back slot and publishes it, the reader picks up the newest published slot.
+// Neither side ever waits, values the reader did not pick up in time are overwritten.
+template <typename T>
+class TripleBuffer {
+ public:
+  // writer side
+  T &GetWriteBuffer() { return buffers_[back_]; }
+  void Publish() { back_ = state_.exchange(back_ | kFresh) & kIndexMask; }
+
+  // reader side, true when a value newer than the current read buffer was published
+  bool Update() {
+    if ((state_.load() & kFresh) == 0) {
+      return false;
+    }
+    front_ = state_.exchange(front_) & kIndexMask;
+    return true;
+  }
+  T &GetReadBuffer() { return buffers_[front_]; }
+
+ private:
+  static constexpr uint8_t kIndexMask = 0x3;
+  static constexpr uint8_t kFresh = 0x4;
+
+  std::array<T, 3> buffers_{};
+  // index of the middle slot, plus kFresh when it holds a value the reader has not seen
+  std::atomic<uint8_t> state_{1};
+  uint8_t back_ = 0;
+  uint8_t front_ = 2;
+};
+
+}  // namespace vulkan_fem
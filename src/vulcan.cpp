@@ -1,9 +1,13 @@
 #include "vulcan.h"
+#include "profiler.h"
+#include "shader_library.h"
+#include "vulkan_compute.h"
 #include <vulkan/vulkan_core.h>
+#include <spdlog/spdlog.h>
 #include <algorithm>
 #include <cstdint>
 #include <cstring>
-#include <fstream>
+#include <future>
 #include <iostream>
 #include <optional>
 #include <set>
@@ -16,9 +20,36 @@ constexpr uint32_t kHeight = 600;
 
 constexpr int kMaxFramesInFlight = 2;
 
+// device buffers grow by half again of the requested size, so slowly growing data does not reallocate every update
+constexpr VkDeviceSize kMinBufferCapacity = 4096;
+constexpr VkDeviceSize kMinStagingCapacity = 64 * 1024;
+
+static_assert(sizeof(DrawCluster) == 40, "std430 layout of Cluster in cull.comp");
+
+// uploaded buffers are read as vertices and indices, and by compute passes ahead of the draws
+constexpr VkPipelineStageFlags kUploadReadStages = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+
 const std::vector<const char *> kValidationLayers = {"VK_LAYER_KHRONOS_validation"};
 
-const std::vector<const char *> kDeviceExtensions = {VK_KHR_SWAPCHAIN_EXTENSION_NAME, "VK_KHR_portability_subset"};
+const char *GetPresentModeName(VkPresentModeKHR mode) {
+  switch (mode) {
+    case VK_PRESENT_MODE_IMMEDIATE_KHR:
+      return "immediate";
+    case VK_PRESENT_MODE_MAILBOX_KHR:
+      return "mailbox";
+    case VK_PRESENT_MODE_FIFO_KHR:
+      return "fifo";
+    case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+      return "fifo relaxed";
+    default:
+      return "other";
+  }
+}
+
+const std::vector<const char *> kDeviceExtensions = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+
+// only on portability implementations such as MoltenVK, where it must be enabled
+constexpr const char *kPortabilitySubsetExtension = "VK_KHR_portability_subset";
 
 #ifdef NDEBUG
 constexpr bool kEnableValidationLayers = false;
@@ -49,9 +80,22 @@ static void KeyCallback(GLFWindow *window, int key, int scancode, int action, in
 }
 
 bool Application::ProcessInput(GLFWindow *window, int key, int /*scancode*/, int action, int /*mods*/) {
-  if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS) {
-    glfwSetWindowShouldClose(window, GLFW_TRUE);
-    return false;
+  if (action != GLFW_PRESS) {
+    return true;
+  }
+
+  switch (key) {
+    case GLFW_KEY_ESCAPE:
+      glfwSetWindowShouldClose(window, GLFW_TRUE);
+      return false;
+    case GLFW_KEY_V:
+      present_mode_ = present_mode_ == VK_PRESENT_MODE_FIFO_KHR ? VK_PRESENT_MODE_MAILBOX_KHR : VK_PRESENT_MODE_FIFO_KHR;
+      recreate_swap_chain_ = true;
+      return false;
+    case GLFW_KEY_T:
+      log_frame_times_ = !log_frame_times_;
+      spdlog::info("frame time log {}", log_frame_times_ ? "on" : "off");
+      return false;
   }
 
   return true;
@@ -68,13 +112,23 @@ VkVertexInputBindingDescription Vertex::GetBindingDescription() {
 }
 
 std::vector<VkVertexInputAttributeDescription> Vertex::GetAttributeDescriptions() {
-  std::vector<VkVertexInputAttributeDescription> attribute_descriptions(1);
+  std::vector<VkVertexInputAttributeDescription> attribute_descriptions(3);
 
   attribute_descriptions[0].binding = 0;
   attribute_descriptions[0].location = 0;
   attribute_descriptions[0].format = VK_FORMAT_R32G32_SFLOAT;
   attribute_descriptions[0].offset = offsetof(Vertex, pos_);
 
+  attribute_descriptions[1].binding = 0;
+  attribute_descriptions[1].location = 1;
+  attribute_descriptions[1].format = VK_FORMAT_R32G32_SFLOAT;
+  attribute_descriptions[1].offset = offsetof(Vertex, displacement_);
+
+  attribute_descriptions[2].binding = 0;
+  attribute_descriptions[2].location = 2;
+  attribute_descriptions[2].format = VK_FORMAT_R32_SFLOAT;
+  attribute_descriptions[2].offset = offsetof(Vertex, value_);
+
   return attribute_descriptions;
 }
 
@@ -91,12 +145,18 @@ void Application::InitWindow() {
   glfwInit();
 
   glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-  glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+  glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
 
   window_ = glfwCreateWindow(kWidth, kHeight, "Vulkan", nullptr, nullptr);
 
   glfwSetWindowUserPointer(window_, this);
   glfwSetKeyCallback(window_, KeyCallback);
+  glfwSetFramebufferSizeCallback(window_, FramebufferResizeCallback);
+}
+
+// not every platform reports VK_ERROR_OUT_OF_DATE_KHR on a resize
+void Application::FramebufferResizeCallback(GLFWindow *window, int /*width*/, int /*height*/) {
+  reinterpret_cast<Application *>(glfwGetWindowUserPointer(window))->recreate_swap_chain_ = true;
 }
 
 void Application::InitVulkan() {
@@ -105,15 +165,27 @@ void Application::InitVulkan() {
   CreateSurface();
   PickPhysicalDevice();
   CreateLogicalDevice();
+  allocator_ = std::make_unique<vulkan_fem::GpuAllocator>(physical_device_, device_);
   CreateSwapChain();
   CreateImageViews();
   CreateRenderPass();
-  graphics_pipeline_ = CreateGraphicsPipeline(device_, swap_chain_extent_, pipeline_layout_, render_pass_, VK_POLYGON_MODE_LINE);
+  CreateDescriptorSetLayout();
+  CreatePipelineLayout();
+  pipeline_cache_ = std::make_unique<vulkan_fem::PipelineCache>(physical_device_, device_);
+  // the compute kernels build on another thread meanwhile, through the same cache
+  std::future<void> compute = std::async(std::launch::async, [this] { CreateCompute(); });
+  CreateGraphicsPipelines();
   CreateFramebuffers();
   CreateCommandPool();
+  CreateRenderFrames();
+  CreateUploadFrames();
+  gpu_timer_ = std::make_unique<vulkan_fem::GpuTimer>(physical_device_, device_, FindQueueFamilies(physical_device_).graphics_family_.value(),
+                                                      static_cast<uint32_t>(kMaxFramesInFlight));
+  compute.get();
+  pipeline_cache_->Save();
   CrateBuffers();
-  CreateCommandBuffers();
   CreateSyncObjects();
+  CreatePresentSemaphores();
 }
 
 void Application::MainLoop() {
@@ -126,34 +198,79 @@ void Application::MainLoop() {
 }
 
 void Application::CleanupSwapChain() {
+  for (auto *semaphore : render_finished_semaphores_) {
+    vkDestroySemaphore(device_, semaphore, nullptr);
+  }
+  render_finished_semaphores_.clear();
+
   for (auto *framebuffer : swap_chain_framebuffers_) {
     vkDestroyFramebuffer(device_, framebuffer, nullptr);
   }
-
-  vkFreeCommandBuffers(device_, command_pool_, static_cast<uint32_t>(command_buffers_.size()), command_buffers_.data());
-
-  vkDestroyPipeline(device_, graphics_pipeline_, nullptr);
-  vkDestroyPipelineLayout(device_, pipeline_layout_, nullptr);
-  vkDestroyRenderPass(device_, render_pass_, nullptr);
+  swap_chain_framebuffers_.clear();
 
   for (auto *image_view : swap_chain_image_views_) {
     vkDestroyImageView(device_, image_view, nullptr);
   }
+  swap_chain_image_views_.clear();
+}
 
-  vkDestroySwapchainKHR(device_, swap_chain_, nullptr);
+void Application::RecreateSwapChain() {
+  // nothing can be presented while minimized
+  int width = 0;
+  int height = 0;
+  glfwGetFramebufferSize(window_, &width, &height);
+  while ((width == 0 || height == 0) && glfwWindowShouldClose(window_) == 0) {
+    glfwWaitEvents();
+    glfwGetFramebufferSize(window_, &width, &height);
+  }
+  if (width == 0 || height == 0) {
+    return;
+  }
+
+  vkDeviceWaitIdle(device_);
+  CleanupSwapChain();
+
+  const VkFormat format = swap_chain_image_format_;
+  CreateSwapChain();
+  CreateImageViews();
+  if (swap_chain_image_format_ != format) {
+    DestroyGraphicsPipelines();
+    vkDestroyRenderPass(device_, render_pass_, nullptr);
+    CreateRenderPass();
+    CreateGraphicsPipelines();
+  }
+  CreateFramebuffers();
+  CreatePresentSemaphores();
+
+  recreate_swap_chain_ = false;
+  frame_timer_.Reset();
 }
 
 void Application::Cleanup() {
   CleanupSwapChain();
+  vkDestroySwapchainKHR(device_, swap_chain_, nullptr);
+
+  DestroyGraphicsPipelines();
+  vkDestroyPipelineLayout(device_, pipeline_layout_, nullptr);
+  vkDestroyRenderPass(device_, render_pass_, nullptr);
+  vkDestroyDescriptorSetLayout(device_, descriptor_set_layout_, nullptr);
 
   for (size_t i = 0; i < kMaxFramesInFlight; i++) {
-    vkDestroySemaphore(device_, render_finished_semaphores_[i], nullptr);
     vkDestroySemaphore(device_, image_available_semaphores_[i], nullptr);
     vkDestroyFence(device_, in_flight_fences_[i], nullptr);
   }
 
+  DestroyRenderFrames();
+  DestroyUploadFrames();
+  if (transfer_command_pool_ != command_pool_) {
+    vkDestroyCommandPool(device_, transfer_command_pool_, nullptr);
+  }
   vkDestroyCommandPool(device_, command_pool_, nullptr);
 
+  compute_.reset();
+  gpu_timer_.reset();
+  pipeline_cache_.reset();
+  allocator_.reset();
   vkDestroyDevice(device_, nullptr);
 
   if (kEnableValidationLayers) {
@@ -264,18 +381,40 @@ void Application::CreateLogicalDevice() {
 
   std::vector<VkDeviceQueueCreateInfo> queue_create_infos;
   std::set<uint32_t> unique_queue_families = {indices.graphics_family_.value(), indices.present_family_.value()};
+  if (indices.transfer_family_.has_value()) {
+    unique_queue_families.insert(indices.transfer_family_.value());
+  }
+  if (indices.compute_family_.has_value()) {
+    unique_queue_families.insert(indices.compute_family_.value());
+  }
+
+  uint32_t queue_family_count = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(physical_device_, &queue_family_count, nullptr);
+  std::vector<VkQueueFamilyProperties> queue_families(queue_family_count);
+  vkGetPhysicalDeviceQueueFamilyProperties(physical_device_, &queue_family_count, queue_families.data());
+
+  // without an async compute family the solvers get a second queue of the graphics family, if there is one
+  const uint32_t graphics_family = indices.graphics_family_.value();
+  const bool second_graphics_queue = !indices.compute_family_.has_value() && queue_families[graphics_family].queueCount > 1 &&
+                                     (queue_families[graphics_family].queueFlags & VK_QUEUE_COMPUTE_BIT) != 0U;
 
-  float queue_priority = 1.0F;
+  const float queue_priorities[] = {1.0F, 1.0F};
   for (uint32_t queue_family : unique_queue_families) {
     VkDeviceQueueCreateInfo queue_create_info{};
     queue_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
     queue_create_info.queueFamilyIndex = queue_family;
-    queue_create_info.queueCount = 1;
-    queue_create_info.pQueuePriorities = &queue_priority;
+    queue_create_info.queueCount = queue_family == graphics_family && second_graphics_queue ? 2 : 1;
+    queue_create_info.pQueuePriorities = queue_priorities;
     queue_create_infos.push_back(queue_create_info);
   }
 
+  // line polygon mode for the wireframe pipeline, one indirect call for all culled clusters
+  VkPhysicalDeviceFeatures supported_features;
+  vkGetPhysicalDeviceFeatures(physical_device_, &supported_features);
   VkPhysicalDeviceFeatures device_features{};
+  device_features.fillModeNonSolid = supported_features.fillModeNonSolid;
+  device_features.multiDrawIndirect = supported_features.multiDrawIndirect;
+  multi_draw_indirect_ = supported_features.multiDrawIndirect == VK_TRUE;
 
   VkDeviceCreateInfo create_info{};
   create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -285,8 +424,9 @@ void Application::CreateLogicalDevice() {
 
   create_info.pEnabledFeatures = &device_features;
 
-  create_info.enabledExtensionCount = static_cast<uint32_t>(kDeviceExtensions.size());
-  create_info.ppEnabledExtensionNames = kDeviceExtensions.data();
+  const auto extensions = GetDeviceExtensions(physical_device_);
+  create_info.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+  create_info.ppEnabledExtensionNames = extensions.data();
 
   if (kEnableValidationLayers) {
     create_info.enabledLayerCount = static_cast<uint32_t>(kValidationLayers.size());
@@ -301,13 +441,28 @@ void Application::CreateLogicalDevice() {
 
   vkGetDeviceQueue(device_, indices.graphics_family_.value(), 0, &graphics_queue_);
   vkGetDeviceQueue(device_, indices.present_family_.value(), 0, &present_queue_);
+
+  if (indices.compute_family_.has_value()) {
+    compute_queue_family_ = indices.compute_family_.value();
+    vkGetDeviceQueue(device_, compute_queue_family_, 0, &compute_queue_);
+  } else if (second_graphics_queue) {
+    compute_queue_family_ = graphics_family;
+    vkGetDeviceQueue(device_, graphics_family, 1, &compute_queue_);
+  }
+
+  dedicated_transfer_ = indices.transfer_family_.has_value();
+  transfer_queue_ = graphics_queue_;
+  if (dedicated_transfer_) {
+    vkGetDeviceQueue(device_, indices.transfer_family_.value(), 0, &transfer_queue_);
+    buffer_queue_families_ = {indices.graphics_family_.value(), indices.transfer_family_.value()};
+  }
 }
 
 void Application::CreateSwapChain() {
   SwapChainSupportDetails swap_chain_support = QuerySwapChainSupport(physical_device_);
 
   VkSurfaceFormatKHR surface_format = ChooseSwapSurfaceFormat(swap_chain_support.formats_);
-  VkPresentModeKHR present_mode = ChooseSwapPresentMode(swap_chain_support.present_modes_);
+  VkPresentModeKHR present_mode = ChooseSwapPresentMode(swap_chain_support.present_modes_, present_mode_);
   VkExtent2D extent = ChooseSwapExtent(swap_chain_support.capabilities_);
 
   uint32_t image_count = swap_chain_support.capabilities_.minImageCount + 1;
@@ -342,9 +497,14 @@ void Application::CreateSwapChain() {
   create_info.presentMode = present_mode;
   create_info.clipped = VK_TRUE;
 
-  create_info.oldSwapchain = VK_NULL_HANDLE;
+  // the old swap chain hands its resources over, it is idle since the device waited
+  VkSwapchainKHR old_swap_chain = swap_chain_;
+  create_info.oldSwapchain = old_swap_chain;
 
-  if (vkCreateSwapchainKHR(device_, &create_info, nullptr, &swap_chain_) != VK_SUCCESS) {
+  const VkResult result = vkCreateSwapchainKHR(device_, &create_info, nullptr, &swap_chain_);
+  vkDestroySwapchainKHR(device_, old_swap_chain, nullptr);
+  if (result != VK_SUCCESS) {
+    swap_chain_ = VK_NULL_HANDLE;
     throw std::runtime_error("failed to create swap chain!");
   }
 
@@ -354,6 +514,8 @@ void Application::CreateSwapChain() {
 
   swap_chain_image_format_ = surface_format.format;
   swap_chain_extent_ = extent;
+
+  spdlog::info("swap chain {}x{}, {} images, {} present mode", extent.width, extent.height, image_count, GetPresentModeName(present_mode));
 }
 
 void Application::CreateImageViews() {
@@ -423,10 +585,60 @@ void Application::CreateRenderPass() {
   }
 }
 
-VkPipeline Application::CreateGraphicsPipeline(VkDevice device, const VkExtent2D &swap_chain_extent, VkPipelineLayout pipeline_layout,
+void Application::CreateDescriptorSetLayout() {
+  VkDescriptorSetLayoutBinding view_binding{};
+  view_binding.binding = 0;
+  view_binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+  view_binding.descriptorCount = 1;
+  view_binding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+  VkDescriptorSetLayoutCreateInfo layout_info{};
+  layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  layout_info.bindingCount = 1;
+  layout_info.pBindings = &view_binding;
+
+  if (vkCreateDescriptorSetLayout(device_, &layout_info, nullptr, &descriptor_set_layout_) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create descriptor set layout!");
+  }
+}
+
+void Application::CreatePipelineLayout() {
+  VkPipelineLayoutCreateInfo pipeline_layout_info{};
+  pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  pipeline_layout_info.setLayoutCount = 1;
+  pipeline_layout_info.pSetLayouts = &descriptor_set_layout_;
+  pipeline_layout_info.pushConstantRangeCount = 0;
+
+  if (vkCreatePipelineLayout(device_, &pipeline_layout_info, nullptr, &pipeline_layout_) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create pipeline layout!");
+  }
+}
+
+void Application::CreateGraphicsPipelines() {
+  VkPhysicalDeviceFeatures features;
+  vkGetPhysicalDeviceFeatures(physical_device_, &features);
+
+  std::future<VkPipeline> solid = std::async(std::launch::async, CreateGraphicsPipeline, device_, pipeline_cache_->Get(), pipeline_layout_,
+                                             render_pass_, VK_POLYGON_MODE_FILL);
+  if (features.fillModeNonSolid == VK_TRUE) {
+    wireframe_pipeline_ = CreateGraphicsPipeline(device_, pipeline_cache_->Get(), pipeline_layout_, render_pass_, VK_POLYGON_MODE_LINE);
+  } else {
+    wireframe_ = false;
+  }
+  solid_pipeline_ = solid.get();
+}
+
+void Application::DestroyGraphicsPipelines() {
+  vkDestroyPipeline(device_, solid_pipeline_, nullptr);
+  vkDestroyPipeline(device_, wireframe_pipeline_, nullptr);
+  solid_pipeline_ = VK_NULL_HANDLE;
+  wireframe_pipeline_ = VK_NULL_HANDLE;
+}
+
+VkPipeline Application::CreateGraphicsPipeline(VkDevice device, VkPipelineCache pipeline_cache, VkPipelineLayout pipeline_layout,
                                                VkRenderPass render_pass, VkPolygonMode mode) {
-  auto vert_shader_code = ReadFile("build/shaders/shaders/shader.vert.spv");
-  auto frag_shader_code = ReadFile("build/shaders/shaders/shader.frag.spv");
+  auto vert_shader_code = vulkan_fem::LoadShader("shader.vert");
+  auto frag_shader_code = vulkan_fem::LoadShader("shader.frag");
 
   VkShaderModule vert_shader_module = CreateShaderModule(device, vert_shader_code);
   VkShaderModule frag_shader_module = CreateShaderModule(device, frag_shader_code);
@@ -461,24 +673,17 @@ VkPipeline Application::CreateGraphicsPipeline(VkDevice device, const VkExtent2D
   input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
   input_assembly.primitiveRestartEnable = VK_FALSE;
 
-  VkViewport viewport{};
-  viewport.x = 0.0F;
-  viewport.y = 0.0F;
-  viewport.width = static_cast<float>(swap_chain_extent.width);
-  viewport.height = static_cast<float>(swap_chain_extent.height);
-  viewport.minDepth = 0.0F;
-  viewport.maxDepth = 1.0F;
-
-  VkRect2D scissor{};
-  scissor.offset = {0, 0};
-  scissor.extent = swap_chain_extent;
-
+  // set while recording, so a resized swap chain keeps the pipelines
   VkPipelineViewportStateCreateInfo viewport_state{};
   viewport_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
   viewport_state.viewportCount = 1;
-  viewport_state.pViewports = &viewport;
   viewport_state.scissorCount = 1;
-  viewport_state.pScissors = &scissor;
+
+  const VkDynamicState dynamic_states[] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+  VkPipelineDynamicStateCreateInfo dynamic_state{};
+  dynamic_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+  dynamic_state.dynamicStateCount = 2;
+  dynamic_state.pDynamicStates = dynamic_states;
 
   VkPipelineRasterizationStateCreateInfo rasterizer{};
   rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
@@ -511,15 +716,6 @@ VkPipeline Application::CreateGraphicsPipeline(VkDevice device, const VkExtent2D
   color_blending.blendConstants[2] = 0.0F;
   color_blending.blendConstants[3] = 0.0F;
 
-  VkPipelineLayoutCreateInfo pipeline_layout_info{};
-  pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-  pipeline_layout_info.setLayoutCount = 0;
-  pipeline_layout_info.pushConstantRangeCount = 0;
-
-  if (vkCreatePipelineLayout(device, &pipeline_layout_info, nullptr, &pipeline_layout) != VK_SUCCESS) {
-    throw std::runtime_error("failed to create pipeline layout!");
-  }
-
   VkGraphicsPipelineCreateInfo pipeline_info{};
   pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
   pipeline_info.stageCount = 2;
@@ -530,13 +726,14 @@ VkPipeline Application::CreateGraphicsPipeline(VkDevice device, const VkExtent2D
   pipeline_info.pRasterizationState = &rasterizer;
   pipeline_info.pMultisampleState = &multisampling;
   pipeline_info.pColorBlendState = &color_blending;
+  pipeline_info.pDynamicState = &dynamic_state;
   pipeline_info.layout = pipeline_layout;
   pipeline_info.renderPass = render_pass;
   pipeline_info.subpass = 0;
   pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
 
   VkPipeline graphics_pipeline;
-  if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &graphics_pipeline) != VK_SUCCESS) {
+  if (vkCreateGraphicsPipelines(device, pipeline_cache, 1, &pipeline_info, nullptr, &graphics_pipeline) != VK_SUCCESS) {
     throw std::runtime_error("failed to create graphics pipeline!");
   }
 
@@ -573,180 +770,387 @@ void Application::CreateCommandPool() {
   VkCommandPoolCreateInfo pool_info{};
   pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
   pool_info.queueFamilyIndex = queue_family_indices.graphics_family_.value();
+  pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 
   if (vkCreateCommandPool(device_, &pool_info, nullptr, &command_pool_) != VK_SUCCESS) {
     throw std::runtime_error("failed to create command pool!");
   }
-}
 
-uint32_t Application::FindMemoryType(uint32_t type_filter, VkMemoryPropertyFlags properties) {
-  VkPhysicalDeviceMemoryProperties mem_properties;
-  vkGetPhysicalDeviceMemoryProperties(physical_device_, &mem_properties);
-
-  for (uint32_t i = 0; i < mem_properties.memoryTypeCount; i++) {
-    if (((type_filter & (1 << i)) != 0U) && (mem_properties.memoryTypes[i].propertyFlags & properties) == properties) {
-      return i;
+  transfer_command_pool_ = command_pool_;
+  if (dedicated_transfer_) {
+    pool_info.queueFamilyIndex = queue_family_indices.transfer_family_.value();
+    if (vkCreateCommandPool(device_, &pool_info, nullptr, &transfer_command_pool_) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create transfer command pool!");
     }
   }
-
-  throw std::runtime_error("failed to find suitable memory type!");
 }
 
-void Application::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer &buffer,
-                               VkDeviceMemory &buffer_memory) {
-  VkBufferCreateInfo buffer_info{};
-  buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-  buffer_info.size = size;
-  buffer_info.usage = usage;
-  buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+void Application::CreateRenderFrames() {
+  const auto frame_count = static_cast<uint32_t>(kMaxFramesInFlight);
+
+  VkDescriptorPoolSize pool_size{};
+  pool_size.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+  pool_size.descriptorCount = frame_count;
 
-  if (vkCreateBuffer(device_, &buffer_info, nullptr, &buffer) != VK_SUCCESS) {
-    throw std::runtime_error("failed to create buffer!");
+  VkDescriptorPoolCreateInfo descriptor_pool_info{};
+  descriptor_pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  descriptor_pool_info.maxSets = frame_count;
+  descriptor_pool_info.poolSizeCount = 1;
+  descriptor_pool_info.pPoolSizes = &pool_size;
+
+  if (vkCreateDescriptorPool(device_, &descriptor_pool_info, nullptr, &descriptor_pool_) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create descriptor pool!");
   }
 
-  VkMemoryRequirements mem_requirements;
-  vkGetBufferMemoryRequirements(device_, buffer, &mem_requirements);
+  // short lived command buffers, the pool is reset as a whole
+  VkCommandPoolCreateInfo command_pool_info{};
+  command_pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  command_pool_info.queueFamilyIndex = FindQueueFamilies(physical_device_).graphics_family_.value();
+  command_pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+  render_frames_.resize(frame_count);
+  for (auto &frame : render_frames_) {
+    if (vkCreateCommandPool(device_, &command_pool_info, nullptr, &frame.command_pool_) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create frame command pool!");
+    }
 
-  VkMemoryAllocateInfo alloc_info{};
-  alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-  alloc_info.allocationSize = mem_requirements.size;
-  alloc_info.memoryTypeIndex = FindMemoryType(mem_requirements.memoryTypeBits, properties);
+    VkCommandBufferAllocateInfo command_buffer_info{};
+    command_buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    command_buffer_info.commandPool = frame.command_pool_;
+    command_buffer_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    command_buffer_info.commandBufferCount = 1;
+    if (vkAllocateCommandBuffers(device_, &command_buffer_info, &frame.command_buffer_) != VK_SUCCESS) {
+      throw std::runtime_error("failed to allocate command buffers!");
+    }
 
-  if (vkAllocateMemory(device_, &alloc_info, nullptr, &buffer_memory) != VK_SUCCESS) {
-    throw std::runtime_error("failed to allocate buffer memory!");
+    CreateBuffer(sizeof(ViewUniforms), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, frame.uniform_buffer_, frame.uniform_allocation_);
+    *static_cast<ViewUniforms *>(frame.uniform_allocation_.mapped_) = ViewUniforms{};
+
+    VkDescriptorSetAllocateInfo descriptor_set_info{};
+    descriptor_set_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    descriptor_set_info.descriptorPool = descriptor_pool_;
+    descriptor_set_info.descriptorSetCount = 1;
+    descriptor_set_info.pSetLayouts = &descriptor_set_layout_;
+    if (vkAllocateDescriptorSets(device_, &descriptor_set_info, &frame.descriptor_set_) != VK_SUCCESS) {
+      throw std::runtime_error("failed to allocate descriptor sets!");
+    }
+
+    VkDescriptorBufferInfo buffer_info{};
+    buffer_info.buffer = frame.uniform_buffer_;
+    buffer_info.offset = 0;
+    buffer_info.range = sizeof(ViewUniforms);
+
+    VkWriteDescriptorSet descriptor_write{};
+    descriptor_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptor_write.dstSet = frame.descriptor_set_;
+    descriptor_write.dstBinding = 0;
+    descriptor_write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    descriptor_write.descriptorCount = 1;
+    descriptor_write.pBufferInfo = &buffer_info;
+
+    vkUpdateDescriptorSets(device_, 1, &descriptor_write, 0, nullptr);
   }
+}
 
-  vkBindBufferMemory(device_, buffer, buffer_memory, 0);
+void Application::DestroyRenderFrames() {
+  for (auto &frame : render_frames_) {
+    allocator_->DestroyBuffer(frame.uniform_buffer_, frame.uniform_allocation_);
+    vkDestroyCommandPool(device_, frame.command_pool_, nullptr);
+  }
+  render_frames_.clear();
+  vkDestroyDescriptorPool(device_, descriptor_pool_, nullptr);
+}
+
+void Application::SetViewUniforms(const ViewUniforms &uniforms) {
+  memcpy(render_frames_[current_frame_].uniform_allocation_.mapped_, &uniforms, sizeof(ViewUniforms));
 }
 
-void Application::CopyBuffer(VkBuffer src_buffer, VkBuffer dst_buffer, VkDeviceSize size) {
+void Application::CreateUploadFrames() {
+  upload_frames_.resize(kMaxFramesInFlight);
+
   VkCommandBufferAllocateInfo alloc_info{};
   alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  alloc_info.commandPool = transfer_command_pool_;
   alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-  alloc_info.commandPool = command_pool_;
   alloc_info.commandBufferCount = 1;
 
-  VkCommandBuffer command_buffer;
-  vkAllocateCommandBuffers(device_, &alloc_info, &command_buffer);
+  VkSemaphoreCreateInfo semaphore_info{};
+  semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+  for (auto &frame : upload_frames_) {
+    if (vkAllocateCommandBuffers(device_, &alloc_info, &frame.command_buffer_) != VK_SUCCESS) {
+      throw std::runtime_error("failed to allocate upload command buffer!");
+    }
+    if (dedicated_transfer_ && vkCreateSemaphore(device_, &semaphore_info, nullptr, &frame.uploaded_) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create upload semaphore!");
+    }
+    ReserveStaging(frame, kMinStagingCapacity);
+  }
+}
+
+void Application::DestroyUploadFrames() {
+  for (auto &frame : upload_frames_) {
+    allocator_->DestroyBuffer(frame.staging_buffer_, frame.staging_allocation_);
+    vkDestroySemaphore(device_, frame.uploaded_, nullptr);
+  }
+  upload_frames_.clear();
+}
+
+void Application::ReserveStaging(UploadFrame &frame, VkDeviceSize size) {
+  if (frame.offset_ + size <= frame.capacity_) {
+    return;
+  }
+
+  // out of space for this frame, finish what was recorded so far and start from the beginning
+  if (frame.offset_ > 0) {
+    FlushUploads(frame);
+  }
+  if (size <= frame.capacity_) {
+    return;
+  }
+
+  if (frame.staging_buffer_ != VK_NULL_HANDLE) {
+    allocator_->DestroyBuffer(frame.staging_buffer_, frame.staging_allocation_);
+  }
+
+  frame.capacity_ = std::max(size, 2 * frame.capacity_);
+  CreateBuffer(frame.capacity_, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+               frame.staging_buffer_, frame.staging_allocation_);
+}
+
+VkCommandBuffer Application::BeginUploads(UploadFrame &frame) {
+  if (frame.recording_) {
+    return frame.command_buffer_;
+  }
+
+  // the command buffer was last submitted with this frame's draw commands
+  if (!in_flight_fences_.empty()) {
+    vkWaitForFences(device_, 1, &in_flight_fences_[current_frame_], VK_TRUE, UINT64_MAX);
+  }
 
   VkCommandBufferBeginInfo begin_info{};
   begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
   begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
-  vkBeginCommandBuffer(command_buffer, &begin_info);
+  if (vkBeginCommandBuffer(frame.command_buffer_, &begin_info) != VK_SUCCESS) {
+    throw std::runtime_error("failed to begin recording upload command buffer!");
+  }
 
-  VkBufferCopy copy_region{};
-  copy_region.size = size;
-  vkCmdCopyBuffer(command_buffer, src_buffer, dst_buffer, 1, &copy_region);
+  // frames still in flight may read the buffers that are about to be overwritten, on a separate queue SubmitUploads waits for them
+  if (!dedicated_transfer_) {
+    vkCmdPipelineBarrier(frame.command_buffer_, kUploadReadStages, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+  }
 
-  vkEndCommandBuffer(command_buffer);
+  frame.recording_ = true;
+  return frame.command_buffer_;
+}
+
+void Application::EndUploads(UploadFrame &frame) const {
+  // the semaphore between the queues makes the copies visible otherwise
+  if (!dedicated_transfer_) {
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(frame.command_buffer_, VK_PIPELINE_STAGE_TRANSFER_BIT, kUploadReadStages, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+  }
+
+  if (vkEndCommandBuffer(frame.command_buffer_) != VK_SUCCESS) {
+    throw std::runtime_error("failed to record upload command buffer!");
+  }
+  frame.recording_ = false;
+}
+
+void Application::SubmitUploads(UploadFrame &frame) {
+  EndUploads(frame);
+
+  // Staging copies and recording overlapped with the previous frame, the copy engine itself must not
+  // overwrite buffers that frame still draws from
+  if (!in_flight_fences_.empty()) {
+    vkWaitForFences(device_, static_cast<uint32_t>(in_flight_fences_.size()), in_flight_fences_.data(), VK_TRUE, UINT64_MAX);
+  }
 
   VkSubmitInfo submit_info{};
   submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
   submit_info.commandBufferCount = 1;
-  submit_info.pCommandBuffers = &command_buffer;
-
-  vkQueueSubmit(graphics_queue_, 1, &submit_info, VK_NULL_HANDLE);
-  vkQueueWaitIdle(graphics_queue_);
+  submit_info.pCommandBuffers = &frame.command_buffer_;
+  submit_info.signalSemaphoreCount = 1;
+  submit_info.pSignalSemaphores = &frame.uploaded_;
 
-  vkFreeCommandBuffers(device_, command_pool_, 1, &command_buffer);
+  if (vkQueueSubmit(transfer_queue_, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS) {
+    throw std::runtime_error("failed to submit upload command buffer!");
+  }
 }
 
-void Application::CreateVertexBuffer(VkBuffer &vertex_buffer, VkDeviceMemory &vertex_buffer_memory, const std::vector<Vertex> &vertexes) {
-  VkDeviceSize buffer_size = sizeof(vertexes[0]) * vertexes.size();
+void Application::FlushUploads(UploadFrame &frame) {
+  if (frame.recording_) {
+    EndUploads(frame);
 
-  VkBuffer staging_buffer;
-  VkDeviceMemory staging_buffer_memory;
-  CreateBuffer(buffer_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-               staging_buffer, staging_buffer_memory);
+    if (dedicated_transfer_) {
+      vkQueueWaitIdle(graphics_queue_);
+    }
 
-  void *data;
-  vkMapMemory(device_, staging_buffer_memory, 0, buffer_size, 0, &data);
-  memcpy(data, vertexes.data(), static_cast<size_t>(buffer_size));
-  vkUnmapMemory(device_, staging_buffer_memory);
+    VkSubmitInfo submit_info{};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &frame.command_buffer_;
 
-  CreateBuffer(buffer_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-               vertex_buffer, vertex_buffer_memory);
+    if (vkQueueSubmit(transfer_queue_, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS) {
+      throw std::runtime_error("failed to submit upload command buffer!");
+    }
+  }
 
-  CopyBuffer(staging_buffer, vertex_buffer, buffer_size);
+  vkQueueWaitIdle(transfer_queue_);
+  frame.offset_ = 0;
+}
 
-  vkDestroyBuffer(device_, staging_buffer, nullptr);
-  vkFreeMemory(device_, staging_buffer_memory, nullptr);
+void Application::CreateCompute() {
+  if (compute_queue_ == VK_NULL_HANDLE) {
+    spdlog::warn("no compute queue besides the graphics one, solving on the host");
+    return;
+  }
+
+  try {
+    compute_ = std::make_shared<vulkan_fem::VulkanCompute>(physical_device_, device_, compute_queue_, compute_queue_family_,
+                                                           pipeline_cache_->Get());
+  } catch (const std::exception &e) {
+    spdlog::warn("compute backend unavailable, solving on the host: {}", e.what());
+  }
 }
 
-void Application::CreateIndexBuffer(VkBuffer &index_buffer, VkDeviceMemory &index_buffer_memory, const std::vector<uint16_t> &indices) {
-  VkDeviceSize buffer_size = sizeof(indices[0]) * indices.size();
+void Application::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer &buffer,
+                               vulkan_fem::GpuAllocation &allocation) {
+  buffer = allocator_->CreateBuffer(size, usage, properties, allocation);
+}
 
-  VkBuffer staging_buffer;
-  VkDeviceMemory staging_buffer_memory;
-  CreateBuffer(buffer_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-               staging_buffer, staging_buffer_memory);
+void Application::CreateSharedBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer &buffer,
+                                     vulkan_fem::GpuAllocation &allocation) {
+  buffer = allocator_->CreateBuffer(size, usage, properties, allocation, buffer_queue_families_);
+}
 
-  void *data;
-  vkMapMemory(device_, staging_buffer_memory, 0, buffer_size, 0, &data);
-  memcpy(data, indices.data(), static_cast<size_t>(buffer_size));
-  vkUnmapMemory(device_, staging_buffer_memory);
+bool Application::ReserveBuffer(DeviceBuffer &buffer, VkBufferUsageFlags usage, VkDeviceSize size) {
+  if (buffer.buffer_ != VK_NULL_HANDLE && size <= buffer.capacity_) {
+    return false;
+  }
 
-  CreateBuffer(buffer_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-               index_buffer, index_buffer_memory);
+  if (buffer.buffer_ != VK_NULL_HANDLE) {
+    // recorded copies and frames in flight may still reference the old buffer
+    for (auto &frame : upload_frames_) {
+      if (frame.recording_) {
+        FlushUploads(frame);
+      }
+    }
+    vkQueueWaitIdle(transfer_queue_);
+    vkQueueWaitIdle(graphics_queue_);
+    DestroyBuffer(buffer);
+  }
 
-  CopyBuffer(staging_buffer, index_buffer, buffer_size);
+  // transfer source as well, defragmentation copies buffers around
+  buffer.capacity_ = std::max(size + size / 2, kMinBufferCapacity);
+  buffer.usage_ = usage | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  CreateSharedBuffer(buffer.capacity_, buffer.usage_, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer.buffer_, buffer.allocation_);
+  return true;
+}
 
-  vkDestroyBuffer(device_, staging_buffer, nullptr);
-  vkFreeMemory(device_, staging_buffer_memory, nullptr);
+void Application::UploadBuffer(const DeviceBuffer &buffer, const void *data, VkDeviceSize offset, VkDeviceSize size) {
+  if (size == 0) {
+    return;
+  }
+  memcpy(MapUpload(buffer, offset, size), data, static_cast<size_t>(size));
 }
 
-void Application::CreateCommandBuffers() {
-  command_buffers_.resize(swap_chain_framebuffers_.size());
+void *Application::MapUpload(const DeviceBuffer &buffer, VkDeviceSize offset, VkDeviceSize size) {
+  if (offset + size > buffer.capacity_) {
+    throw std::runtime_error("upload outside of the buffer!");
+  }
 
-  VkCommandBufferAllocateInfo alloc_info{};
-  alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-  alloc_info.commandPool = command_pool_;
-  alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-  alloc_info.commandBufferCount = static_cast<uint32_t>(command_buffers_.size());
+  UploadFrame &frame = upload_frames_[current_frame_];
+  ReserveStaging(frame, size);
+  VkCommandBuffer command_buffer = BeginUploads(frame);
+  vulkan_fem::ProfileCount("uploaded bytes", static_cast<double>(size));
 
-  if (vkAllocateCommandBuffers(device_, &alloc_info, command_buffers_.data()) != VK_SUCCESS) {
-    throw std::runtime_error("failed to allocate command buffers!");
-  }
+  // the copy only runs once the frame is submitted, the caller fills the range before that
+  VkBufferCopy copy_region{};
+  copy_region.srcOffset = frame.offset_;
+  copy_region.dstOffset = offset;
+  copy_region.size = size;
+  vkCmdCopyBuffer(command_buffer, frame.staging_buffer_, buffer.buffer_, 1, &copy_region);
 
-  for (size_t i = 0; i < command_buffers_.size(); i++) {
-    VkCommandBufferBeginInfo begin_info{};
-    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  void *mapped = static_cast<char *>(frame.staging_allocation_.mapped_) + frame.offset_;
+  frame.offset_ += size;
+  return mapped;
+}
 
-    if (vkBeginCommandBuffer(command_buffers_[i], &begin_info) != VK_SUCCESS) {
-      throw std::runtime_error("failed to begin recording command buffer!");
-    }
+void Application::DestroyBuffer(DeviceBuffer &buffer) {
+  allocator_->DestroyBuffer(buffer.buffer_, buffer.allocation_);
+  buffer = DeviceBuffer{};
+}
 
-    VkRenderPassBeginInfo render_pass_info{};
-    render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    render_pass_info.renderPass = render_pass_;
-    render_pass_info.framebuffer = swap_chain_framebuffers_[i];
-    render_pass_info.renderArea.offset = {0, 0};
-    render_pass_info.renderArea.extent = swap_chain_extent_;
+bool Application::DefragmentBuffers(const std::vector<DeviceBuffer *> &buffers) {
+  std::vector<vulkan_fem::GpuAllocation> allocations;
+  allocations.reserve(buffers.size());
+  for (const auto *buffer : buffers) {
+    allocations.push_back(buffer->allocation_);
+  }
 
-    VkClearValue clear_color = {0.0F, 0.0F, 0.0F, 1.0F};
-    render_pass_info.clearValueCount = 1;
-    render_pass_info.pClearValues = &clear_color;
+  const auto moves = allocator_->PlanDefragmentation(allocations);
+  if (moves.empty()) {
+    return false;
+  }
 
-    vkCmdBeginRenderPass(command_buffers_[i], &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
+  UploadFrame &frame = upload_frames_[current_frame_];
+  VkCommandBuffer command_buffer = BeginUploads(frame);
+
+  // earlier uploads into the buffers must land before they are read back
+  VkMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+  vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0,
+                       nullptr);
+
+  std::vector<VkBuffer> moved(moves.size());
+  for (size_t i = 0; i < moves.size(); i++) {
+    const DeviceBuffer &source = *buffers[moves[i].index_];
+
+    VkBufferCreateInfo buffer_info{};
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.size = source.capacity_;
+    buffer_info.usage = source.usage_;
+    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    if (dedicated_transfer_) {
+      buffer_info.sharingMode = VK_SHARING_MODE_CONCURRENT;
+      buffer_info.queueFamilyIndexCount = static_cast<uint32_t>(buffer_queue_families_.size());
+      buffer_info.pQueueFamilyIndices = buffer_queue_families_.data();
+    }
 
-    vkCmdBindPipeline(command_buffers_[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphics_pipeline_);
+    if (vkCreateBuffer(device_, &buffer_info, nullptr, &moved[i]) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create buffer!");
+    }
+    vkBindBufferMemory(device_, moved[i], moves[i].destination_.memory_, moves[i].destination_.offset_);
 
-    DrawRenderPass(command_buffers_[i]);
+    VkBufferCopy copy_region{};
+    copy_region.size = source.capacity_;
+    vkCmdCopyBuffer(command_buffer, source.buffer_, moved[i], 1, &copy_region);
+  }
 
-    vkCmdEndRenderPass(command_buffers_[i]);
+  FlushUploads(frame);
 
-    if (vkEndCommandBuffer(command_buffers_[i]) != VK_SUCCESS) {
-      throw std::runtime_error("failed to record command buffer!");
-    }
+  for (size_t i = 0; i < moves.size(); i++) {
+    DeviceBuffer &buffer = *buffers[moves[i].index_];
+    allocator_->DestroyBuffer(buffer.buffer_, buffer.allocation_);
+    buffer.buffer_ = moved[i];
+    buffer.allocation_ = moves[i].destination_;
   }
+
+  SPDLOG_INFO("Moved {} buffers", moves.size());
+  return true;
 }
 
 void Application::CreateSyncObjects() {
   image_available_semaphores_.resize(kMaxFramesInFlight);
-  render_finished_semaphores_.resize(kMaxFramesInFlight);
   in_flight_fences_.resize(kMaxFramesInFlight);
-  images_in_flight_.resize(swap_chain_images_.size(), VK_NULL_HANDLE);
 
   VkSemaphoreCreateInfo semaphore_info{};
   semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
@@ -757,48 +1161,109 @@ void Application::CreateSyncObjects() {
 
   for (size_t i = 0; i < kMaxFramesInFlight; i++) {
     if (vkCreateSemaphore(device_, &semaphore_info, nullptr, &image_available_semaphores_[i]) != VK_SUCCESS ||
-        vkCreateSemaphore(device_, &semaphore_info, nullptr, &render_finished_semaphores_[i]) != VK_SUCCESS ||
         vkCreateFence(device_, &fence_info, nullptr, &in_flight_fences_[i]) != VK_SUCCESS) {
       throw std::runtime_error("failed to create synchronization objects for a frame!");
     }
   }
 }
 
+void Application::CreatePresentSemaphores() {
+  VkSemaphoreCreateInfo semaphore_info{};
+  semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+  render_finished_semaphores_.resize(swap_chain_images_.size());
+  for (auto &semaphore : render_finished_semaphores_) {
+    if (vkCreateSemaphore(device_, &semaphore_info, nullptr, &semaphore) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create synchronization objects for a swap chain image!");
+    }
+  }
+}
+
 void Application::DrawFrame() {
-  vkWaitForFences(device_, 1, &in_flight_fences_[current_frame_], VK_TRUE, UINT64_MAX);
+  frame_timer_.BeginFrame();
+  const auto frame_index = static_cast<uint32_t>(current_frame_);
+  {
+    const vulkan_fem::ScopedTimer timer("wait for frame", "render");
+    vkWaitForFences(device_, 1, &in_flight_fences_[current_frame_], VK_TRUE, UINT64_MAX);
+  }
+  gpu_timer_->Collect(frame_index);
 
-  uint32_t image_index;
-  vkAcquireNextImageKHR(device_, swap_chain_, UINT64_MAX, image_available_semaphores_[current_frame_], VK_NULL_HANDLE, &image_index);
+  // copies submitted with this frame last time are complete
+  UploadFrame &upload_frame = upload_frames_[current_frame_];
+  if (!upload_frame.recording_) {
+    upload_frame.offset_ = 0;
+  }
 
-  if (images_in_flight_[image_index] != VK_NULL_HANDLE) {
-    vkWaitForFences(device_, 1, &images_in_flight_[image_index], VK_TRUE, UINT64_MAX);
+  uint32_t image_index;
+  VkResult result;
+  {
+    const vulkan_fem::ScopedTimer timer("acquire image", "render");
+    result =
+        vkAcquireNextImageKHR(device_, swap_chain_, UINT64_MAX, image_available_semaphores_[current_frame_], VK_NULL_HANDLE, &image_index);
   }
+  if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+    RecreateSwapChain();
+    return;
+  }
+  if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
+    throw std::runtime_error("failed to acquire swap chain image!");
+  }
+  frame_timer_.EndWait();
 
-  PreDrawFrame(image_index);
+  {
+    const vulkan_fem::ScopedTimer timer("update frame", "render");
+    PreDrawFrame();
+  }
 
-  images_in_flight_[image_index] = in_flight_fences_[current_frame_];
+  // the fence signalled, nothing recorded from the pool is pending anymore
+  const RenderFrame &render_frame = render_frames_[current_frame_];
+  {
+    const vulkan_fem::ScopedTimer timer("record frame", "render");
+    vkResetCommandPool(device_, render_frame.command_pool_, 0);
+    RecordCommandBuffer(render_frame, image_index);
+  }
 
   VkSubmitInfo submit_info{};
   submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-  VkSemaphore wait_semaphores[] = {image_available_semaphores_[current_frame_]};
-  VkPipelineStageFlags wait_stages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-  submit_info.waitSemaphoreCount = 1;
-  submit_info.pWaitSemaphores = wait_semaphores;
-  submit_info.pWaitDstStageMask = wait_stages;
+  std::vector<VkSemaphore> wait_semaphores = {image_available_semaphores_[current_frame_]};
+  std::vector<VkPipelineStageFlags> wait_stages = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
+
+  // Uploads recorded for this frame run first. On the graphics queue they share the batch, the image semaphore
+  // only blocks color output. On a transfer queue only the stages reading uploaded buffers wait for them.
+  std::vector<VkCommandBuffer> submit_buffers;
+  if (upload_frame.recording_) {
+    if (dedicated_transfer_) {
+      SubmitUploads(upload_frame);
+      wait_semaphores.push_back(upload_frame.uploaded_);
+      wait_stages.push_back(kUploadReadStages);
+    } else {
+      EndUploads(upload_frame);
+      submit_buffers.push_back(upload_frame.command_buffer_);
+    }
+  }
+  submit_buffers.push_back(render_frame.command_buffer_);
 
-  submit_info.commandBufferCount = 1;
-  submit_info.pCommandBuffers = &command_buffers_[image_index];
+  submit_info.waitSemaphoreCount = static_cast<uint32_t>(wait_semaphores.size());
+  submit_info.pWaitSemaphores = wait_semaphores.data();
+  submit_info.pWaitDstStageMask = wait_stages.data();
+
+  submit_info.commandBufferCount = static_cast<uint32_t>(submit_buffers.size());
+  submit_info.pCommandBuffers = submit_buffers.data();
 
-  VkSemaphore signal_semaphores[] = {render_finished_semaphores_[current_frame_]};
+  VkSemaphore signal_semaphores[] = {render_finished_semaphores_[image_index]};
   submit_info.signalSemaphoreCount = 1;
   submit_info.pSignalSemaphores = signal_semaphores;
 
   vkResetFences(device_, 1, &in_flight_fences_[current_frame_]);
 
-  if (vkQueueSubmit(graphics_queue_, 1, &submit_info, in_flight_fences_[current_frame_]) != VK_SUCCESS) {
-    throw std::runtime_error("failed to submit draw command buffer!");
+  {
+    const vulkan_fem::ScopedTimer timer("submit", "render");
+    if (vkQueueSubmit(graphics_queue_, 1, &submit_info, in_flight_fences_[current_frame_]) != VK_SUCCESS) {
+      throw std::runtime_error("failed to submit draw command buffer!");
+    }
   }
+  gpu_timer_->Submitted(frame_index);
 
   VkPresentInfoKHR present_info{};
   present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -812,9 +1277,83 @@ void Application::DrawFrame() {
 
   present_info.pImageIndices = &image_index;
 
-  vkQueuePresentKHR(present_queue_, &present_info);
+  {
+    const vulkan_fem::ScopedTimer timer("present", "render");
+    result = vkQueuePresentKHR(present_queue_, &present_info);
+  }
 
   current_frame_ = (current_frame_ + 1) % kMaxFramesInFlight;
+
+  if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || recreate_swap_chain_) {
+    RecreateSwapChain();
+  } else if (result != VK_SUCCESS) {
+    throw std::runtime_error("failed to present swap chain image!");
+  }
+
+  if (frame_timer_.EndFrame() && log_frame_times_) {
+    LogFrameTimes();
+  }
+}
+
+void Application::RecordCommandBuffer(const RenderFrame &frame, uint32_t image_index) {
+  VkCommandBufferBeginInfo begin_info{};
+  begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+  if (vkBeginCommandBuffer(frame.command_buffer_, &begin_info) != VK_SUCCESS) {
+    throw std::runtime_error("failed to begin recording command buffer!");
+  }
+  gpu_timer_->BeginFrame(frame.command_buffer_, static_cast<uint32_t>(current_frame_));
+
+  VkRenderPassBeginInfo render_pass_info{};
+  render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+  render_pass_info.renderPass = render_pass_;
+  render_pass_info.framebuffer = swap_chain_framebuffers_[image_index];
+  render_pass_info.renderArea.offset = {0, 0};
+  render_pass_info.renderArea.extent = swap_chain_extent_;
+
+  VkClearValue clear_color = {0.0F, 0.0F, 0.0F, 1.0F};
+  render_pass_info.clearValueCount = 1;
+  render_pass_info.pClearValues = &clear_color;
+
+  PreRenderPass(frame.command_buffer_);
+
+  gpu_timer_->BeginPass(frame.command_buffer_, "render pass");
+  vkCmdBeginRenderPass(frame.command_buffer_, &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
+
+  VkViewport viewport{};
+  viewport.x = 0.0F;
+  viewport.y = 0.0F;
+  viewport.width = static_cast<float>(swap_chain_extent_.width);
+  viewport.height = static_cast<float>(swap_chain_extent_.height);
+  viewport.minDepth = 0.0F;
+  viewport.maxDepth = 1.0F;
+  vkCmdSetViewport(frame.command_buffer_, 0, 1, &viewport);
+
+  VkRect2D scissor{};
+  scissor.offset = {0, 0};
+  scissor.extent = swap_chain_extent_;
+  vkCmdSetScissor(frame.command_buffer_, 0, 1, &scissor);
+
+  vkCmdBindPipeline(frame.command_buffer_, VK_PIPELINE_BIND_POINT_GRAPHICS, wireframe_ ? wireframe_pipeline_ : solid_pipeline_);
+  vkCmdBindDescriptorSets(frame.command_buffer_, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout_, 0, 1, &frame.descriptor_set_, 0,
+                          nullptr);
+
+  DrawRenderPass(frame.command_buffer_);
+
+  vkCmdEndRenderPass(frame.command_buffer_);
+  gpu_timer_->EndPass(frame.command_buffer_);
+
+  if (vkEndCommandBuffer(frame.command_buffer_) != VK_SUCCESS) {
+    throw std::runtime_error("failed to record command buffer!");
+  }
+}
+
+void Application::LogFrameTimes() const {
+  const vulkan_fem::FrameStats &stats = frame_timer_.GetStats();
+  spdlog::info("{} frames, {:.2f} ms mean ({:.0f} fps), median {:.2f} ms, p99 {:.2f} ms, max {:.2f} ms, wait {:.2f} ms, cpu {:.2f} ms",
+               stats.frames_, stats.average_ms_, 1000.0 / stats.average_ms_, stats.median_ms_, stats.p99_ms_, stats.max_ms_, stats.wait_ms_,
+               stats.cpu_ms_);
 }
 
 VkShaderModule Application::CreateShaderModule(VkDevice device, const std::vector<char> &code) {
@@ -841,13 +1380,14 @@ VkSurfaceFormatKHR Application::ChooseSwapSurfaceFormat(const std::vector<VkSurf
   return available_formats[0];
 }
 
-VkPresentModeKHR Application::ChooseSwapPresentMode(const std::vector<VkPresentModeKHR> &available_present_modes) {
+VkPresentModeKHR Application::ChooseSwapPresentMode(const std::vector<VkPresentModeKHR> &available_present_modes, VkPresentModeKHR preferred) {
   for (const auto &available_present_mode : available_present_modes) {
-    if (available_present_mode == VK_PRESENT_MODE_MAILBOX_KHR) {
+    if (available_present_mode == preferred) {
       return available_present_mode;
     }
   }
 
+  // the only mode every surface supports
   return VK_PRESENT_MODE_FIFO_KHR;
 }
 
@@ -921,6 +1461,23 @@ bool Application::CheckDeviceExtensionSupport(VkPhysicalDevice device) {
   return required_extensions.empty();
 }
 
+std::vector<const char *> Application::GetDeviceExtensions(VkPhysicalDevice device) {
+  uint32_t extension_count;
+  vkEnumerateDeviceExtensionProperties(device, nullptr, &extension_count, nullptr);
+
+  std::vector<VkExtensionProperties> available_extensions(extension_count);
+  vkEnumerateDeviceExtensionProperties(device, nullptr, &extension_count, available_extensions.data());
+
+  std::vector<const char *> extensions = kDeviceExtensions;
+  for (const auto &extension : available_extensions) {
+    if (strcmp(extension.extensionName, kPortabilitySubsetExtension) == 0) {
+      extensions.push_back(kPortabilitySubsetExtension);
+    }
+  }
+
+  return extensions;
+}
+
 QueueFamilyIndices Application::FindQueueFamilies(VkPhysicalDevice device) {
   QueueFamilyIndices indices;
 
@@ -950,6 +1507,17 @@ QueueFamilyIndices Application::FindQueueFamilies(VkPhysicalDevice device) {
     i++;
   }
 
+  // copy engines and async compute run alongside rendering, general purpose families would only compete with it
+  for (uint32_t family = 0; family < queue_family_count; family++) {
+    const VkQueueFlags flags = queue_families[family].queueFlags;
+    if (!indices.transfer_family_ && (flags & VK_QUEUE_TRANSFER_BIT) != 0U && (flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) == 0U) {
+      indices.transfer_family_ = family;
+    }
+    if (!indices.compute_family_ && (flags & VK_QUEUE_COMPUTE_BIT) != 0U && (flags & VK_QUEUE_GRAPHICS_BIT) == 0U) {
+      indices.compute_family_ = family;
+    }
+  }
+
   return indices;
 }
 
@@ -994,24 +1562,6 @@ bool Application::CheckValidationLayerSupport() {
   return true;
 }
 
-std::vector<char> Application::ReadFile(const std::string &filename) {
-  std::ifstream file(filename, std::ios::ate | std::ios::binary);
-
-  if (!file.is_open()) {
-    throw std::runtime_error("failed to open file!");
-  }
-
-  size_t file_size = (size_t)file.tellg();
-  std::vector<char> buffer(file_size);
-
-  file.seekg(0);
-  file.read(buffer.data(), file_size);
-
-  file.close();
-
-  return buffer;
-}
-
 VKAPI_ATTR VkBool32 VKAPI_CALL Application::DebugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT /*messageSeverity*/,
                                                           VkDebugUtilsMessageTypeFlagsEXT /*messageType*/,
                                                           const VkDebugUtilsMessengerCallbackDataEXT *p_callback_data,
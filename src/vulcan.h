@@ -1,9 +1,15 @@
 #pragma once
 
+#include "frame_timer.h"
+#include "gpu_allocator.h"
+#include "gpu_timer.h"
+#include "pipeline_cache.h"
 #include <cstddef>
 #include <cstdint>
 #include <iosfwd>
+#include <memory>
 #include <optional>
+#include <string>
 #include <vector>
 
 #define GLFW_INCLUDE_VULKAN
@@ -12,9 +18,15 @@
 #include <vulkan/vk_platform.h>
 #include <vulkan/vulkan_core.h>
 
+namespace vulkan_fem {
+class VulkanCompute;
+}
+
 struct QueueFamilyIndices {
   std::optional<uint32_t> graphics_family_;
   std::optional<uint32_t> present_family_;
+  std::optional<uint32_t> transfer_family_;  // dedicated copy engine, neither graphics nor compute
+  std::optional<uint32_t> compute_family_;   // async compute, no graphics
 
   bool IsComplete() { return graphics_family_.has_value() && present_family_.has_value(); }
 };
@@ -25,17 +37,49 @@ struct SwapChainSupportDetails {
   std::vector<VkPresentModeKHR> present_modes_;
 };
 
+// device local buffer kept across updates, reallocated with headroom only when the data outgrows it
+struct DeviceBuffer {
+  VkBuffer buffer_ = VK_NULL_HANDLE;
+  vulkan_fem::GpuAllocation allocation_;
+  VkDeviceSize capacity_ = 0;
+  VkBufferUsageFlags usage_ = 0;
+};
+
 struct Vertex {
-  glm::vec2 pos_;
+  glm::vec2 pos_;  // reference position
+  glm::vec2 displacement_;
+  float value_ = 0.F;  // scalar field shown through the colormap
 
   static VkVertexInputBindingDescription GetBindingDescription();
   static std::vector<VkVertexInputAttributeDescription> GetAttributeDescriptions();
 };
 
+// uniform block of shader.vert, std140
+struct ViewUniforms {
+  glm::vec2 scale_{1.F, 1.F};  // model to clip space, zoom and pan
+  glm::vec2 offset_{0.F, 0.F};
+  float deformation_scale_ = 1.F;  // animating it needs no vertex upload
+  float min_value_ = 0.F;          // colormap range, a flat colour when empty
+  float max_value_ = 0.F;
+};
+
+// consecutive triangles of the index buffer as read by cull.comp, std430
+struct DrawCluster {
+  glm::vec2 min_position_;  // bounding box of the reference positions
+  glm::vec2 max_position_;
+  glm::vec2 min_displacement_;  // and of the displacements, scaled by the view before they are added
+  glm::vec2 max_displacement_;
+  uint32_t first_index_ = 0;
+  uint32_t index_count_ = 0;
+};
+
 class Application {
  public:
   void Run();
 
+  // preferred before Run, FIFO is used when the surface does not support it
+  void SetPresentMode(VkPresentModeKHR mode) { present_mode_ = mode; }
+
   virtual bool ProcessInput(GLFWindow *window, int key, int scancode, int action, int mods);
 
  protected:
@@ -50,6 +94,12 @@ class Application {
 
   VkQueue graphics_queue_ = VK_NULL_HANDLE;
   VkQueue present_queue_ = VK_NULL_HANDLE;
+  // a dedicated transfer queue when the device has one, the graphics queue otherwise
+  VkQueue transfer_queue_ = VK_NULL_HANDLE;
+  bool dedicated_transfer_ = false;
+  // for the solvers, which run on their own thread and must not share a queue with rendering
+  VkQueue compute_queue_ = VK_NULL_HANDLE;
+  uint32_t compute_queue_family_ = 0;
 
   VkSwapchainKHR swap_chain_ = VK_NULL_HANDLE;
   std::vector<VkImage> swap_chain_images_;
@@ -59,39 +109,101 @@ class Application {
   std::vector<VkFramebuffer> swap_chain_framebuffers_;
 
   VkRenderPass render_pass_ = VK_NULL_HANDLE;
+  VkDescriptorSetLayout descriptor_set_layout_ = VK_NULL_HANDLE;
   VkPipelineLayout pipeline_layout_ = VK_NULL_HANDLE;
-  VkPipeline graphics_pipeline_ = VK_NULL_HANDLE;
+  VkPipeline solid_pipeline_ = VK_NULL_HANDLE;
+  VkPipeline wireframe_pipeline_ = VK_NULL_HANDLE;  // null without fillModeNonSolid
+  bool wireframe_ = true;                            // pipeline bound by the frames recorded from now on
+  bool multi_draw_indirect_ = false;                 // more than one draw per vkCmdDrawIndexedIndirect
+
+  std::unique_ptr<vulkan_fem::PipelineCache> pipeline_cache_;
 
   VkCommandPool command_pool_ = VK_NULL_HANDLE;
+  VkCommandPool transfer_command_pool_ = VK_NULL_HANDLE;
 
-  std::vector<VkCommandBuffer> command_buffers_;
+  std::unique_ptr<vulkan_fem::GpuAllocator> allocator_;
+  // timestamps of the passes recorded into the frames, only while profiling
+  std::unique_ptr<vulkan_fem::GpuTimer> gpu_timer_;
+
+  // compute kernels on the graphics queue, null when unavailable and the solvers stay on the host
+  std::shared_ptr<vulkan_fem::VulkanCompute> compute_;
 
   std::vector<VkSemaphore> image_available_semaphores_;
+  // per swap chain image, the presentation of an image has finished with it once the image is acquired again
   std::vector<VkSemaphore> render_finished_semaphores_;
   std::vector<VkFence> in_flight_fences_;
-  std::vector<VkFence> images_in_flight_;
   size_t current_frame_ = 0;
 
   virtual void PreInit() {}
   virtual void Cleanup();
+  // recorded ahead of the render pass, e.g. compute passes generating draws
+  virtual void PreRenderPass(VkCommandBuffer command_buffer) {}
   virtual void DrawRenderPass(VkCommandBuffer command_buffers) {}
-  virtual void PreDrawFrame(uint32_t image_index) {}
+  // after the frame's fence, before its commands are recorded
+  virtual void PreDrawFrame() {}
   virtual void CrateBuffers() {}
 
-  void CreateIndexBuffer(VkBuffer &index_buffer, VkDeviceMemory &index_buffer_memory, const std::vector<uint16_t> &indices);
-  void CreateVertexBuffer(VkBuffer &vertex_buffer, VkDeviceMemory &vertex_buffer_memory, const std::vector<Vertex> &vertexes);
-
   void CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer &buffer,
-                    VkDeviceMemory &buffer_memory);
-  void CopyBuffer(VkBuffer src_buffer, VkBuffer dst_buffer, VkDeviceSize size);
+                    vulkan_fem::GpuAllocation &allocation);
+  // usable from both the graphics and the transfer queue
+  void CreateSharedBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer &buffer,
+                          vulkan_fem::GpuAllocation &allocation);
 
-  void CreateCommandBuffers();
+  // true when the buffer had to be reallocated, its contents are lost and command buffers binding it must be re-recorded
+  bool ReserveBuffer(DeviceBuffer &buffer, VkBufferUsageFlags usage, VkDeviceSize size);
+  // copies through the staging ring, batched into one submission ahead of the next frame's draw commands
+  void UploadBuffer(const DeviceBuffer &buffer, const void *data, VkDeviceSize offset, VkDeviceSize size);
+  // Staging memory for size bytes at offset of the buffer, for writing data in place instead of copying it in.
+  // Must be filled before the next upload call, which may submit the copies recorded so far.
+  void *MapUpload(const DeviceBuffer &buffer, VkDeviceSize offset, VkDeviceSize size);
+  void DestroyBuffer(DeviceBuffer &buffer);
+  // moves buffers out of sparsely used memory blocks, true when any moved and command buffers must be re-recorded
+  bool DefragmentBuffers(const std::vector<DeviceBuffer *> &buffers);
+
+  // writes the view block of the frame being prepared
+  void SetViewUniforms(const ViewUniforms &uniforms);
 
  private:
+  // per frame in flight: persistently mapped staging memory and the copies recorded from it
+  struct UploadFrame {
+    VkCommandBuffer command_buffer_ = VK_NULL_HANDLE;
+    bool recording_ = false;
+    VkSemaphore uploaded_ = VK_NULL_HANDLE;  // transfer queue to the frame's draw submission
+    VkBuffer staging_buffer_ = VK_NULL_HANDLE;
+    vulkan_fem::GpuAllocation staging_allocation_;
+    VkDeviceSize capacity_ = 0;
+    VkDeviceSize offset_ = 0;
+  };
+
+  // Per frame in flight: commands recorded anew every frame from a pool that is reset as a whole once the
+  // frame's fence signals, and the host visible view block they bind. Nothing depends on the swap chain images.
+  struct RenderFrame {
+    VkCommandPool command_pool_ = VK_NULL_HANDLE;
+    VkCommandBuffer command_buffer_ = VK_NULL_HANDLE;
+    VkBuffer uniform_buffer_ = VK_NULL_HANDLE;
+    vulkan_fem::GpuAllocation uniform_allocation_;
+    VkDescriptorSet descriptor_set_ = VK_NULL_HANDLE;
+  };
+
+  std::vector<UploadFrame> upload_frames_;
+  std::vector<RenderFrame> render_frames_;
+  VkDescriptorPool descriptor_pool_ = VK_NULL_HANDLE;
+  // device buffers are shared by the graphics and transfer families, no ownership transfers needed
+  std::vector<uint32_t> buffer_queue_families_;
+
+  VkPresentModeKHR present_mode_ = VK_PRESENT_MODE_MAILBOX_KHR;
+  bool recreate_swap_chain_ = false;  // resized or a new present mode, done after the next present
+
+  vulkan_fem::FrameTimer frame_timer_;
+  bool log_frame_times_ = false;
+
   void InitWindow();
+  static void FramebufferResizeCallback(GLFWindow *window, int width, int height);
   void InitVulkan();
   void MainLoop();
+  // what depends on the swap chain images, the render pass and pipelines survive a resize
   void CleanupSwapChain();
+  void RecreateSwapChain();
   void CreateInstance();
   static void PopulateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT &create_info);
   void SetupDebugMessenger();
@@ -102,27 +214,47 @@ class Application {
   void CreateSwapChain();
   void CreateImageViews();
   void CreateRenderPass();
-  static VkPipeline CreateGraphicsPipeline(VkDevice device, const VkExtent2D &swap_chain_extent, VkPipelineLayout pipeline_layout,
+  void CreateDescriptorSetLayout();
+  void CreatePipelineLayout();
+  // viewport and scissor are dynamic state
+  static VkPipeline CreateGraphicsPipeline(VkDevice device, VkPipelineCache pipeline_cache, VkPipelineLayout pipeline_layout,
                                            VkRenderPass render_pass, VkPolygonMode mode);
+  // solid and wireframe variants, compiled concurrently
+  void CreateGraphicsPipelines();
+  void DestroyGraphicsPipelines();
   void CreateFramebuffers();
   void CreateCommandPool();
+  void CreateRenderFrames();
+  void DestroyRenderFrames();
+  void CreateCompute();
+  void CreateUploadFrames();
+  void DestroyUploadFrames();
+  void ReserveStaging(UploadFrame &frame, VkDeviceSize size);
+  VkCommandBuffer BeginUploads(UploadFrame &frame);
+  void EndUploads(UploadFrame &frame) const;
+  // dedicated transfer queue only, signals the frame's semaphore
+  void SubmitUploads(UploadFrame &frame);
+  // submits the pending copies and waits, the staging memory is free again afterwards
+  void FlushUploads(UploadFrame &frame);
 
   void CreateSyncObjects();
+  void CreatePresentSemaphores();
 
   void DrawFrame();
+  void RecordCommandBuffer(const RenderFrame &frame, uint32_t image_index);
+  void LogFrameTimes() const;
 
-  uint32_t FindMemoryType(uint32_t type_filter, VkMemoryPropertyFlags properties);
   static VkShaderModule CreateShaderModule(VkDevice device, const std::vector<char> &code);
   static VkSurfaceFormatKHR ChooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR> &available_formats);
-  static VkPresentModeKHR ChooseSwapPresentMode(const std::vector<VkPresentModeKHR> &available_present_modes);
+  static VkPresentModeKHR ChooseSwapPresentMode(const std::vector<VkPresentModeKHR> &available_present_modes, VkPresentModeKHR preferred);
   VkExtent2D ChooseSwapExtent(const VkSurfaceCapabilitiesKHR &capabilities);
   SwapChainSupportDetails QuerySwapChainSupport(VkPhysicalDevice device);
   bool IsDeviceSuitable(VkPhysicalDevice device);
   static bool CheckDeviceExtensionSupport(VkPhysicalDevice device);
+  static std::vector<const char *> GetDeviceExtensions(VkPhysicalDevice device);
   QueueFamilyIndices FindQueueFamilies(VkPhysicalDevice device);
   static std::vector<const char *> GetRequiredExtensions();
   static bool CheckValidationLayerSupport();
-  static std::vector<char> ReadFile(const std::string &filename);
 
   static VKAPI_ATTR VkBool32 VKAPI_CALL DebugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT message_severity,
                                                       VkDebugUtilsMessageTypeFlagsEXT message_type,
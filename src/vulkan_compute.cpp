@@ -0,0 +1,757 @@
+#include "vulkan_compute.h"
+#include "shader_library.h"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <exception>
+#include <future>
+#include <stdexcept>
+
+namespace vulkan_fem {
+namespace {
+
+constexpr uint32_t kGroupSize = 64;      // local_size_x of the row and vector kernels
+constexpr uint32_t kDotGroups = 256;     // partial sums per dot product
+constexpr uint32_t kMaxGroupCount = 65535;  // smallest maxComputeWorkGroupCount allowed by the spec
+constexpr uint32_t kMaxSets = 16;
+constexpr uint32_t kMaxBindings = 8;
+
+// reduce.comp modes and scalars
+constexpr uint32_t kStoreRz = 0;
+constexpr uint32_t kAlpha = 1;
+constexpr uint32_t kBeta = 2;
+constexpr uint32_t kStoreRr = 3;
+constexpr uint32_t kScalarRr = 3;
+constexpr uint32_t kScalarCount = 4;
+
+// cg_update.comp modes
+constexpr uint32_t kStart = 0;
+constexpr uint32_t kUpdateSolution = 1;
+constexpr uint32_t kUpdateDirection = 2;
+
+struct SizeParameters {
+  uint32_t size_;
+};
+
+struct ModeParameters {
+  uint32_t size_;
+  uint32_t mode_;
+};
+
+struct BlockParameters {
+  uint32_t block_rows_;
+  uint32_t dim_;
+};
+
+struct ElementParameters {
+  uint32_t element_count_;
+  uint32_t node_count_;
+  uint32_t point_count_;
+  uint32_t dim_;
+};
+
+uint32_t GroupCount(size_t size, uint32_t group_size) {
+  const size_t count = (size + group_size - 1) / group_size;
+  if (count > kMaxGroupCount) {
+    throw std::runtime_error("problem too large for a one dimensional dispatch");
+  }
+  return static_cast<uint32_t>(count);
+}
+
+bool HasExtension(const std::vector<VkExtensionProperties> &extensions, const char *name) {
+  return std::any_of(extensions.begin(), extensions.end(),
+                     [&](const VkExtensionProperties &extension) { return std::strcmp(extension.extensionName, name) == 0; });
+}
+
+}  // namespace
+
+VulkanCompute::VulkanCompute() : owns_device_(true) {
+  try {
+    CreateInstance();
+    PickPhysicalDevice();
+    CreateDevice();
+    owned_pipeline_cache_ = std::make_unique<PipelineCache>(physical_device_, device_);
+    pipeline_cache_ = owned_pipeline_cache_->Get();
+    Init();
+  } catch (...) {
+    Release();
+    throw;
+  }
+}
+
+VulkanCompute::VulkanCompute(VkPhysicalDevice physical_device, VkDevice device, VkQueue queue, uint32_t queue_family,
+                             VkPipelineCache pipeline_cache)
+    : physical_device_(physical_device), device_(device), queue_(queue), queue_family_(queue_family), pipeline_cache_(pipeline_cache) {
+  try {
+    Init();
+  } catch (...) {
+    Release();
+    throw;
+  }
+}
+
+VulkanCompute::~VulkanCompute() { Release(); }
+
+std::string VulkanCompute::GetName() const {
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physical_device_, &properties);
+  return properties.deviceName;
+}
+
+void VulkanCompute::CreateInstance() {
+  VkApplicationInfo app_info{};
+  app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+  app_info.pApplicationName = "vulkan_fem compute";
+  app_info.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
+  app_info.pEngineName = "No Engine";
+  app_info.engineVersion = VK_MAKE_VERSION(1, 0, 0);
+  app_info.apiVersion = VK_API_VERSION_1_1;
+
+  VkInstanceCreateInfo create_info{};
+  create_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+  create_info.pApplicationInfo = &app_info;
+
+  std::vector<const char *> extensions;
+#ifdef VK_KHR_portability_enumeration
+  // portability drivers such as MoltenVK are only listed when asked for
+  uint32_t extension_count = 0;
+  vkEnumerateInstanceExtensionProperties(nullptr, &extension_count, nullptr);
+  std::vector<VkExtensionProperties> available(extension_count);
+  vkEnumerateInstanceExtensionProperties(nullptr, &extension_count, available.data());
+  if (HasExtension(available, VK_KHR_PORTABILITY_ENUMERATION_EXTENSION_NAME)) {
+    extensions.push_back(VK_KHR_PORTABILITY_ENUMERATION_EXTENSION_NAME);
+    create_info.flags |= VK_INSTANCE_CREATE_ENUMERATE_PORTABILITY_BIT_KHR;
+  }
+#endif
+  create_info.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+  create_info.ppEnabledExtensionNames = extensions.data();
+
+  if (vkCreateInstance(&create_info, nullptr, &instance_) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create a Vulkan 1.1 instance");
+  }
+}
+
+void VulkanCompute::PickPhysicalDevice() {
+  uint32_t device_count = 0;
+  vkEnumeratePhysicalDevices(instance_, &device_count, nullptr);
+  std::vector<VkPhysicalDevice> devices(device_count);
+  vkEnumeratePhysicalDevices(instance_, &device_count, devices.data());
+
+  int best_score = -1;
+  for (auto *device : devices) {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(device, &properties);
+    if (properties.apiVersion < VK_API_VERSION_1_1) {
+      continue;
+    }
+
+    uint32_t family_count = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(device, &family_count, nullptr);
+    std::vector<VkQueueFamilyProperties> families(family_count);
+    vkGetPhysicalDeviceQueueFamilyProperties(device, &family_count, families.data());
+
+    const auto family = std::find_if(families.begin(), families.end(),
+                                     [](const VkQueueFamilyProperties &queue_family) { return (queue_family.queueFlags & VK_QUEUE_COMPUTE_BIT) != 0U; });
+    if (family == families.end()) {
+      continue;
+    }
+
+    int score = 0;
+    switch (properties.deviceType) {
+      case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+        score = 3;
+        break;
+      case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+        score = 2;
+        break;
+      case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+        score = 1;
+        break;
+      default:
+        break;
+    }
+
+    if (score > best_score) {
+      best_score = score;
+      physical_device_ = device;
+      queue_family_ = static_cast<uint32_t>(family - families.begin());
+    }
+  }
+
+  if (physical_device_ == VK_NULL_HANDLE) {
+    throw std::runtime_error("failed to find a Vulkan 1.1 device with a compute queue");
+  }
+}
+
+void VulkanCompute::CreateDevice() {
+  const float queue_priority = 1.0F;
+  VkDeviceQueueCreateInfo queue_create_info{};
+  queue_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+  queue_create_info.queueFamilyIndex = queue_family_;
+  queue_create_info.queueCount = 1;
+  queue_create_info.pQueuePriorities = &queue_priority;
+
+  // must be enabled whenever the implementation offers it
+  uint32_t extension_count = 0;
+  vkEnumerateDeviceExtensionProperties(physical_device_, nullptr, &extension_count, nullptr);
+  std::vector<VkExtensionProperties> available(extension_count);
+  vkEnumerateDeviceExtensionProperties(physical_device_, nullptr, &extension_count, available.data());
+
+  std::vector<const char *> extensions;
+  if (HasExtension(available, "VK_KHR_portability_subset")) {
+    extensions.push_back("VK_KHR_portability_subset");
+  }
+
+  VkPhysicalDeviceFeatures device_features{};
+
+  VkDeviceCreateInfo create_info{};
+  create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+  create_info.queueCreateInfoCount = 1;
+  create_info.pQueueCreateInfos = &queue_create_info;
+  create_info.pEnabledFeatures = &device_features;
+  create_info.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+  create_info.ppEnabledExtensionNames = extensions.data();
+
+  if (vkCreateDevice(physical_device_, &create_info, nullptr, &device_) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create compute device");
+  }
+
+  vkGetDeviceQueue(device_, queue_family_, 0, &queue_);
+}
+
+void VulkanCompute::Init() {
+  VkCommandPoolCreateInfo pool_info{};
+  pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+  pool_info.queueFamilyIndex = queue_family_;
+  if (vkCreateCommandPool(device_, &pool_info, nullptr, &command_pool_) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create compute command pool");
+  }
+
+  VkCommandBufferAllocateInfo alloc_info{};
+  alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  alloc_info.commandPool = command_pool_;
+  alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  alloc_info.commandBufferCount = static_cast<uint32_t>(command_buffers_.size());
+  if (vkAllocateCommandBuffers(device_, &alloc_info, command_buffers_.data()) != VK_SUCCESS) {
+    throw std::runtime_error("failed to allocate compute command buffers");
+  }
+
+  VkFenceCreateInfo fence_info{};
+  fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+  if (vkCreateFence(device_, &fence_info, nullptr, &fence_) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create compute fence");
+  }
+
+  VkDescriptorPoolSize pool_size{};
+  pool_size.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  pool_size.descriptorCount = kMaxSets * kMaxBindings;
+
+  VkDescriptorPoolCreateInfo descriptor_pool_info{};
+  descriptor_pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  descriptor_pool_info.maxSets = kMaxSets;
+  descriptor_pool_info.poolSizeCount = 1;
+  descriptor_pool_info.pPoolSizes = &pool_size;
+  if (vkCreateDescriptorPool(device_, &descriptor_pool_info, nullptr, &descriptor_pool_) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create compute descriptor pool");
+  }
+
+  // every kernel compiles on its own thread, the pipeline cache is internally synchronized
+  std::vector<std::future<void>> pipelines;
+  const auto create = [&](Kernel kernel, const char *name, uint32_t binding_count, uint32_t push_constant_size) {
+    pipelines.push_back(std::async(std::launch::async, [=] { CreatePipeline(kernel, name, binding_count, push_constant_size); }));
+  };
+  create(kElementStiffness, "element_stiffness", 4, sizeof(ElementParameters));
+  create(kAssemble, "assemble", 7, sizeof(SizeParameters));
+  create(kMultiplyCsr, "spmv_csr", 5, sizeof(SizeParameters));
+  create(kMultiplyBsr, "spmv_bsr", 5, sizeof(BlockParameters));
+  create(kDot, "dot", 3, sizeof(SizeParameters));
+  create(kReduce, "reduce", 2, sizeof(ModeParameters));
+  create(kConjugateGradientUpdate, "cg_update", 7, sizeof(ModeParameters));
+
+  // all of them finish before the first failure is rethrown, Release destroys what was created
+  std::exception_ptr failure;
+  for (auto &pipeline : pipelines) {
+    try {
+      pipeline.get();
+    } catch (...) {
+      failure = failure ? failure : std::current_exception();
+    }
+  }
+  if (failure) {
+    std::rethrow_exception(failure);
+  }
+
+  spdlog::info("Vulkan compute on {}", GetName());
+}
+
+void VulkanCompute::CreatePipeline(Kernel kernel, const char *name, uint32_t binding_count, uint32_t push_constant_size) {
+  Pipeline &pipeline = pipelines_[kernel];
+
+  std::vector<VkDescriptorSetLayoutBinding> bindings(binding_count);
+  for (uint32_t i = 0; i < binding_count; ++i) {
+    bindings[i].binding = i;
+    bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[i].descriptorCount = 1;
+    bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  }
+
+  VkDescriptorSetLayoutCreateInfo set_layout_info{};
+  set_layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  set_layout_info.bindingCount = binding_count;
+  set_layout_info.pBindings = bindings.data();
+  if (vkCreateDescriptorSetLayout(device_, &set_layout_info, nullptr, &pipeline.set_layout_) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create descriptor set layout");
+  }
+
+  VkPushConstantRange push_constant_range{};
+  push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  push_constant_range.offset = 0;
+  push_constant_range.size = push_constant_size;
+
+  VkPipelineLayoutCreateInfo layout_info{};
+  layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  layout_info.setLayoutCount = 1;
+  layout_info.pSetLayouts = &pipeline.set_layout_;
+  layout_info.pushConstantRangeCount = 1;
+  layout_info.pPushConstantRanges = &push_constant_range;
+  if (vkCreatePipelineLayout(device_, &layout_info, nullptr, &pipeline.layout_) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create compute pipeline layout");
+  }
+
+  const std::vector<char> code = LoadShader(std::string(name) + ".comp");
+  VkShaderModuleCreateInfo module_info{};
+  module_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+  module_info.codeSize = code.size();
+  module_info.pCode = reinterpret_cast<const uint32_t *>(code.data());
+
+  VkShaderModule shader_module;
+  if (vkCreateShaderModule(device_, &module_info, nullptr, &shader_module) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create shader module");
+  }
+
+  VkComputePipelineCreateInfo pipeline_info{};
+  pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+  pipeline_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+  pipeline_info.stage.module = shader_module;
+  pipeline_info.stage.pName = "main";
+  pipeline_info.layout = pipeline.layout_;
+
+  const VkResult result = vkCreateComputePipelines(device_, pipeline_cache_, 1, &pipeline_info, nullptr, &pipeline.pipeline_);
+  vkDestroyShaderModule(device_, shader_module, nullptr);
+  if (result != VK_SUCCESS) {
+    throw std::runtime_error("failed to create compute pipeline");
+  }
+}
+
+void VulkanCompute::Release() {
+  if (device_ != VK_NULL_HANDLE) {
+    vkDeviceWaitIdle(device_);
+
+    BeginOperation();
+    for (auto &pipeline : pipelines_) {
+      vkDestroyPipeline(device_, pipeline.pipeline_, nullptr);
+      vkDestroyPipelineLayout(device_, pipeline.layout_, nullptr);
+      vkDestroyDescriptorSetLayout(device_, pipeline.set_layout_, nullptr);
+      pipeline = {};
+    }
+
+    vkDestroyDescriptorPool(device_, descriptor_pool_, nullptr);
+    vkDestroyFence(device_, fence_, nullptr);
+    vkDestroyCommandPool(device_, command_pool_, nullptr);
+    descriptor_pool_ = VK_NULL_HANDLE;
+    fence_ = VK_NULL_HANDLE;
+    command_pool_ = VK_NULL_HANDLE;
+
+    owned_pipeline_cache_.reset();
+    if (owns_device_) {
+      vkDestroyDevice(device_, nullptr);
+    }
+    device_ = VK_NULL_HANDLE;
+  }
+
+  if (instance_ != VK_NULL_HANDLE) {
+    vkDestroyInstance(instance_, nullptr);
+    instance_ = VK_NULL_HANDLE;
+  }
+}
+
+uint32_t VulkanCompute::FindMemoryType(uint32_t type_filter) const {
+  VkPhysicalDeviceMemoryProperties memory_properties;
+  vkGetPhysicalDeviceMemoryProperties(physical_device_, &memory_properties);
+
+  // device local memory the host can map (integrated GPUs, resizable BAR, CPU devices) before plain host memory
+  constexpr VkMemoryPropertyFlags kHostVisible = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+  for (const VkMemoryPropertyFlags properties : {kHostVisible | VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, kHostVisible}) {
+    for (uint32_t i = 0; i < memory_properties.memoryTypeCount; i++) {
+      if (((type_filter & (1U << i)) != 0U) && (memory_properties.memoryTypes[i].propertyFlags & properties) == properties) {
+        return i;
+      }
+    }
+  }
+
+  throw std::runtime_error("failed to find host visible memory for compute buffers");
+}
+
+void VulkanCompute::BeginOperation() {
+  for (auto &buffer : operation_buffers_) {
+    vkDestroyBuffer(device_, buffer.buffer_, nullptr);
+    vkFreeMemory(device_, buffer.memory_, nullptr);
+  }
+  operation_buffers_.clear();
+
+  if (descriptor_pool_ != VK_NULL_HANDLE) {
+    vkResetDescriptorPool(device_, descriptor_pool_, 0);
+  }
+}
+
+VulkanCompute::Buffer VulkanCompute::CreateBuffer(VkDeviceSize size) {
+  Buffer buffer;
+  buffer.size_ = std::max<VkDeviceSize>(size, sizeof(float));  // empty buffers are not allowed
+
+  VkBufferCreateInfo buffer_info{};
+  buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  buffer_info.size = buffer.size_;
+  buffer_info.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  if (vkCreateBuffer(device_, &buffer_info, nullptr, &buffer.buffer_) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create compute buffer");
+  }
+  operation_buffers_.push_back(buffer);
+
+  VkMemoryRequirements memory_requirements;
+  vkGetBufferMemoryRequirements(device_, buffer.buffer_, &memory_requirements);
+
+  VkMemoryAllocateInfo alloc_info{};
+  alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  alloc_info.allocationSize = memory_requirements.size;
+  alloc_info.memoryTypeIndex = FindMemoryType(memory_requirements.memoryTypeBits);
+  if (vkAllocateMemory(device_, &alloc_info, nullptr, &buffer.memory_) != VK_SUCCESS) {
+    throw std::runtime_error("failed to allocate compute buffer memory");
+  }
+  operation_buffers_.back().memory_ = buffer.memory_;
+
+  vkBindBufferMemory(device_, buffer.buffer_, buffer.memory_, 0);
+  if (vkMapMemory(device_, buffer.memory_, 0, VK_WHOLE_SIZE, 0, &buffer.mapped_) != VK_SUCCESS) {
+    throw std::runtime_error("failed to map compute buffer memory");
+  }
+  std::memset(buffer.mapped_, 0, buffer.size_);
+  return buffer;
+}
+
+template <typename T>
+VulkanCompute::Buffer VulkanCompute::Upload(const T *data, size_t count) {
+  Buffer buffer = CreateBuffer(count * sizeof(T));
+  if (count != 0) {
+    std::memcpy(buffer.mapped_, data, count * sizeof(T));
+  }
+  return buffer;
+}
+
+template <typename T>
+void VulkanCompute::Download(const Buffer &buffer, T *data, size_t count) {
+  std::memcpy(data, buffer.mapped_, count * sizeof(T));
+}
+
+VkDescriptorSet VulkanCompute::Bind(Kernel kernel, const std::vector<Buffer> &buffers) {
+  VkDescriptorSetAllocateInfo alloc_info{};
+  alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  alloc_info.descriptorPool = descriptor_pool_;
+  alloc_info.descriptorSetCount = 1;
+  alloc_info.pSetLayouts = &pipelines_[kernel].set_layout_;
+
+  VkDescriptorSet set;
+  if (vkAllocateDescriptorSets(device_, &alloc_info, &set) != VK_SUCCESS) {
+    throw std::runtime_error("failed to allocate compute descriptor set");
+  }
+
+  std::vector<VkDescriptorBufferInfo> buffer_infos(buffers.size());
+  std::vector<VkWriteDescriptorSet> writes(buffers.size());
+  for (size_t i = 0; i < buffers.size(); ++i) {
+    buffer_infos[i].buffer = buffers[i].buffer_;
+    buffer_infos[i].offset = 0;
+    buffer_infos[i].range = VK_WHOLE_SIZE;
+
+    writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[i].dstSet = set;
+    writes[i].dstBinding = static_cast<uint32_t>(i);
+    writes[i].descriptorCount = 1;
+    writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    writes[i].pBufferInfo = &buffer_infos[i];
+  }
+  vkUpdateDescriptorSets(device_, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+  return set;
+}
+
+template <typename Parameters>
+void VulkanCompute::Dispatch(VkCommandBuffer command_buffer, Kernel kernel, VkDescriptorSet set, const Parameters &parameters,
+                             uint32_t group_count) {
+  const Pipeline &pipeline = pipelines_[kernel];
+  vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.pipeline_);
+  vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.layout_, 0, 1, &set, 0, nullptr);
+  vkCmdPushConstants(command_buffer, pipeline.layout_, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(Parameters), &parameters);
+
+  // Larger grids wrap into y. Only element_stiffness.comp, one group per element, flattens the workgroup id again;
+  // the vector kernels read gl_GlobalInvocationID.x alone and rely on GroupCount refusing more than 65535 groups.
+  const uint32_t groups_x = std::min(group_count, kMaxGroupCount);
+  const uint32_t groups_y = (group_count + groups_x - 1) / std::max(groups_x, 1U);
+  vkCmdDispatch(command_buffer, groups_x, std::max(groups_y, 1U), 1);
+  Barrier(command_buffer);
+}
+
+void VulkanCompute::Barrier(VkCommandBuffer command_buffer) {
+  VkMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+  vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0,
+                       nullptr);
+}
+
+VkCommandBuffer VulkanCompute::Begin(uint32_t index, VkCommandBufferUsageFlags flags) {
+  VkCommandBuffer command_buffer = command_buffers_[index];
+  vkResetCommandBuffer(command_buffer, 0);
+
+  VkCommandBufferBeginInfo begin_info{};
+  begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  begin_info.flags = flags;
+  if (vkBeginCommandBuffer(command_buffer, &begin_info) != VK_SUCCESS) {
+    throw std::runtime_error("failed to begin compute command buffer");
+  }
+  return command_buffer;
+}
+
+void VulkanCompute::End(VkCommandBuffer command_buffer) {
+  // results are read through the mapped memory
+  VkMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+  vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+  if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
+    throw std::runtime_error("failed to record compute command buffer");
+  }
+}
+
+void VulkanCompute::Submit(VkCommandBuffer command_buffer) {
+  VkSubmitInfo submit_info{};
+  submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submit_info.commandBufferCount = 1;
+  submit_info.pCommandBuffers = &command_buffer;
+
+  if (vkQueueSubmit(queue_, 1, &submit_info, fence_) != VK_SUCCESS) {
+    throw std::runtime_error("failed to submit compute command buffer");
+  }
+  if (vkWaitForFences(device_, 1, &fence_, VK_TRUE, UINT64_MAX) != VK_SUCCESS) {
+    throw std::runtime_error("compute submission failed");
+  }
+  vkResetFences(device_, 1, &fence_);
+}
+
+void VulkanCompute::Multiply(const CsrMatrix &matrix, const VectorX &x, VectorX &y) {
+  if (!matrix.isCompressed() || matrix.cols() != x.size()) {
+    throw std::runtime_error("VulkanCompute::Multiply: expected a compressed matrix matching x");
+  }
+
+  BeginOperation();
+  const auto rows = static_cast<uint32_t>(matrix.rows());
+  const Buffer row_offsets = Upload(matrix.outerIndexPtr(), rows + 1);
+  const Buffer columns = Upload(matrix.innerIndexPtr(), matrix.nonZeros());
+  const Buffer values = Upload(matrix.valuePtr(), matrix.nonZeros());
+  const Buffer input = Upload(x.data(), x.size());
+  const Buffer output = CreateBuffer(rows * sizeof(Precision));
+
+  VkCommandBuffer command_buffer = Begin(0);
+  Dispatch(command_buffer, kMultiplyCsr, Bind(kMultiplyCsr, {row_offsets, columns, values, input, output}), SizeParameters{rows},
+           GroupCount(rows, kGroupSize));
+  End(command_buffer);
+  Submit(command_buffer);
+
+  y.resize(rows);
+  Download(output, y.data(), rows);
+}
+
+void VulkanCompute::MultiplyBlocks(uint32_t dim, const std::vector<uint32_t> &row_offsets, const std::vector<uint32_t> &columns,
+                                   const Precision *blocks, const VectorX &x, VectorX &y) {
+  const auto block_rows = static_cast<uint32_t>(row_offsets.size()) - 1;
+  if ((dim != 2 && dim != 3) || x.size() != dim * block_rows) {
+    throw std::runtime_error("VulkanCompute::MultiplyBlocks: dimension mismatch");
+  }
+
+  BeginOperation();
+  const Buffer offsets_buffer = Upload(row_offsets.data(), row_offsets.size());
+  const Buffer columns_buffer = Upload(columns.data(), columns.size());
+  const Buffer blocks_buffer = Upload(blocks, columns.size() * dim * dim);
+  const Buffer input = Upload(x.data(), x.size());
+  const Buffer output = CreateBuffer(x.size() * sizeof(Precision));
+
+  VkCommandBuffer command_buffer = Begin(0);
+  Dispatch(command_buffer, kMultiplyBsr, Bind(kMultiplyBsr, {offsets_buffer, columns_buffer, blocks_buffer, input, output}),
+           BlockParameters{block_rows, dim}, GroupCount(block_rows, kGroupSize));
+  End(command_buffer);
+  Submit(command_buffer);
+
+  y.resize(x.size());
+  Download(output, y.data(), x.size());
+}
+
+void VulkanCompute::RecordElementStiffness(VkCommandBuffer command_buffer, uint32_t dim, uint32_t node_count, uint32_t point_count,
+                                           const std::vector<Precision> &gradients, const std::vector<Precision> &scales,
+                                           const Precision *d_matrix, const Buffer &element_matrices) {
+  const uint32_t strain_size = dim == 2 ? 3 : 6;
+  const auto element_count = static_cast<uint32_t>(scales.size() / point_count);
+
+  const Buffer gradients_buffer = Upload(gradients.data(), gradients.size());
+  const Buffer scales_buffer = Upload(scales.data(), scales.size());
+  const Buffer d_buffer = Upload(d_matrix, strain_size * strain_size);
+
+  Dispatch(command_buffer, kElementStiffness, Bind(kElementStiffness, {gradients_buffer, scales_buffer, d_buffer, element_matrices}),
+           ElementParameters{element_count, node_count, point_count, dim}, element_count);
+}
+
+std::vector<Precision> VulkanCompute::ElementStiffness(uint32_t dim, uint32_t node_count, uint32_t point_count,
+                                                       const std::vector<Precision> &gradients, const std::vector<Precision> &scales,
+                                                       const Precision *d_matrix) {
+  if ((dim != 2 && dim != 3) || point_count == 0 || gradients.size() != scales.size() * dim * node_count) {
+    throw std::runtime_error("VulkanCompute::ElementStiffness: inconsistent gradients");
+  }
+
+  BeginOperation();
+  const size_t element_size = dim * node_count;
+  std::vector<Precision> result(scales.size() / point_count * element_size * element_size);
+  const Buffer element_matrices = CreateBuffer(result.size() * sizeof(Precision));
+
+  VkCommandBuffer command_buffer = Begin(0);
+  RecordElementStiffness(command_buffer, dim, node_count, point_count, gradients, scales, d_matrix, element_matrices);
+  End(command_buffer);
+  Submit(command_buffer);
+
+  Download(element_matrices, result.data(), result.size());
+  return result;
+}
+
+CsrMatrix VulkanCompute::AssembleStiffness(const AssemblyPlan &plan, uint32_t point_count, const std::vector<Precision> &gradients,
+                                           const std::vector<Precision> &scales, const Precision *d_matrix) {
+  if (point_count == 0 || scales.size() != static_cast<size_t>(plan.element_count_) * point_count) {
+    throw std::runtime_error("VulkanCompute::AssembleStiffness: gradients do not match the plan");
+  }
+
+  BeginOperation();
+  const uint32_t element_size = plan.GetElementSize();
+  const Buffer element_matrices = CreateBuffer(static_cast<VkDeviceSize>(plan.element_count_) * element_size * element_size * sizeof(Precision));
+  const Buffer source_offsets = Upload(plan.source_offsets_.data(), plan.source_offsets_.size());
+  const Buffer sources = Upload(plan.sources_.data(), plan.sources_.size());
+  const Buffer rows = Upload(plan.rows_.data(), plan.rows_.size());
+  const Buffer columns = Upload(plan.columns_.data(), plan.columns_.size());
+  const Buffer constrained = Upload(plan.constrained_.data(), plan.constrained_.size());
+  const Buffer values = CreateBuffer(plan.GetNonZeroCount() * sizeof(Precision));
+
+  VkCommandBuffer command_buffer = Begin(0);
+  RecordElementStiffness(command_buffer, plan.dim_, plan.node_count_, point_count, gradients, scales, d_matrix, element_matrices);
+  Dispatch(command_buffer, kAssemble, Bind(kAssemble, {source_offsets, sources, element_matrices, rows, columns, constrained, values}),
+           SizeParameters{plan.GetNonZeroCount()}, GroupCount(plan.GetNonZeroCount(), kGroupSize));
+  End(command_buffer);
+  Submit(command_buffer);
+
+  std::vector<Precision> result(plan.GetNonZeroCount());
+  Download(values, result.data(), result.size());
+
+  const std::vector<int> row_offsets(plan.row_offsets_.begin(), plan.row_offsets_.end());
+  const std::vector<int> column_indices(plan.columns_.begin(), plan.columns_.end());
+  return Eigen::Map<const CsrMatrix>(plan.GetRowCount(), plan.GetRowCount(), plan.GetNonZeroCount(), row_offsets.data(), column_indices.data(),
+                                     result.data());
+}
+
+IterativeResult VulkanCompute::ConjugateGradient(const CsrMatrix &matrix, const VectorX &b, VectorX &x, uint32_t max_iterations,
+                                                 Precision tolerance) {
+  if (!matrix.isCompressed() || matrix.rows() != b.size()) {
+    throw std::runtime_error("VulkanCompute::ConjugateGradient: expected a compressed matrix matching b");
+  }
+
+  IterativeResult result;
+  const Precision b_norm = b.norm();
+  x.setZero(b.size());
+  if (b_norm == 0) {
+    result.converged_ = true;
+    return result;
+  }
+
+  VectorX inverse_diagonal = matrix.diagonal();
+  for (Eigen::Index i = 0; i < inverse_diagonal.size(); ++i) {
+    inverse_diagonal[i] = inverse_diagonal[i] != 0 ? 1 / inverse_diagonal[i] : Precision(1.);
+  }
+
+  BeginOperation();
+  const auto size = static_cast<uint32_t>(b.size());
+  const Buffer row_offsets = Upload(matrix.outerIndexPtr(), size + 1);
+  const Buffer columns = Upload(matrix.innerIndexPtr(), matrix.nonZeros());
+  const Buffer values = Upload(matrix.valuePtr(), matrix.nonZeros());
+  const Buffer inverse_diagonal_buffer = Upload(inverse_diagonal.data(), size);
+
+  const VkDeviceSize vector_bytes = size * sizeof(Precision);
+  const Buffer solution = CreateBuffer(vector_bytes);
+  const Buffer residual = Upload(b.data(), size);  // r = b - A * 0
+  const Buffer direction = CreateBuffer(vector_bytes);
+  const Buffer product = CreateBuffer(vector_bytes);
+  const Buffer preconditioned = CreateBuffer(vector_bytes);
+  const Buffer partials = CreateBuffer(kDotGroups * sizeof(Precision));
+  const Buffer scalars = CreateBuffer(kScalarCount * sizeof(Precision));
+
+  const VkDescriptorSet multiply_set = Bind(kMultiplyCsr, {row_offsets, columns, values, direction, product});
+  const VkDescriptorSet pq_set = Bind(kDot, {direction, product, partials});
+  const VkDescriptorSet rz_set = Bind(kDot, {residual, preconditioned, partials});
+  const VkDescriptorSet rr_set = Bind(kDot, {residual, residual, partials});
+  const VkDescriptorSet reduce_set = Bind(kReduce, {partials, scalars});
+  const VkDescriptorSet update_set =
+      Bind(kConjugateGradientUpdate, {solution, residual, direction, product, preconditioned, inverse_diagonal_buffer, scalars});
+
+  const uint32_t vector_groups = GroupCount(size, kGroupSize);
+  const uint32_t dot_groups = std::min(kDotGroups, (size + kDotGroups - 1) / kDotGroups);
+  const auto dot = [&](VkCommandBuffer command_buffer, VkDescriptorSet set, uint32_t mode) {
+    Dispatch(command_buffer, kDot, set, SizeParameters{size}, dot_groups);
+    Dispatch(command_buffer, kReduce, reduce_set, ModeParameters{dot_groups, mode}, 1);
+  };
+
+  // z = M^-1 * r, p = z, rz = r . z
+  VkCommandBuffer start = Begin(0);
+  Dispatch(start, kConjugateGradientUpdate, update_set, ModeParameters{size, kStart}, vector_groups);
+  dot(start, rz_set, kStoreRz);
+  End(start);
+  Submit(start);
+
+  // a batch of iterations recorded once and resubmitted, the residual norm is the only value read back
+  VkCommandBuffer iterations = Begin(1, 0);
+  for (uint32_t i = 0; i < kIterationsPerSubmit; ++i) {
+    Dispatch(iterations, kMultiplyCsr, multiply_set, SizeParameters{size}, vector_groups);
+    dot(iterations, pq_set, kAlpha);
+    Dispatch(iterations, kConjugateGradientUpdate, update_set, ModeParameters{size, kUpdateSolution}, vector_groups);
+    dot(iterations, rz_set, kBeta);
+    Dispatch(iterations, kConjugateGradientUpdate, update_set, ModeParameters{size, kUpdateDirection}, vector_groups);
+  }
+  dot(iterations, rr_set, kStoreRr);
+  End(iterations);
+
+  while (result.iterations_ < max_iterations) {
+    Submit(iterations);
+    result.iterations_ += kIterationsPerSubmit;
+
+    Precision rr = 0.;
+    std::memcpy(&rr, static_cast<const Precision *>(scalars.mapped_) + kScalarRr, sizeof(Precision));
+    result.relative_residual_ = std::sqrt(std::max(rr, Precision(0.))) / b_norm;
+    if (!std::isfinite(result.relative_residual_)) {
+      break;
+    }
+    if (result.relative_residual_ <= tolerance) {
+      result.converged_ = true;
+      break;
+    }
+  }
+
+  Download(solution, x.data(), size);
+  return result;
+}
+
+}  // namespace vulkan_fem
@@ -0,0 +1,127 @@
+#pragma once
+
+#include "device_assembly.h"
+#include "device_solver.h"
+#include "fem.h"
+#include "pipeline_cache.h"
+#include <vulkan/vulkan_core.h>
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace vulkan_fem {
+
+// Compute shader backend for element stiffness, assembly, SpMV and CG. Needs Vulkan 1.1 and nothing beyond
+// core storage buffers, so it runs on any conforming device including lavapipe. Kernels are the embedded
+// SPIR-V of shaders/*.comp, built in parallel through a pipeline cache. All buffers are host visible, uploads and downloads are plain copies.
+class VulkanCompute final : public DeviceSolver {
+ public:
+  // own instance and device without a window, discrete GPUs are preferred
+  VulkanCompute();
+  // runs on a device created elsewhere, the queue must support compute and must not be used concurrently,
+  // pipelines are built through the given cache when there is one
+  VulkanCompute(VkPhysicalDevice physical_device, VkDevice device, VkQueue queue, uint32_t queue_family,
+                VkPipelineCache pipeline_cache = VK_NULL_HANDLE);
+  ~VulkanCompute() override;
+
+  VulkanCompute(const VulkanCompute &) = delete;
+  VulkanCompute &operator=(const VulkanCompute &) = delete;
+
+  [[nodiscard]] std::string GetName() const override;
+
+  void Multiply(const CsrMatrix &matrix, const VectorX &x, VectorX &y) override;
+
+  // iterations are reported in whole submissions of kIterationsPerSubmit
+  IterativeResult ConjugateGradient(const CsrMatrix &matrix, const VectorX &b, VectorX &x, uint32_t max_iterations,
+                                    Precision tolerance) override;
+
+  // y = A * x for block sparse rows with dim x dim column major blocks
+  void MultiplyBlocks(uint32_t dim, const std::vector<uint32_t> &row_offsets, const std::vector<uint32_t> &columns, const Precision *blocks,
+                      const VectorX &x, VectorX &y);
+
+  // row major K_e of every element from shape function gradients (dim x nodes column major per point) and w * det J
+  std::vector<Precision> ElementStiffness(uint32_t dim, uint32_t node_count, uint32_t point_count, const std::vector<Precision> &gradients,
+                                          const std::vector<Precision> &scales, const Precision *d_matrix);
+
+  // element stiffness and assembly into the CSR pattern of the plan in one submission, constraints applied
+  CsrMatrix AssembleStiffness(const AssemblyPlan &plan, uint32_t point_count, const std::vector<Precision> &gradients,
+                              const std::vector<Precision> &scales, const Precision *d_matrix);
+
+ private:
+  enum Kernel : uint32_t {
+    kElementStiffness,
+    kAssemble,
+    kMultiplyCsr,
+    kMultiplyBsr,
+    kDot,
+    kReduce,
+    kConjugateGradientUpdate,
+    kKernelCount,
+  };
+
+  struct Pipeline {
+    VkDescriptorSetLayout set_layout_ = VK_NULL_HANDLE;
+    VkPipelineLayout layout_ = VK_NULL_HANDLE;
+    VkPipeline pipeline_ = VK_NULL_HANDLE;
+  };
+
+  struct Buffer {
+    VkBuffer buffer_ = VK_NULL_HANDLE;
+    VkDeviceMemory memory_ = VK_NULL_HANDLE;
+    VkDeviceSize size_ = 0;
+    void *mapped_ = nullptr;
+  };
+
+  static constexpr uint32_t kIterationsPerSubmit = 16;
+
+  void CreateInstance();
+  void PickPhysicalDevice();
+  void CreateDevice();
+  void Init();
+  void CreatePipeline(Kernel kernel, const char *name, uint32_t binding_count, uint32_t push_constant_size);
+  void Release();
+
+  uint32_t FindMemoryType(uint32_t type_filter) const;
+
+  // buffers live until the next operation starts, descriptor sets likewise
+  void BeginOperation();
+  Buffer CreateBuffer(VkDeviceSize size);
+  template <typename T>
+  Buffer Upload(const T *data, size_t count);
+  template <typename T>
+  static void Download(const Buffer &buffer, T *data, size_t count);
+
+  VkDescriptorSet Bind(Kernel kernel, const std::vector<Buffer> &buffers);
+  template <typename Parameters>
+  void Dispatch(VkCommandBuffer command_buffer, Kernel kernel, VkDescriptorSet set, const Parameters &parameters, uint32_t group_count);
+  static void Barrier(VkCommandBuffer command_buffer);
+
+  VkCommandBuffer Begin(uint32_t index, VkCommandBufferUsageFlags flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+  static void End(VkCommandBuffer command_buffer);
+  void Submit(VkCommandBuffer command_buffer);
+
+  void RecordElementStiffness(VkCommandBuffer command_buffer, uint32_t dim, uint32_t node_count, uint32_t point_count,
+                              const std::vector<Precision> &gradients, const std::vector<Precision> &scales, const Precision *d_matrix,
+                              const Buffer &element_matrices);
+
+  bool owns_device_ = false;
+  VkInstance instance_ = VK_NULL_HANDLE;
+  VkPhysicalDevice physical_device_ = VK_NULL_HANDLE;
+  VkDevice device_ = VK_NULL_HANDLE;
+  VkQueue queue_ = VK_NULL_HANDLE;
+  uint32_t queue_family_ = 0;
+  VkPipelineCache pipeline_cache_ = VK_NULL_HANDLE;
+  std::unique_ptr<PipelineCache> owned_pipeline_cache_;  // with an own device
+
+  VkCommandPool command_pool_ = VK_NULL_HANDLE;
+  std::array<VkCommandBuffer, 2> command_buffers_{};
+  VkFence fence_ = VK_NULL_HANDLE;
+  VkDescriptorPool descriptor_pool_ = VK_NULL_HANDLE;
+  std::array<Pipeline, kKernelCount> pipelines_{};
+
+  std::vector<Buffer> operation_buffers_;
+};
+
+}  // namespace vulkan_fem
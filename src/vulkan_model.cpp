@@ -1,6 +1,152 @@
 #include "vulkan_model.h"
+#include <array>
+#include <numeric>
+#include <stdexcept>
+#include <string>
 
 namespace vulkan_fem {
+namespace {
 
+constexpr uint16_t kNoNode = std::numeric_limits<uint16_t>::max();
 
-}  // namespace vulkan_fem
\ No newline at end of file
+// corners of the faces, counter-clockwise seen from outside
+constexpr std::array<std::array<uint16_t, 4>, 4> kTetrahedronFaces{{{0, 1, 3, kNoNode}, {1, 2, 3, kNoNode}, {2, 0, 3, kNoNode}, {0, 2, 1, kNoNode}}};
+constexpr std::array<std::array<uint16_t, 4>, 6> kHexahedronFaces{
+    {{0, 4, 7, 3}, {1, 2, 6, 5}, {0, 1, 5, 4}, {3, 7, 6, 2}, {0, 3, 2, 1}, {4, 5, 6, 7}}};
+
+// quads become two triangles along the a-c diagonal
+void AddPolygon(const uint16_t *element, const std::array<uint16_t, 4> &corners, TriangleGroups &groups) {
+  const uint16_t a = element[corners[0]];
+  const uint16_t b = element[corners[1]];
+  const uint16_t c = element[corners[2]];
+  if (corners[3] == kNoNode) {
+    groups.indices_.insert(groups.indices_.end(), {a, b, c});
+  } else {
+    const uint16_t d = element[corners[3]];
+    groups.indices_.insert(groups.indices_.end(), {a, b, c, c, d, a});
+  }
+  groups.offsets_.push_back(static_cast<uint32_t>(groups.indices_.size()));
+}
+
+// 10 bits per axis, interleaved
+uint32_t MortonCode(uint32_t x, uint32_t y, uint32_t z) {
+  const auto spread = [](uint32_t v) {
+    v = (v | (v << 16)) & 0x030000FF;
+    v = (v | (v << 8)) & 0x0300F00F;
+    v = (v | (v << 4)) & 0x030C30C3;
+    v = (v | (v << 2)) & 0x09249249;
+    return v;
+  };
+  return spread(x) | (spread(y) << 1) | (spread(z) << 2);
+}
+
+}  // namespace
+
+void TriangulateElements(uint32_t node_count, const std::vector<uint16_t> &elements, TriangleGroups &groups) {
+  std::array<uint16_t, 4> corners{0, 1, 2, kNoNode};
+  switch (node_count) {
+    case 3:
+    case 6:
+      break;
+    case 4:
+    case 8:
+      corners[3] = 3;
+      break;
+    default:
+      throw std::runtime_error("cannot triangulate 2D elements with " + std::to_string(node_count) + " nodes");
+  }
+
+  for (size_t e = 0; e + node_count <= elements.size(); e += node_count) {
+    AddPolygon(&elements[e], corners, groups);
+  }
+}
+
+void ExtractBoundaryFaces(uint32_t node_count, const std::vector<uint16_t> &elements, TriangleGroups &groups) {
+  const std::array<uint16_t, 4> *faces = nullptr;
+  size_t face_count = 0;
+  switch (node_count) {
+    case 4:
+      faces = kTetrahedronFaces.data();
+      face_count = kTetrahedronFaces.size();
+      break;
+    case 8:
+    case 27:
+      faces = kHexahedronFaces.data();
+      face_count = kHexahedronFaces.size();
+      break;
+    default:
+      throw std::runtime_error("no boundary faces for 3D elements with " + std::to_string(node_count) + " nodes");
+  }
+
+  // a face shared by two elements has the same sorted corners in both
+  struct Face {
+    std::array<uint16_t, 4> key_;
+    uint32_t element_;
+    uint32_t face_;
+  };
+  std::vector<Face> keys;
+  keys.reserve(elements.size() / node_count * face_count);
+  for (uint32_t e = 0; e * node_count + node_count <= elements.size(); ++e) {
+    const uint16_t *element = &elements[size_t{e} * node_count];
+    for (uint32_t f = 0; f < face_count; ++f) {
+      Face face{{kNoNode, kNoNode, kNoNode, kNoNode}, e, f};
+      for (size_t k = 0; k < 4 && faces[f][k] != kNoNode; ++k) {
+        face.key_[k] = element[faces[f][k]];
+      }
+      std::sort(face.key_.begin(), face.key_.end());
+      keys.push_back(face);
+    }
+  }
+  std::sort(keys.begin(), keys.end(), [](const Face &a, const Face &b) { return a.key_ < b.key_; });
+
+  for (size_t i = 0; i < keys.size();) {
+    size_t j = i + 1;
+    while (j < keys.size() && keys[j].key_ == keys[i].key_) {
+      ++j;
+    }
+    if (j == i + 1) {
+      AddPolygon(&elements[size_t{keys[i].element_} * node_count], faces[keys[i].face_], groups);
+    }
+    i = j;
+  }
+}
+
+std::vector<uint16_t> SortSpatially(const std::vector<Vertex3> &positions, const TriangleGroups &groups) {
+  const size_t group_count = groups.offsets_.size() - 1;
+  if (group_count == 0) {
+    return {};
+  }
+
+  Vertex3 low = positions[groups.indices_[0]];
+  Vertex3 high = low;
+  for (const uint16_t index : groups.indices_) {
+    low = low.cwiseMin(positions[index]);
+    high = high.cwiseMax(positions[index]);
+  }
+  const Vertex3 extent = (high - low).cwiseMax(Vertex3::Constant(std::numeric_limits<Precision>::epsilon()));
+
+  std::vector<uint32_t> codes(group_count);
+  for (size_t g = 0; g < group_count; ++g) {
+    Vertex3 centroid = Vertex3::Zero();
+    for (uint32_t i = groups.offsets_[g]; i < groups.offsets_[g + 1]; ++i) {
+      centroid += positions[groups.indices_[i]];
+    }
+    centroid /= static_cast<Precision>(groups.offsets_[g + 1] - groups.offsets_[g]);
+
+    const Vertex3 cell = ((centroid - low).cwiseQuotient(extent) * Precision(1023)).cwiseMax(Precision(0)).cwiseMin(Precision(1023));
+    codes[g] = MortonCode(static_cast<uint32_t>(cell[0]), static_cast<uint32_t>(cell[1]), static_cast<uint32_t>(cell[2]));
+  }
+
+  std::vector<uint32_t> order(group_count);
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return codes[a] < codes[b]; });
+
+  std::vector<uint16_t> indices;
+  indices.reserve(groups.indices_.size());
+  for (const uint32_t g : order) {
+    indices.insert(indices.end(), groups.indices_.begin() + groups.offsets_[g], groups.indices_.begin() + groups.offsets_[g + 1]);
+  }
+  return indices;
+}
+
+}  // namespace vulkan_fem
@@ -2,80 +2,123 @@
 
 #include "model.h"
 #include "vulcan.h"
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
 
 namespace vulkan_fem {
 
+// triangle list in groups that are kept together when reordered, such as the two triangles of a quad
+struct TriangleGroups {
+  std::vector<uint16_t> indices_;
+  std::vector<uint32_t> offsets_{0};  // group i spans offsets_[i] to offsets_[i + 1]
+};
+
+// Every element of a 2D mesh, one group per element. Quads are split along the 2-0 diagonal, higher order
+// elements drawn through their corners.
+void TriangulateElements(uint32_t node_count, const std::vector<uint16_t> &elements, TriangleGroups &groups);
+
+// Faces of a 3D mesh that belong to a single element, counter-clockwise seen from outside, one group per face.
+// Tetrahedra and hexahedra of any order through their corners, the interior faces are never drawn.
+void ExtractBoundaryFaces(uint32_t node_count, const std::vector<uint16_t> &elements, TriangleGroups &groups);
+
+// the groups concatenated along a Morton curve through their centroids, so consecutive triangles lie close together
+std::vector<uint16_t> SortSpatially(const std::vector<Vertex3> &positions, const TriangleGroups &groups);
+
+// Render view of a model: a triangle list computed once per topology and vertices written straight from model storage.
+// The triangles are ordered spatially and cut into clusters of kClusterTriangles, which are culled as a whole.
 template <uint32_t DIM = 3>
 class VulkanModel {
+ public:
+  static constexpr uint32_t kClusterTriangles = 64;
+
  private:
+  static constexpr uint32_t kClusterIndices = 3 * kClusterTriangles;
+
   std::shared_ptr<Model<DIM>> model_;
+  uint64_t topology_ = 0;
+  std::vector<uint16_t> indices_;
 
  public:
-  explicit VulkanModel(std::shared_ptr<Model<DIM>> model) : model_(model) {}
-
-  [[nodiscard]] std::vector<Vertex> GetVertices() const { return ToVertices(model_->GetVertices()); }
-  [[nodiscard]] std::vector<uint16_t> GetIndices() const { return ToIndices(model_->GetIndices()); }
+  VulkanModel() = default;
+  explicit VulkanModel(std::shared_ptr<Model<DIM>> model) { SetModel(std::move(model)); }
 
- private:
-  static std::vector<Vertex> ToVertices(const std::vector<vulkan_fem::Vertex3> &data) {
-    std::vector<Vertex> result;
-    result.reserve(data.size());
-    
-    for (const auto & i : data) {
-      Vertex vertex{};
-      vertex.pos_ = {i[0], i[1]};
-      result.push_back(vertex);
+  // the triangulation is kept when the topology is the same, e.g. for the solved copy of a model
+  void SetModel(std::shared_ptr<Model<DIM>> model) {
+    model_ = std::move(model);
+    if (model_->GetTopology() != topology_) {
+      topology_ = model_->GetTopology();
+      Triangulate();
     }
+  }
+
+  [[nodiscard]] uint64_t GetTopology() const { return topology_; }
+  [[nodiscard]] size_t GetVertexCount() const { return model_->GetVertices().size(); }
+  [[nodiscard]] const std::vector<uint16_t> &GetIndices() const { return indices_; }
+  [[nodiscard]] size_t GetClusterCount() const { return (indices_.size() + kClusterIndices - 1) / kClusterIndices; }
 
-    return result;
+  // GetVertexCount vertices, model positions as reference, DIM displacements per vertex and a nodal scalar field,
+  // either may be empty. The destination is typically mapped staging memory.
+  void WriteVertices(Vertex *destination, const VectorX &displacements, const std::vector<Precision> &field) const {
+    const std::vector<Vertex3> &positions = model_->GetVertices();
+    const bool displaced = displacements.size() > 0;
+    for (size_t i = 0; i < positions.size(); ++i) {
+      Vertex &vertex = destination[i];
+      vertex.pos_ = {positions[i][0], positions[i][1]};
+      vertex.displacement_ = displaced ? glm::vec2(displacements[static_cast<Eigen::Index>(DIM * i)],
+                                                   displacements[static_cast<Eigen::Index>(DIM * i + 1)])
+                                       : glm::vec2(0.F, 0.F);
+      vertex.value_ = field.empty() ? 0.F : field[i];
+    }
   }
 
-  [[nodiscard]] std::vector<uint16_t> ToIndices(const std::vector<uint16_t> &data) const {
-    switch (model_->GetElementType()->GetElementCount()) {
-      case 4: {
-        std::vector<uint16_t> result;
-        result.reserve(data.size() / 4 * 6);
-
-        for (int i = 0; i < data.size(); ++i) {
-          if (i % 4 == 3) {
-            result.push_back(data[i - 1]);
-            result.push_back(data[i]);
-            result.push_back(data[i - 3]);
-          } else {
-            result.push_back(data[i]);
-          }
-        }
-        return result;
-      }
-      case 6: {
-        std::vector<uint16_t> result;
-        result.reserve(data.size() / 2);
-
-        for (int i = 0; i < data.size(); ++i) {
-          if (i % 6 < 3) {
-            result.push_back(data[i]);
-          }
-        }
-        return result;
-      }
-      case 8: {
-        std::vector<uint16_t> result;
-        result.reserve(data.size() / 8 * 6);
-
-        for (int i = 0; i < data.size(); ++i) {
-          if (i % 8 == 3) {
-            result.push_back(data[i - 1]);
-            result.push_back(data[i]);
-            result.push_back(data[i - 3]);
-          } else if (i < 4) {
-            result.push_back(data[i]);
-          }
+  // GetClusterCount clusters with the bounds of the same vertices, refreshed whenever these are written
+  void WriteClusters(DrawCluster *destination, const VectorX &displacements) const {
+    constexpr float kMax = std::numeric_limits<float>::max();
+    const std::vector<Vertex3> &positions = model_->GetVertices();
+    const bool displaced = displacements.size() > 0;
+
+    for (size_t c = 0; c < GetClusterCount(); ++c) {
+      const size_t first = c * kClusterIndices;
+      const size_t last = std::min(first + kClusterIndices, indices_.size());
+
+      // x and y of the positions, then of the displacements
+      float low[4] = {kMax, kMax, kMax, kMax};
+      float high[4] = {-kMax, -kMax, -kMax, -kMax};
+      for (size_t i = first; i < last; ++i) {
+        const uint16_t node = indices_[i];
+        const float values[4] = {
+            positions[node][0], positions[node][1],
+            displaced ? static_cast<float>(displacements[static_cast<Eigen::Index>(DIM * node)]) : 0.F,
+            displaced ? static_cast<float>(displacements[static_cast<Eigen::Index>(DIM * node + 1)]) : 0.F};
+        for (int k = 0; k < 4; ++k) {
+          low[k] = std::min(low[k], values[k]);
+          high[k] = std::max(high[k], values[k]);
         }
-        return result;
       }
+
+      DrawCluster &cluster = destination[c];
+      cluster.min_position_ = {low[0], low[1]};
+      cluster.max_position_ = {high[0], high[1]};
+      cluster.min_displacement_ = {low[2], low[3]};
+      cluster.max_displacement_ = {high[2], high[3]};
+      cluster.first_index_ = static_cast<uint32_t>(first);
+      cluster.index_count_ = static_cast<uint32_t>(last - first);
+    }
+  }
+
+ private:
+  void Triangulate() {
+    TriangleGroups groups;
+    const uint32_t node_count = model_->GetElementType()->GetElementCount();
+    if constexpr (DIM == 3) {
+      ExtractBoundaryFaces(node_count, model_->GetIndices(), groups);
+    } else {
+      TriangulateElements(node_count, model_->GetIndices(), groups);
     }
-    return data;
+    indices_ = SortSpatially(model_->GetVertices(), groups);
   }
 };
 
-}  // namespace vulkan_fem
\ No newline at end of file
+}  // namespace vulkan_fem
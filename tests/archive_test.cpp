@@ -0,0 +1,67 @@
+#include "archive.h"
+#include "check.h"
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+namespace vulkan_fem {
+namespace {
+
+// offset of the stored size of the first block of an archive whose first block is named "u"
+constexpr std::streamoff kStoredSizeOffset = 8 + 4 + 4 + 4 + 1 + 1 + 4 + 8;
+
+std::string GetPath() { return (std::filesystem::temp_directory_path() / "vulkan_fem_archive_test.bin").string(); }
+
+void WriteArchive(const std::string &path, Compression compression) {
+  Archive archive;
+  archive.PutVector("u", VectorX::LinSpaced(1000, 0, 1));
+  archive.PutValue("v", uint32_t{7});
+  archive.Write(path, compression);
+}
+
+void CheckRoundTrip(Compression compression, const std::string &name) {
+  const std::string path = GetPath();
+  WriteArchive(path, compression);
+  const Archive archive = Archive::Read(path);
+  Check(archive.GetVector("u") == VectorX::LinSpaced(1000, 0, 1), name + " archive does not read back its vector");
+  Check(archive.GetValue<uint32_t>("v") == 7, name + " archive does not read back its value");
+  std::remove(path.c_str());
+}
+
+// a corrupt size has to be rejected with an error before it is allocated
+void CheckCorruptSize(uint64_t stored_size, const std::string &name) {
+  const std::string path = GetPath();
+  WriteArchive(path, Compression::kNone);
+  {
+    std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+    file.seekp(kStoredSizeOffset);
+    file.write(reinterpret_cast<const char *>(&stored_size), sizeof(stored_size));
+  }
+
+  std::string error;
+  try {
+    static_cast<void>(Archive::Read(path));
+  } catch (const std::runtime_error &e) {
+    error = e.what();
+  }
+  Check(error.find("corrupt archive block u") == 0, name + " was not rejected as corrupt: " + error);
+  std::remove(path.c_str());
+}
+
+}  // namespace
+}  // namespace vulkan_fem
+
+int main() {
+  vulkan_fem::CheckRoundTrip(vulkan_fem::Compression::kNone, "uncompressed");
+  if (vulkan_fem::IsCompressionAvailable(vulkan_fem::Compression::kLz4)) {
+    vulkan_fem::CheckRoundTrip(vulkan_fem::Compression::kLz4, "LZ4");
+  }
+  if (vulkan_fem::IsCompressionAvailable(vulkan_fem::Compression::kZstd)) {
+    vulkan_fem::CheckRoundTrip(vulkan_fem::Compression::kZstd, "zstd");
+  }
+  vulkan_fem::CheckCorruptSize(uint64_t{1} << 60, "stored size beyond the file");
+  vulkan_fem::CheckCorruptSize(3, "stored size off the raw size");
+  return EXIT_SUCCESS;
+}
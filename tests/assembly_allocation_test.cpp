@@ -0,0 +1,78 @@
+#include "check.h"
+#include "model.h"
+#include "model_factory.h"
+#include <Eigen/Core>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+// every global operator new counts, Eigen's own heap use goes through malloc and is caught by
+// EIGEN_RUNTIME_NO_MALLOC, which the test build defines for all sources
+namespace {
+std::atomic<size_t> allocations{0};
+
+void *Allocate(size_t size) {
+  ++allocations;
+  if (void *pointer = std::malloc(size == 0 ? 1 : size)) {
+    return pointer;
+  }
+  throw std::bad_alloc();
+}
+
+void *AllocateAligned(size_t size, std::align_val_t alignment) {
+  ++allocations;
+  const auto align = static_cast<size_t>(alignment);
+  if (void *pointer = std::aligned_alloc(align, (size + align - 1) / align * align)) {
+    return pointer;
+  }
+  throw std::bad_alloc();
+}
+}  // namespace
+
+void *operator new(size_t size) { return Allocate(size); }
+void *operator new[](size_t size) { return Allocate(size); }
+void *operator new(size_t size, std::align_val_t alignment) { return AllocateAligned(size, alignment); }
+void *operator new[](size_t size, std::align_val_t alignment) { return AllocateAligned(size, alignment); }
+void operator delete(void *pointer) noexcept { std::free(pointer); }
+void operator delete[](void *pointer) noexcept { std::free(pointer); }
+void operator delete(void *pointer, size_t /*size*/) noexcept { std::free(pointer); }
+void operator delete[](void *pointer, size_t /*size*/) noexcept { std::free(pointer); }
+void operator delete(void *pointer, std::align_val_t /*alignment*/) noexcept { std::free(pointer); }
+void operator delete[](void *pointer, std::align_val_t /*alignment*/) noexcept { std::free(pointer); }
+void operator delete(void *pointer, size_t /*size*/, std::align_val_t /*alignment*/) noexcept { std::free(pointer); }
+void operator delete[](void *pointer, size_t /*size*/, std::align_val_t /*alignment*/) noexcept { std::free(pointer); }
+
+namespace vulkan_fem {
+namespace {
+
+// the element loops of the assembly, after a first pass that caches the gradients, must not touch the heap
+template <uint32_t DIM>
+void CheckAssemblyLoops(Model<DIM> &model, const std::string &name) {
+  Precision sum = 0;
+  const auto add_stiffness = [&sum](uint32_t /*index*/, const auto &element_stiffness_matrix) { sum += element_stiffness_matrix(0, 0); };
+  const auto add_mass = [&sum](uint32_t /*index*/, const auto &element_mass_matrix) { sum += element_mass_matrix(0, 0); };
+
+  model.ForEachElementStiffness(false, add_stiffness);
+  model.ForEachElementMass(add_mass);
+
+  const size_t before = allocations;
+  Eigen::internal::set_is_malloc_allowed(false);
+  model.ForEachElementStiffness(false, add_stiffness);
+  model.ForEachElementStiffness(true, add_stiffness);
+  model.ForEachElementMass(add_mass);
+  Eigen::internal::set_is_malloc_allowed(true);
+  const size_t count = allocations - before;
+
+  Check(sum > 0, name + " has no element matrices");
+  Check(count == 0, name + " element loops allocated " + std::to_string(count) + " times");
+}
+
+}  // namespace
+}  // namespace vulkan_fem
+
+int main() {
+  vulkan_fem::CheckAssemblyLoops(*vulkan_fem::ModelFactory::CreateBlock(4, 2, 2), "block");
+  vulkan_fem::CheckAssemblyLoops(*vulkan_fem::ModelFactory::CreateRectangle2(), "quadratic rectangle");
+  return EXIT_SUCCESS;
+}
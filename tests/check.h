@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+namespace vulkan_fem {
+
+// ends the test with a non-zero exit code when condition does not hold
+inline void Check(bool condition, const std::string &message) {
+  if (!condition) {
+    std::cerr << "FAILED: " << message << std::endl;
+    std::exit(EXIT_FAILURE);
+  }
+}
+
+}  // namespace vulkan_fem
@@ -0,0 +1,109 @@
+#include "check.h"
+#include "explicit_dynamics.h"
+#include "modal.h"
+#include "model_factory.h"
+#include "solver.h"
+#include <cmath>
+#include <string>
+#include <vector>
+
+namespace vulkan_fem {
+namespace {
+
+constexpr double kTolerance = 1e-3;
+
+// lowest natural circular frequency of the block with lumped mass
+Precision GetLowestOmega(Model<3> &model) {
+  ModalOptions options;
+  options.mode_count_ = 1;
+  options.mass_type_ = MassType::kLumped;
+  Solver<3> solver;
+  return std::sqrt(ModalAnalysis<3>(options).Solve(model, solver).eigenvalues_[0]);
+}
+
+// critically damping the lowest mode, the step load settles to the static solution
+void CheckSettlesToStatic() {
+  const auto static_model = ModelFactory::CreateBlock(4, 2, 2);
+  Solver<3> solver;
+  solver.Solve(*static_model);
+  const VectorX &expected = solver.GetDisplacements();
+
+  const auto model = ModelFactory::CreateBlock(4, 2, 2);
+  const Precision omega = GetLowestOmega(*model);
+  ExplicitOptions options;
+  options.damping_ = 2 * omega;
+  options.end_time_ = 25 / omega;
+  options.thread_count_ = 3;
+  ExplicitDynamics<3> dynamics(*model, options);
+  dynamics.Run();
+
+  const double difference = (dynamics.GetDisplacements() - expected).norm() / expected.norm();
+  Check(difference <= kTolerance, "damped run is off the static solution by " + std::to_string(difference));
+}
+
+// the Gershgorin step is below the critical one, a few times it has to blow up
+void CheckStableTimeStep() {
+  const auto model = ModelFactory::CreateBlock(4, 2, 2);
+  const ExplicitDynamics<3> probe(*model);
+  const Precision stable_time_step = probe.GetStableTimeStep();
+  Check(stable_time_step > 0, "stable time step " + std::to_string(stable_time_step) + " is not positive");
+  Check(probe.GetTimeStep() < stable_time_step, "default time step is not below the stable one");
+
+  const auto run = [&](Precision time_step) {
+    ExplicitOptions options;
+    options.time_step_ = time_step;
+    options.end_time_ = 500 * time_step;
+    ExplicitDynamics<3> dynamics(*model, options);
+    dynamics.Run();
+    return dynamics.GetDisplacements().norm();
+  };
+
+  // an undamped step response stays within twice the static displacement
+  const auto static_model = ModelFactory::CreateBlock(4, 2, 2);
+  Solver<3> solver;
+  solver.Solve(*static_model);
+  const Precision bound = 2 * solver.GetDisplacements().norm() * (1 + Precision(kTolerance));
+
+  const Precision stable = run(stable_time_step);
+  const Precision unstable = run(3 * stable_time_step);
+  Check(std::isfinite(stable) && stable <= bound, "run at the stable time step grows to " + std::to_string(stable));
+  Check(!std::isfinite(unstable) || unstable > 1e6F * bound, "run at three times the stable time step does not diverge");
+}
+
+// frames every interval steps and one of the final state
+void CheckStream() {
+  constexpr uint32_t kInterval = 10;
+  constexpr uint32_t kSteps = 95;
+
+  const auto model = ModelFactory::CreateBlock(4, 2, 2);
+  ExplicitOptions options;
+  options.time_step_ = ExplicitDynamics<3>(*model).GetTimeStep();
+  options.end_time_ = kSteps * options.time_step_;
+  options.output_interval_ = kInterval;
+  options.max_pending_frames_ = kSteps;
+  ExplicitDynamics<3> dynamics(*model, options);
+
+  // only the stream thread writes, Run joins it before returning
+  std::vector<uint32_t> steps;
+  dynamics.SetOutputCallback([&steps](const ExplicitFrame &frame) { steps.push_back(frame.step_); });
+  const ExplicitResult result = dynamics.Run();
+
+  std::vector<uint32_t> expected;
+  for (uint32_t step = kInterval; step < result.steps_; step += kInterval) {
+    expected.push_back(step);
+  }
+  expected.push_back(result.steps_);
+  Check(result.steps_ >= kSteps, "run stopped after " + std::to_string(result.steps_) + " steps");
+  Check(result.dropped_frames_ == 0 && result.frames_ == expected.size(), std::to_string(result.frames_) + " frames streamed");
+  Check(steps == expected, "frames are not streamed every " + std::to_string(kInterval) + " steps");
+}
+
+}  // namespace
+}  // namespace vulkan_fem
+
+int main() {
+  vulkan_fem::CheckSettlesToStatic();
+  vulkan_fem::CheckStableTimeStep();
+  vulkan_fem::CheckStream();
+  return EXIT_SUCCESS;
+}
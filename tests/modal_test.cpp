@@ -0,0 +1,83 @@
+#include "check.h"
+#include "modal.h"
+#include "model_factory.h"
+#include "solver.h"
+#include <Eigen/Dense>
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+namespace vulkan_fem {
+namespace {
+
+constexpr uint32_t kModeCount = 4;
+constexpr double kTolerance = 1e-3;
+
+// eigenvalues of K * phi = lambda * M * phi on the free dofs, ascending
+Eigen::VectorXd GetDenseEigenvalues(Model<3> &model, MassType mass_type) {
+  const Eigen::MatrixXd stiffness = Eigen::MatrixXf(model.BuildGlobalStiffnessMatrix(StiffnessStorage::kFull)).cast<double>();
+  const Eigen::MatrixXd mass = Eigen::MatrixXf(model.BuildGlobalMassMatrix(StiffnessStorage::kFull, mass_type)).cast<double>();
+
+  const std::vector<int> constrained = model.GetConstrainedDofs();
+  std::vector<Eigen::Index> free;
+  for (Eigen::Index dof = 0; dof < stiffness.rows(); ++dof) {
+    if (std::find(constrained.begin(), constrained.end(), dof) == constrained.end()) {
+      free.push_back(dof);
+    }
+  }
+
+  const auto count = static_cast<Eigen::Index>(free.size());
+  Eigen::MatrixXd free_stiffness(count, count);
+  Eigen::MatrixXd free_mass(count, count);
+  for (Eigen::Index i = 0; i < count; ++i) {
+    for (Eigen::Index j = 0; j < count; ++j) {
+      free_stiffness(i, j) = stiffness(free[i], free[j]);
+      free_mass(i, j) = mass(free[i], free[j]);
+    }
+  }
+  return Eigen::GeneralizedSelfAdjointEigenSolver<Eigen::MatrixXd>(free_stiffness, free_mass, Eigen::EigenvaluesOnly).eigenvalues();
+}
+
+// the kModeCount reference eigenvalues closest to the shift, ascending
+std::vector<double> GetClosest(const Eigen::VectorXd &eigenvalues, double shift) {
+  std::vector<double> closest(eigenvalues.data(), eigenvalues.data() + eigenvalues.size());
+  std::sort(closest.begin(), closest.end(), [shift](double a, double b) { return std::abs(a - shift) < std::abs(b - shift); });
+  closest.resize(kModeCount);
+  std::sort(closest.begin(), closest.end());
+  return closest;
+}
+
+void CheckModes(MassType mass_type, bool shifted, const std::string &name) {
+  const auto model = ModelFactory::CreateBlock(4, 2, 2);
+  const Eigen::VectorXd reference = GetDenseEigenvalues(*model, mass_type);
+
+  // a shift between the second and third eigenvalue has modes on both sides of it
+  ModalOptions options;
+  options.mode_count_ = kModeCount;
+  options.mass_type_ = mass_type;
+  options.shift_ = shifted ? static_cast<Precision>((reference[1] + reference[2]) / 2) : Precision(0);
+
+  Solver<3> solver;
+  const ModalResult result = ModalAnalysis<3>(options).Solve(*model, solver);
+  const std::vector<double> expected = GetClosest(reference, options.shift_);
+
+  Check(result.converged_, name + " did not converge");
+  Check(result.eigenvalues_.size() == kModeCount, name + " found " + std::to_string(result.eigenvalues_.size()) + " modes");
+  for (uint32_t k = 0; k < kModeCount; ++k) {
+    const double error = std::abs(result.eigenvalues_[k] - expected[k]) / expected[k];
+    Check(error <= kTolerance, name + " eigenvalue " + std::to_string(result.eigenvalues_[k]) + " instead of " + std::to_string(expected[k]));
+  }
+}
+
+}  // namespace
+}  // namespace vulkan_fem
+
+int main() {
+  using vulkan_fem::MassType;
+  vulkan_fem::CheckModes(MassType::kConsistent, false, "consistent mass");
+  vulkan_fem::CheckModes(MassType::kConsistent, true, "consistent mass, shifted");
+  vulkan_fem::CheckModes(MassType::kLumped, false, "lumped mass");
+  vulkan_fem::CheckModes(MassType::kLumped, true, "lumped mass, shifted");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,50 @@
+#include "check.h"
+#include "model_factory.h"
+#include "newton.h"
+#include "solver.h"
+#include <string>
+
+namespace vulkan_fem {
+namespace {
+
+// small enough for the response to stay linear, large enough for the residual to be well above float rounding
+constexpr Precision kLoad = -0.05;
+constexpr double kTolerance = 1e-3;
+
+// at small strains both materials reduce to the linear one, Newton has to converge to it
+void CheckSmallStrain(HyperelasticModel material, const std::string &name) {
+  const auto linear_model = ModelFactory::CreateBlock(8, 4, 4, kLoad);
+  Solver<3> solver;
+  solver.Solve(*linear_model);
+  const VectorX &linear = solver.GetDisplacements();
+
+  const auto model = ModelFactory::CreateBlock(8, 4, 4, kLoad);
+  NewtonOptions options;
+  options.material_ = material;
+  const NewtonResult result = NewtonSolver<3>(options).Solve(*model);
+
+  Check(result.converged_, name + " did not converge, relative residual " + std::to_string(result.relative_residual_));
+  Check(result.relative_residual_ <= options.tolerance_, name + " stopped at relative residual " + std::to_string(result.relative_residual_));
+  const double difference = (result.displacements_ - linear).norm() / linear.norm();
+  Check(difference <= kTolerance, name + " is off the linear solution by " + std::to_string(difference));
+}
+
+// a full step under a huge load inverts elements, the run has to end as not converged instead of throwing
+void CheckInvertedElement() {
+  const auto model = ModelFactory::CreateBlock(8, 4, 4, -1e5);
+  NewtonOptions options;
+  options.load_steps_ = 1;
+  options.line_search_ = false;
+  const NewtonResult result = NewtonSolver<3>(options).Solve(*model);
+  Check(!result.converged_, "Newton converged through an inverted element");
+}
+
+}  // namespace
+}  // namespace vulkan_fem
+
+int main() {
+  vulkan_fem::CheckSmallStrain(vulkan_fem::HyperelasticModel::kSaintVenantKirchhoff, "Saint Venant-Kirchhoff");
+  vulkan_fem::CheckSmallStrain(vulkan_fem::HyperelasticModel::kNeoHookean, "neo-Hookean");
+  vulkan_fem::CheckInvertedElement();
+  return EXIT_SUCCESS;
+}
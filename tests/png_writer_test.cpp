@@ -0,0 +1,103 @@
+#include "check.h"
+#include "png_writer.h"
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace vulkan_fem {
+namespace {
+
+constexpr uint32_t kWidth = 5;
+constexpr uint32_t kHeight = 3;
+
+uint32_t ReadBigEndian(const std::vector<uint8_t> &bytes, size_t offset) {
+  return static_cast<uint32_t>(bytes[offset]) << 24U | static_cast<uint32_t>(bytes[offset + 1]) << 16U |
+         static_cast<uint32_t>(bytes[offset + 2]) << 8U | bytes[offset + 3];
+}
+
+// bitwise CRC-32, independent of the table in the writer
+uint32_t Crc(const uint8_t *data, size_t size) {
+  uint32_t crc = 0xFFFFFFFFU;
+  for (size_t i = 0; i < size; ++i) {
+    crc ^= data[i];
+    for (int k = 0; k < 8; ++k) {
+      crc = (crc & 1U) != 0U ? 0xEDB88320U ^ (crc >> 1U) : crc >> 1U;
+    }
+  }
+  return crc ^ 0xFFFFFFFFU;
+}
+
+struct Chunk {
+  std::string type_;
+  std::vector<uint8_t> data_;
+};
+
+void CheckPng() {
+  std::vector<uint8_t> rgba(4 * kWidth * kHeight);
+  for (size_t i = 0; i < rgba.size(); ++i) {
+    rgba[i] = static_cast<uint8_t>(i * 37 + 11);
+  }
+
+  const std::string path = (std::filesystem::temp_directory_path() / "vulkan_fem_png_writer_test.png").string();
+  WritePng(path, kWidth, kHeight, rgba);
+  std::ifstream file(path, std::ios::binary);
+  const std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  file.close();
+  std::remove(path.c_str());
+
+  const std::vector<uint8_t> signature = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+  Check(bytes.size() > signature.size() && std::equal(signature.begin(), signature.end(), bytes.begin()), "PNG signature is wrong");
+
+  // length, type, data, CRC over type and data
+  std::vector<Chunk> chunks;
+  size_t offset = signature.size();
+  while (offset + 12 <= bytes.size()) {
+    const uint32_t length = ReadBigEndian(bytes, offset);
+    Check(offset + 12 + length <= bytes.size(), "chunk runs past the end of the file");
+    const uint8_t *type = bytes.data() + offset + 4;
+    Check(ReadBigEndian(bytes, offset + 8 + length) == Crc(type, length + 4), "CRC of chunk " + std::string(type, type + 4) + " is wrong");
+    chunks.push_back({std::string(type, type + 4), std::vector<uint8_t>(type + 4, type + 4 + length)});
+    offset += 12 + length;
+  }
+  Check(offset == bytes.size(), "trailing bytes after the last chunk");
+  Check(chunks.size() == 3 && chunks[0].type_ == "IHDR" && chunks[1].type_ == "IDAT" && chunks[2].type_ == "IEND",
+        "chunks are not IHDR, IDAT, IEND");
+
+  // width, height, 8 bit RGBA, deflate, no filter, no interlace
+  const std::vector<uint8_t> &header = chunks[0].data_;
+  Check(header.size() == 13 && ReadBigEndian(header, 0) == kWidth && ReadBigEndian(header, 4) == kHeight, "IHDR size is wrong");
+  Check(header[8] == 8 && header[9] == 6 && header[10] == 0 && header[11] == 0 && header[12] == 0, "IHDR format is wrong");
+
+  // zlib header, one final stored block of the filtered rows, Adler-32
+  const std::vector<uint8_t> &stream = chunks[1].data_;
+  Check(stream.size() > 11 && ((stream[0] << 8U) | stream[1]) % 31 == 0 && (stream[0] & 0x0FU) == 8, "IDAT is not a zlib stream");
+  const size_t length = stream[3] | static_cast<size_t>(stream[4]) << 8U;
+  Check(stream[2] == 1 && (length ^ 0xFFFFU) == (stream[5] | static_cast<size_t>(stream[6]) << 8U), "IDAT block header is wrong");
+  Check(length == (4 * kWidth + 1) * kHeight && stream.size() == 7 + length + 4, "IDAT block length is wrong");
+
+  uint32_t a = 1;
+  uint32_t b = 0;
+  for (size_t i = 0; i < length; ++i) {
+    a = (a + stream[7 + i]) % 65521U;
+    b = (b + a) % 65521U;
+  }
+  Check(ReadBigEndian(stream, 7 + length) == ((b << 16U) | a), "Adler-32 of IDAT is wrong");
+
+  for (uint32_t y = 0; y < kHeight; ++y) {
+    const uint8_t *row = stream.data() + 7 + y * (4 * kWidth + 1);
+    Check(row[0] == 0, "row filter is not none");
+    Check(std::equal(row + 1, row + 1 + 4 * kWidth, rgba.begin() + 4 * kWidth * y), "pixels of row " + std::to_string(y) + " differ");
+  }
+}
+
+}  // namespace
+}  // namespace vulkan_fem
+
+int main() {
+  vulkan_fem::CheckPng();
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,129 @@
+#include "check.h"
+#include "model.h"
+#include "model_factory.h"
+#include "solver.h"
+#include "sum_factorization.h"
+#include <Eigen/Dense>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace vulkan_fem {
+namespace {
+
+constexpr Precision kTolerance = 1e-5;
+
+// HexStiffnessKernel::Apply against the assembled K_e * u on one distorted element of the order
+template <typename ELEMENT, uint32_t ORDER>
+void CheckAgainstElementMatrix() {
+  using Kernel = HexStiffnessKernel<ORDER>;
+  const auto &lattice = ELEMENT::GetNodeLattice();
+
+  // a sheared, unevenly stretched element, smooth so that its jacobian stays positive
+  std::vector<Vertex3> vertices;
+  typename Kernel::ElementCoords coords;
+  for (uint32_t a = 0; a < Kernel::kNodeCount; ++a) {
+    const Vertex3 r = Vertex3(lattice[a][0], lattice[a][1], lattice[a][2]) / static_cast<Precision>(ORDER);
+    const Vertex3 x(2 * r[0] + Precision(0.3) * r[1], r[1] + Precision(0.1) * r[0] * r[2], Precision(0.5) * r[2] + Precision(0.2) * r[0] * r[0]);
+    vertices.push_back(x);
+    coords.col(a) = x;
+  }
+  std::vector<uint16_t> indices(Kernel::kNodeCount);
+  for (uint32_t a = 0; a < Kernel::kNodeCount; ++a) {
+    indices[a] = static_cast<uint16_t>(a);
+  }
+
+  const Model<3> model(std::make_shared<ELEMENT>(), vertices, indices, {}, {}, 0.2e4, 0.3);
+  LinearMaterial<3> material = model.GetMaterial();
+  const MatrixConstitutive<3> d_matrix = material.GetStiffnessMatrix();
+  MatrixElementStiffness<3> element_stiffness_matrix;
+  model.CalcElementStiffness(0, d_matrix, element_stiffness_matrix);
+
+  typename Kernel::ElementVector u;
+  for (Eigen::Index i = 0; i < u.size(); ++i) {
+    u[i] = std::sin(Precision(0.7) * static_cast<Precision>(i) + 1);
+  }
+
+  typename Kernel::ElementVector y;
+  Kernel().Apply(coords, d_matrix, u, y);
+  const VectorX expected = element_stiffness_matrix * u;
+
+  const Precision error = (y - expected).norm() / expected.norm();
+  Check(error <= kTolerance, "order " + std::to_string(ORDER) + " kernel is off K_e * u by " + std::to_string(error));
+}
+
+// cantilever of nx triquadratic elements in a row, clamped at x = 0 and loaded at the far top corner
+std::shared_ptr<Model<3>> CreateQuadraticBeam(uint32_t nx) {
+  const uint32_t columns = 2 * nx + 1;
+  const auto node = [columns](uint32_t i, uint32_t j, uint32_t k) { return static_cast<uint16_t>(i + columns * (j + 3 * k)); };
+
+  std::vector<Vertex3> vertices;
+  for (uint32_t k = 0; k < 3; ++k) {
+    for (uint32_t j = 0; j < 3; ++j) {
+      for (uint32_t i = 0; i < columns; ++i) {
+        vertices.emplace_back(Precision(0.5) * static_cast<Precision>(i), Precision(0.25) * static_cast<Precision>(j),
+                              Precision(0.25) * static_cast<Precision>(k));
+      }
+    }
+  }
+
+  std::vector<uint16_t> indices;
+  for (uint32_t element = 0; element < nx; ++element) {
+    for (const auto &[di, dj, dk] : Hexahedron2Element::GetNodeLattice()) {
+      indices.push_back(node(2 * element + di, dj, dk));
+    }
+  }
+
+  std::vector<Constraint> constraints;
+  for (uint32_t k = 0; k < 3; ++k) {
+    for (uint32_t j = 0; j < 3; ++j) {
+      constraints.push_back({node(0, j, k), Constraint::kUxyz});
+    }
+  }
+  const std::vector<Load<3>> loads = {{node(columns - 1, 2, 2), {0.0, 0.0, -50.0}}};
+  return std::make_shared<Model<3>>(std::make_shared<Hexahedron2Element>(), vertices, indices, constraints, loads, 0.2e4, 0.3);
+}
+
+// HexStiffnessOperator against the assembled, constrained K, and the matrix-free CG solve against a dense double
+// precision solve of it. K of the quadratic beam has a condition number near 1e5, float CG gets within about 1e-4.
+template <uint32_t ORDER>
+void CheckMatrixFreeSolve(const std::shared_ptr<Model<3>> &model, const std::string &name) {
+  Model<3>::ElementMatrix global_stiffness_matrix = model->BuildGlobalStiffnessMatrix();
+  model->ApplyConstraints(global_stiffness_matrix);
+
+  const HexStiffnessOperator<ORDER> global_stiffness(*model);
+  VectorX x(global_stiffness_matrix.rows());
+  for (Eigen::Index i = 0; i < x.size(); ++i) {
+    x[i] = std::sin(Precision(0.3) * static_cast<Precision>(i) + 1);
+  }
+  VectorX y;
+  global_stiffness(x, y);
+  const VectorX expected_y = global_stiffness_matrix * x;
+  const Precision operator_error = (y - expected_y).norm() / expected_y.norm();
+  Check(operator_error <= kTolerance, name + " operator is off K * x by " + std::to_string(operator_error));
+  Check(global_stiffness.GetDiagonal().isApprox(VectorX(global_stiffness_matrix.diagonal()), kTolerance), name + " diagonal is wrong");
+
+  const Eigen::VectorXd expected =
+      Eigen::MatrixXf(global_stiffness_matrix).cast<double>().ldlt().solve(model->GetLoads().cast<double>());
+
+  SolverOptions options;
+  options.method_ = SolverMethod::kMatrixFreeConjugateGradient;
+  options.tolerance_ = 1e-7;
+  Solver<3> solver(options);
+  solver.Solve(*model);
+
+  const double error = (solver.GetDisplacements().cast<double>() - expected).norm() / expected.norm();
+  Check(error <= 1e-3, name + " matrix-free solve is off the dense one by " + std::to_string(error));
+}
+
+}  // namespace
+}  // namespace vulkan_fem
+
+int main() {
+  vulkan_fem::CheckAgainstElementMatrix<vulkan_fem::HexahedronElement, 1>();
+  vulkan_fem::CheckAgainstElementMatrix<vulkan_fem::Hexahedron2Element, 2>();
+  vulkan_fem::CheckMatrixFreeSolve<1>(vulkan_fem::ModelFactory::CreateBlock(4, 2, 2), "trilinear block");
+  vulkan_fem::CheckMatrixFreeSolve<2>(vulkan_fem::CreateQuadraticBeam(3), "triquadratic beam");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,76 @@
+#include "check.h"
+#include "model.h"
+#include "solver.h"
+#include <cmath>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace vulkan_fem {
+namespace {
+
+constexpr Precision kForce = 1.;
+constexpr Precision kDampingRatio = 0.05;
+constexpr Precision kAlpha = -0.05;
+constexpr uint32_t kPeriods = 3;
+constexpr uint32_t kStepsPerPeriod = 400;
+// of the static displacement
+constexpr double kTolerance = 0.01;
+
+// one unit hexahedron with x of node 0 as its only free dof, a damped oscillator m * u'' + c * u' + k * u = F
+std::shared_ptr<Model<3>> CreateOscillator() {
+  std::vector<Vertex3> vertices;
+  std::vector<uint16_t> indices;
+  std::vector<Constraint> constraints;
+  for (const auto &[i, j, k] : HexahedronElement::GetNodeLattice()) {
+    const auto node = static_cast<uint32_t>(vertices.size());
+    vertices.emplace_back(i, j, k);
+    indices.push_back(static_cast<uint16_t>(node));
+    constraints.push_back({node, node == 0 ? Constraint::kUyz : Constraint::kUxyz});
+  }
+  const std::vector<Load<3>> loads = {{0, {kForce, 0, 0}}};
+  return std::make_shared<Model<3>>(std::make_shared<HexahedronElement>(), vertices, indices, constraints, loads, 0.2e4, 0.3);
+}
+
+// HHT-alpha with Rayleigh damping against the closed form step response of the single dof
+void CheckStepResponse() {
+  const auto model = CreateOscillator();
+  Solver<3> solver;
+  const double k = solver.AssembleStiffness(*model).coeff(0, 0);
+  const double m = solver.AssembleMass(*model, MassType::kConsistent).coeff(0, 0);
+  const double omega = std::sqrt(k / m);
+
+  // half of the damping ratio from each Rayleigh term, c = a_m * m + a_k * k, zeta = c / (2 * m * omega)
+  NewmarkOptions options;
+  options.alpha_ = kAlpha;
+  options.mass_damping_ = static_cast<Precision>(kDampingRatio * omega);
+  options.stiffness_damping_ = static_cast<Precision>(kDampingRatio / omega);
+  const double period = 2 * M_PI / omega;
+  options.time_step_ = static_cast<Precision>(period / kStepsPerPeriod);
+  options.end_time_ = static_cast<Precision>(kPeriods * period);
+
+  const double zeta = (options.mass_damping_ * m + options.stiffness_damping_ * k) / (2 * m * omega);
+  const double damped_omega = omega * std::sqrt(1 - zeta * zeta);
+  const double static_displacement = kForce / k;
+
+  double max_error = 0;
+  uint32_t steps = 0;
+  solver.SolveTransient(*model, options, [&](uint32_t step, Precision /*time*/, const VectorX &u) {
+    const double t = step * static_cast<double>(options.time_step_);
+    const double expected = static_displacement * (1 - std::exp(-zeta * omega * t) * (std::cos(damped_omega * t) +
+                                                                                     zeta / std::sqrt(1 - zeta * zeta) * std::sin(damped_omega * t)));
+    max_error = std::max(max_error, std::abs(u[0] - expected) / static_displacement);
+    ++steps;
+  });
+
+  Check(steps >= kPeriods * kStepsPerPeriod, "transient run stopped after " + std::to_string(steps) + " steps");
+  Check(max_error <= kTolerance, "damped response is off the closed form by " + std::to_string(max_error) + " of the static displacement");
+}
+
+}  // namespace
+}  // namespace vulkan_fem
+
+int main() {
+  vulkan_fem::CheckStepResponse();
+  return EXIT_SUCCESS;
+}